@@ -0,0 +1,36 @@
+#!/bin/bash
+#
+# PURPOSE: Runs a parallel fuzzing campaign against a source08 test harness (see: src/hare_campaign.c).
+#   Replaces the one-input-at-a-time Radamsa loops: every core runs its own fork server.
+#
+# USAGE: source08_campaign.sh <best, bad, best_ASAN, bad_ASAN, best_Memwatch, bad_Memwatch> [seconds] [workers]
+#
+# NOTE: Consider using a tmpfs/ramdisk for OUTPUT_DIR, as the harnesses write a file per input.
+#
+
+# Seed corpus: filenames for the harness to create in its watch directory
+SEED_DIR="test/campaign/seeds"
+# Crashes, hangs, leftovers, and each worker's directory
+OUTPUT_DIR="test/campaign/output"
+VARIANT=$1            # <best, bad, best_ASAN, bad_ASAN, best_Memwatch, bad_Memwatch>
+SECONDS_TO_RUN=${2:-60}  # How long to run
+WORKERS=${3:-$(nproc)}   # Worker processes
+
+# INPUT VALIDATION
+if [[ -z "$VARIANT" ]]
+then
+    echo "Usage: $0 <best, bad, best_ASAN, bad_ASAN, best_Memwatch, bad_Memwatch> [seconds] [workers]"
+    exit 1
+fi
+
+# SETUP ENVIRONMENT
+make source08 hare_campaign || exit 2
+mkdir -p $SEED_DIR $OUTPUT_DIR
+if [ `ls $SEED_DIR | wc -l` -eq 0 ]
+then
+    echo -n "some_filename.txt" > $SEED_DIR/seed_01
+    echo -n "report.final.v2.doc" > $SEED_DIR/seed_02
+fi
+
+# TEST CODE
+./dist/hare_campaign.bin -j $WORKERS -d $SECONDS_TO_RUN -o $OUTPUT_DIR ./dist/source08_test_harness_$VARIANT.bin $SEED_DIR
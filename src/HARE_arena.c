@@ -0,0 +1,608 @@
+/*
+ *  Implements HARE_arena.h functions.
+ */
+
+#include <errno.h>           // errno
+#include <stdint.h>          // uintptr_t
+#include <stdlib.h>          // calloc(), free()
+#include <string.h>          // memset()
+#include "HARE_arena.h"
+#include "HARE_library.h"    // syslog_*()
+#include "HARE_memwatch.h"   // mwMark(), mwUnmark() (if MEMWATCH is defined)
+
+// Detect Address Sanitizer (ASAN) builds (GCC defines the former, Clang supports the latter)
+#if defined(__SANITIZE_ADDRESS__)
+#define HARE_ASAN
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define HARE_ASAN
+#endif  // __has_feature(address_sanitizer)
+#endif  // __SANITIZE_ADDRESS__
+
+#ifdef HARE_ASAN
+#include <sanitizer/asan_interface.h>  // ASAN_POISON_MEMORY_REGION(), ASAN_UNPOISON_MEMORY_REGION()
+#define ARENA_REDZONE 32               // Poisoned bytes between two chunks/slots
+#else
+#define ASAN_POISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#define ASAN_UNPOISON_MEMORY_REGION(addr, size) ((void)(addr), (void)(size))
+#define ARENA_REDZONE 0                // Don't waste memory when nobody is watching
+#endif  // HARE_ASAN
+
+#ifdef MEMWATCH
+#define ARENA_HEADER_SIZE ARENA_ALIGNMENT  // Room to link each chunk to the previous one
+#else
+#define ARENA_HEADER_SIZE 0                // Chunks only need to be tracked for mwUnmark()
+#define mwMark(p, t, f, n) ((void)(p))
+#define mwUnmark(p, f, n) ((void)(p))
+#endif  // MEMWATCH
+
+Arena *message_arena = NULL;       // Active per-message arena (NULL means use the heap)
+MessagePool *message_pool = NULL;  // Active Message buffer pool (NULL means use the heap)
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Round size up to the next multiple of ARENA_ALIGNMENT
+ */
+static size_t _align_size(size_t size)
+{
+    return (size + (ARENA_ALIGNMENT - 1)) & ~((size_t)ARENA_ALIGNMENT - 1);
+}
+
+
+/*
+ *  Does ptr point inside block's storage?
+ */
+static bool _block_owns(ArenaBlock *block, void *ptr)
+{
+    // LOCAL VARIABLES
+    bool owns = false;  // Return value
+
+    // CHECK IT
+    if (block && block->data && ptr)
+    {
+        if ((uintptr_t)ptr >= (uintptr_t)block->data
+            && (uintptr_t)ptr < (uintptr_t)block->data + block->capacity)
+        {
+            owns = true;
+        }
+    }
+
+    // DONE
+    return owns;
+}
+
+
+/*
+ *  Bump-allocate size bytes from block on behalf of arena.  Each chunk is laid out as
+ *      [header][size bytes, aligned][red zone] where only the header (Memwatch builds) and
+ *      the requested size bytes are left unpoisoned.  Does not validate input.
+ *  Returns a pointer on success, NULL if block doesn't have room
+ */
+static void *_block_alloc(Arena *arena, ArenaBlock *block, size_t size)
+{
+    // LOCAL VARIABLES
+    void *chunk = NULL;     // Return value
+    char *base = NULL;      // Start of the chunk's footprint (header included)
+    size_t footprint = ARENA_HEADER_SIZE + _align_size(size) + ARENA_REDZONE;  // Bytes consumed
+
+    // BUMP IT
+    if (block->data && block->capacity - block->offset >= footprint)
+    {
+        base = block->data + block->offset;
+        block->offset += footprint;
+        chunk = base + ARENA_HEADER_SIZE;
+        ASAN_UNPOISON_MEMORY_REGION(base, ARENA_HEADER_SIZE + size);
+        memset(chunk, 0, size);
+#ifdef MEMWATCH
+        *((void **)base) = arena->last_chunk;  // Link to the previous chunk
+        arena->last_chunk = chunk;
+        mwMark(chunk, "HARE arena chunk", __FILE__, __LINE__);
+#endif  // MEMWATCH
+    }
+
+    // DONE
+    return chunk;
+}
+
+
+/*
+ *  Release block's storage.  Does not validate input.
+ */
+static void _block_free(ArenaBlock *block)
+{
+    if (block->data)
+    {
+        ASAN_UNPOISON_MEMORY_REGION(block->data, block->capacity);  // Hand it back clean
+        free(block->data);
+        block->data = NULL;
+    }
+    block->capacity = 0;
+    block->offset = 0;
+}
+
+
+/*
+ *  Allocate storage for a block of capacity bytes.  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _block_init(ArenaBlock *block, size_t capacity)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;  // 0 on success, errno on failure
+
+    // ALLOCATE
+    block->next = NULL;
+    block->offset = 0;
+    block->capacity = 0;
+    block->data = calloc(capacity, sizeof(char));
+    if (block->data)
+    {
+        block->capacity = capacity;
+        ASAN_POISON_MEMORY_REGION(block->data, capacity);  // Nothing has been handed out yet
+    }
+    else
+    {
+        errnum = errno;
+        if (0 == errnum)
+        {
+            errnum = ENOMEM;
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Total number of bytes currently used by arena.  Does not validate input.
+ */
+static size_t _arena_used(Arena *arena)
+{
+    // LOCAL VARIABLES
+    size_t used = arena->primary.offset;  // Return value
+    ArenaBlock *block = arena->overflow;  // Iterating variable
+
+    // COUNT IT
+    while (block)
+    {
+        used += block->offset;
+        block = block->next;
+    }
+
+    // DONE
+    return used;
+}
+
+
+/*
+ *  Unregister every live chunk in arena with Memwatch.  Does not validate input.
+ */
+static void _unmark_chunks(Arena *arena)
+{
+#ifdef MEMWATCH
+    // LOCAL VARIABLES
+    void *chunk = arena->last_chunk;  // Iterating variable
+    void *prev_chunk = NULL;          // Link stored in chunk's header
+
+    // UNMARK
+    while (chunk)
+    {
+        prev_chunk = *((void **)((char *)chunk - ARENA_HEADER_SIZE));
+        mwUnmark(chunk, __FILE__, __LINE__);
+        chunk = prev_chunk;
+    }
+#endif  // MEMWATCH
+    arena->last_chunk = NULL;
+}
+
+
+/*
+ *  Free arena's overflow blocks.  Does not validate input.
+ */
+static void _free_overflow(Arena *arena)
+{
+    // LOCAL VARIABLES
+    ArenaBlock *block = NULL;  // Iterating variable
+
+    // FREE IT
+    while (arena->overflow)
+    {
+        block = arena->overflow;
+        arena->overflow = block->next;
+        _block_free(block);
+        free(block);
+    }
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+int arena_init(Arena *arena, size_t capacity)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;  // 0 on success, -1 on bad input, errno on failure
+
+    // INPUT VALIDATION
+    if (arena && capacity > 0 && NULL == arena->primary.data)
+    {
+        errnum = 0;
+    }
+
+    // INITIALIZE
+    if (0 == errnum)
+    {
+        arena->overflow = NULL;
+        arena->high_water = 0;
+        arena->last_chunk = NULL;
+        errnum = _block_init(&(arena->primary), _align_size(capacity));
+        if (errnum)
+        {
+            syslog_errno(errnum, "Unable to allocate a %zu byte arena", capacity);
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    // LOCAL VARIABLES
+    void *chunk = NULL;          // Return value
+    ArenaBlock *block = NULL;    // New overflow block
+    size_t aligned_size = 0;     // Bytes size actually consumes (header and red zone included)
+    size_t block_size = 0;       // Capacity of a new overflow block
+
+    // INPUT VALIDATION
+    if (arena && size > 0 && size < SIZE_MAX - (ARENA_HEADER_SIZE + ARENA_ALIGNMENT + ARENA_REDZONE))
+    {
+        aligned_size = ARENA_HEADER_SIZE + _align_size(size) + ARENA_REDZONE;
+
+        // BUMP IT
+        // Steady state: the primary block has room
+        chunk = _block_alloc(arena, &(arena->primary), size);
+        // Otherwise, try the most recent overflow block
+        if (!chunk && arena->overflow)
+        {
+            chunk = _block_alloc(arena, arena->overflow, size);
+        }
+        // Otherwise, chain a new overflow block at least as big as the primary
+        if (!chunk)
+        {
+            block_size = arena->primary.capacity > aligned_size ? arena->primary.capacity : aligned_size;
+            block = calloc(1, sizeof(ArenaBlock));
+            if (block)
+            {
+                if (0 == _block_init(block, block_size))
+                {
+                    block->next = arena->overflow;
+                    arena->overflow = block;
+                    chunk = _block_alloc(arena, block, size);
+                }
+                else
+                {
+                    free(block);
+                    block = NULL;
+                }
+            }
+            if (!chunk)
+            {
+                syslog_errno(errno, "Unable to grow the arena by %zu bytes", block_size);
+            }
+        }
+    }
+
+    // DONE
+    return chunk;
+}
+
+
+void arena_destroy(Arena *arena)
+{
+    // INPUT VALIDATION
+    if (arena)
+    {
+        // FREE IT
+        _unmark_chunks(arena);
+        _free_overflow(arena);
+        _block_free(&(arena->primary));
+        memset(arena, 0, sizeof(Arena));
+    }
+}
+
+
+bool arena_owns(Arena *arena, void *ptr)
+{
+    // LOCAL VARIABLES
+    bool owns = false;         // Return value
+    ArenaBlock *block = NULL;  // Iterating variable
+
+    // INPUT VALIDATION
+    if (arena && ptr)
+    {
+        // CHECK IT
+        owns = _block_owns(&(arena->primary), ptr);
+        block = arena->overflow;
+        while (false == owns && block)
+        {
+            owns = _block_owns(block, ptr);
+            block = block->next;
+        }
+    }
+
+    // DONE
+    return owns;
+}
+
+
+int arena_reset(Arena *arena)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;           // 0 on success, -1 on bad input, errno on failure
+    size_t used = 0;           // Bytes used since the last reset
+    ArenaBlock coalesced;      // Replacement for primary
+
+    // INPUT VALIDATION
+    if (arena && arena->primary.data)
+    {
+        errnum = 0;
+    }
+
+    // RESET IT
+    if (0 == errnum)
+    {
+        used = _arena_used(arena);
+        if (used > arena->high_water)
+        {
+            arena->high_water = used;
+        }
+
+        _unmark_chunks(arena);
+        if (arena->overflow)
+        {
+            // Coalesce into one block large enough for the busiest message seen so far
+            _free_overflow(arena);
+            errnum = _block_init(&coalesced, _align_size(arena->high_water));
+            if (errnum)
+            {
+                // Keep the old primary: the arena still works, it just overflows again
+                syslog_errno(errnum, "Unable to coalesce the arena into %zu bytes", arena->high_water);
+            }
+            else
+            {
+                _block_free(&(arena->primary));
+                arena->primary = coalesced;
+            }
+        }
+        ASAN_POISON_MEMORY_REGION(arena->primary.data, arena->primary.capacity);  // Catch use-after-reset
+        arena->primary.offset = 0;
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+void *hare_calloc(size_t nmemb, size_t size)
+{
+    // LOCAL VARIABLES
+    void *ptr = NULL;  // Return value
+
+    // ALLOCATE
+    if (message_arena)
+    {
+        if (0 == size || nmemb <= SIZE_MAX / size)
+        {
+            ptr = arena_alloc(message_arena, nmemb * size);
+        }
+    }
+    else
+    {
+        ptr = calloc(nmemb, size);
+    }
+
+    // DONE
+    return ptr;
+}
+
+
+void hare_free(void *ptr)
+{
+    if (ptr)
+    {
+        if (true == arena_owns(message_arena, ptr))
+        {
+            // Released in bulk by arena_reset()
+        }
+        else if (true == pool_owns(message_pool, ptr))
+        {
+            pool_put(message_pool, ptr);
+        }
+        else
+        {
+            free(ptr);
+        }
+    }
+}
+
+
+char *hare_message_alloc(size_t size)
+{
+    // LOCAL VARIABLES
+    char *buffer = NULL;  // Return value
+
+    // ALLOCATE
+    if (message_pool && size <= message_pool->slot_size)
+    {
+        buffer = pool_get(message_pool);
+        if (buffer)
+        {
+            // Only size bytes belong to the caller
+            ASAN_POISON_MEMORY_REGION(buffer + size, message_pool->slot_size - size);
+            message_pool->hits++;
+        }
+    }
+    if (!buffer && message_pool)
+    {
+        message_pool->misses++;
+    }
+    if (!buffer)
+    {
+        buffer = calloc(size, sizeof(char));
+    }
+
+    // DONE
+    return buffer;
+}
+
+
+void pool_destroy(MessagePool *pool)
+{
+    if (pool)
+    {
+        if (pool->slab)
+        {
+            // Slots still in use keep their Memwatch marks so they're reported as leaks
+            ASAN_UNPOISON_MEMORY_REGION(pool->slab, pool->num_slots * pool->slot_stride);
+            free(pool->slab);
+        }
+        memset(pool, 0, sizeof(MessagePool));
+    }
+}
+
+
+char *pool_get(MessagePool *pool)
+{
+    // LOCAL VARIABLES
+    char *buffer = NULL;  // Return value
+
+    // INPUT VALIDATION
+    if (pool && pool->slab && pool->num_free > 0)
+    {
+        // TAKE IT
+        pool->num_free--;
+        buffer = pool->free_slots[pool->num_free];
+        pool->free_slots[pool->num_free] = NULL;
+        ASAN_UNPOISON_MEMORY_REGION(buffer, pool->slot_size);
+        memset(buffer, 0, pool->slot_size);
+        mwMark(buffer, "HARE message pool slot", __FILE__, __LINE__);
+    }
+
+    // DONE
+    return buffer;
+}
+
+
+int pool_init(MessagePool *pool, size_t slot_size, size_t num_slots)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;  // 0 on success, -1 on bad input, errno on failure
+    size_t index = 0;  // Iterating variable
+
+    // INPUT VALIDATION
+    if (pool && NULL == pool->slab && slot_size > 0 && num_slots > 0 && num_slots <= MESSAGE_POOL_SLOTS)
+    {
+        errnum = 0;
+    }
+
+    // INITIALIZE
+    if (0 == errnum)
+    {
+        pool->slot_size = _align_size(slot_size);
+        pool->slot_stride = pool->slot_size + ARENA_REDZONE;
+        pool->slab = calloc(num_slots, pool->slot_stride);
+        if (pool->slab)
+        {
+            pool->num_slots = num_slots;
+            for (index = 0; index < num_slots; index++)
+            {
+                pool->free_slots[index] = pool->slab + (index * pool->slot_stride);
+            }
+            pool->num_free = num_slots;
+            ASAN_POISON_MEMORY_REGION(pool->slab, num_slots * pool->slot_stride);
+        }
+        else
+        {
+            errnum = errno;
+            if (0 == errnum)
+            {
+                errnum = ENOMEM;
+            }
+            syslog_errno(errnum, "Unable to allocate a %zu slot message pool", num_slots);
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+bool pool_owns(MessagePool *pool, void *buffer)
+{
+    // LOCAL VARIABLES
+    bool owns = false;  // Return value
+
+    // CHECK IT
+    if (pool && pool->slab && buffer)
+    {
+        if ((uintptr_t)buffer >= (uintptr_t)pool->slab
+            && (uintptr_t)buffer < (uintptr_t)pool->slab + (pool->num_slots * pool->slot_stride))
+        {
+            owns = true;
+        }
+    }
+
+    // DONE
+    return owns;
+}
+
+
+int pool_put(MessagePool *pool, char *buffer)
+{
+    // LOCAL VARIABLES
+    int success = -1;  // 0 on success, -1 on bad input
+    size_t index = 0;  // Iterating variable
+
+    // INPUT VALIDATION
+    if (true == pool_owns(pool, buffer) && pool->num_free < pool->num_slots
+        && 0 == ((uintptr_t)(buffer - pool->slab) % pool->slot_stride))
+    {
+        success = 0;
+        // Double release?
+        for (index = 0; index < pool->num_free; index++)
+        {
+            if (buffer == pool->free_slots[index])
+            {
+                syslog_it2(LOG_CRIT, "Message pool slot %p was released twice", buffer);
+                success = -1;
+                break;
+            }
+        }
+    }
+    else
+    {
+        syslog_it(LOG_ERR, "Attempted to return an invalid buffer to the message pool");
+    }
+
+    // RECYCLE IT
+    if (0 == success)
+    {
+        mwUnmark(buffer, __FILE__, __LINE__);
+        ASAN_POISON_MEMORY_REGION(buffer, pool->slot_size);  // Catch use-after-release
+        pool->free_slots[pool->num_free] = buffer;
+        pool->num_free++;
+    }
+
+    // DONE
+    return success;
+}
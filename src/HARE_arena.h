@@ -0,0 +1,152 @@
+/*
+ *  Per-message memory management for the HARE daemon hot path.
+ *  The Arena is a bump allocator whose lifetime matches a single message: everything
+ *      allocated while processing a message is released at once by arena_reset().
+ *  The MessagePool recycles fixed-size Message buffers so read_a_pipe() never calls calloc()
+ *      once the daemon reaches a steady state.
+ *  hare_calloc() and hare_free() route library allocations to the active arena/pool (if any)
+ *      and fall back to the heap otherwise, so callers never need to know where memory came from.
+ *  SANITIZERS:
+ *      ASAN - Unused arena/pool memory is poisoned and every chunk is followed by a poisoned
+ *          red zone, so overflows and use-after-reset inside pooled memory are still reported.
+ *      Memwatch - Compiled with -DMEMWATCH, every live chunk and pool slot is registered with
+ *          mwMark() and unregistered with mwUnmark() so leaks show up in the Memwatch log.
+ */
+
+#ifndef __HARE_ARENA__
+#define __HARE_ARENA__
+
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+
+#define ARENA_DEFAULT_SIZE 65536  // Starting capacity, in bytes, of a message arena
+#define ARENA_ALIGNMENT 16        // Every arena allocation is aligned to this many bytes
+#define MESSAGE_POOL_SLOTS 8      // Maximum number of recycled Message buffers in a MessagePool
+
+// A single contiguous block of arena memory
+typedef struct _ArenaBlock
+{
+    struct _ArenaBlock *next;  // Next overflow block (NULL terminated)
+    size_t capacity;           // Usable size of data
+    size_t offset;             // Index of the next free byte in data
+    char *data;                // Block storage
+} ArenaBlock;
+
+// Bump allocator tied to the lifetime of one message
+typedef struct _Arena
+{
+    ArenaBlock primary;     // Steady-state block: allocations are a pointer bump
+    ArenaBlock *overflow;   // Blocks chained when primary runs out (coalesced by arena_reset())
+    size_t high_water;      // Largest number of bytes used between two resets
+    void *last_chunk;       // Most recent chunk (Memwatch builds chain chunks to mwUnmark() them)
+} Arena;
+
+// Fixed-size, recycled buffers for Message contents
+typedef struct _MessagePool
+{
+    char *slab;                             // Contiguous storage for every slot
+    size_t slot_size;                       // Size of each slot in bytes
+    size_t slot_stride;                     // Distance between slots (slot_size plus a red zone)
+    size_t num_slots;                       // Number of slots carved out of slab
+    char *free_slots[MESSAGE_POOL_SLOTS];   // Stack of available slots
+    size_t num_free;                        // Number of entries in free_slots
+    size_t hits;                            // hare_message_alloc() calls served from a slot
+    size_t misses;                          // hare_message_alloc() calls that fell back to the heap
+} MessagePool;
+
+extern Arena *message_arena;       // Active per-message arena (NULL means use the heap)
+extern MessagePool *message_pool;  // Active Message buffer pool (NULL means use the heap)
+
+
+/*
+ *  Allocate the primary block for arena
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int arena_init(Arena *arena, size_t capacity);
+
+
+/*
+ *  Bump-allocate size zeroed bytes from arena.  A new overflow block is chained if
+ *      the primary block is exhausted.
+ *  Returns a pointer on success, NULL on bad input or failure
+ */
+void *arena_alloc(Arena *arena, size_t size);
+
+
+/*
+ *  Free all memory held by arena
+ */
+void arena_destroy(Arena *arena);
+
+
+/*
+ *  Does ptr point inside one of arena's blocks?
+ */
+bool arena_owns(Arena *arena, void *ptr);
+
+
+/*
+ *  Release every allocation made from arena in one step.  If overflow blocks were needed,
+ *      they are coalesced into a single, larger primary block so the next message fits.
+ *  Returns 0 on success, -1 on bad input, errno on failure (arena keeps its old primary block)
+ */
+int arena_reset(Arena *arena);
+
+
+/*
+ *  Allocate nmemb * size zeroed bytes from message_arena, if active, or the heap
+ *  Returns a pointer on success, NULL on failure
+ */
+void *hare_calloc(size_t nmemb, size_t size);
+
+
+/*
+ *  Release memory obtained from hare_calloc() or hare_message_alloc().  Arena memory is
+ *      ignored (see: arena_reset()), pool slots are recycled, and everything else is free()d.
+ *      Never pass it anything else: Memwatch builds only track HARE_arena.c's heap allocations.
+ */
+void hare_free(void *ptr);
+
+
+/*
+ *  Allocate a zeroed Message buffer of size bytes from message_pool, if active and large
+ *      enough, or the heap
+ *  Returns a pointer on success, NULL on failure
+ */
+char *hare_message_alloc(size_t size);
+
+
+/*
+ *  Free all memory held by pool
+ */
+void pool_destroy(MessagePool *pool);
+
+
+/*
+ *  Take a zeroed slot from pool
+ *  Returns a pointer on success, NULL if pool is exhausted or on bad input
+ */
+char *pool_get(MessagePool *pool);
+
+
+/*
+ *  Allocate num_slots (maximum: MESSAGE_POOL_SLOTS) buffers of slot_size bytes for pool
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int pool_init(MessagePool *pool, size_t slot_size, size_t num_slots);
+
+
+/*
+ *  Does buffer point inside pool's slab?
+ */
+bool pool_owns(MessagePool *pool, void *buffer);
+
+
+/*
+ *  Return buffer to pool.  Releasing a slot twice is logged and refused.
+ *  Returns 0 on success, -1 on bad input
+ */
+int pool_put(MessagePool *pool, char *buffer);
+
+
+#endif  // __HARE_ARENA__
@@ -0,0 +1,461 @@
+/*
+ *  Implements HARE_backlog.h functions.
+ */
+
+#define _GNU_SOURCE          // qsort_r(), syscall()
+#include <errno.h>           // errno
+#include <fcntl.h>           // open(), O_* macros, AT_* macros
+#include <linux/limits.h>    // PATH_MAX
+#include <stdint.h>          // uint64_t, int64_t
+#include <stdlib.h>          // calloc(), free(), qsort_r(), realloc()
+#include <string.h>          // memcpy(), strcmp(), strlen()
+#include <sys/stat.h>        // fstat(), fstatat(), stat()
+#include <sys/syscall.h>     // SYS_getdents64
+#include <sys/wait.h>        // waitpid(), W* macros
+#include <unistd.h>          // close(), fork(), syscall(), _exit()
+#include "HARE_backlog.h"
+#include "HARE_filelog.h"    // filelog_flush()
+#include "HARE_library.h"    // syslog_*(), INVALID_FD, get_errno()
+#include "HARE_logger.h"     // logger_flush()
+
+#define BACKLOG_INITIAL_FILES 1024   // Starting capacity of a Backlog's offsets
+#define BACKLOG_INITIAL_NAMES 65536  // Starting size of a Backlog's names
+
+// Directory entry filled in by getdents64() (see: man getdents64)
+typedef struct _LinuxDirent64
+{
+    uint64_t d_ino;            // Inode number
+    int64_t d_off;             // Offset to the next entry
+    unsigned short d_reclen;   // Size of this entry
+    unsigned char d_type;      // File type (DT_* macros)
+    char d_name[];             // Filename (nul-terminated)
+} LinuxDirent64;
+
+// Identity of a directory backlog_scan() must not enter
+typedef struct _SkipDir
+{
+    dev_t dev;  // Device
+    ino_t ino;  // Inode
+} SkipDir;
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Sort Backlog offsets by the filenames they refer to (see: qsort_r())
+ */
+static int _compare_offsets(const void *left, const void *right, void *names)
+{
+    return strcmp((char *)names + *(const size_t *)left, (char *)names + *(const size_t *)right);
+}
+
+
+/*
+ *  Append dir_path/name to backlog.  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _add_file(Backlog *backlog, char *dir_path, size_t dir_len, char *name)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                                  // 0 on success, errno on failure
+    size_t name_len = strlen(name);                  // Length of name
+    size_t needed = dir_len + name_len + 1;          // Bytes name needs in backlog->names
+    size_t new_size = 0;                             // New allocation size
+    void *grown = NULL;                              // Reallocated memory
+
+    // MAKE ROOM
+    if (backlog->num_files == backlog->capacity)
+    {
+        new_size = backlog->capacity ? backlog->capacity * 2 : BACKLOG_INITIAL_FILES;
+        grown = realloc(backlog->offsets, new_size * sizeof(size_t));
+        if (grown)
+        {
+            backlog->offsets = grown;
+            backlog->capacity = new_size;
+        }
+        else
+        {
+            errnum = ENOMEM;
+        }
+    }
+    if (0 == errnum && backlog->names_len + needed > backlog->names_size)
+    {
+        new_size = backlog->names_size ? backlog->names_size : BACKLOG_INITIAL_NAMES;
+        while (backlog->names_len + needed > new_size)
+        {
+            new_size *= 2;
+        }
+        grown = realloc(backlog->names, new_size);
+        if (grown)
+        {
+            backlog->names = grown;
+            backlog->names_size = new_size;
+        }
+        else
+        {
+            errnum = ENOMEM;
+        }
+    }
+
+    // ADD IT
+    if (0 == errnum)
+    {
+        backlog->offsets[backlog->num_files++] = backlog->names_len;
+        memcpy(backlog->names + backlog->names_len, dir_path, dir_len);
+        memcpy(backlog->names + backlog->names_len + dir_len, name, name_len + 1);
+        backlog->names_len += needed;
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Enumerate the directory path (a PATH_MAX + 1 buffer ending in '/') into backlog, then
+ *      descend into its subdirectories.  Each directory is read completely and closed
+ *      before descending so only one file descriptor and dents buffer are ever in use.
+ *      Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _scan_dir(Backlog *backlog, char *path, size_t path_len, char *dents,
+                     SkipDir *skip, size_t num_skip)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                 // 0 on success, errno on failure
+    int dir_fd = INVALID_FD;        // File descriptor for path
+    struct stat entry_stat;         // Metadata for path and DT_UNKNOWN entries
+    long bytes_read = 0;            // Return value from getdents64()
+    long offset = 0;                // Offset of the current entry in dents
+    LinuxDirent64 *entry = NULL;    // Current entry
+    unsigned char entry_type = 0;   // Type of entry
+    char *subdirs = NULL;           // Subdirectory names, nul-separated
+    size_t subdirs_len = 0;         // Bytes of subdirs in use
+    size_t subdirs_size = 0;        // Bytes of subdirs allocated
+    size_t name_len = 0;            // Length of a name
+    char *grown = NULL;             // Reallocated subdirs
+    size_t i = 0;                   // Iterating variable
+
+    // OPEN IT
+    dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd < 0 || fstat(dir_fd, &entry_stat))
+    {
+        errnum = get_errno();
+        syslog_errno(errnum, "Unable to scan the backlog in %s", path);
+    }
+    for (i = 0; 0 == errnum && i < num_skip; i++)
+    {
+        if (skip[i].dev == entry_stat.st_dev && skip[i].ino == entry_stat.st_ino)
+        {
+            close(dir_fd);  // e.g., the process directory
+            dir_fd = INVALID_FD;
+            break;
+        }
+    }
+
+    // READ IT
+    while (0 == errnum && dir_fd > INVALID_FD
+           && 0 < (bytes_read = syscall(SYS_getdents64, dir_fd, dents, BACKLOG_DENTS_SIZE)))
+    {
+        for (offset = 0; offset < bytes_read && 0 == errnum; offset += entry->d_reclen)
+        {
+            entry = (LinuxDirent64 *)(dents + offset);
+            if ('.' == entry->d_name[0])
+            {
+                continue;  // Skip ".", "..", and hidden (e.g., temporary) files
+            }
+            entry_type = entry->d_type;
+            if (DT_UNKNOWN == entry_type)
+            {
+                if (fstatat(dir_fd, entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW))
+                {
+                    continue;  // Vanished
+                }
+                entry_type = S_ISDIR(entry_stat.st_mode) ? DT_DIR : S_ISREG(entry_stat.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+            if (DT_REG == entry_type)
+            {
+                errnum = _add_file(backlog, path, path_len, entry->d_name);
+            }
+            else if (DT_DIR == entry_type)
+            {
+                // Remember it for later so this directory can be closed first
+                name_len = strlen(entry->d_name) + 1;
+                if (subdirs_len + name_len > subdirs_size)
+                {
+                    subdirs_size = (subdirs_size + name_len) * 2;
+                    grown = realloc(subdirs, subdirs_size);
+                    if (grown)
+                    {
+                        subdirs = grown;
+                    }
+                    else
+                    {
+                        errnum = ENOMEM;
+                    }
+                }
+                if (0 == errnum)
+                {
+                    memcpy(subdirs + subdirs_len, entry->d_name, name_len);
+                    subdirs_len += name_len;
+                }
+            }
+        }
+    }
+    if (0 == errnum && bytes_read < 0)
+    {
+        errnum = get_errno();
+        syslog_errno(errnum, "Call to getdents64() failed in %s", path);
+    }
+    if (dir_fd > INVALID_FD)
+    {
+        close(dir_fd);
+        dir_fd = INVALID_FD;
+    }
+
+    // DESCEND
+    for (i = 0; 0 == errnum && i < subdirs_len; i += name_len + 1)
+    {
+        name_len = strlen(subdirs + i);
+        if (path_len + name_len + 1 > PATH_MAX)
+        {
+            syslog_it2(LOG_WARNING, "Skipping backlog directory %s%s: the path is too long", path, subdirs + i);
+            continue;
+        }
+        memcpy(path + path_len, subdirs + i, name_len);
+        path[path_len + name_len] = '/';
+        path[path_len + name_len + 1] = '\0';
+        errnum = _scan_dir(backlog, path, path_len + name_len + 1, dents, skip, num_skip);
+        path[path_len] = '\0';
+        if (EACCES == errnum || ENOENT == errnum)
+        {
+            errnum = 0;  // One unreadable (or vanished) subdirectory shouldn't end the scan
+        }
+    }
+
+    // CLEANUP
+    free(subdirs);
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Process every num_workers'th file of backlog, starting with index first
+ *  Returns the number of files that failed
+ */
+static int _drain_share(Backlog *backlog, size_t first, int num_workers, BacklogCallback callback, void *context)
+{
+    // LOCAL VARIABLES
+    int failures = 0;  // Return value
+    size_t i = 0;      // Iterating variable
+
+    // DRAIN IT
+    for (i = first; i < backlog->num_files; i += num_workers)
+    {
+        if (0 != callback(backlog->names + backlog->offsets[i], context))
+        {
+            failures++;
+        }
+    }
+
+    // DONE
+    return failures;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+bool backlog_contains(Backlog *backlog, char *filename)
+{
+    // LOCAL VARIABLES
+    bool found = false;  // Return value
+    size_t low = 0;      // Lowest index that may hold filename
+    size_t high = 0;     // One past the highest index that may hold filename
+    size_t middle = 0;   // Index being compared
+    int compare = 0;     // Return value from strcmp()
+
+    // INPUT VALIDATION
+    if (backlog && backlog->offsets && filename)
+    {
+        high = backlog->num_files;
+    }
+
+    // FIND IT
+    while (low < high && false == found)
+    {
+        middle = low + ((high - low) / 2);
+        compare = strcmp(filename, backlog->names + backlog->offsets[middle]);
+        if (0 == compare)
+        {
+            found = true;
+        }
+        else if (compare < 0)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+
+    // DONE
+    return found;
+}
+
+
+void backlog_destroy(Backlog *backlog)
+{
+    if (backlog)
+    {
+        free(backlog->names);
+        free(backlog->offsets);
+        memset(backlog, 0, sizeof(Backlog));
+    }
+}
+
+
+int backlog_drain(Backlog *backlog, int num_workers, BacklogCallback callback, void *context)
+{
+    // LOCAL VARIABLES
+    int results = -1;                                // Failures on success, -1 on bad input
+    pid_t workers[BACKLOG_MAX_WORKERS] = { 0 };      // Worker PIDs
+    int status = 0;                                  // Worker exit status
+    int i = 0;                                       // Iterating variable
+
+    // INPUT VALIDATION
+    if (backlog && callback && num_workers > 0)
+    {
+        results = 0;
+        if (num_workers > BACKLOG_MAX_WORKERS)
+        {
+            num_workers = BACKLOG_MAX_WORKERS;
+        }
+        if (num_workers > backlog->num_files)
+        {
+            num_workers = backlog->num_files ? backlog->num_files : 1;
+        }
+    }
+
+    // DRAIN IT
+    if (0 == results && 1 == num_workers)
+    {
+        results = _drain_share(backlog, 0, 1, callback, context);
+    }
+    else if (0 == results)
+    {
+        for (i = 0; i < num_workers; i++)
+        {
+            workers[i] = fork();
+            if (0 == workers[i])
+            {
+                // Worker: report (at most 255) failures through the exit code
+                status = _drain_share(backlog, i, num_workers, callback, context);
+                logger_flush(LOGGER_FLUSH_MS);  // _exit() skips the atexit() flushes
+                filelog_flush();
+                _exit(status > 255 ? 255 : status);
+            }
+            else if (workers[i] < 0)
+            {
+                syslog_errno(errno, "Unable to fork backlog worker %d so the daemon will drain its share", i);
+                results += _drain_share(backlog, i, num_workers, callback, context);
+            }
+        }
+        for (i = 0; i < num_workers; i++)
+        {
+            if (workers[i] > 0)
+            {
+                while (-1 == waitpid(workers[i], &status, 0) && EINTR == errno);
+                if (WIFEXITED(status))
+                {
+                    results += WEXITSTATUS(status);
+                }
+                else
+                {
+                    syslog_it2(LOG_ERR, "Backlog worker %d (PID %ld) died before finishing", i, (long)workers[i]);
+                    results++;
+                }
+            }
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+int backlog_scan(Backlog *backlog, char *watched_dir, char *skip_dirs[], size_t num_skip)
+{
+    // LOCAL VARIABLES
+    int results = -1;                      // Count on success, -1 on bad input, -errno on failure
+    int errnum = 0;                        // Return value from _scan_dir()
+    char path[PATH_MAX + 1] = { 0 };       // Directory being scanned
+    size_t path_len = 0;                   // Length of path
+    char *dents = NULL;                    // getdents64() buffer
+    SkipDir *skip = NULL;                  // Identities of skip_dirs
+    size_t num_found = 0;                  // Number of skip_dirs that exist
+    struct stat skip_stat;                 // Metadata for a skip_dirs entry
+    size_t i = 0;                          // Iterating variable
+
+    // INPUT VALIDATION
+    if (backlog && watched_dir && *watched_dir && strlen(watched_dir) < PATH_MAX - 1 && (skip_dirs || !num_skip))
+    {
+        results = 0;
+        path_len = strlen(watched_dir);
+        memcpy(path, watched_dir, path_len);
+        if ('/' != path[path_len - 1])
+        {
+            path[path_len++] = '/';
+        }
+    }
+
+    // PREPARE IT
+    if (0 == results)
+    {
+        dents = calloc(BACKLOG_DENTS_SIZE, sizeof(char));
+        skip = calloc(num_skip + 1, sizeof(SkipDir));
+        if (!dents || !skip)
+        {
+            results = -ENOMEM;
+        }
+        for (i = 0; 0 == results && i < num_skip; i++)
+        {
+            if (skip_dirs[i] && 0 == stat(skip_dirs[i], &skip_stat))
+            {
+                skip[num_found].dev = skip_stat.st_dev;
+                skip[num_found].ino = skip_stat.st_ino;
+                num_found++;
+            }
+        }
+    }
+
+    // SCAN IT
+    if (0 == results)
+    {
+        errnum = _scan_dir(backlog, path, path_len, dents, skip, num_found);
+        if (errnum)
+        {
+            results = -errnum;
+        }
+        else
+        {
+            qsort_r(backlog->offsets, backlog->num_files, sizeof(size_t), _compare_offsets, backlog->names);
+            results = backlog->num_files;
+        }
+    }
+
+    // CLEANUP
+    free(dents);
+    free(skip);
+
+    // DONE
+    return results;
+}
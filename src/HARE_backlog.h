@@ -0,0 +1,69 @@
+/*
+ *  Startup backlog drain for the HARE daemon.
+ *  Files already sitting in the watched directory when the daemon starts never generate an
+ *      event.  backlog_scan() enumerates them with large getdents64() reads (no per-entry
+ *      stat() unless the filesystem doesn't report d_type) and backlog_drain() splits them
+ *      across forked worker processes.  Workers are processes, not threads, because the
+ *      library's per-message state (e.g., processed_filename, message_arena) is global.
+ *  The scan is kept sorted so backlog_contains() can drop live events for files the drain
+ *      already handled.
+ */
+
+#ifndef __HARE_BACKLOG__
+#define __HARE_BACKLOG__
+
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+
+#define BACKLOG_DENTS_SIZE 262144  // Size of the getdents64() buffer (thousands of entries per call)
+#define BACKLOG_MAX_WORKERS 64     // Maximum number of drain processes
+#define BACKLOG_ENV_VAR "HARE_BACKLOG_WORKERS"  // Drain processes (see: read_settings())
+
+/*
+ *  Process one backlog file.  Called in a worker process.
+ *  Returns 0 on success, non-zero on failure
+ */
+typedef int (*BacklogCallback)(char *filename, void *context);
+
+// Files found by backlog_scan()
+typedef struct _Backlog
+{
+    char *names;         // Every absolute filename, nul-separated
+    size_t names_len;    // Bytes of names in use
+    size_t names_size;   // Bytes of names allocated
+    size_t *offsets;     // Offset of each filename in names (sorted by filename)
+    size_t num_files;    // Number of entries in offsets
+    size_t capacity;     // Number of entries allocated for offsets
+} Backlog;
+
+
+/*
+ *  Does backlog hold filename?
+ */
+bool backlog_contains(Backlog *backlog, char *filename);
+
+
+/*
+ *  Free all memory held by backlog
+ */
+void backlog_destroy(Backlog *backlog);
+
+
+/*
+ *  Process every file in backlog with callback.  Files are dealt round-robin to num_workers
+ *      forked processes (num_workers of 1 processes them in the calling process).  If a
+ *      worker can't be forked, the calling process handles its share.
+ *  Returns the number of files that failed (each worker reports at most 255), -1 on bad input
+ */
+int backlog_drain(Backlog *backlog, int num_workers, BacklogCallback callback, void *context);
+
+
+/*
+ *  Recursively enumerate the regular files in watched_dir into backlog, skipping hidden
+ *      entries and any of the num_skip directories in skip_dirs (entries may be NULL)
+ *  Returns the number of files found, -1 on bad input, -errno on failure
+ */
+int backlog_scan(Backlog *backlog, char *watched_dir, char *skip_dirs[], size_t num_skip);
+
+
+#endif  // __HARE_BACKLOG__
@@ -0,0 +1,445 @@
+/*
+ *  Implements HARE_cleanup.h functions.
+ */
+
+#define _GNU_SOURCE          // close_range(), renameat2()
+#include <errno.h>           // errno
+#include <fcntl.h>           // open(), AT_FDCWD, O_* macros
+#include <linux/limits.h>    // PATH_MAX
+#include <poll.h>            // poll()
+#include <stdbool.h>         // bool
+#include <stdint.h>          // uint64_t
+#include <stdio.h>           // rename(), renameat2(), snprintf(), RENAME_NOREPLACE
+#include <stdlib.h>          // calloc(), free(), getenv()
+#include <string.h>          // memcpy(), memset(), strcmp(), strcpy(), strlen(), strndup(), strrchr()
+#include <sys/socket.h>      // bind(), recv(), sendto(), socket(), setsockopt()
+#include <sys/stat.h>        // chmod(), fstat(), lstat(), struct stat
+#include <sys/un.h>          // struct sockaddr_un
+#include <sys/wait.h>        // waitpid()
+#include <unistd.h>          // close(), dup2(), fork(), getpid(), setsid(), unlink(), unlinkat()
+#include "HARE_cleanup.h"
+#include "HARE_library.h"    // INVALID_FD, get_errno()
+
+#define CLEANUP_SERVICE_FD 3  // The service's socket after it closes everything it inherited
+
+// An open directory the service deletes files from
+typedef struct _CleanupDir
+{
+    int fd;                    // O_PATH file descriptor (INVALID_FD if the slot is free)
+    uint64_t used;             // When it was last used (for eviction)
+    char name[PATH_MAX + 1];   // Directory name
+} CleanupDir;
+
+// The cleanup service's state
+typedef struct _CleanupService
+{
+    int fd;                                 // Bound socket
+    struct stat socket_stat;                // The socket file (so the service only removes its own)
+    char *queue[CLEANUP_HIGH_WATER];        // Filenames waiting to be deleted (heap-allocated)
+    size_t head;                            // Index of the oldest filename in queue
+    size_t count;                           // Filenames in queue
+    CleanupDir dirs[CLEANUP_DIRS];          // Cached directories
+    uint64_t clock;                         // Bumped on every lookup in dirs
+} CleanupService;
+
+static int _socket_fd = INVALID_FD;  // Unbound socket cleanup_request() sends from
+static struct sockaddr_un _address;  // The service's socket address
+static unsigned long _tombstones = 0; // Tombstones this process has named (see: cleanup_request())
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Find dirname in service's cache, opening it (and evicting the least recently used entry) if
+ *      it isn't there
+ *  Returns the cache entry (its fd is INVALID_FD if dirname couldn't be opened)
+ */
+static CleanupDir *_find_dir(CleanupService *service, const char *dirname)
+{
+    // LOCAL VARIABLES
+    CleanupDir *dir = service->dirs;  // Return value
+    int i = 0;                        // Iterating variable
+
+    // LOOK IT UP
+    service->clock++;
+    for (i = 0; i < CLEANUP_DIRS; i++)
+    {
+        if (INVALID_FD != service->dirs[i].fd && 0 == strcmp(service->dirs[i].name, dirname))
+        {
+            dir = service->dirs + i;
+            dir->used = service->clock;
+            return dir;
+        }
+        if (service->dirs[i].used < dir->used)
+        {
+            dir = service->dirs + i;  // Free slots are never used so they go first
+        }
+    }
+
+    // OPEN IT
+    if (INVALID_FD != dir->fd)
+    {
+        close(dir->fd);
+    }
+    dir->fd = open(dirname, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    dir->used = INVALID_FD == dir->fd ? 0 : service->clock;
+    strcpy(dir->name, dirname);
+
+    // DONE
+    return dir;
+}
+
+
+/*
+ *  Delete filename (an absolute path) relative to its cached directory.  Errors are ignored:
+ *      the harness already moved on.
+ */
+static void _delete(CleanupService *service, const char *filename)
+{
+    // LOCAL VARIABLES
+    char dirname[PATH_MAX + 1] = { 0 };        // filename's directory
+    const char *base = strrchr(filename, '/');  // filename's base filename
+    CleanupDir *dir = NULL;                     // filename's cached directory
+    struct stat dir_stat;                       // dir's link count (0 once it's removed)
+    int i = 0;                                  // Iterating variable
+
+    // SPLIT IT
+    if (base && base[1])
+    {
+        memcpy(dirname, filename, base == filename ? 1 : base - filename);
+        base++;
+
+        // DELETE IT
+        // A cached directory may have been removed (and recreated) since it was opened
+        for (i = 0; i < 2; i++)
+        {
+            dir = _find_dir(service, dirname);
+            if (INVALID_FD == dir->fd || 0 == unlinkat(dir->fd, base, 0) || ENOENT != errno
+                || fstat(dir->fd, &dir_stat) || dir_stat.st_nlink > 0)
+            {
+                break;
+            }
+            close(dir->fd);
+            dir->fd = INVALID_FD;
+            dir->used = 0;
+        }
+    }
+}
+
+
+/*
+ *  Move waiting requests from the socket to service's queue, stopping at CLEANUP_HIGH_WATER
+ *      (requests then wait in the socket, which eventually blocks their senders)
+ */
+static void _take_requests(CleanupService *service)
+{
+    // LOCAL VARIABLES
+    char filename[PATH_MAX + 1] = { 0 };  // Current request
+    ssize_t length = 0;                   // Return value from recv()
+    char *entry = NULL;                   // Heap-allocated copy of filename
+
+    // TAKE THEM
+    while (service->count < CLEANUP_HIGH_WATER)
+    {
+        length = recv(service->fd, filename, PATH_MAX, MSG_DONTWAIT);
+        if (length < 0)
+        {
+            break;  // Nothing waiting
+        }
+        filename[length] = '\0';
+        entry = '/' == filename[0] ? strndup(filename, length) : NULL;
+        if (entry)
+        {
+            service->queue[(service->head + service->count) % CLEANUP_HIGH_WATER] = entry;
+            service->count++;
+        }
+    }
+}
+
+
+/*
+ *  Delete up to max filenames from the front of service's queue
+ */
+static void _delete_batch(CleanupService *service, size_t max)
+{
+    // LOCAL VARIABLES
+    char *filename = NULL;  // Oldest filename in the queue
+
+    // DELETE THEM
+    while (max-- > 0 && service->count > 0)
+    {
+        filename = service->queue[service->head];
+        service->queue[service->head] = NULL;
+        service->head = (service->head + 1) % CLEANUP_HIGH_WATER;
+        service->count--;
+        _delete(service, filename);
+        free(filename);
+    }
+}
+
+
+/*
+ *  Body of the cleanup service (in a detached process).  Never returns.
+ */
+static void _run_service(int socket_fd, struct stat *socket_stat)
+{
+    // LOCAL VARIABLES
+    CleanupService *service = calloc(1, sizeof(CleanupService));  // Service state
+    struct pollfd waiting = { CLEANUP_SERVICE_FD, POLLIN, 0 };      // Wait for requests
+    struct stat current;                                           // The socket filename now
+    int null_fd = open("/dev/null", O_RDWR);                        // Replaces the standard streams
+    int i = 0;                                                     // Iterating variable
+
+    // DETACH
+    // Keep nothing the harness had open (e.g., its pipes) or the harness' readers never see EOF
+    if (null_fd > INVALID_FD)
+    {
+        dup2(null_fd, STDIN_FILENO);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+    }
+    if (CLEANUP_SERVICE_FD != socket_fd)
+    {
+        dup2(socket_fd, CLEANUP_SERVICE_FD);
+    }
+    close_range(CLEANUP_SERVICE_FD + 1, ~0U, 0);
+    if (0 != chdir("/") || !service)
+    {
+        _exit(EXIT_FAILURE);
+    }
+    service->fd = CLEANUP_SERVICE_FD;
+    service->socket_stat = *socket_stat;
+    for (i = 0; i < CLEANUP_DIRS; i++)
+    {
+        service->dirs[i].fd = INVALID_FD;
+    }
+
+    // SERVE
+    while (1)
+    {
+        _take_requests(service);
+        _delete_batch(service, CLEANUP_BATCH);
+        if (0 == service->count && 0 == poll(&waiting, 1, CLEANUP_IDLE_MS))
+        {
+            break;  // Idle
+        }
+    }
+
+    // RETIRE
+    // New requests start a new service once the filename is gone, so only this socket's
+    //  backlog is left to finish
+    if (0 == lstat(_address.sun_path, &current) && current.st_ino == service->socket_stat.st_ino
+        && current.st_dev == service->socket_stat.st_dev)
+    {
+        unlink(_address.sun_path);
+    }
+    do
+    {
+        _delete_batch(service, CLEANUP_HIGH_WATER);
+        _take_requests(service);
+    } while (service->count > 0);
+    _exit(EXIT_SUCCESS);
+}
+
+
+/*
+ *  Bind the service's socket and hand it to a new, detached cleanup service process
+ *  Returns 0 on success, errno on failure (EADDRINUSE if the socket filename exists)
+ */
+static int _start_service(void)
+{
+    // LOCAL VARIABLES
+    int results = 0;                 // 0 on success, errno on failure
+    int socket_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);  // The service's socket
+    struct stat socket_stat;         // The socket file
+    pid_t child = 0;                 // Intermediate process that detaches the service
+
+    // BIND IT
+    // Bound before the fork so requests sent in the meantime wait in the socket
+    if (socket_fd < 0 || bind(socket_fd, (struct sockaddr *)&_address, sizeof(_address)))
+    {
+        results = get_errno();
+    }
+    // The harness' umask is 0 so restrict the socket to its owner explicitly (it deletes as root)
+    else if (chmod(_address.sun_path, S_IRUSR | S_IWUSR) || lstat(_address.sun_path, &socket_stat))
+    {
+        results = get_errno();
+        unlink(_address.sun_path);
+    }
+
+    // START IT
+    // Fork twice so the service belongs to init instead of being a zombie in the harness
+    if (0 == results)
+    {
+        child = fork();
+        if (0 == child)
+        {
+            setsid();  // Out of the harness' session and process group
+            if (0 == fork())
+            {
+                _run_service(socket_fd, &socket_stat);
+            }
+            _exit(EXIT_SUCCESS);
+        }
+        else if (child < 0)
+        {
+            results = get_errno();
+            unlink(_address.sun_path);
+        }
+        else
+        {
+            waitpid(child, NULL, 0);
+        }
+    }
+
+    // CLEANUP
+    if (socket_fd >= 0)
+    {
+        close(socket_fd);
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+void cleanup_close(void)
+{
+    if (INVALID_FD != _socket_fd)
+    {
+        close(_socket_fd);
+        _socket_fd = INVALID_FD;
+    }
+}
+
+
+int cleanup_open(const char *socket_name)
+{
+    // LOCAL VARIABLES
+    int results = 0;                                                 // 0 on success, -1 on bad input, errno on failure
+    struct timeval timeout = { CLEANUP_THROTTLE_MS / 1000, CLEANUP_THROTTLE_MS % 1000 * 1000 };  // Send timeout
+    size_t name_len = 0;                                             // Length of socket_name
+
+    // INPUT VALIDATION
+    if (!socket_name)
+    {
+        socket_name = getenv(CLEANUP_ENV_VAR);
+        socket_name = socket_name && *socket_name ? socket_name : CLEANUP_DEFAULT_SOCKET;
+    }
+    if (0 == strcmp(socket_name, "off"))
+    {
+        results = ENOTSUP;
+    }
+    else
+    {
+        name_len = strlen(socket_name);
+        if (0 == name_len || name_len >= sizeof(_address.sun_path))
+        {
+            results = -1;
+        }
+    }
+
+    // OPEN IT
+    if (0 == results)
+    {
+        cleanup_close();
+        memset(&_address, 0, sizeof(_address));
+        _address.sun_family = AF_UNIX;
+        memcpy(_address.sun_path, socket_name, name_len);
+        _socket_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        // A backed-up service blocks sendto() (that's the throttle) but only for so long
+        if (_socket_fd < 0 || setsockopt(_socket_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)))
+        {
+            results = get_errno();
+            cleanup_close();
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+int cleanup_request(const char *filename)
+{
+    // LOCAL VARIABLES
+    int results = -1;          // 0 on success, -1 on bad input, errno on failure
+    char tombstone[PATH_MAX + 1] = { 0 };  // What filename is renamed to until it's deleted
+    int tombstone_len = 0;     // Length of tombstone
+    const char *base = NULL;   // filename's base filename
+    int errnum = 0;            // Errno value from sendto() or _start_service()
+    bool in_use = false;       // Did _start_service() find the socket filename already taken?
+    bool renamed = false;      // Is filename at tombstone?
+    int attempt = 0;           // Iterating variable
+
+    // INPUT VALIDATION
+    if (INVALID_FD != _socket_fd && filename && '/' == *filename)
+    {
+        base = strrchr(filename, '/') + 1;
+        tombstone_len = snprintf(tombstone, sizeof(tombstone), "%.*s%s%ld_%lu", (int)(base - filename),
+                                 filename, CLEANUP_TOMBSTONE_PREFIX, (long)getpid(), ++_tombstones);
+        results = (*base && tombstone_len <= PATH_MAX) ? 0 : -1;
+    }
+
+    // RENAME IT
+    // The request may wait in the service's queue while the next harness run creates filename
+    //  again, so the service only ever sees a name nothing else will use
+    if (0 == results)
+    {
+        renamed = (0 == rename(filename, tombstone));
+        results = true == renamed ? EAGAIN : get_errno();
+    }
+
+    // SEND IT
+    // Start the service if it isn't running.  A filename nobody is bound to (ECONNREFUSED) that
+    //  can't be bound (EADDRINUSE) either is left over from a service that died: remove it.
+    for (attempt = 0; attempt < 4 && EAGAIN == results; attempt++)
+    {
+        if (tombstone_len == sendto(_socket_fd, tombstone, tombstone_len, MSG_NOSIGNAL,
+                                    (struct sockaddr *)&_address, sizeof(_address)))
+        {
+            results = 0;
+        }
+        else if (ENOENT != errno && ECONNREFUSED != errno)
+        {
+            results = get_errno();  // Including EAGAIN: the service stayed backed up
+            break;
+        }
+        else
+        {
+            if (ECONNREFUSED == errno && true == in_use)
+            {
+                unlink(_address.sun_path);
+            }
+            errnum = _start_service();
+            in_use = (EADDRINUSE == errnum);
+            if (errnum && false == in_use)
+            {
+                results = errnum;
+            }
+        }
+    }
+    if (EAGAIN == results && attempt >= 4)
+    {
+        results = ECONNREFUSED;
+    }
+
+    // PUT IT BACK
+    // The caller deletes filename itself when the request fails, unless it was recreated
+    if (0 != results && true == renamed
+        && renameat2(AT_FDCWD, tombstone, AT_FDCWD, filename, RENAME_NOREPLACE))
+    {
+        results = unlink(tombstone) ? results : 0;
+    }
+
+    // DONE
+    return results;
+}
@@ -0,0 +1,56 @@
+/*
+ *  Background deletion of test artifacts, off the test harness' critical path.
+ *  cleanup_request() sends a filename (one datagram) to the cleanup service: a detached helper
+ *      process listening on a Unix domain datagram socket.  The first request starts the service
+ *      and it exits once it's been idle for CLEANUP_IDLE_MS, so it outlives the harness that
+ *      started it and takes requests from every harness run that follows.
+ *  The service queues filenames and deletes them in batches of CLEANUP_BATCH with unlinkat()
+ *      relative to cached directory file descriptors (no path walk per file).  Once
+ *      CLEANUP_HIGH_WATER filenames are waiting it stops reading the socket, so requests back up
+ *      in the kernel and cleanup_request() blocks: harnesses only slow down when deletion falls
+ *      dangerously behind.  A request blocked longer than CLEANUP_THROTTLE_MS fails with EAGAIN
+ *      and the caller should delete the file itself.
+ *  The service only sees the real filesystem: don't send it files from the memory I/O backend
+ *      (see: HARE_io.h).
+ */
+
+#ifndef __HARE_CLEANUP__
+#define __HARE_CLEANUP__
+
+#define CLEANUP_ENV_VAR "HARE_CLEANUP"                    // Socket filename (or "off")
+#define CLEANUP_DEFAULT_SOCKET "/tmp/hare_cleanup.sock"   // Socket filename if CLEANUP_ENV_VAR isn't set
+#define CLEANUP_HIGH_WATER 4096   // Queued filenames at which the service stops taking requests
+#define CLEANUP_BATCH 64          // Most files deleted between checks for new requests
+#define CLEANUP_DIRS 16           // Directory file descriptors the service keeps open
+#define CLEANUP_IDLE_MS 5000      // Service exits after this long without a request
+#define CLEANUP_THROTTLE_MS 1000  // Longest cleanup_request() waits for a backed-up service
+#define CLEANUP_TOMBSTONE_PREFIX ".hare_tomb_"  // cleanup_request() renames files to <prefix><pid>_<count>
+
+
+/*
+ *  Stop sending requests (the service keeps running until it's idle)
+ */
+void cleanup_close(void);
+
+
+/*
+ *  Get ready to send requests to the service listening on socket_name.  NULL reads the name
+ *      from CLEANUP_ENV_VAR, falling back to CLEANUP_DEFAULT_SOCKET.
+ *  Returns 0 on success, -1 on bad input, errno on failure (ENOTSUP if it's "off")
+ */
+int cleanup_open(const char *socket_name);
+
+
+/*
+ *  Ask the service to delete filename (an absolute path), starting the service if it isn't running.
+ *      filename is first renamed to a tombstone (CLEANUP_TOMBSTONE_PREFIX, this pid, and a counter)
+ *      in the same directory, so a request that waits in the queue can't delete a new file that
+ *      reuses the name.  If the request fails, filename is renamed back for the caller to delete.
+ *  Returns 0 on success, -1 on bad input (or cleanup_open() wasn't called), errno on failure
+ *      (e.g., ENOENT if filename doesn't exist, EAGAIN if the service stayed backed up for
+ *      CLEANUP_THROTTLE_MS)
+ */
+int cleanup_request(const char *filename);
+
+
+#endif  // __HARE_CLEANUP__
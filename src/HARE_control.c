@@ -0,0 +1,570 @@
+/*
+ *  Implements HARE_control.h functions.
+ */
+
+#define _GNU_SOURCE          // accept4()
+#include <errno.h>           // errno
+#include <poll.h>            // poll(), struct pollfd
+#include <stdarg.h>          // va_end(), va_start()
+#include <stdio.h>           // snprintf(), vsnprintf()
+#include <stdlib.h>          // calloc(), free()
+#include <string.h>          // memcpy(), memset(), strchr(), strcmp(), strcspn(), strlen()
+#include <sys/ioctl.h>       // ioctl(), FIONREAD
+#include <sys/socket.h>      // accept4(), bind(), connect(), listen(), recv(), send(), socket()
+#include <sys/stat.h>        // chmod(), lstat()
+#include <sys/time.h>        // struct timeval
+#include <sys/un.h>          // struct sockaddr_un
+#include <syslog.h>          // LOG_* macros
+#include <unistd.h>          // close(), unlink()
+#include "HARE_arena.h"      // message_arena, message_pool
+#include "HARE_control.h"
+#include "HARE_library.h"    // pipe_fds, priorityNames, syslog_*(), get_errno()
+#include "HARE_logger.h"     // logger_dropped(), logger_level, logger_*_level()
+#include "HARE_ring.h"       // message_ring
+#include "HARE_stats.h"      // stats_now()
+#include "HARE_storage.h"    // SHARD_* values
+
+#define CONTROL_NS_PER_MS 1000000ULL  // Nanoseconds per millisecond
+
+ControlSocket *control_socket = NULL;
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Append a printf()-style line to the reply buffer (truncating at CONTROL_REPLY_SIZE)
+ */
+static void _append(char *reply, size_t *reply_len, const char *format, ...)
+{
+    // LOCAL VARIABLES
+    va_list args;     // Needed for variable length arguments
+    int written = 0;  // Return value from vsnprintf()
+
+    // DO IT
+    if (*reply_len < CONTROL_REPLY_SIZE - 1)
+    {
+        va_start(args, format);
+        written = vsnprintf(reply + *reply_len, CONTROL_REPLY_SIZE - *reply_len, format, args);
+        va_end(args);
+        if (written > 0)
+        {
+            *reply_len += written;
+            if (*reply_len > CONTROL_REPLY_SIZE - 1)
+            {
+                *reply_len = CONTROL_REPLY_SIZE - 1;  // vsnprintf() truncated it
+            }
+        }
+    }
+}
+
+
+/*
+ *  Name of the syslog priority level (see: priorityNames)
+ */
+static char *_level_name(int level)
+{
+    // LOCAL VARIABLES
+    CODE *priority = priorityNames;  // Iterating variable
+    char *name = "UNKNOWN";          // Return value
+
+    // FIND IT
+    for (priority = priorityNames; priority->name; priority++)
+    {
+        if (priority->value == level)
+        {
+            name = priority->name;
+            break;
+        }
+    }
+
+    // DONE
+    return name;
+}
+
+
+/*
+ *  Bytes waiting to be read from fd (0 if it can't be measured)
+ */
+static size_t _pending_bytes(int fd)
+{
+    // LOCAL VARIABLES
+    int pending = 0;  // FIONREAD value
+
+    // MEASURE IT
+    if (fd > INVALID_FD && (0 != ioctl(fd, FIONREAD, &pending) || pending < 0))
+    {
+        pending = 0;
+    }
+
+    // DONE
+    return (size_t)pending;
+}
+
+
+/*
+ *  Answer the "config" command
+ */
+static void _report_config(ControlSocket *control, char *reply, size_t *reply_len)
+{
+    // LOCAL VARIABLES
+    INotifySettings *settings = &control->config->inotify_config;  // Daemon settings
+    char *schemes[] = { "flat", "hash", "time" };                   // ShardScheme names
+
+    // REPORT IT
+    _append(reply, reply_len, "watched %s\n", settings->watched ? settings->watched : "-");
+    _append(reply, reply_len, "process %s\n", settings->process ? settings->process : "-");
+    _append(reply, reply_len, "store %s\n", settings->store ? settings->store : "-");
+    if (settings->shard && settings->shard->scheme >= SHARD_FLAT && settings->shard->scheme <= SHARD_TIME)
+    {
+        _append(reply, reply_len, "shard %s/%d\n", schemes[settings->shard->scheme], settings->shard->levels);
+    }
+    else
+    {
+        _append(reply, reply_len, "shard flat\n");
+    }
+    if (settings->retention)
+    {
+        _append(reply, reply_len, "retention_max_age %lld\n", (long long)settings->retention->max_age);
+        _append(reply, reply_len, "retention_max_bytes %lld\n", (long long)settings->retention->max_bytes);
+        _append(reply, reply_len, "retention_max_files %zu\n", settings->retention->max_files);
+    }
+    else
+    {
+        _append(reply, reply_len, "retention -\n");
+    }
+    _append(reply, reply_len, "journal %s\n", settings->journal ? settings->journal : "-");
+    _append(reply, reply_len, "backlog_workers %d\n", settings->backlog_workers);
+    _append(reply, reply_len, "recursive %s\n", settings->recursive ? "yes" : "no");
+    _append(reply, reply_len, "max_watches %zu\n", settings->max_watches);
+    _append(reply, reply_len, "fanotify %s\n", settings->fanotify ? "yes" : "no");
+    _append(reply, reply_len, "workers %d\n", settings->workers);
+    _append(reply, reply_len, "stats %s\n", settings->stats ? settings->stats : "-");
+    _append(reply, reply_len, "control %s\n", control->path);
+    _append(reply, reply_len, "transport %s\n", message_ring ? "ring" : "pipe");
+}
+
+
+/*
+ *  Answer the "status" command
+ */
+static void _report_status(ControlSocket *control, char *reply, size_t *reply_len)
+{
+    // LOCAL VARIABLES
+    ControlCounters *counters = &control->counters;                    // Shorthand
+    double uptime = (stats_now() - control->started_ns) / 1000000000.0;  // Seconds since control_open()
+    size_t queued = 0;         // Bytes waiting for the daemon
+    size_t worker_queued = 0;  // Bytes waiting for the workers
+    int running = 0;           // Workers running
+    uint64_t lookups = 0;      // Message pool hits and misses
+    int i = 0;                 // Iterating variable
+
+    // MEASURE IT
+    if (message_ring)
+    {
+        queued = atomic_load_explicit(&message_ring->header->tail, memory_order_acquire)
+                 - atomic_load_explicit(&message_ring->header->head, memory_order_relaxed);
+    }
+    else
+    {
+        queued = _pending_bytes(pipe_fds[PIPE_READ]);
+    }
+    if (control->supervisor)
+    {
+        for (i = 0; i < control->supervisor->num_workers; i++)
+        {
+            if (control->supervisor->workers[i].pid > 0)
+            {
+                running++;
+                worker_queued += _pending_bytes(control->supervisor->workers[i].write_fd);
+            }
+        }
+    }
+    if (message_pool)
+    {
+        lookups = message_pool->hits + message_pool->misses;
+    }
+
+    // REPORT IT
+    _append(reply, reply_len, "uptime_s %.3f\n", uptime);
+    _append(reply, reply_len, "paused %s\n", control->paused ? "yes" : "no");
+    _append(reply, reply_len, "received %llu\n", (unsigned long long)counters->received);
+    _append(reply, reply_len, "processed %llu\n", (unsigned long long)counters->processed);
+    _append(reply, reply_len, "failed %llu\n", (unsigned long long)counters->failed);
+    _append(reply, reply_len, "dispatched %llu\n", (unsigned long long)counters->dispatched);
+    _append(reply, reply_len, "duplicates %llu\n", (unsigned long long)counters->duplicates);
+    _append(reply, reply_len, "received_per_s %.3f\n", uptime > 0 ? counters->received / uptime : 0.0);
+    _append(reply, reply_len, "queue_bytes %zu\n", queued);
+    _append(reply, reply_len, "in_flight %zu\n", control->journal ? control->journal->num_in_flight : 0);
+    _append(reply, reply_len, "workers_running %d\n", running);
+    _append(reply, reply_len, "worker_queue_bytes %zu\n", worker_queued);
+    _append(reply, reply_len, "pool_hits %llu\n", (unsigned long long)(message_pool ? message_pool->hits : 0));
+    _append(reply, reply_len, "pool_misses %llu\n", (unsigned long long)(message_pool ? message_pool->misses : 0));
+    _append(reply, reply_len, "pool_hit_rate %.3f\n", lookups ? (double)message_pool->hits / lookups : 0.0);
+    _append(reply, reply_len, "arena_high_water %zu\n", message_arena ? message_arena->high_water : 0);
+    _append(reply, reply_len, "retention_evicted %zu\n", control->retention ? control->retention->evicted : 0);
+    _append(reply, reply_len, "log_level %s\n", _level_name(logger_level));
+    _append(reply, reply_len, "log_dropped %llu\n", (unsigned long long)logger_dropped());
+    _append(reply, reply_len, "served %llu\n", (unsigned long long)control->served);
+}
+
+
+/*
+ *  Run one command and build its reply.  Does not validate input.
+ */
+static void _run_command(ControlSocket *control, char *command, char *reply, size_t *reply_len)
+{
+    // LOCAL VARIABLES
+    char *argument = strchr(command, ' ');  // Text after the command name (if any)
+    int level = 0;                          // New log level
+
+    // PARSE IT
+    if (argument)
+    {
+        *argument = '\0';
+        argument++;
+        while (' ' == *argument)
+        {
+            argument++;
+        }
+    }
+
+    // RUN IT
+    if (0 == strcmp(command, "status"))
+    {
+        _report_status(control, reply, reply_len);
+    }
+    else if (0 == strcmp(command, "config"))
+    {
+        _report_config(control, reply, reply_len);
+    }
+    else if (0 == strcmp(command, "log-level") && (!argument || !*argument))
+    {
+        _append(reply, reply_len, "log_level %s\n", _level_name(logger_level));
+    }
+    else if (0 == strcmp(command, "log-level"))
+    {
+        level = logger_parse_level(argument);
+        if (level < 0)
+        {
+            _append(reply, reply_len, "error: unknown log level %s\n", argument);
+        }
+        else
+        {
+            logger_set_level(level);
+            syslog_it2(LOG_NOTICE, "Control: log level set to %s", _level_name(level));
+            _append(reply, reply_len, "log_level %s\n", _level_name(level));
+        }
+    }
+    else if (0 == strcmp(command, "pause") || 0 == strcmp(command, "resume"))
+    {
+        control->paused = (0 == strcmp(command, "pause"));
+        syslog_it2(LOG_NOTICE, "Control: intake %s", control->paused ? "paused" : "resumed");
+        _append(reply, reply_len, "paused %s\n", control->paused ? "yes" : "no");
+    }
+    else if (0 == strcmp(command, "sweep"))
+    {
+        if (control->retention)
+        {
+            retention_trigger(control->retention);
+            _append(reply, reply_len, "sweep started\n");
+        }
+        else
+        {
+            _append(reply, reply_len, "error: retention is not configured\n");
+        }
+    }
+    else if (0 == strcmp(command, "help"))
+    {
+        _append(reply, reply_len, "commands status config log-level [LEVEL] pause resume sweep help\n");
+    }
+    else
+    {
+        _append(reply, reply_len, "error: unknown command %s (try help)\n", command);
+    }
+}
+
+
+/*
+ *  Read client's command, run it, and send the reply.  Gives up once CONTROL_TIMEOUT_MS pass.
+ *  Returns 0 on success, errno on failure
+ */
+static int _answer_client(ControlSocket *control, int client)
+{
+    // LOCAL VARIABLES
+    int results = 0;                                              // 0 on success, errno on failure
+    struct timeval timeout = { 0, CONTROL_TIMEOUT_MS * 1000 };    // Per-call socket timeout
+    uint64_t deadline = stats_now() + CONTROL_TIMEOUT_MS * CONTROL_NS_PER_MS;  // Overall limit
+    char command[CONTROL_COMMAND_SIZE] = { 0 };                   // Command from the client
+    size_t command_len = 0;                                       // Bytes in command
+    char *newline = NULL;                                         // End of the command
+    char reply[CONTROL_REPLY_SIZE] = { 0 };                       // Reply to the client
+    size_t reply_len = 0;                                         // Bytes in reply
+    size_t sent = 0;                                              // Bytes of reply sent
+    ssize_t num_bytes = 0;                                        // Return value from recv()/send()
+
+    // SETUP
+    if (setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout))
+        || setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)))
+    {
+        results = get_errno();
+    }
+
+    // READ THE COMMAND
+    while (0 == results && !newline && command_len < sizeof(command) - 1)
+    {
+        num_bytes = recv(client, command + command_len, sizeof(command) - 1 - command_len, 0);
+        if (num_bytes > 0)
+        {
+            command_len += num_bytes;
+            newline = strchr(command, '\n');
+        }
+        else if (0 == num_bytes)
+        {
+            break;  // The client finished without a newline
+        }
+        else if (EINTR != errno)
+        {
+            results = get_errno();
+        }
+        if (0 == results && !newline && stats_now() > deadline)
+        {
+            results = ETIMEDOUT;
+        }
+    }
+    if (0 == results)
+    {
+        command[strcspn(command, "\r\n")] = '\0';
+        _run_command(control, command, reply, &reply_len);
+        control->served++;
+    }
+
+    // SEND THE REPLY
+    while (0 == results && sent < reply_len)
+    {
+        num_bytes = send(client, reply + sent, reply_len - sent, MSG_NOSIGNAL);
+        if (num_bytes > 0)
+        {
+            sent += num_bytes;
+        }
+        else if (EINTR != errno)
+        {
+            results = get_errno();
+        }
+        if (0 == results && sent < reply_len && stats_now() > deadline)
+        {
+            results = ETIMEDOUT;
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+void control_close(ControlSocket *control)
+{
+    if (control)
+    {
+        if (control->fd > INVALID_FD)
+        {
+            close(control->fd);
+            if (control->path)
+            {
+                unlink(control->path);
+            }
+        }
+        free(control->path);
+        memset(control, 0, sizeof(ControlSocket));
+        control->fd = INVALID_FD;
+    }
+}
+
+
+void control_detach(ControlSocket *control)
+{
+    if (control && control->fd > INVALID_FD)
+    {
+        close(control->fd);  // The socket file belongs to the process that opened it
+        control->fd = INVALID_FD;
+    }
+}
+
+
+int control_open(ControlSocket *control, char *path, Configuration *config)
+{
+    // LOCAL VARIABLES
+    int results = -1;                    // 0 on success, -1 on bad input, errno on failure
+    struct sockaddr_un address;          // Socket address for path
+    struct stat path_stat;               // Metadata for an existing path
+    int probe = INVALID_FD;              // Connection to a socket already at path
+    size_t path_len = 0;                 // Length of path
+
+    // INPUT VALIDATION
+    if (control && path && config)
+    {
+        memset(control, 0, sizeof(ControlSocket));
+        control->fd = INVALID_FD;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        path_len = strlen(path);
+        if (path_len > 0 && path_len < sizeof(address.sun_path))
+        {
+            memcpy(address.sun_path, path, path_len);
+            results = 0;
+        }
+    }
+
+    // CLEAR THE WAY
+    if (0 == results && 0 == lstat(path, &path_stat))
+    {
+        if (!S_ISSOCK(path_stat.st_mode))
+        {
+            results = EEXIST;  // Not ours to remove
+        }
+        else
+        {
+            probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (probe > INVALID_FD && 0 == connect(probe, (struct sockaddr *)&address, sizeof(address)))
+            {
+                results = EADDRINUSE;  // Another daemon is listening on it
+            }
+            else if (0 != unlink(path))
+            {
+                results = get_errno();
+            }
+        }
+    }
+
+    // LISTEN
+    if (0 == results)
+    {
+        control->path = calloc(path_len + 1, sizeof(char));
+        control->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (!control->path || control->fd < 0)
+        {
+            results = get_errno();
+        }
+        else
+        {
+            memcpy(control->path, path, path_len);
+        }
+    }
+    if (0 == results)
+    {
+        if (bind(control->fd, (struct sockaddr *)&address, sizeof(address)))
+        {
+            results = get_errno();
+            close(control->fd);
+            control->fd = INVALID_FD;  // Keeps control_close() from removing someone else's path
+        }
+        // The daemon's umask is 0 so restrict the socket to its owner explicitly
+        else if (chmod(path, S_IRUSR | S_IWUSR) || listen(control->fd, CONTROL_MAX_CLIENTS))
+        {
+            results = get_errno();
+        }
+    }
+    if (0 == results)
+    {
+        control->config = config;
+        control->started_ns = stats_now();
+    }
+
+    // CLEANUP
+    if (probe > INVALID_FD)
+    {
+        close(probe);
+    }
+    if (results > 0)
+    {
+        syslog_errno(results, "Unable to open the control socket %s", path);
+        control_close(control);
+    }
+
+    // DONE
+    return results;
+}
+
+
+int control_service(ControlSocket *control)
+{
+    // LOCAL VARIABLES
+    int answered = -1;        // Return value
+    int client = INVALID_FD;  // Accepted connection
+    int errnum = 0;           // Errno value from _answer_client()
+
+    // INPUT VALIDATION
+    if (control && control->fd > INVALID_FD)
+    {
+        answered = 0;
+    }
+
+    // SERVICE IT
+    while (answered >= 0 && answered < CONTROL_MAX_CLIENTS)
+    {
+        client = accept4(control->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client < 0)
+        {
+            if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+            {
+                syslog_errno(errno, "Unable to accept a control connection");
+            }
+            break;  // Nobody else is waiting
+        }
+        errnum = _answer_client(control, client);
+        if (errnum)
+        {
+            syslog_errno(errnum, "Dropped a control connection");
+        }
+        else
+        {
+            answered++;
+        }
+        close(client);
+    }
+
+    // DONE
+    return answered;
+}
+
+
+int control_wait(ControlSocket *control, int other_fd, int timeout_ms)
+{
+    // LOCAL VARIABLES
+    int results = -1;                       // 0 on success, -1 on bad input, errno on failure
+    struct pollfd poll_fds[2] = { { 0 } };  // Control socket and other_fd
+    nfds_t num_fds = 1;                     // Number of entries in poll_fds
+
+    // INPUT VALIDATION
+    if (control && control->fd > INVALID_FD)
+    {
+        results = 0;
+    }
+
+    // WAIT
+    if (0 == results)
+    {
+        poll_fds[0].fd = control->fd;
+        poll_fds[0].events = POLLIN;
+        if (other_fd > INVALID_FD)
+        {
+            poll_fds[1].fd = other_fd;
+            poll_fds[1].events = POLLIN;
+            num_fds = 2;
+        }
+        if (-1 == poll(poll_fds, num_fds, timeout_ms) && EINTR != errno)
+        {
+            results = get_errno();
+        }
+    }
+
+    // DONE
+    return results;
+}
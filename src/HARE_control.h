@@ -0,0 +1,99 @@
+/*
+ *  Live introspection and control of a running HARE daemon over a Unix domain socket.
+ *  The daemon's event loop calls control_service() between messages and while idle.  Each
+ *      connection carries one newline-terminated command and gets a plain text reply of
+ *      "name value" lines (or "error: ..."), then the daemon closes it.  Try:
+ *          echo status | socat - UNIX-CONNECT:<control socket>
+ *  Commands
+ *      status - Counters, throughput, queue depth, in-flight files, and message pool hit rate
+ *      config - The daemon's settings
+ *      log-level [LEVEL] - Report (or set) the lowest priority sent to syslog (e.g., DEBUG)
+ *      pause - Stop taking messages (they wait in the pipe or ring)
+ *      resume - Take messages again
+ *      sweep - Start a retention sweep now
+ *      help - List the commands
+ *  Client I/O is bounded by CONTROL_TIMEOUT_MS, so a stuck client can't stall the event loop,
+ *      and worker processes never wait on the control socket at all.
+ */
+
+#ifndef __HARE_CONTROL__
+#define __HARE_CONTROL__
+
+#include <stdbool.h>    // bool
+#include <stdint.h>     // uint64_t
+#include "HARE_journal.h"     // Journal
+#include "HARE_library.h"     // Configuration
+#include "HARE_retention.h"   // RetentionEngine
+#include "HARE_supervisor.h"  // Supervisor
+
+#define CONTROL_TIMEOUT_MS 100      // Longest a client may take to send a command or read a reply
+#define CONTROL_MAX_CLIENTS 8       // Most connections control_service() answers per call
+#define CONTROL_COMMAND_SIZE 256    // Longest command (including the newline)
+#define CONTROL_REPLY_SIZE 8192     // Longest reply
+#define CONTROL_ENV_VAR "HARE_CONTROL"  // Control socket filename (see: read_settings())
+
+// Daemon activity counters (updated by the event loop)
+typedef struct _ControlCounters
+{
+    uint64_t received;    // Messages taken from the pipe, ring, or watcher
+    uint64_t processed;   // Messages the daemon processed itself
+    uint64_t failed;      // Messages the daemon failed to process
+    uint64_t dispatched;  // Messages handed to worker processes
+    uint64_t duplicates;  // Events dropped because the backlog drain already handled them
+} ControlCounters;
+
+// A daemon's control socket
+typedef struct _ControlSocket
+{
+    int fd;                       // Listening socket
+    char *path;                   // Socket filename (heap-allocated)
+    Configuration *config;        // Daemon configuration (reported by "config")
+    Journal *journal;             // Active journal (NULL if none) for the in-flight count
+    Supervisor *supervisor;       // Active supervisor (NULL if none) for the worker queues
+    RetentionEngine *retention;   // Active retention engine (NULL if none) for "sweep"
+    ControlCounters counters;     // Updated by the event loop
+    uint64_t started_ns;          // When control_open() was called (CLOCK_MONOTONIC)
+    uint64_t served;              // Commands answered
+    bool paused;                  // Has a client paused intake?
+} ControlSocket;
+
+extern ControlSocket *control_socket;  // Active control socket (NULL if none)
+
+
+/*
+ *  Stop listening, remove the socket file, and free control's resources
+ */
+void control_close(ControlSocket *control);
+
+
+/*
+ *  Close a forked process' copy of control's listening socket, leaving the socket file (and
+ *      the daemon's copy) alone
+ */
+void control_detach(ControlSocket *control);
+
+
+/*
+ *  Listen for commands on the Unix domain socket path (replacing a stale socket left there).
+ *      Only the daemon's user may connect.  Set control's component pointers afterwards.
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int control_open(ControlSocket *control, char *path, Configuration *config);
+
+
+/*
+ *  Answer every client waiting on control (up to CONTROL_MAX_CLIENTS) without blocking.
+ *  Returns the number of commands answered, -1 on bad input
+ */
+int control_service(ControlSocket *control);
+
+
+/*
+ *  Sleep until a client connects to control, other_fd (if valid) is readable, or timeout_ms
+ *      milliseconds pass
+ *  Returns 0 on success (or timeout), -1 on bad input, errno on failure
+ */
+int control_wait(ControlSocket *control, int other_fd, int timeout_ms);
+
+
+#endif  // __HARE_CONTROL__
@@ -0,0 +1,521 @@
+/*
+ *  Implements HARE_fanotify.h functions.
+ */
+
+#define _GNU_SOURCE          // open_by_handle_at(), struct file_handle
+#include <errno.h>           // errno
+#include <fcntl.h>           // open(), open_by_handle_at(), O_* macros, AT_FDCWD
+#include <linux/limits.h>    // PATH_MAX
+#include <poll.h>            // poll(), struct pollfd
+#include <stdio.h>           // snprintf()
+#include <stdlib.h>          // calloc(), free(), realpath()
+#include <string.h>          // memcmp(), memcpy(), memset(), strlen(), strncmp()
+#include <sys/fanotify.h>    // fanotify_*(), FAN_* macros
+#include <unistd.h>          // close(), read(), readlink()
+#include "HARE_arena.h"      // hare_message_alloc()
+#include "HARE_fanotify.h"
+#include "HARE_library.h"    // syslog_*(), INVALID_FD, get_errno()
+
+// Events the filesystem mark reports
+#define FAN_WATCHER_MASK (FAN_CLOSE_WRITE | FAN_MOVED_TO | FAN_MOVED_FROM | FAN_ONDIR)
+#define FAN_WATCHER_FNV_OFFSET 2166136261U  // FNV-1a 32-bit offset basis
+#define FAN_WATCHER_FNV_PRIME 16777619U     // FNV-1a 32-bit prime
+
+FanWatcher *fan_watcher = NULL;
+
+// A struct file_handle with room for the largest handle
+typedef union _FanHandle
+{
+    struct file_handle handle;                                            // Handle header
+    char buffer[sizeof(struct file_handle) + FAN_WATCHER_HANDLE_SIZE];   // Room for f_handle
+} FanHandle;
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Canonicalize dirname into a heap-allocated path ending in '/'
+ *  Returns the path on success, NULL on failure (errno is set)
+ */
+static char *_canonical_dir(char *dirname)
+{
+    // LOCAL VARIABLES
+    char *resolved = realpath(dirname, NULL);  // Canonical dirname
+    char *canonical = NULL;                    // Return value
+    size_t resolved_len = 0;                   // Length of resolved
+
+    // BUILD IT
+    if (resolved)
+    {
+        resolved_len = strlen(resolved);
+        canonical = calloc(resolved_len + 2, sizeof(char));
+        if (canonical)
+        {
+            memcpy(canonical, resolved, resolved_len);
+            if (0 == resolved_len || '/' != canonical[resolved_len - 1])
+            {
+                canonical[resolved_len] = '/';
+            }
+        }
+        else
+        {
+            errno = ENOMEM;
+        }
+    }
+
+    // CLEANUP
+    free(resolved);
+
+    // DONE
+    return canonical;
+}
+
+
+/*
+ *  Forget every cached directory (e.g., after a directory was renamed)
+ */
+static void _clear_cache(FanWatcher *watcher)
+{
+    // LOCAL VARIABLES
+    size_t i = 0;  // Iterating variable
+
+    // CLEAR IT
+    for (i = 0; i < FAN_WATCHER_CACHE_SLOTS; i++)
+    {
+        free(watcher->cache[i].path);
+        watcher->cache[i].path = NULL;
+        watcher->cache[i].hash = 0;
+    }
+}
+
+
+/*
+ *  Is path (ending in '/') beneath the watched directory and outside every skip directory?
+ */
+static bool _is_watched(FanWatcher *watcher, char *path)
+{
+    // LOCAL VARIABLES
+    bool watched = false;  // Return value
+    size_t i = 0;          // Iterating variable
+
+    // CHECK IT
+    if (0 == strncmp(path, watcher->watched, watcher->watched_len))
+    {
+        watched = true;
+        for (i = 0; i < watcher->num_skip && true == watched; i++)
+        {
+            watched = (0 != strncmp(path, watcher->skip[i], strlen(watcher->skip[i])));
+        }
+    }
+
+    // DONE
+    return watched;
+}
+
+
+/*
+ *  Translate a directory file handle into a path, consulting the cache first.  Directories
+ *      outside the watched tree are cached too so unrelated activity elsewhere on the
+ *      filesystem costs a single lookup.
+ *  Returns the cached path (ending in '/') or NULL if the directory isn't watched or is gone
+ */
+static char *_lookup_dir(FanWatcher *watcher, char *event_handle)
+{
+    // LOCAL VARIABLES
+    char *dir_path = NULL;                    // Return value
+    FanHandle handle;                         // Aligned copy of event_handle
+    uint32_t hash = FAN_WATCHER_FNV_OFFSET;   // FNV-1a hash of the handle
+    FanDirEntry *entry = NULL;                // Cache slot for hash
+    int dir_fd = INVALID_FD;                  // Directory opened by handle
+    char link[64] = { 0 };                    // /proc/self/fd/ link for dir_fd
+    char resolved[PATH_MAX + 1] = { 0 };      // Path dir_fd refers to
+    ssize_t resolved_len = 0;                 // Return value from readlink()
+    bool resolve = true;                      // Does the handle need open_by_handle_at()?
+    unsigned int i = 0;                       // Iterating variable
+
+    // HASH IT
+    // The event's handle isn't necessarily aligned
+    memset(&handle, 0, sizeof(handle));
+    memcpy(&handle, event_handle, sizeof(struct file_handle));
+    if (handle.handle.handle_bytes > FAN_WATCHER_HANDLE_SIZE)
+    {
+        resolve = false;  // Can't happen with MAX_HANDLE_SZ
+    }
+    else
+    {
+        memcpy(handle.handle.f_handle, event_handle + sizeof(struct file_handle), handle.handle.handle_bytes);
+        hash = (hash ^ (uint32_t)handle.handle.handle_type) * FAN_WATCHER_FNV_PRIME;
+        for (i = 0; i < handle.handle.handle_bytes; i++)
+        {
+            hash = (hash ^ handle.handle.f_handle[i]) * FAN_WATCHER_FNV_PRIME;
+        }
+        hash = hash ? hash : 1;  // Zero marks an empty slot
+        entry = watcher->cache + (hash & (FAN_WATCHER_CACHE_SLOTS - 1));
+    }
+
+    // CHECK THE CACHE
+    if (true == resolve && hash == entry->hash && handle.handle.handle_type == entry->handle_type
+        && handle.handle.handle_bytes == entry->handle_bytes
+        && 0 == memcmp(handle.handle.f_handle, entry->handle, entry->handle_bytes))
+    {
+        dir_path = entry->path;
+        resolve = false;
+    }
+
+    // RESOLVE IT
+    if (true == resolve)
+    {
+        dir_fd = open_by_handle_at(watcher->mount_fd, &handle.handle, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    }
+    if (dir_fd > INVALID_FD)
+    {
+        snprintf(link, sizeof(link), "/proc/self/fd/%d", dir_fd);
+        resolved_len = readlink(link, resolved, PATH_MAX - 1);
+        close(dir_fd);
+    }
+    if (dir_fd > INVALID_FD && resolved_len > 0)
+    {
+        // Replace whatever occupied the slot
+        if (resolved[resolved_len - 1] != '/')
+        {
+            resolved[resolved_len++] = '/';
+        }
+        resolved[resolved_len] = '\0';
+        free(entry->path);
+        entry->path = NULL;
+        entry->hash = hash;
+        entry->handle_type = handle.handle.handle_type;
+        entry->handle_bytes = handle.handle.handle_bytes;
+        memcpy(entry->handle, handle.handle.f_handle, handle.handle.handle_bytes);
+        if (true == _is_watched(watcher, resolved))
+        {
+            entry->path = calloc(resolved_len + 1, sizeof(char));
+            if (entry->path)
+            {
+                memcpy(entry->path, resolved, resolved_len);
+            }
+            else
+            {
+                entry->hash = 0;  // Try again next time
+            }
+        }
+        dir_path = entry->path;
+    }
+
+    // DONE
+    return dir_path;  // ESTALE (deleted directory) and friends are simply not watched
+}
+
+
+/*
+ *  Act on the fanotify event at raw, setting *filename for a watched file.  Records with
+ *      names aren't padded to 8 bytes, so every header is copied out before it's read.
+ *  Returns 0 on success, errno on failure
+ */
+static int _handle_event(FanWatcher *watcher, char *raw, char **filename)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                                          // 0 on success, errno on failure
+    struct fanotify_event_metadata event;                    // Copy of the event's metadata
+    struct fanotify_event_info_header info;                  // Copy of the current information record
+    struct file_handle handle_header;                        // Copy of dir_handle's header
+    char *dir_handle = NULL;                                 // Parent directory of the event's subject
+    char *name = NULL;                                       // Name of the subject in dir_handle
+    char *dir_path = NULL;                                   // Watched path of dir_handle
+    size_t dir_len = 0;                                      // Length of dir_path
+    size_t name_len = 0;                                     // Length of name
+    size_t offset = sizeof(struct fanotify_event_metadata);  // Offset of info in raw
+
+    // VALIDATE IT
+    memcpy(&event, raw, sizeof(event));
+    if (FANOTIFY_METADATA_VERSION != event.vers)
+    {
+        errnum = EPROTO;
+        syslog_it2(LOG_ERR, "Unexpected fanotify metadata version %u", event.vers);
+    }
+    else if (event.fd > FAN_NOFD)
+    {
+        close(event.fd);  // Not requested, but never leak one
+    }
+
+    // FIND THE NAME
+    while (0 == errnum && offset + sizeof(info) <= event.event_len)
+    {
+        memcpy(&info, raw + offset, sizeof(info));
+        if (0 == info.len)
+        {
+            break;  // Malformed
+        }
+        if (FAN_EVENT_INFO_TYPE_DFID_NAME == info.info_type)
+        {
+            dir_handle = raw + offset + sizeof(struct fanotify_event_info_fid);
+            memcpy(&handle_header, dir_handle, sizeof(handle_header));
+            name = dir_handle + sizeof(struct file_handle) + handle_header.handle_bytes;
+        }
+        offset += info.len;
+    }
+
+    // HANDLE IT
+    if (0 != errnum)
+    {
+        // Already logged
+    }
+    else if (event.mask & FAN_Q_OVERFLOW)
+    {
+        // Not expected with FAN_UNLIMITED_QUEUE
+        syslog_it(LOG_WARNING, "The fanotify event queue overflowed");
+    }
+    else if (event.mask & FAN_ONDIR)
+    {
+        if (event.mask & (FAN_MOVED_FROM | FAN_MOVED_TO))
+        {
+            _clear_cache(watcher);  // Cached paths (and verdicts) beneath it are stale
+        }
+    }
+    else if (dir_handle && name && '.' != name[0] && (event.mask & (FAN_CLOSE_WRITE | FAN_MOVED_TO))
+             && (dir_path = _lookup_dir(watcher, dir_handle)))
+    {
+        dir_len = strlen(dir_path);
+        name_len = strlen(name);
+        if (dir_len + name_len > PATH_MAX)
+        {
+            syslog_it2(LOG_WARNING, "Ignoring an event for %s%s: the path is too long", dir_path, name);
+        }
+        else
+        {
+            *filename = hare_message_alloc(dir_len + name_len + 1);
+            if (*filename)
+            {
+                memcpy(*filename, dir_path, dir_len);
+                memcpy(*filename + dir_len, name, name_len);
+            }
+            else
+            {
+                errnum = ENOMEM;
+            }
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+void fan_watcher_destroy(FanWatcher *watcher)
+{
+    // LOCAL VARIABLES
+    size_t i = 0;  // Iterating variable
+
+    // DESTROY IT
+    if (watcher && watcher->cache)
+    {
+        if (watcher->fd > INVALID_FD)
+        {
+            close(watcher->fd);  // Removes the mark
+        }
+        if (watcher->mount_fd > INVALID_FD)
+        {
+            close(watcher->mount_fd);
+        }
+        _clear_cache(watcher);
+        for (i = 0; i < watcher->num_skip; i++)
+        {
+            free(watcher->skip[i]);
+        }
+        free(watcher->watched);
+        free(watcher->cache);
+        free(watcher->events);
+        memset(watcher, 0, sizeof(FanWatcher));
+        watcher->fd = INVALID_FD;
+        watcher->mount_fd = INVALID_FD;
+    }
+}
+
+
+int fan_watcher_init(FanWatcher *watcher, char *root_dir, char *skip_dirs[], size_t num_skip)
+{
+    // LOCAL VARIABLES
+    int results = -1;  // 0 on success, -1 on bad input, errno on failure
+    size_t i = 0;      // Iterating variable
+
+    // INPUT VALIDATION
+    if (watcher && root_dir && *root_dir && num_skip <= FAN_WATCHER_MAX_SKIP && (skip_dirs || 0 == num_skip))
+    {
+        memset(watcher, 0, sizeof(FanWatcher));
+        watcher->fd = INVALID_FD;
+        watcher->mount_fd = INVALID_FD;
+        results = 0;
+    }
+
+    // SETUP
+    if (0 == results)
+    {
+        watcher->cache = calloc(FAN_WATCHER_CACHE_SLOTS, sizeof(FanDirEntry));
+        watcher->events = calloc(FAN_WATCHER_EVENTS_SIZE, sizeof(char));
+        watcher->watched = _canonical_dir(root_dir);
+        if (!watcher->cache || !watcher->events || !watcher->watched)
+        {
+            results = watcher->watched ? ENOMEM : get_errno();
+        }
+        else
+        {
+            watcher->watched_len = strlen(watcher->watched);
+        }
+    }
+    for (i = 0; 0 == results && i < num_skip; i++)
+    {
+        if (skip_dirs[i] && (watcher->skip[watcher->num_skip] = _canonical_dir(skip_dirs[i])))
+        {
+            watcher->num_skip++;  // Missing directories have nothing to skip
+        }
+    }
+    if (0 == results)
+    {
+        watcher->mount_fd = open(watcher->watched, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (watcher->mount_fd < 0)
+        {
+            results = get_errno();
+        }
+    }
+
+    // MARK IT
+    if (0 == results)
+    {
+        watcher->fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_UNLIMITED_QUEUE
+                                    | FAN_NONBLOCK | FAN_CLOEXEC, O_RDONLY | O_LARGEFILE);
+        if (watcher->fd < 0)
+        {
+            results = get_errno();
+        }
+        else if (fanotify_mark(watcher->fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, FAN_WATCHER_MASK,
+                               AT_FDCWD, watcher->watched))
+        {
+            results = get_errno();
+        }
+    }
+
+    // DONE
+    if (0 == results)
+    {
+        syslog_it2(LOG_INFO, "Watching the filesystem under %s with fanotify", watcher->watched);
+    }
+    else if (results > 0)
+    {
+        syslog_errno(results, "Unable to watch %s with fanotify", root_dir);
+        if (!watcher->cache)
+        {
+            free(watcher->watched);
+            free(watcher->events);
+            watcher->watched = NULL;
+            watcher->events = NULL;
+        }
+        fan_watcher_destroy(watcher);
+    }
+    return results;
+}
+
+
+int fan_watcher_next(FanWatcher *watcher, char **filename)
+{
+    // LOCAL VARIABLES
+    int results = -1;                                // 0 on success, -1 on bad input, errno on failure
+    ssize_t bytes_read = 0;                          // Return value from read()
+    struct fanotify_event_metadata event;            // Copy of the next event's metadata
+
+    // INPUT VALIDATION
+    if (watcher && watcher->cache && filename)
+    {
+        *filename = NULL;
+        results = 0;
+    }
+
+    // FIND ONE
+    while (0 == results && !*filename)
+    {
+        if (watcher->events_pos + FAN_EVENT_METADATA_LEN <= watcher->events_len)
+        {
+            memcpy(&event, watcher->events + watcher->events_pos, sizeof(event));
+            if (event.event_len < FAN_EVENT_METADATA_LEN
+                || watcher->events_pos + event.event_len > watcher->events_len)
+            {
+                watcher->events_pos = watcher->events_len;  // Truncated (see: FAN_EVENT_OK())
+                continue;
+            }
+            results = _handle_event(watcher, watcher->events + watcher->events_pos, filename);
+            watcher->events_pos += event.event_len;
+        }
+        else
+        {
+            watcher->events_pos = 0;
+            watcher->events_len = 0;
+            bytes_read = read(watcher->fd, watcher->events, FAN_WATCHER_EVENTS_SIZE);
+            if (bytes_read > 0)
+            {
+                watcher->events_len = bytes_read;
+            }
+            else if (bytes_read < 0 && EINTR == errno)
+            {
+                continue;
+            }
+            else if (bytes_read < 0 && EAGAIN != errno)
+            {
+                results = get_errno();
+                syslog_errno(results, "Unable to read fanotify events");
+            }
+            else
+            {
+                break;  // Nothing to read right now
+            }
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+int fan_watcher_wait(FanWatcher *watcher, int other_fd, int timeout_ms)
+{
+    // LOCAL VARIABLES
+    int results = -1;                      // 0 on success, -1 on bad input, errno on failure
+    struct pollfd poll_fds[2] = { { 0 } }; // Watcher's fanotify instance and other_fd
+    nfds_t num_fds = 1;                    // Number of entries in poll_fds
+
+    // INPUT VALIDATION
+    if (watcher && watcher->cache)
+    {
+        results = 0;
+    }
+
+    // WAIT
+    if (0 == results && watcher->events_pos < watcher->events_len)
+    {
+        // Already something to do
+    }
+    else if (0 == results)
+    {
+        poll_fds[0].fd = watcher->fd;
+        poll_fds[0].events = POLLIN;
+        if (other_fd > INVALID_FD)
+        {
+            poll_fds[1].fd = other_fd;
+            poll_fds[1].events = POLLIN;
+            num_fds = 2;
+        }
+        if (-1 == poll(poll_fds, num_fds, timeout_ms) && EINTR != errno)
+        {
+            results = get_errno();
+        }
+    }
+
+    // DONE
+    return results;
+}
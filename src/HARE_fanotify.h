@@ -0,0 +1,86 @@
+/*
+ *  Filesystem-wide fanotify watcher for the HARE daemon.
+ *  A single FAN_MARK_FILESYSTEM mark replaces the per-directory watches of HARE_watcher.h, so
+ *      setup time and kernel memory don't grow with the size of the watched tree and new
+ *      subdirectories are covered the moment they exist.  Events identify the parent
+ *      directory by file handle (FAN_REPORT_DFID_NAME).  Handles are resolved to paths with
+ *      open_by_handle_at() and remembered in a fixed-size cache, and only events beneath the
+ *      watched directory are kept.
+ *  Requires root (CAP_SYS_ADMIN and CAP_DAC_READ_SEARCH) and Linux 5.9 or later.
+ *  Files inside a directory that is moved into the watched tree are not reported (they were
+ *      never closed or moved there); the startup backlog drain finds them.
+ */
+
+#ifndef __HARE_FANOTIFY__
+#define __HARE_FANOTIFY__
+
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t
+
+#define FAN_WATCHER_EVENTS_SIZE 65536   // Size of the fanotify read buffer
+#define FAN_WATCHER_CACHE_SLOTS 1024    // Directory handles remembered (a power of two)
+#define FAN_WATCHER_HANDLE_SIZE 128     // Largest file handle (see: MAX_HANDLE_SZ)
+#define FAN_WATCHER_MAX_SKIP 4          // Maximum number of directories fan_watcher_init() can skip
+#define FAN_WATCHER_ENV_VAR "HARE_FANOTIFY"  // 1 watches with fanotify (see: read_settings())
+
+// A directory handle and the path it resolved to
+typedef struct _FanDirEntry
+{
+    uint32_t hash;                                  // Hash of the handle (0 marks an empty slot)
+    int handle_type;                                // struct file_handle's handle_type
+    unsigned int handle_bytes;                      // Bytes of handle in use
+    unsigned char handle[FAN_WATCHER_HANDLE_SIZE];  // struct file_handle's f_handle
+    char *path;                                     // Path ending in '/' (NULL if not watched)
+} FanDirEntry;
+
+// Filesystem-wide fanotify watcher
+typedef struct _FanWatcher
+{
+    int fd;                                      // fanotify instance (non-blocking)
+    int mount_fd;                                // Watched directory, for open_by_handle_at()
+    char *watched;                               // Canonical watched directory ending in '/'
+    size_t watched_len;                          // Length of watched
+    char *skip[FAN_WATCHER_MAX_SKIP];            // Canonical directories ending in '/' to ignore
+    size_t num_skip;                             // Number of entries in skip
+    FanDirEntry *cache;                          // Direct-mapped cache of directory handles
+    char *events;                                // fanotify read buffer
+    size_t events_len;                           // Bytes of events read
+    size_t events_pos;                           // Offset of the next event to handle
+} FanWatcher;
+
+extern FanWatcher *fan_watcher;  // Active fanotify watcher (NULL means it isn't in use)
+
+
+/*
+ *  Remove the mark and free all memory held by watcher
+ */
+void fan_watcher_destroy(FanWatcher *watcher);
+
+
+/*
+ *  Mark root_dir's entire filesystem and report only files beneath root_dir, except those in
+ *      the num_skip directories of skip_dirs (entries may be NULL)
+ *  Returns 0 on success, -1 on bad input, errno on failure (e.g., EINVAL on older kernels)
+ */
+int fan_watcher_init(FanWatcher *watcher, char *root_dir, char *skip_dirs[], size_t num_skip);
+
+
+/*
+ *  Fetch the next file that was closed after writing, or moved, beneath the watched directory
+ *  Arguments
+ *      watcher - Initialized FanWatcher
+ *      filename - [Out] Absolute filename from hare_message_alloc() or NULL if nothing is ready
+ *  Returns 0 on success (even if nothing is ready), -1 on bad input, errno on failure
+ */
+int fan_watcher_next(FanWatcher *watcher, char **filename);
+
+
+/*
+ *  Wait up to timeout_ms milliseconds for watcher, or other_fd (if valid), to become readable
+ *  Returns 0 on success (or timeout), -1 on bad input, errno on failure
+ */
+int fan_watcher_wait(FanWatcher *watcher, int other_fd, int timeout_ms);
+
+
+#endif  // __HARE_FANOTIFY__
@@ -0,0 +1,442 @@
+/*
+ *  Implements HARE_filelog.h functions.
+ */
+
+#include <errno.h>           // errno
+#include <fcntl.h>           // open(), O_* macros
+#include <linux/limits.h>    // PATH_MAX
+#include <pthread.h>         // pthread_*()
+#include <stdatomic.h>       // atomic_*(), _Atomic
+#include <stdbool.h>         // bool
+#include <stdint.h>          // uint64_t
+#include <stdlib.h>          // atexit(), calloc()
+#include <string.h>          // memcpy(), strcmp(), strcpy(), strlen()
+#include <sys/stat.h>        // S_I* macros
+#include <sys/uio.h>         // writev(), struct iovec
+#include <time.h>            // clock_gettime()
+#include "HARE_filelog.h"
+#include "HARE_library.h"    // INVALID_FD, get_errno()
+
+// A file being logged to
+typedef struct _FileLogTarget
+{
+    char path[PATH_MAX];  // Name the file was opened with
+    int fd;               // O_APPEND file descriptor
+} FileLogTarget;
+
+// One thread's buffered lines (never freed: a new thread reuses a released one)
+typedef struct _FileLogBuffer
+{
+    struct _FileLogBuffer *next;    // Next buffer in _buffers
+    atomic_flag busy;               // Held while the buffer is appended to or flushed
+    _Atomic bool claimed;           // Does a thread own it?
+    int target;                     // Index into _targets of the buffered lines (-1 if none)
+    _Atomic size_t length;          // Bytes of data buffered
+    uint64_t oldest_ms;             // When the first buffered line arrived (CLOCK_MONOTONIC)
+    char data[FILELOG_BUFFER_SIZE]; // Buffered lines
+} FileLogBuffer;
+
+static FileLogTarget _targets[FILELOG_MAX_FILES];       // Files opened so far
+static _Atomic int _num_targets = 0;                     // Entries of _targets in use
+static pthread_mutex_t _targets_lock = PTHREAD_MUTEX_INITIALIZER;  // Serializes opening files
+static FileLogBuffer *_Atomic _buffers = NULL;           // Every thread's buffer
+static _Thread_local FileLogBuffer *_mine = NULL;        // This thread's buffer
+static pthread_once_t _once = PTHREAD_ONCE_INIT;         // Guards _setup()
+static pthread_key_t _release_key;                       // Releases _mine when its thread exits
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Forget the parent's buffered lines in a forked child (registered with pthread_atfork())
+ */
+static void _after_fork_child(void)
+{
+    // LOCAL VARIABLES
+    FileLogBuffer *buffer = NULL;  // Iterating variable
+
+    // EMPTY THEM
+    for (buffer = atomic_load(&_buffers); buffer; buffer = buffer->next)
+    {
+        atomic_store(&buffer->length, 0);
+        buffer->target = -1;
+        atomic_flag_clear(&buffer->busy);
+        atomic_store(&buffer->claimed, buffer == _mine);  // The other threads weren't forked
+    }
+    pthread_mutex_unlock(&_targets_lock);
+}
+
+
+/*
+ *  Hold _targets_lock across fork() so the child gets it unlocked (registered with pthread_atfork())
+ */
+static void _before_fork(void)
+{
+    pthread_mutex_lock(&_targets_lock);
+}
+
+
+/*
+ *  Let the parent open files again (registered with pthread_atfork())
+ */
+static void _after_fork_parent(void)
+{
+    pthread_mutex_unlock(&_targets_lock);
+}
+
+
+/*
+ *  Milliseconds on CLOCK_MONOTONIC
+ */
+static uint64_t _now_ms(void)
+{
+    // LOCAL VARIABLES
+    struct timespec now = { 0 };  // Current time
+
+    // DONE
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+/*
+ *  Write all of vectors to fd (async-signal-safe)
+ *  Returns 0 on success, errno on failure
+ */
+static int _write_all(int fd, struct iovec *vectors, int count)
+{
+    // LOCAL VARIABLES
+    int results = 0;      // 0 on success, errno on failure
+    ssize_t written = 0;  // Return value from writev()
+
+    // WRITE IT
+    while (0 == results && count > 0)
+    {
+        written = writev(fd, vectors, count);
+        if (written < 0 && EINTR != errno)
+        {
+            results = get_errno();
+        }
+        while (written > 0 && count > 0)
+        {
+            if ((size_t)written >= vectors->iov_len)
+            {
+                written -= vectors->iov_len;
+                vectors++;
+                count--;
+            }
+            else
+            {
+                vectors->iov_base = (char *)vectors->iov_base + written;
+                vectors->iov_len -= written;
+                written = 0;
+            }
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Write buffer's lines to their file (the caller holds buffer->busy, or is a signal handler)
+ *  Returns 0 on success, errno on failure (the lines are dropped either way)
+ */
+static int _flush_buffer(FileLogBuffer *buffer)
+{
+    // LOCAL VARIABLES
+    int results = 0;                              // 0 on success, errno on failure
+    size_t length = atomic_load(&buffer->length); // Bytes buffered
+    struct iovec vector = { buffer->data, length }; // What to write
+
+    // FLUSH IT
+    if (length > 0 && buffer->target >= 0)
+    {
+        results = _write_all(_targets[buffer->target].fd, &vector, 1);
+    }
+    atomic_store(&buffer->length, 0);
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Flush and release the exiting thread's buffer (a pthread_key_create() destructor)
+ */
+static void _release_buffer(void *value)
+{
+    // LOCAL VARIABLES
+    FileLogBuffer *buffer = value;  // Exiting thread's buffer
+
+    // RELEASE IT
+    while (atomic_flag_test_and_set(&buffer->busy))
+    {
+        // filelog_flush() is writing it
+    }
+    _flush_buffer(buffer);
+    buffer->target = -1;
+    atomic_flag_clear(&buffer->busy);
+    atomic_store(&buffer->claimed, false);
+}
+
+
+/*
+ *  Flush at exit() (registered with atexit())
+ */
+static void _flush_at_exit(void)
+{
+    filelog_flush();
+}
+
+
+/*
+ *  One-time setup (called through pthread_once())
+ */
+static void _setup(void)
+{
+    pthread_key_create(&_release_key, _release_buffer);
+    pthread_atfork(_before_fork, _after_fork_parent, _after_fork_child);
+    atexit(_flush_at_exit);
+}
+
+
+/*
+ *  This thread's buffer (claimed or allocated on first use)
+ *  Returns the buffer, NULL if it can't be allocated
+ */
+static FileLogBuffer *_get_buffer(void)
+{
+    // LOCAL VARIABLES
+    FileLogBuffer *buffer = _mine;     // Return value
+    FileLogBuffer *candidate = NULL;   // Iterating variable
+    bool unclaimed = false;            // Expected value of claimed
+
+    // CLAIM ONE
+    for (candidate = atomic_load(&_buffers); candidate && !buffer; candidate = candidate->next)
+    {
+        unclaimed = false;
+        if (atomic_compare_exchange_strong(&candidate->claimed, &unclaimed, true))
+        {
+            buffer = candidate;  // Released by a thread that exited
+        }
+    }
+
+    // ALLOCATE ONE
+    if (!buffer)
+    {
+        buffer = calloc(1, sizeof(FileLogBuffer));
+        if (buffer)
+        {
+            atomic_flag_clear(&buffer->busy);
+            atomic_store(&buffer->claimed, true);
+            buffer->target = -1;
+            buffer->next = atomic_load(&_buffers);
+            while (!atomic_compare_exchange_weak(&_buffers, &buffer->next, buffer))
+            {
+                // buffer->next now holds the current head
+            }
+        }
+    }
+    if (buffer && !_mine)
+    {
+        _mine = buffer;
+        pthread_setspecific(_release_key, buffer);
+    }
+
+    // DONE
+    return buffer;
+}
+
+
+/*
+ *  Find (or open) filename's entry in _targets
+ *  Returns the index, -1 on failure (with errno set)
+ */
+static int _get_target(const char *filename)
+{
+    // LOCAL VARIABLES
+    int target = -1;                        // Return value
+    int count = atomic_load(&_num_targets); // Entries in use
+    int fd = INVALID_FD;                    // Newly opened file
+    int i = 0;                              // Iterating variable
+
+    // FIND IT
+    for (i = 0; i < count && target < 0; i++)
+    {
+        if (0 == strcmp(_targets[i].path, filename))
+        {
+            target = i;
+        }
+    }
+
+    // OPEN IT
+    if (target < 0)
+    {
+        pthread_mutex_lock(&_targets_lock);
+        count = atomic_load(&_num_targets);
+        for (i = 0; i < count && target < 0; i++)
+        {
+            if (0 == strcmp(_targets[i].path, filename))
+            {
+                target = i;  // Another thread opened it first
+            }
+        }
+        if (target < 0 && count >= FILELOG_MAX_FILES)
+        {
+            errno = EMFILE;
+        }
+        else if (target < 0 && strlen(filename) >= PATH_MAX)
+        {
+            errno = ENAMETOOLONG;
+        }
+        else if (target < 0)
+        {
+            fd = open(filename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+            if (fd > INVALID_FD)
+            {
+                strcpy(_targets[count].path, filename);
+                _targets[count].fd = fd;
+                target = count;
+                atomic_store(&_num_targets, count + 1);  // Publishes the entry
+            }
+        }
+        pthread_mutex_unlock(&_targets_lock);
+    }
+
+    // DONE
+    return target;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+int filelog_flush(void)
+{
+    // LOCAL VARIABLES
+    int results = 0;               // 0 on success, errno on failure
+    int errnum = 0;                // Return value from _flush_buffer()
+    FileLogBuffer *buffer = NULL;  // Iterating variable
+
+    // FLUSH THEM
+    for (buffer = atomic_load(&_buffers); buffer; buffer = buffer->next)
+    {
+        while (atomic_flag_test_and_set(&buffer->busy))
+        {
+            // Its thread is appending a line
+        }
+        errnum = _flush_buffer(buffer);
+        results = results ? results : errnum;
+        atomic_flag_clear(&buffer->busy);
+    }
+
+    // DONE
+    return results;
+}
+
+
+void filelog_flush_from_signal(void)
+{
+    // LOCAL VARIABLES
+    FileLogBuffer *buffer = NULL;  // Iterating variable
+    int errnum = errno;            // Restored for the interrupted code
+
+    // FLUSH THEM
+    // Ignores busy: the interrupted thread may hold it, and length only ever covers whole lines
+    for (buffer = atomic_load(&_buffers); buffer; buffer = buffer->next)
+    {
+        _flush_buffer(buffer);
+    }
+
+    // DONE
+    errno = errnum;
+}
+
+
+int filelog_write(const char *filename, const char *entry)
+{
+    // LOCAL VARIABLES
+    int results = -1;                // 0 on success, -1 on bad input, errno on failure
+    FileLogBuffer *buffer = NULL;    // This thread's buffer
+    int target = -1;                 // filename's index in _targets
+    size_t entry_len = 0;            // Length of entry
+    size_t length = 0;               // Bytes buffered
+    uint64_t now_ms = 0;             // Current time
+    struct iovec vectors[2];         // An entry too big to buffer, and its newline
+
+    // INPUT VALIDATION
+    if (filename && *filename && entry)
+    {
+        results = 0;
+        entry_len = strlen(entry);
+        pthread_once(&_once, _setup);
+    }
+
+    // FIND THE FILE AND BUFFER
+    if (0 == results)
+    {
+        buffer = _get_buffer();
+        target = _get_target(filename);
+        if (!buffer)
+        {
+            results = ENOMEM;
+        }
+        else if (target < 0)
+        {
+            results = get_errno();
+        }
+    }
+
+    // BUFFER IT
+    if (0 == results)
+    {
+        while (atomic_flag_test_and_set(&buffer->busy))
+        {
+            // filelog_flush() is writing it
+        }
+        now_ms = _now_ms();
+        length = atomic_load(&buffer->length);
+        // Flush first if the buffered lines are for another file or there's no room
+        if (length > 0 && (target != buffer->target || length + entry_len + 1 > FILELOG_BUFFER_SIZE))
+        {
+            results = _flush_buffer(buffer);
+            length = 0;
+        }
+        buffer->target = target;
+        if (entry_len + 1 > FILELOG_BUFFER_SIZE)
+        {
+            // Too big to buffer: write it now
+            vectors[0].iov_base = (void *)entry;
+            vectors[0].iov_len = entry_len;
+            vectors[1].iov_base = "\n";
+            vectors[1].iov_len = 1;
+            results = results ? results : _write_all(_targets[target].fd, vectors, 2);
+        }
+        else
+        {
+            if (0 == length)
+            {
+                buffer->oldest_ms = now_ms;
+            }
+            memcpy(buffer->data + length, entry, entry_len);
+            buffer->data[length + entry_len] = '\n';
+            atomic_store(&buffer->length, length + entry_len + 1);  // Only whole lines are ever visible
+            if (now_ms - buffer->oldest_ms >= FILELOG_FLUSH_MS)
+            {
+                results = results ? results : _flush_buffer(buffer);
+            }
+        }
+        atomic_flag_clear(&buffer->busy);
+    }
+
+    // DONE
+    return results;
+}
@@ -0,0 +1,43 @@
+/*
+ *  Buffered file logging for log_it() and the harnesses' log_external().
+ *  Each target file is opened once (O_APPEND) and stays open.  Lines are buffered per thread and
+ *      written in groups: one write() per FILELOG_BUFFER_SIZE bytes, or sooner once the oldest
+ *      buffered line is FILELOG_FLUSH_MS old (checked on the next line).  O_APPEND keeps each
+ *      group whole when several threads or processes share a file.
+ *  A quiet process never writes that next line, so the daemon calls filelog_flush() whenever
+ *      it runs out of messages (see: execute_order(), worker_next()).
+ *  Buffered lines are flushed at exit(), by filelog_flush(), and on fatal signals (by the flight
+ *      recorder's handler, see: HARE_recorder.h).  Call filelog_flush() before _exit().  A forked
+ *      child starts with empty buffers: its parent's buffered lines stay with the parent.
+ */
+
+#ifndef __HARE_FILELOG__
+#define __HARE_FILELOG__
+
+#define FILELOG_BUFFER_SIZE 8192  // Bytes buffered per thread before a write()
+#define FILELOG_FLUSH_MS 100      // Oldest a buffered line gets before the next line flushes it
+#define FILELOG_MAX_FILES 8       // Most files one process logs to
+
+
+/*
+ *  Write every thread's buffered lines (taking turns with threads still logging)
+ *  Returns 0 on success, errno on failure (the first write() error)
+ */
+int filelog_flush(void);
+
+
+/*
+ *  Write every thread's buffered lines without locking anything.  Async-signal-safe, for fatal
+ *      signal handlers: the process mustn't log afterwards.
+ */
+void filelog_flush_from_signal(void);
+
+
+/*
+ *  Append entry and a newline to filename (opened on first use)
+ *  Returns 0 on success, -1 on bad input, errno on failure (EMFILE after FILELOG_MAX_FILES files)
+ */
+int filelog_write(const char *filename, const char *entry);
+
+
+#endif  // __HARE_FILELOG__
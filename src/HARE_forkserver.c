@@ -0,0 +1,507 @@
+/*
+ *  Implements HARE_forkserver.h functions.
+ */
+
+#define _GNU_SOURCE          // pipe2()
+#include <errno.h>           // errno
+#include <fcntl.h>           // fcntl(), O_CLOEXEC
+#include <linux/limits.h>    // PATH_MAX
+#include <poll.h>            // poll()
+#include <signal.h>          // kill(), raise(), signal(), SIGKILL, SIGPIPE, SIGTERM
+#include <stdbool.h>         // bool
+#include <stdlib.h>          // exit(), _exit()
+#include <string.h>          // memcpy(), strlen()
+#include <sys/wait.h>        // waitpid()
+#include <unistd.h>          // close(), dup2(), execv(), fork(), getpid(), read(), write()
+#include "HARE_forkserver.h"
+#include "HARE_library.h"    // INVALID_FD, wait_daemon(), get_errno()
+
+static char _filename[PATH_MAX + 1];  // A child's input filename (see: forkserver_serve())
+static volatile pid_t _tracked;       // A child's SIGTERM kills this instead (see: forkserver_track())
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Make fd available as target in exec()ed programs
+ *  Returns 0 on success, errno on failure
+ */
+static int _inherit(int fd, int target)
+{
+    // LOCAL VARIABLES
+    int results = 0;  // 0 on success, errno on failure
+
+    // DO IT
+    // dup2() onto itself would leave O_CLOEXEC set
+    if ((fd == target && fcntl(fd, F_SETFD, 0)) || (fd != target && dup2(fd, target) < 0))
+    {
+        results = get_errno();
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  A child's SIGTERM handler: kill the tracked daemon (and its workers) so the child's own
+ *      wait for it returns, or die as usual if there isn't one
+ */
+static void _terminate(int signum)
+{
+    // LOCAL VARIABLES
+    pid_t tracked = _tracked;  // Copy it once
+
+    // DO IT
+    if (tracked > 0)
+    {
+        // It isn't reaped yet (see: forkserver_track()) so neither ID can have been reused
+        kill(-tracked, SIGKILL);
+        kill(tracked, SIGKILL);
+    }
+    else
+    {
+        signal(signum, SIG_DFL);
+        raise(signum);
+    }
+}
+
+
+/*
+ *  Read exactly size bytes from fd, waiting up to timeout_ms (negative waits forever) for each read
+ *  Returns 0 on success, errno on failure (ETIMEDOUT if it timed out, EPIPE if the writer hung up)
+ */
+static int _read_all(int fd, void *buffer, size_t size, int timeout_ms)
+{
+    // LOCAL VARIABLES
+    int results = 0;                     // 0 on success, errno on failure
+    struct pollfd poll_fd = { fd, POLLIN, 0 };  // Wait on fd
+    ssize_t count = 0;                   // Return value from poll() and read()
+    size_t done = 0;                     // Bytes read so far
+
+    // READ IT
+    while (0 == results && done < size)
+    {
+        count = timeout_ms < 0 ? 1 : poll(&poll_fd, 1, timeout_ms);
+        if (0 == count)
+        {
+            results = ETIMEDOUT;
+        }
+        else if (count > 0)
+        {
+            count = read(fd, (char *)buffer + done, size - done);
+        }
+        if (0 == results && 0 == count)
+        {
+            results = EPIPE;
+        }
+        else if (0 == results && count < 0 && EINTR != errno)
+        {
+            results = get_errno();
+        }
+        else if (0 == results && count > 0)
+        {
+            done += count;
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Write exactly size bytes to fd
+ *  Returns 0 on success, errno on failure
+ */
+static int _write_all(int fd, const void *buffer, size_t size)
+{
+    // LOCAL VARIABLES
+    int results = 0;    // 0 on success, errno on failure
+    ssize_t count = 0;  // Return value from write()
+    size_t done = 0;    // Bytes written so far
+
+    // WRITE IT
+    while (0 == results && done < size)
+    {
+        count = write(fd, (const char *)buffer + done, size - done);
+        if (count > 0)
+        {
+            done += count;
+        }
+        else if (count < 0 && EINTR != errno)
+        {
+            results = get_errno();
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Send the driver a ForkReply
+ *  Returns 0 on success, errno on failure
+ */
+static int _reply(uint32_t type, pid_t pid, int status)
+{
+    // LOCAL VARIABLES
+    ForkReply reply = { FORKSERVER_MAGIC, type, pid, status };  // Reply to send
+
+    // DONE
+    return _write_all(FORKSERVER_STATUS_FD, &reply, sizeof(reply));
+}
+
+
+/*
+ *  Fork a child that waits for its input filename on a pipe.  The server writes the filename's
+ *      length (a uint32_t) and the filename to *handoff_fd, then closes it.  A child that gets
+ *      nothing (the server is shutting down) exits.
+ *  Returns the child's pid in the server, 0 in the child once _filename holds its input, or -1
+ *      on failure
+ */
+static pid_t _prefork(int *handoff_fd, void (*old_handler)(int))
+{
+    // LOCAL VARIABLES
+    pid_t child = -1;                     // Return value
+    int handoff[2] = { INVALID_FD, INVALID_FD };  // Server -> child pipe
+    uint32_t length = 0;                  // Length of the child's input filename
+
+    // FORK IT
+    if (0 == pipe2(handoff, O_CLOEXEC))
+    {
+        child = fork();
+        if (0 == child)
+        {
+            // Leave the server's descriptors (and SIGPIPE) the way the harness had them
+            close(handoff[PIPE_WRITE]);
+            close(FORKSERVER_CONTROL_FD);
+            close(FORKSERVER_STATUS_FD);
+            signal(SIGPIPE, old_handler);
+            if (_read_all(handoff[PIPE_READ], &length, sizeof(length), -1) || length > PATH_MAX
+                || _read_all(handoff[PIPE_READ], _filename, length, -1))
+            {
+                _exit(EXIT_SUCCESS);
+            }
+            _filename[length] = '\0';
+            close(handoff[PIPE_READ]);
+            signal(SIGTERM, _terminate);  // Its daemon's forks inherit this but never track anything
+        }
+        else
+        {
+            close(handoff[PIPE_READ]);
+            if (child > 0)
+            {
+                *handoff_fd = handoff[PIPE_WRITE];
+            }
+            else
+            {
+                close(handoff[PIPE_WRITE]);
+            }
+        }
+    }
+
+    // DONE
+    return child;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+int forkserver_run(ForkServer *server, const char *filename, int timeout_ms, int *status)
+{
+    // LOCAL VARIABLES
+    int results = -1;             // 0 on success, -1 on bad input, errno on failure
+    char request[sizeof(ForkRequest) + PATH_MAX] = { 0 };  // ForkRequest and filename
+    ForkRequest header = { FORKSERVER_MAGIC, 0 };          // Start of request
+    ForkReply started = { 0 };    // FORKSERVER_STARTED reply
+    ForkReply exited = { 0 };     // FORKSERVER_EXITED reply
+
+    // INPUT VALIDATION
+    if (server && INVALID_FD != server->control_fd && filename && *filename && status)
+    {
+        header.length = strlen(filename);
+        results = header.length > PATH_MAX ? -1 : 0;
+    }
+
+    // SEND IT
+    if (0 == results)
+    {
+        memcpy(request, &header, sizeof(header));
+        memcpy(request + sizeof(header), filename, header.length);
+        results = _write_all(server->control_fd, request, sizeof(header) + header.length);
+    }
+    if (0 == results)
+    {
+        results = _read_all(server->status_fd, &started, sizeof(started), FORKSERVER_START_MS);
+        if (0 == results && (FORKSERVER_MAGIC != started.magic || FORKSERVER_STARTED != started.type))
+        {
+            results = EPROTO;
+        }
+    }
+
+    // WAIT FOR IT
+    if (0 == results)
+    {
+        results = _read_all(server->status_fd, &exited, sizeof(exited), timeout_ms);
+        if (ETIMEDOUT == results)
+        {
+            // The server hasn't reaped it yet, so its pid can't have been reused
+            kill(started.pid, SIGTERM);  // Let it reap its daemon (see: forkserver_track())
+            results = _read_all(server->status_fd, &exited, sizeof(exited), FORKSERVER_GRACE_MS);
+            if (ETIMEDOUT == results)
+            {
+                kill(started.pid, SIGKILL);
+                results = _read_all(server->status_fd, &exited, sizeof(exited), -1);
+            }
+            results = results ? EPIPE : ETIMEDOUT;
+        }
+        if ((0 == results || ETIMEDOUT == results)
+            && (FORKSERVER_MAGIC != exited.magic || FORKSERVER_EXITED != exited.type || started.pid != exited.pid))
+        {
+            results = EPROTO;
+        }
+        else if (0 == results || ETIMEDOUT == results)
+        {
+            *status = exited.status;
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+int forkserver_serve(char **filename)
+{
+    // LOCAL VARIABLES
+    int results = -1;                  // 0 on success, -1 on bad input, errno on failure
+    bool serving = false;              // Is this the server?
+    void (*old_handler)(int) = SIG_DFL;  // The harness' SIGPIPE handler (restored in children)
+    ForkRequest request = { 0 };       // Request from the driver
+    char handoff[sizeof(uint32_t) + PATH_MAX];  // Length and filename for the pre-forked child
+    int handoff_fd = INVALID_FD;       // Pipe to the pre-forked child
+    pid_t pending = 0;                 // Pre-forked child
+    pid_t running = 0;                 // Child running the current input
+    int status = 0;                    // running's wait status
+
+    // INPUT VALIDATION
+    if (filename)
+    {
+        results = 0;
+        // No driver, no server: run the one input on the command line as usual
+        serving = fcntl(FORKSERVER_CONTROL_FD, F_GETFD) >= 0 && fcntl(FORKSERVER_STATUS_FD, F_GETFD) >= 0;
+    }
+
+    // START SERVING
+    if (true == serving)
+    {
+        old_handler = signal(SIGPIPE, SIG_IGN);  // A driver that hangs up shuts the server down
+        results = _reply(FORKSERVER_READY, getpid(), 0);
+        serving = (0 == results);
+    }
+
+    // SERVE
+    while (true == serving)
+    {
+        // 1. Fork the next input's child while the current input runs
+        pending = _prefork(&handoff_fd, old_handler);
+        if (0 == pending)
+        {
+            *filename = _filename;
+            break;  // This is the child: go test _filename
+        }
+        else if (pending < 0)
+        {
+            results = get_errno();
+        }
+        // 2. Report on the current input
+        if (running > 0)
+        {
+            while (running != waitpid(running, &status, 0) && EINTR == errno);
+            if (0 == results)
+            {
+                results = _reply(FORKSERVER_EXITED, running, status);
+            }
+            running = 0;
+        }
+        // 3. Wait for the next input (the driver hanging up is a shut down request too)
+        if (0 == results && _read_all(FORKSERVER_CONTROL_FD, &request, sizeof(request), -1))
+        {
+            request.length = 0;
+        }
+        if (0 == results && request.length > 0)
+        {
+            if (FORKSERVER_MAGIC != request.magic || request.length > PATH_MAX)
+            {
+                results = EPROTO;
+            }
+            else
+            {
+                memcpy(handoff, &request.length, sizeof(request.length));
+                results = _read_all(FORKSERVER_CONTROL_FD, handoff + sizeof(uint32_t), request.length, -1);
+            }
+        }
+        // 4. Hand it to the pre-forked child
+        if (0 == results && request.length > 0)
+        {
+            results = _write_all(handoff_fd, handoff, sizeof(uint32_t) + request.length);
+            close(handoff_fd);
+            handoff_fd = INVALID_FD;
+            running = pending;
+            pending = 0;
+            if (0 == results)
+            {
+                results = _reply(FORKSERVER_STARTED, running, 0);
+            }
+        }
+        // SHUT DOWN
+        // The pre-forked child exits when its pipe closes without a filename
+        if (results || 0 == request.length)
+        {
+            if (INVALID_FD != handoff_fd)
+            {
+                close(handoff_fd);
+            }
+            if (pending > 0)
+            {
+                while (pending != waitpid(pending, NULL, 0) && EINTR == errno);
+            }
+            if (running > 0)
+            {
+                while (running != waitpid(running, NULL, 0) && EINTR == errno);
+            }
+            exit(results ? EXIT_FAILURE : EXIT_SUCCESS);
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+void forkserver_track(pid_t pid)
+{
+    _tracked = pid > 0 ? pid : 0;
+}
+
+
+int forkserver_start(ForkServer *server, char *const argv[])
+{
+    // LOCAL VARIABLES
+    int results = -1;                              // 0 on success, -1 on bad input, errno on failure
+    int control[2] = { INVALID_FD, INVALID_FD };   // Driver -> server pipe
+    int status[2] = { INVALID_FD, INVALID_FD };    // Server -> driver pipe
+    ForkReply ready = { 0 };                       // FORKSERVER_READY reply
+    int i = 0;                                     // Iterating variable
+
+    // INPUT VALIDATION
+    if (server && argv && argv[0] && *argv[0])
+    {
+        server->pid = 0;
+        server->control_fd = INVALID_FD;
+        server->status_fd = INVALID_FD;
+        results = 0;
+    }
+
+    // START IT
+    if (0 == results && (pipe2(control, O_CLOEXEC) || pipe2(status, O_CLOEXEC)))
+    {
+        results = get_errno();
+    }
+    if (0 == results)
+    {
+        server->pid = fork();
+        if (0 == server->pid)
+        {
+            if (0 == _inherit(control[PIPE_READ], FORKSERVER_CONTROL_FD)
+                && 0 == _inherit(status[PIPE_WRITE], FORKSERVER_STATUS_FD))
+            {
+                execv(argv[0], argv);
+            }
+            _exit(127);  // What the shell returns for a command it couldn't run
+        }
+        else if (server->pid < 0)
+        {
+            results = get_errno();
+            server->pid = 0;
+        }
+        else
+        {
+            server->control_fd = control[PIPE_WRITE];
+            server->status_fd = status[PIPE_READ];
+            control[PIPE_WRITE] = INVALID_FD;
+            status[PIPE_READ] = INVALID_FD;
+        }
+    }
+
+    // WAIT FOR IT
+    if (0 == results)
+    {
+        results = _read_all(server->status_fd, &ready, sizeof(ready), FORKSERVER_START_MS);
+        if (EPIPE == results || ETIMEDOUT == results)
+        {
+            results = ENOTSUP;
+        }
+        else if (0 == results && (FORKSERVER_MAGIC != ready.magic || FORKSERVER_READY != ready.type))
+        {
+            results = EPROTO;
+        }
+        if (results)
+        {
+            forkserver_stop(server);
+        }
+    }
+
+    // CLEANUP
+    for (i = 0; i < 2; i++)
+    {
+        if (INVALID_FD != control[i])
+        {
+            close(control[i]);
+        }
+        if (INVALID_FD != status[i])
+        {
+            close(status[i]);
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+void forkserver_stop(ForkServer *server)
+{
+    // LOCAL VARIABLES
+    ForkRequest request = { FORKSERVER_MAGIC, 0 };  // Shut down request
+    int exit_code = 0;                              // The server's exit code (unused)
+
+    // STOP IT
+    if (server)
+    {
+        if (INVALID_FD != server->control_fd)
+        {
+            _write_all(server->control_fd, &request, sizeof(request));
+            close(server->control_fd);
+            server->control_fd = INVALID_FD;
+        }
+        if (INVALID_FD != server->status_fd)
+        {
+            close(server->status_fd);
+            server->status_fd = INVALID_FD;
+        }
+        if (server->pid > 0)
+        {
+            wait_daemon(server->pid, &exit_code, FORKSERVER_START_MS);
+            server->pid = 0;
+        }
+    }
+}
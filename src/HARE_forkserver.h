@@ -0,0 +1,108 @@
+/*
+ *  Fork server for harness drivers other than AFL (e.g., hare_driver.bin feeding Radamsa output).
+ *  The driver starts a harness once (forkserver_start()) with two pipes on inherited file
+ *      descriptors.  The harness calls forkserver_serve() when its one-time setup is done and
+ *      becomes a server: every input the driver sends (forkserver_run()) goes to a child forked
+ *      from that initialized state, so each input skips exec(), dynamic linking, libc startup,
+ *      and the harness' own setup.
+ *  The server always keeps one child pre-forked and blocked on a pipe, so the next input's
+ *      fork() overlaps the current input instead of delaying the next one.
+ *  Protocol (host byte order, fixed-size structs):
+ *      Driver -> FORKSERVER_CONTROL_FD: a ForkRequest, then request.length bytes of input
+ *          filename (no nul terminator).  A length of 0 shuts the server down.
+ *      Server -> FORKSERVER_STATUS_FD: FORKSERVER_READY once, then FORKSERVER_STARTED (the
+ *          child's pid) and FORKSERVER_EXITED (its wait status) for each request.
+ *  The descriptors aren't AFL's (198 and 199), so the same binary works under afl-fuzz.
+ */
+
+#ifndef __HARE_FORKSERVER__
+#define __HARE_FORKSERVER__
+
+#include <stdint.h>     // int32_t, uint32_t
+#include <sys/types.h>  // pid_t
+
+#define FORKSERVER_CONTROL_FD 210     // Server reads ForkRequests here
+#define FORKSERVER_STATUS_FD 211      // Server writes ForkReplys here
+#define FORKSERVER_MAGIC 0x48415245u  // "HARE": starts every ForkRequest and ForkReply
+#define FORKSERVER_START_MS 10000     // Longest forkserver_start() waits for FORKSERVER_READY
+#define FORKSERVER_GRACE_MS 1000      // How long a timed out child gets to clean up after SIGTERM
+
+// ForkReply types
+#define FORKSERVER_READY 1    // pid is the server
+#define FORKSERVER_STARTED 2  // pid is the child running the input
+#define FORKSERVER_EXITED 3   // status is the child's wait status (see: waitpid())
+
+// Driver -> server
+typedef struct _ForkRequest
+{
+    uint32_t magic;   // FORKSERVER_MAGIC
+    uint32_t length;  // Length of the filename that follows (0 to shut down)
+} ForkRequest;
+
+// Server -> driver
+typedef struct _ForkReply
+{
+    uint32_t magic;   // FORKSERVER_MAGIC
+    uint32_t type;    // FORKSERVER_READY, FORKSERVER_STARTED, or FORKSERVER_EXITED
+    int32_t pid;      // Server (READY) or child (STARTED, EXITED)
+    int32_t status;   // Child's wait status (EXITED)
+} ForkReply;
+
+// The driver's handle on a harness that's serving
+typedef struct _ForkServer
+{
+    pid_t pid;        // Harness (server) process
+    int control_fd;   // Write ForkRequests here
+    int status_fd;    // Read ForkReplys here
+} ForkServer;
+
+
+/*
+ *  Run filename through the server: send the request, wait for the child, and store its wait
+ *      status in status.  If the child runs longer than timeout_ms (negative waits forever)
+ *      it gets SIGTERM (see: forkserver_track()), then SIGKILL if it's still running
+ *      FORKSERVER_GRACE_MS later.  Ignore SIGPIPE before calling this (a dead server would
+ *      otherwise kill the driver).
+ *  Returns 0 on success, -1 on bad input, errno on failure (ETIMEDOUT if the child was killed,
+ *      which still fills in status; EPIPE or EPROTO if the server died)
+ */
+int forkserver_run(ForkServer *server, const char *filename, int timeout_ms, int *status);
+
+
+/*
+ *  Serve inputs if a driver started this process (FORKSERVER_CONTROL_FD and FORKSERVER_STATUS_FD
+ *      are open), otherwise return immediately.  The server never returns: it exits when the
+ *      driver shuts it down or hangs up.  Each child returns from here with *filename pointing
+ *      at its input's filename (which stays valid for the life of the child) and carries on
+ *      exactly as if it had been exec()ed with it.
+ *  Returns 0 in a child or if there's no driver, -1 on bad input, errno on failure
+ */
+int forkserver_serve(char **filename);
+
+
+/*
+ *  Have a child's SIGTERM from the driver (see: forkserver_run()) SIGKILL pid's process group
+ *      instead of the child, so the child can reap pid and clean up after it as usual.  Meant
+ *      for a daemon that left the child's process group (see: daemonize()), which would
+ *      otherwise outlive a timed out child.  Track 0 once pid is reaped: SIGTERM kills the
+ *      child again.  Does nothing outside of a fork server's child.
+ */
+void forkserver_track(pid_t pid);
+
+
+/*
+ *  Start argv[0] (with arguments argv, NULL-terminated) as a fork server and wait for it to say
+ *      it's ready.
+ *  Returns 0 on success, -1 on bad input, errno on failure (ENOTSUP if it exited or didn't
+ *      answer within FORKSERVER_START_MS: it doesn't call forkserver_serve())
+ */
+int forkserver_start(ForkServer *server, char *const argv[]);
+
+
+/*
+ *  Shut the server down and reap it (its pending children exit with it)
+ */
+void forkserver_stop(ForkServer *server);
+
+
+#endif  // __HARE_FORKSERVER__
@@ -0,0 +1,1289 @@
+/*
+ *  Implements HARE_io.h functions.
+ */
+
+#define _GNU_SOURCE          // nftw(), struct FTW
+#include <errno.h>           // errno
+#include <fcntl.h>           // open(), O_* macros
+#include <ftw.h>             // nftw(), FTW macros
+#include <linux/limits.h>    // PATH_MAX
+#include <sched.h>           // sched_yield()
+#include <stdatomic.h>       // atomic_*()
+#include <stdbool.h>         // bool
+#include <stdint.h>          // uint*_t
+#include <stdio.h>           // remove(), rename()
+#include <stdlib.h>          // calloc(), free(), getenv(), qsort()
+#include <string.h>          // memcpy(), memset(), strcmp(), strlen(), strncmp()
+#include <sys/mman.h>        // mmap(), munmap()
+#include <time.h>            // clock_gettime()
+#include <unistd.h>          // close(), fsync(), getegid(), geteuid(), read(), write()
+#include "HARE_io.h"
+#include "HARE_library.h"    // syslog_errno(), get_errno()
+
+#define MEM_SLOTS (IO_MEMORY_NODES * 2)  // Hash table slots (a power of two, half full at most)
+#define MEM_EMPTY 0                      // Never-used hash table slot
+#define MEM_TOMBSTONE UINT32_MAX         // Hash table slot whose node was removed
+#define MEM_NONE UINT32_MAX              // No node
+#define MEM_DEV 0x4d454d                 // st_dev of every in-memory file ("MEM")
+
+// A file or directory in the in-memory filesystem
+typedef struct _MemNode
+{
+    uint64_t ino;            // Inode number (0 if the node is unused)
+    mode_t mode;             // File type and permissions
+    uid_t uid;               // Owner
+    gid_t gid;               // Group
+    struct timespec mtime;   // Last modification
+    uint64_t data_off;       // Offset of the contents in the data area
+    uint64_t data_len;       // Length of the contents
+    uint64_t data_cap;       // Bytes reserved for the contents
+    uint32_t next_free;      // Next node on the free list
+    char path[PATH_MAX];     // Normalized path (see: _mem_normalize())
+} MemNode;
+
+// The in-memory filesystem, shared by every process forked after it was created
+typedef struct _MemFS
+{
+    _Atomic int lock;            // Spinlock guarding everything below
+    uint64_t next_ino;           // Next inode number
+    uint64_t data_used;          // Bytes of the data area handed out
+    uint32_t free_head;          // First node on the free list
+    uint32_t next_new;           // First node that was never used
+    uint32_t num_tombstones;     // Tombstones in slots
+    uint32_t slots[MEM_SLOTS];   // Open addressing: node index + 1, MEM_EMPTY, or MEM_TOMBSTONE
+    MemNode nodes[IO_MEMORY_NODES];  // Files and directories
+    char data[];                 // File contents (IO_MEMORY_DATA_SIZE bytes)
+} MemFS;
+
+// An open in-memory file (private to each process, like a file descriptor)
+typedef struct _MemFile
+{
+    bool used;        // Is this entry open?
+    uint32_t node;    // Node it refers to
+    uint64_t ino;     // Inode number when it was opened (detects removed files)
+    uint64_t offset;  // File offset
+    int flags;        // Flags it was opened with
+} MemFile;
+
+// One entry of an in-memory nftw()
+typedef struct _MemWalkEntry
+{
+    char *path;        // Path reported to the callback (heap-allocated)
+    size_t rel;        // Offset of the part below dirpath (sort key)
+    struct stat st;    // Reported stat
+    int tflag;         // Reported type flag
+    struct FTW ftw;    // Reported base and level
+} MemWalkEntry;
+
+static int _posix_open(const char *pathname, int flags, mode_t mode);
+static int _mem_stat(const char *pathname, struct stat *statbuf);
+static int _mem_open(const char *pathname, int flags, mode_t mode);
+static ssize_t _mem_read(int fd, void *buf, size_t count);
+static ssize_t _mem_write(int fd, const void *buf, size_t count);
+static int _mem_fsync(int fd);
+static int _mem_close(int fd);
+static int _mem_rename(const char *oldpath, const char *newpath);
+static int _mem_remove(const char *pathname);
+static int _mem_mkdir(const char *pathname, mode_t mode);
+static int _mem_nftw(const char *dirpath, IoWalker fn, int nopenfd, int flags);
+
+const HareIO hare_io_posix = { "posix", stat, _posix_open, read, write, fsync, close, rename, remove,
+                               mkdir, nftw };
+const HareIO hare_io_memory = { "memory", _mem_stat, _mem_open, _mem_read, _mem_write, _mem_fsync,
+                                _mem_close, _mem_rename, _mem_remove, _mem_mkdir, _mem_nftw };
+const HareIO *hare_io = &hare_io_posix;  // Even with HARE_IO_MEMORY: io_select() creates the filesystem
+
+static MemFS *_memfs = NULL;                  // The in-memory filesystem
+static size_t _memfs_size = 0;                // Size of the _memfs mapping
+static MemFile _mem_files[IO_MEMORY_FILES];   // Open in-memory files
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  open() isn't variadic here
+ */
+static int _posix_open(const char *pathname, int flags, mode_t mode)
+{
+    return open(pathname, flags, mode);
+}
+
+
+/*
+ *  Lock and unlock the in-memory filesystem.  Critical sections never block, so spin.
+ */
+static void _mem_lock(void)
+{
+    while (atomic_exchange_explicit(&_memfs->lock, 1, memory_order_acquire))
+    {
+        sched_yield();
+    }
+}
+
+
+static void _mem_unlock(void)
+{
+    atomic_store_explicit(&_memfs->lock, 0, memory_order_release);
+}
+
+
+/*
+ *  FNV-1a hash of path
+ */
+static uint32_t _mem_hash(const char *path)
+{
+    uint32_t hash = 2166136261u;  // Return value
+
+    while (*path)
+    {
+        hash = (hash ^ (unsigned char)*path++) * 16777619u;
+    }
+    return hash;
+}
+
+
+/*
+ *  Normalize path into norm (PATH_MAX bytes): collapse repeated '/' characters and drop "."
+ *      components and trailing '/' characters.  Relative paths stay relative ("." is the current
+ *      directory).  ".." is not resolved.
+ *  Returns 0 on success, errno on failure
+ */
+static int _mem_normalize(const char *path, char *norm)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;           // 0 on success, errno on failure
+    size_t len = 0;           // Length of norm
+    const char *end = NULL;   // End of the current component
+    size_t comp_len = 0;      // Length of the current component
+
+    // INPUT VALIDATION
+    if (!path)
+    {
+        errnum = EFAULT;
+    }
+    else if (!(*path))
+    {
+        errnum = ENOENT;
+    }
+    else if ('/' == *path)
+    {
+        norm[len++] = '/';
+    }
+
+    // NORMALIZE IT
+    while (0 == errnum && *path)
+    {
+        while ('/' == *path)
+        {
+            path++;
+        }
+        for (end = path; *end && '/' != *end; end++);
+        comp_len = end - path;
+        if (comp_len > 0 && !(1 == comp_len && '.' == *path))
+        {
+            if (len + comp_len + 2 > PATH_MAX)
+            {
+                errnum = ENAMETOOLONG;
+            }
+            else
+            {
+                if (len > 0 && '/' != norm[len - 1])
+                {
+                    norm[len++] = '/';
+                }
+                memcpy(norm + len, path, comp_len);
+                len += comp_len;
+            }
+        }
+        path = end;
+    }
+    if (0 == errnum)
+    {
+        if (0 == len)
+        {
+            norm[len++] = '.';
+        }
+        norm[len] = '\0';
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Is path inside the directory dir (both normalized)?
+ */
+static bool _mem_is_child(const char *path, const char *dir)
+{
+    // LOCAL VARIABLES
+    bool is_child = false;        // Return value
+    size_t dir_len = strlen(dir);  // Length of dir
+
+    if (0 == strcmp(dir, "."))
+    {
+        is_child = ('/' != *path && 0 != strcmp(path, "."));
+    }
+    else if (0 == strcmp(dir, "/"))
+    {
+        is_child = ('/' == path[0] && path[1]);
+    }
+    else
+    {
+        is_child = (0 == strncmp(path, dir, dir_len) && '/' == path[dir_len]);
+    }
+    return is_child;
+}
+
+
+/*
+ *  Find the node for a normalized path
+ *  Returns its index, MEM_NONE if it doesn't exist
+ */
+static uint32_t _mem_find(const char *norm)
+{
+    // LOCAL VARIABLES
+    uint32_t found = MEM_NONE;                             // Return value
+    uint32_t slot = _mem_hash(norm) & (MEM_SLOTS - 1);     // Current slot
+    uint32_t value = 0;                                    // Contents of the slot
+    uint32_t probes = 0;                                   // Slots checked
+
+    // FIND IT
+    for (value = _memfs->slots[slot]; MEM_EMPTY != value && probes < MEM_SLOTS && MEM_NONE == found;
+         value = _memfs->slots[slot])
+    {
+        if (MEM_TOMBSTONE != value && 0 == strcmp(_memfs->nodes[value - 1].path, norm))
+        {
+            found = value - 1;
+        }
+        slot = (slot + 1) & (MEM_SLOTS - 1);
+        probes++;
+    }
+
+    // DONE
+    return found;
+}
+
+
+/*
+ *  Add node index to the hash table (the table is never more than half full)
+ */
+static void _mem_link(uint32_t index)
+{
+    uint32_t slot = _mem_hash(_memfs->nodes[index].path) & (MEM_SLOTS - 1);  // Current slot
+
+    while (MEM_EMPTY != _memfs->slots[slot] && MEM_TOMBSTONE != _memfs->slots[slot])
+    {
+        slot = (slot + 1) & (MEM_SLOTS - 1);
+    }
+    if (MEM_TOMBSTONE == _memfs->slots[slot])
+    {
+        _memfs->num_tombstones--;
+    }
+    _memfs->slots[slot] = index + 1;
+}
+
+
+/*
+ *  Rebuild the hash table (clears the tombstones)
+ */
+static void _mem_rehash(void)
+{
+    uint32_t i = 0;  // Iterating variable
+
+    memset(_memfs->slots, 0, sizeof(_memfs->slots));
+    _memfs->num_tombstones = 0;
+    for (i = 0; i < _memfs->next_new; i++)
+    {
+        if (_memfs->nodes[i].ino)
+        {
+            _mem_link(i);
+        }
+    }
+}
+
+
+/*
+ *  Remove node index from the hash table
+ */
+static void _mem_unlink(uint32_t index)
+{
+    uint32_t slot = _mem_hash(_memfs->nodes[index].path) & (MEM_SLOTS - 1);  // Current slot
+
+    while (MEM_EMPTY != _memfs->slots[slot] && index + 1 != _memfs->slots[slot])
+    {
+        slot = (slot + 1) & (MEM_SLOTS - 1);
+    }
+    if (index + 1 == _memfs->slots[slot])
+    {
+        _memfs->slots[slot] = MEM_TOMBSTONE;
+        if (++_memfs->num_tombstones > MEM_SLOTS / 4)
+        {
+            _mem_rehash();
+        }
+    }
+}
+
+
+/*
+ *  Create a node for a normalized path
+ *  Returns its index, MEM_NONE if the filesystem is full
+ */
+static uint32_t _mem_new(const char *norm, mode_t mode)
+{
+    // LOCAL VARIABLES
+    uint32_t index = _memfs->free_head;  // Return value
+    MemNode *node = NULL;                // The new node
+
+    // ALLOCATE IT
+    if (MEM_NONE != index)
+    {
+        _memfs->free_head = _memfs->nodes[index].next_free;
+    }
+    else if (_memfs->next_new < IO_MEMORY_NODES)
+    {
+        index = _memfs->next_new++;  // Untouched nodes stay untouched (and unmapped)
+    }
+
+    // INITIALIZE IT
+    if (MEM_NONE != index)
+    {
+        node = _memfs->nodes + index;
+        node->ino = _memfs->next_ino++;
+        node->mode = mode;
+        node->uid = geteuid();
+        node->gid = getegid();
+        clock_gettime(CLOCK_REALTIME, &node->mtime);
+        node->data_off = 0;
+        node->data_len = 0;
+        node->data_cap = 0;
+        node->next_free = MEM_NONE;
+        memcpy(node->path, norm, strlen(norm) + 1);
+        _mem_link(index);
+    }
+
+    // DONE
+    return index;
+}
+
+
+/*
+ *  Delete node index
+ */
+static void _mem_free(uint32_t index)
+{
+    MemNode *node = _memfs->nodes + index;  // Node to free
+
+    _mem_unlink(index);
+    if (node->data_cap && node->data_off + node->data_cap == _memfs->data_used)
+    {
+        _memfs->data_used = node->data_off;  // The data area is a bump allocator: give back the top
+    }
+    node->ino = 0;
+    node->next_free = _memfs->free_head;
+    _memfs->free_head = index;
+}
+
+
+/*
+ *  Make sure node index can hold size bytes
+ *  Returns 0 on success, errno on failure
+ */
+static int _mem_reserve(uint32_t index, uint64_t size)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                          // 0 on success, errno on failure
+    MemNode *node = _memfs->nodes + index;   // Node to grow
+    uint64_t capacity = node->data_cap;      // New capacity
+    bool on_top = false;                     // Is node's data at the top of the data area?
+
+    // GROW IT
+    if (size > node->data_cap)
+    {
+        capacity = capacity ? capacity * 2 : 64;
+        capacity = capacity < size ? size : capacity;
+        capacity = (capacity + 7) & ~(uint64_t)7;
+        on_top = (node->data_cap && node->data_off + node->data_cap == _memfs->data_used);
+        if ((true == on_top ? node->data_off : _memfs->data_used) + capacity > IO_MEMORY_DATA_SIZE)
+        {
+            errnum = ENOSPC;
+        }
+        else if (true == on_top)
+        {
+            _memfs->data_used = node->data_off + capacity;  // Grow in place
+            node->data_cap = capacity;
+        }
+        else
+        {
+            memcpy(_memfs->data + _memfs->data_used, _memfs->data + node->data_off, node->data_len);
+            node->data_off = _memfs->data_used;
+            node->data_cap = capacity;
+            _memfs->data_used += capacity;
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Verify the parent directory of a normalized path exists
+ *  Returns 0 if it does, errno otherwise
+ */
+static int _mem_check_parent(const char *norm)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                   // 0 on success, errno on failure
+    char parent[PATH_MAX] = { 0 };    // norm's parent
+    const char *last = strrchr(norm, '/');  // Last '/' in norm
+    uint32_t index = MEM_NONE;        // parent's node
+
+    // FIND IT
+    if (!last)
+    {
+        parent[0] = '.';
+    }
+    else if (last == norm)
+    {
+        parent[0] = '/';
+    }
+    else
+    {
+        memcpy(parent, norm, last - norm);
+    }
+    index = _mem_find(parent);
+    if (MEM_NONE == index)
+    {
+        errnum = ENOENT;
+    }
+    else if (!S_ISDIR(_memfs->nodes[index].mode))
+    {
+        errnum = ENOTDIR;
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Does the directory at node index have anything in it?
+ */
+static bool _mem_has_children(uint32_t index)
+{
+    bool has_children = false;  // Return value
+    uint32_t i = 0;             // Iterating variable
+
+    for (i = 0; i < _memfs->next_new && false == has_children; i++)
+    {
+        has_children = (0 != _memfs->nodes[i].ino
+                        && true == _mem_is_child(_memfs->nodes[i].path, _memfs->nodes[index].path));
+    }
+    return has_children;
+}
+
+
+/*
+ *  Describe node index like stat() would
+ */
+static void _mem_fill_stat(uint32_t index, struct stat *statbuf)
+{
+    MemNode *node = _memfs->nodes + index;  // Node to describe
+
+    memset(statbuf, 0, sizeof(struct stat));
+    statbuf->st_dev = MEM_DEV;
+    statbuf->st_ino = node->ino;
+    statbuf->st_mode = node->mode;
+    statbuf->st_nlink = S_ISDIR(node->mode) ? 2 : 1;
+    statbuf->st_uid = node->uid;
+    statbuf->st_gid = node->gid;
+    statbuf->st_size = node->data_len;
+    statbuf->st_blksize = 4096;
+    statbuf->st_blocks = (node->data_cap + 511) / 512;
+    statbuf->st_atim = node->mtime;
+    statbuf->st_mtim = node->mtime;
+    statbuf->st_ctim = node->mtime;
+}
+
+
+/*
+ *  Translate fd into its open in-memory file
+ *  Returns NULL if fd isn't an open in-memory file
+ */
+static MemFile *_mem_get_file(int fd)
+{
+    MemFile *file = NULL;  // Return value
+
+    if (fd >= IO_MEMORY_FD_BASE && fd < IO_MEMORY_FD_BASE + IO_MEMORY_FILES
+        && true == _mem_files[fd - IO_MEMORY_FD_BASE].used)
+    {
+        file = _mem_files + (fd - IO_MEMORY_FD_BASE);
+    }
+    return file;
+}
+
+
+/*
+ *  Is file's node still the one it opened?  Contents of removed files are gone, so reads of
+ *      them see an empty file and writes to them are discarded.
+ */
+static bool _mem_file_valid(MemFile *file)
+{
+    return file->ino == _memfs->nodes[file->node].ino;
+}
+
+
+/*
+ *  qsort() comparisons for _mem_nftw(): parents before children, or children before parents
+ */
+static int _mem_walk_preorder(const void *left, const void *right)
+{
+    const MemWalkEntry *l = left;   // Left entry
+    const MemWalkEntry *r = right;  // Right entry
+
+    return strcmp(l->path + l->rel, r->path + r->rel);
+}
+
+
+static int _mem_walk_postorder(const void *left, const void *right)
+{
+    return _mem_walk_preorder(right, left);
+}
+
+
+/*
+ *  Fill in entry for node index of a walk of dirpath (normalized as dir)
+ *  Returns 0 on success, errno on failure
+ */
+static int _mem_walk_entry(MemWalkEntry *entry, uint32_t index, const char *dirpath, const char *dir,
+                           int flags)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                                    // 0 on success, errno on failure
+    const char *path = _memfs->nodes[index].path;      // Normalized path of the node
+    const char *relative = "";                         // Part of path below dir
+    size_t dir_len = strlen(dirpath);                  // Length of dirpath
+    bool slash = (dir_len > 0 && '/' != dirpath[dir_len - 1]);  // Add a '/' after dirpath?
+    size_t len = 0;                                    // Length of the reported path
+    const char *tmp_ptr = NULL;                        // Iterating pointer
+
+    // SPLIT IT
+    if (0 != strcmp(path, dir))
+    {
+        relative = 0 == strcmp(dir, ".") ? path : 0 == strcmp(dir, "/") ? path + 1 : path + strlen(dir) + 1;
+        entry->ftw.level = 1;
+        for (tmp_ptr = relative; *tmp_ptr; tmp_ptr++)
+        {
+            entry->ftw.level += ('/' == *tmp_ptr);
+        }
+    }
+
+    // REPORT IT
+    // The root is reported as dirpath, everything below it as dirpath/relative (like nftw())
+    entry->path = calloc(dir_len + strlen(relative) + 2, sizeof(char));
+    if (entry->path)
+    {
+        memcpy(entry->path, dirpath, dir_len);
+        len = dir_len;
+        if (*relative)
+        {
+            if (true == slash)
+            {
+                entry->path[len++] = '/';
+            }
+            memcpy(entry->path + len, relative, strlen(relative) + 1);
+            len += strlen(relative);
+        }
+        entry->rel = *relative ? len - strlen(relative) : len;
+        // base is the offset of the last component (ignoring trailing '/' characters)
+        while (len > 1 && '/' == entry->path[len - 1])
+        {
+            len--;
+        }
+        for (entry->ftw.base = len; entry->ftw.base > 0 && '/' != entry->path[entry->ftw.base - 1];
+             entry->ftw.base--);
+        _mem_fill_stat(index, &entry->st);
+        entry->tflag = S_ISDIR(entry->st.st_mode) ? (flags & FTW_DEPTH ? FTW_DP : FTW_D) : FTW_F;
+    }
+    else
+    {
+        errnum = get_errno();
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Create the in-memory filesystem (if it doesn't exist yet)
+ *  Returns 0 on success, errno on failure
+ */
+static int _mem_create(void)
+{
+    // LOCAL VARIABLES
+    int results = 0;              // 0 on success, errno on failure
+    void *mapping = MAP_FAILED;   // Return value from mmap()
+
+    // CREATE IT
+    if (!_memfs)
+    {
+        // Shared so a forked daemon sees the test harness' files (and vice versa)
+        _memfs_size = sizeof(MemFS) + IO_MEMORY_DATA_SIZE;
+        mapping = mmap(NULL, _memfs_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE,
+                       -1, 0);
+        if (MAP_FAILED == mapping)
+        {
+            results = get_errno();
+            syslog_errno(results, "Unable to map a %zu byte in-memory filesystem", _memfs_size);
+            _memfs_size = 0;
+        }
+        else
+        {
+            _memfs = mapping;
+            _memfs->next_ino = 2;
+            _memfs->free_head = MEM_NONE;
+            _mem_new("/", S_IFDIR | S_IRWXU | S_IRWXG | S_IRWXO);
+            _mem_new(".", S_IFDIR | S_IRWXU | S_IRWXG | S_IRWXO);
+            memset(_mem_files, 0, sizeof(_mem_files));
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  In-memory backend functions.  Same arguments and return values as the functions they replace.
+ */
+static int _mem_stat(const char *pathname, struct stat *statbuf)
+{
+    // LOCAL VARIABLES
+    int results = -1;             // 0 on success, -1 on failure (see: errno)
+    int errnum = 0;               // errno value
+    char norm[PATH_MAX] = { 0 };  // Normalized pathname
+    uint32_t index = MEM_NONE;    // pathname's node
+
+    // INPUT VALIDATION
+    errnum = statbuf ? _mem_normalize(pathname, norm) : EFAULT;
+
+    // STAT IT
+    if (0 == errnum)
+    {
+        _mem_lock();
+        index = _mem_find(norm);
+        if (MEM_NONE == index)
+        {
+            errnum = ENOENT;
+        }
+        else
+        {
+            _mem_fill_stat(index, statbuf);
+            results = 0;
+        }
+        _mem_unlock();
+    }
+
+    // DONE
+    if (errnum)
+    {
+        errno = errnum;
+    }
+    return results;
+}
+
+
+static int _mem_open(const char *pathname, int flags, mode_t mode)
+{
+    // LOCAL VARIABLES
+    int results = -1;                         // File descriptor on success, -1 on failure
+    int errnum = 0;                           // errno value
+    char norm[PATH_MAX] = { 0 };              // Normalized pathname
+    uint32_t index = MEM_NONE;                // pathname's node
+    int access_mode = flags & O_ACCMODE;      // O_RDONLY, O_WRONLY, or O_RDWR
+    int slot = 0;                             // Index into _mem_files
+
+    // INPUT VALIDATION
+    errnum = _mem_normalize(pathname, norm);
+    if (0 == errnum && O_TMPFILE == (flags & O_TMPFILE))
+    {
+        errnum = EOPNOTSUPP;
+    }
+    for (slot = 0; 0 == errnum && slot < IO_MEMORY_FILES && true == _mem_files[slot].used; slot++);
+    if (0 == errnum && IO_MEMORY_FILES == slot)
+    {
+        errnum = EMFILE;
+    }
+
+    // OPEN IT
+    if (0 == errnum)
+    {
+        _mem_lock();
+        index = _mem_find(norm);
+        if (MEM_NONE == index)
+        {
+            if (!(flags & O_CREAT))
+            {
+                errnum = ENOENT;
+            }
+            else if (0 == (errnum = _mem_check_parent(norm)))
+            {
+                index = _mem_new(norm, S_IFREG | (mode & 07777));
+                errnum = MEM_NONE == index ? ENOSPC : 0;
+            }
+        }
+        else if ((flags & O_CREAT) && (flags & O_EXCL))
+        {
+            errnum = EEXIST;
+        }
+        else if (S_ISDIR(_memfs->nodes[index].mode) && O_RDONLY != access_mode)
+        {
+            errnum = EISDIR;
+        }
+        else if (!S_ISDIR(_memfs->nodes[index].mode) && (flags & O_DIRECTORY))
+        {
+            errnum = ENOTDIR;
+        }
+        else if ((flags & O_TRUNC) && O_RDONLY != access_mode)
+        {
+            _memfs->nodes[index].data_len = 0;
+            clock_gettime(CLOCK_REALTIME, &_memfs->nodes[index].mtime);
+        }
+        if (0 == errnum)
+        {
+            _mem_files[slot].used = true;
+            _mem_files[slot].node = index;
+            _mem_files[slot].ino = _memfs->nodes[index].ino;
+            _mem_files[slot].offset = 0;
+            _mem_files[slot].flags = flags;
+            results = IO_MEMORY_FD_BASE + slot;
+        }
+        _mem_unlock();
+    }
+
+    // DONE
+    if (errnum)
+    {
+        errno = errnum;
+    }
+    return results;
+}
+
+
+static ssize_t _mem_read(int fd, void *buf, size_t count)
+{
+    // LOCAL VARIABLES
+    ssize_t results = -1;                  // Bytes read on success, -1 on failure
+    int errnum = 0;                        // errno value
+    MemFile *file = _mem_get_file(fd);     // fd's open file
+    MemNode *node = NULL;                  // file's node
+    uint64_t length = 0;                   // Bytes to read
+
+    // INPUT VALIDATION
+    if (!file || O_WRONLY == (file->flags & O_ACCMODE))
+    {
+        errnum = EBADF;
+    }
+    else if (!buf && count)
+    {
+        errnum = EFAULT;
+    }
+
+    // READ IT
+    if (0 == errnum)
+    {
+        _mem_lock();
+        node = _memfs->nodes + file->node;
+        if (true == _mem_file_valid(file) && S_ISDIR(node->mode))
+        {
+            errnum = EISDIR;
+        }
+        else
+        {
+            if (true == _mem_file_valid(file) && file->offset < node->data_len)
+            {
+                length = node->data_len - file->offset;
+                length = length < count ? length : count;
+                memcpy(buf, _memfs->data + node->data_off + file->offset, length);
+                file->offset += length;
+            }
+            results = length;
+        }
+        _mem_unlock();
+    }
+
+    // DONE
+    if (errnum)
+    {
+        errno = errnum;
+    }
+    return results;
+}
+
+
+static ssize_t _mem_write(int fd, const void *buf, size_t count)
+{
+    // LOCAL VARIABLES
+    ssize_t results = -1;                  // Bytes written on success, -1 on failure
+    int errnum = 0;                        // errno value
+    MemFile *file = _mem_get_file(fd);     // fd's open file
+    MemNode *node = NULL;                  // file's node
+
+    // INPUT VALIDATION
+    if (!file || O_RDONLY == (file->flags & O_ACCMODE))
+    {
+        errnum = EBADF;
+    }
+    else if (!buf && count)
+    {
+        errnum = EFAULT;
+    }
+
+    // WRITE IT
+    if (0 == errnum)
+    {
+        _mem_lock();
+        node = _memfs->nodes + file->node;
+        if (true == _mem_file_valid(file))
+        {
+            if (file->flags & O_APPEND)
+            {
+                file->offset = node->data_len;
+            }
+            errnum = _mem_reserve(file->node, file->offset + count);
+            if (0 == errnum)
+            {
+                if (file->offset > node->data_len)
+                {
+                    memset(_memfs->data + node->data_off + node->data_len, 0, file->offset - node->data_len);
+                }
+                memcpy(_memfs->data + node->data_off + file->offset, buf, count);
+                file->offset += count;
+                node->data_len = file->offset > node->data_len ? file->offset : node->data_len;
+                clock_gettime(CLOCK_REALTIME, &node->mtime);
+            }
+        }
+        if (0 == errnum)
+        {
+            results = count;
+        }
+        _mem_unlock();
+    }
+
+    // DONE
+    if (errnum)
+    {
+        errno = errnum;
+    }
+    return results;
+}
+
+
+static int _mem_fsync(int fd)
+{
+    int results = 0;  // 0 on success, -1 on failure
+
+    if (!_mem_get_file(fd))
+    {
+        errno = EBADF;
+        results = -1;
+    }
+    return results;
+}
+
+
+static int _mem_close(int fd)
+{
+    int results = 0;                    // 0 on success, -1 on failure
+    MemFile *file = _mem_get_file(fd);  // fd's open file
+
+    if (file)
+    {
+        file->used = false;
+    }
+    else
+    {
+        errno = EBADF;
+        results = -1;
+    }
+    return results;
+}
+
+
+static int _mem_rename(const char *oldpath, const char *newpath)
+{
+    // LOCAL VARIABLES
+    int results = -1;                  // 0 on success, -1 on failure
+    int errnum = 0;                    // errno value
+    char old_norm[PATH_MAX] = { 0 };   // Normalized oldpath
+    char new_norm[PATH_MAX] = { 0 };   // Normalized newpath
+    char moved[PATH_MAX] = { 0 };      // New path of a node inside a renamed directory
+    uint32_t source = MEM_NONE;        // oldpath's node
+    uint32_t dest = MEM_NONE;          // newpath's node
+    size_t old_len = 0;                // Length of old_norm
+    size_t new_len = 0;                // Length of new_norm
+    uint32_t i = 0;                    // Iterating variable
+    bool is_dir = false;               // Is oldpath a directory?
+
+    // INPUT VALIDATION
+    errnum = _mem_normalize(oldpath, old_norm);
+    if (0 == errnum)
+    {
+        errnum = _mem_normalize(newpath, new_norm);
+    }
+    if (0 == errnum)
+    {
+        _mem_lock();
+        source = _mem_find(old_norm);
+        dest = _mem_find(new_norm);
+        old_len = strlen(old_norm);
+        new_len = strlen(new_norm);
+        if (MEM_NONE == source)
+        {
+            errnum = ENOENT;
+        }
+        else if (0 == strcmp(old_norm, "/") || 0 == strcmp(old_norm, ".")
+                 || 0 == strcmp(new_norm, "/") || 0 == strcmp(new_norm, "."))
+        {
+            errnum = EBUSY;
+        }
+        else if (0 != (errnum = _mem_check_parent(new_norm)))
+        {
+            // Missing destination directory
+        }
+        else if (true == (is_dir = S_ISDIR(_memfs->nodes[source].mode)) && true == _mem_is_child(new_norm, old_norm))
+        {
+            errnum = EINVAL;  // Can't move a directory inside itself
+        }
+        else if (MEM_NONE != dest && source != dest)
+        {
+            if (S_ISDIR(_memfs->nodes[dest].mode) && false == is_dir)
+            {
+                errnum = EISDIR;
+            }
+            else if (!S_ISDIR(_memfs->nodes[dest].mode) && true == is_dir)
+            {
+                errnum = ENOTDIR;
+            }
+            else if (true == _mem_has_children(dest))
+            {
+                errnum = ENOTEMPTY;
+            }
+        }
+        // Everything inside a directory moves with it
+        for (i = 0; 0 == errnum && true == is_dir && i < _memfs->next_new; i++)
+        {
+            if (_memfs->nodes[i].ino && true == _mem_is_child(_memfs->nodes[i].path, old_norm)
+                && new_len + strlen(_memfs->nodes[i].path) - old_len >= PATH_MAX)
+            {
+                errnum = ENAMETOOLONG;
+            }
+        }
+
+        // MOVE IT
+        if (0 == errnum && source != dest)
+        {
+            if (MEM_NONE != dest)
+            {
+                _mem_free(dest);  // Replaced
+            }
+            for (i = 0; true == is_dir && i < _memfs->next_new; i++)
+            {
+                if (_memfs->nodes[i].ino && true == _mem_is_child(_memfs->nodes[i].path, old_norm))
+                {
+                    _mem_unlink(i);
+                    memcpy(moved, new_norm, new_len);
+                    memcpy(moved + new_len, _memfs->nodes[i].path + old_len,
+                           strlen(_memfs->nodes[i].path + old_len) + 1);
+                    memcpy(_memfs->nodes[i].path, moved, strlen(moved) + 1);
+                    _mem_link(i);
+                }
+            }
+            _mem_unlink(source);
+            memcpy(_memfs->nodes[source].path, new_norm, new_len + 1);
+            _mem_link(source);
+        }
+        if (0 == errnum)
+        {
+            results = 0;
+        }
+        _mem_unlock();
+    }
+
+    // DONE
+    if (errnum)
+    {
+        errno = errnum;
+    }
+    return results;
+}
+
+
+static int _mem_remove(const char *pathname)
+{
+    // LOCAL VARIABLES
+    int results = -1;             // 0 on success, -1 on failure
+    int errnum = 0;               // errno value
+    char norm[PATH_MAX] = { 0 };  // Normalized pathname
+    uint32_t index = MEM_NONE;    // pathname's node
+
+    // INPUT VALIDATION
+    errnum = _mem_normalize(pathname, norm);
+
+    // REMOVE IT
+    if (0 == errnum)
+    {
+        _mem_lock();
+        index = _mem_find(norm);
+        if (MEM_NONE == index)
+        {
+            errnum = ENOENT;
+        }
+        else if (0 == strcmp(norm, "/") || 0 == strcmp(norm, "."))
+        {
+            errnum = EBUSY;
+        }
+        else if (S_ISDIR(_memfs->nodes[index].mode) && true == _mem_has_children(index))
+        {
+            errnum = ENOTEMPTY;
+        }
+        else
+        {
+            _mem_free(index);
+            results = 0;
+        }
+        _mem_unlock();
+    }
+
+    // DONE
+    if (errnum)
+    {
+        errno = errnum;
+    }
+    return results;
+}
+
+
+static int _mem_mkdir(const char *pathname, mode_t mode)
+{
+    // LOCAL VARIABLES
+    int results = -1;             // 0 on success, -1 on failure
+    int errnum = 0;               // errno value
+    char norm[PATH_MAX] = { 0 };  // Normalized pathname
+
+    // INPUT VALIDATION
+    errnum = _mem_normalize(pathname, norm);
+
+    // MAKE IT
+    if (0 == errnum)
+    {
+        _mem_lock();
+        if (MEM_NONE != _mem_find(norm))
+        {
+            errnum = EEXIST;
+        }
+        else if (0 == (errnum = _mem_check_parent(norm)))
+        {
+            if (MEM_NONE == _mem_new(norm, S_IFDIR | (mode & 07777)))
+            {
+                errnum = ENOSPC;
+            }
+            else
+            {
+                results = 0;
+            }
+        }
+        _mem_unlock();
+    }
+
+    // DONE
+    if (errnum)
+    {
+        errno = errnum;
+    }
+    return results;
+}
+
+
+static int _mem_nftw(const char *dirpath, IoWalker fn, int nopenfd, int flags)
+{
+    // LOCAL VARIABLES
+    int results = -1;                 // 0 when done, the callback's non-zero return, -1 on failure
+    int errnum = 0;                   // errno value
+    char norm[PATH_MAX] = { 0 };      // Normalized dirpath
+    uint32_t root = MEM_NONE;         // dirpath's node
+    MemWalkEntry *entries = NULL;     // Everything to report
+    size_t num_entries = 0;           // Number of entries
+    uint32_t i = 0;                   // Iterating variable
+
+    // INPUT VALIDATION
+    errnum = fn ? _mem_normalize(dirpath, norm) : EINVAL;
+
+    // COLLECT IT
+    // Copy everything out so the callback can change the filesystem (e.g., remove() files)
+    if (0 == errnum)
+    {
+        _mem_lock();
+        root = _mem_find(norm);
+        if (MEM_NONE == root)
+        {
+            errnum = ENOENT;
+        }
+        else if (NULL == (entries = calloc(_memfs->next_new, sizeof(MemWalkEntry))))
+        {
+            errnum = get_errno();
+        }
+        else
+        {
+            errnum = _mem_walk_entry(entries + num_entries++, root, dirpath, norm, flags);
+        }
+        for (i = 0; 0 == errnum && S_ISDIR(_memfs->nodes[root].mode) && i < _memfs->next_new; i++)
+        {
+            if (_memfs->nodes[i].ino && true == _mem_is_child(_memfs->nodes[i].path, norm))
+            {
+                errnum = _mem_walk_entry(entries + num_entries++, i, dirpath, norm, flags);
+            }
+        }
+        _mem_unlock();
+    }
+
+    // WALK IT
+    if (0 == errnum)
+    {
+        qsort(entries, num_entries, sizeof(MemWalkEntry),
+              flags & FTW_DEPTH ? _mem_walk_postorder : _mem_walk_preorder);
+        results = 0;
+        for (i = 0; i < num_entries && 0 == results; i++)
+        {
+            results = fn(entries[i].path, &entries[i].st, entries[i].tflag, &entries[i].ftw);
+        }
+    }
+
+    // CLEANUP
+    for (i = 0; entries && i < num_entries; i++)
+    {
+        free(entries[i].path);
+    }
+    free(entries);
+
+    // DONE
+    if (errnum)
+    {
+        errno = errnum;
+    }
+    return results;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+int io_select(const char *backend)
+{
+    // LOCAL VARIABLES
+    int results = -1;  // 0 on success, -1 on bad input, errno on failure
+
+    // INPUT VALIDATION
+    if (!backend)
+    {
+        backend = getenv(IO_ENV_VAR);
+        backend = backend && *backend ? backend : IO_DEFAULT_BACKEND;
+    }
+
+    // SELECT IT
+    if (0 == strcmp(backend, hare_io_posix.name))
+    {
+        hare_io = &hare_io_posix;
+        results = 0;
+    }
+    else if (0 == strcmp(backend, hare_io_memory.name))
+    {
+        results = _mem_create();
+        if (0 == results)
+        {
+            hare_io = &hare_io_memory;
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+void io_release(void)
+{
+    hare_io = &hare_io_posix;
+    if (_memfs)
+    {
+        munmap(_memfs, _memfs_size);
+        _memfs = NULL;
+        _memfs_size = 0;
+    }
+}
+
+
+int io_stat(const char *pathname, struct stat *statbuf)
+{
+    return hare_io->stat(pathname, statbuf);
+}
+
+
+int io_open(const char *pathname, int flags, mode_t mode)
+{
+    return hare_io->open(pathname, flags, mode);
+}
+
+
+ssize_t io_read(int fd, void *buf, size_t count)
+{
+    return hare_io->read(fd, buf, count);
+}
+
+
+ssize_t io_write(int fd, const void *buf, size_t count)
+{
+    return hare_io->write(fd, buf, count);
+}
+
+
+int io_fsync(int fd)
+{
+    return hare_io->fsync(fd);
+}
+
+
+int io_close(int fd)
+{
+    return hare_io->close(fd);
+}
+
+
+int io_rename(const char *oldpath, const char *newpath)
+{
+    return hare_io->rename(oldpath, newpath);
+}
+
+
+int io_remove(const char *pathname)
+{
+    return hare_io->remove(pathname);
+}
+
+
+int io_mkdir(const char *pathname, mode_t mode)
+{
+    return hare_io->mkdir(pathname, mode);
+}
+
+
+int io_nftw(const char *dirpath, IoWalker fn, int nopenfd, int flags)
+{
+    return hare_io->nftw(dirpath, fn, nopenfd, flags);
+}
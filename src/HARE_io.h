@@ -0,0 +1,89 @@
+/*
+ *  Pluggable file I/O for the HARE library.
+ *  Every stat(), open(), read(), write(), fsync(), close(), rename(), remove(), mkdir(), and
+ *      nftw() the library makes on the watched and process directories goes through hare_io.
+ *  Two backends are available:
+ *      posix - The real filesystem (the default)
+ *      memory - An in-memory filesystem (a hash of paths to buffers with directory semantics).
+ *          It lives in a shared mapping, so a daemon forked after io_select() shares it with
+ *          the test harness.  Fuzzing and benchmarking then never touch a disk (or /ramdisk).
+ *  Select a backend at runtime with io_select() (e.g., from IO_ENV_VAR) or at build time with
+ *      -DHARE_IO_MEMORY.
+ *  The backends report errors like the system calls they replace: -1 and errno.
+ */
+
+#ifndef __HARE_IO__
+#define __HARE_IO__
+
+#include <sys/stat.h>   // struct stat
+#include <sys/types.h>  // mode_t, ssize_t
+
+#define IO_ENV_VAR "HARE_IO"                   // io_select(NULL) reads the backend's name from here
+#define IO_MEMORY_NODES 4096                   // Files and directories the memory backend holds
+#define IO_MEMORY_DATA_SIZE (64 * 1024 * 1024) // Bytes of file contents the memory backend holds
+#define IO_MEMORY_FILES 256                    // Memory backend files each process may have open
+#define IO_MEMORY_FD_BASE 0x40000000           // Memory backend file descriptors start here
+
+#ifdef HARE_IO_MEMORY
+#define IO_DEFAULT_BACKEND "memory"  // Built to run in memory
+#else
+#define IO_DEFAULT_BACKEND "posix"   // Production default
+#endif  // HARE_IO_MEMORY
+
+struct FTW;  // See: <ftw.h> (which needs _XOPEN_SOURCE)
+
+// Callback for io_nftw() (see: man nftw)
+typedef int (*IoWalker)(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftwbuf);
+
+// An I/O backend
+typedef struct _HareIO
+{
+    const char *name;                                                        // Backend name
+    int (*stat)(const char *pathname, struct stat *statbuf);                 // See: man 2 stat
+    int (*open)(const char *pathname, int flags, mode_t mode);               // See: man 2 open
+    ssize_t (*read)(int fd, void *buf, size_t count);                        // See: man 2 read
+    ssize_t (*write)(int fd, const void *buf, size_t count);                 // See: man 2 write
+    int (*fsync)(int fd);                                                    // See: man 2 fsync
+    int (*close)(int fd);                                                    // See: man 2 close
+    int (*rename)(const char *oldpath, const char *newpath);                 // See: man 2 rename
+    int (*remove)(const char *pathname);                                     // See: man 3 remove
+    int (*mkdir)(const char *pathname, mode_t mode);                         // See: man 2 mkdir
+    int (*nftw)(const char *dirpath, IoWalker fn, int nopenfd, int flags);   // See: man 3 nftw
+} HareIO;
+
+extern const HareIO hare_io_posix;   // Real filesystem
+extern const HareIO hare_io_memory;  // In-memory filesystem
+extern const HareIO *hare_io;        // Backend in use (defaults to hare_io_posix)
+
+
+/*
+ *  Use the backend named backend ("posix" or "memory").  NULL reads the name from IO_ENV_VAR,
+ *      falling back to IO_DEFAULT_BACKEND.  Creates the in-memory filesystem the first time
+ *      it's selected, so call it before daemonize().
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int io_select(const char *backend);
+
+
+/*
+ *  Free the in-memory filesystem (if any) and go back to the posix backend
+ */
+void io_release(void);
+
+
+/*
+ *  Dispatch to hare_io.  Same arguments and return values as the functions they replace.
+ */
+int io_stat(const char *pathname, struct stat *statbuf);
+int io_open(const char *pathname, int flags, mode_t mode);
+ssize_t io_read(int fd, void *buf, size_t count);
+ssize_t io_write(int fd, const void *buf, size_t count);
+int io_fsync(int fd);
+int io_close(int fd);
+int io_rename(const char *oldpath, const char *newpath);
+int io_remove(const char *pathname);
+int io_mkdir(const char *pathname, mode_t mode);
+int io_nftw(const char *dirpath, IoWalker fn, int nopenfd, int flags);
+
+
+#endif  // __HARE_IO__
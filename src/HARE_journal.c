@@ -0,0 +1,714 @@
+/*
+ *  Implements HARE_journal.h functions.
+ */
+
+#include <errno.h>           // errno
+#include <fcntl.h>           // open(), O_* macros
+#include <libgen.h>          // dirname()
+#include <linux/limits.h>    // PATH_MAX
+#include <stdio.h>           // rename(), snprintf()
+#include <stdlib.h>          // calloc(), free(), realloc()
+#include <string.h>          // memcmp(), memcpy(), memset(), strlen()
+#include <sys/mman.h>        // mmap(), msync(), munmap()
+#include <sys/stat.h>        // fstat()
+#include <unistd.h>          // close(), fsync(), ftruncate(), sysconf()
+#include "HARE_journal.h"
+#include "HARE_library.h"    // syslog_*(), INVALID_FD, get_errno()
+
+#define JOURNAL_ALIGNMENT 8                     // Records start on multiples of this
+#define JOURNAL_COMPACT_SUFFIX ".compact"       // Suffix of the replacement file journal_compact() builds
+#define JOURNAL_CRC_POLYNOMIAL 0xEDB88320U      // Reflected CRC-32 (IEEE 802.3) polynomial
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  CRC-32 of data_len bytes of data
+ */
+static uint32_t _crc32(const uint8_t *data, size_t data_len)
+{
+    // LOCAL VARIABLES
+    uint32_t crc = 0xFFFFFFFFU;  // Running CRC
+    size_t i = 0;                // Iterating variable
+    int bit = 0;                 // Iterating variable
+
+    // CALCULATE IT
+    for (i = 0; i < data_len; i++)
+    {
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (JOURNAL_CRC_POLYNOMIAL & (0U - (crc & 1)));
+        }
+    }
+
+    // DONE
+    return ~crc;
+}
+
+
+/*
+ *  Size, in bytes, of a record holding path_len bytes of path
+ */
+static size_t _record_size(size_t path_len)
+{
+    return (sizeof(JournalRecord) + path_len + (JOURNAL_ALIGNMENT - 1)) & ~((size_t)JOURNAL_ALIGNMENT - 1);
+}
+
+
+/*
+ *  Microseconds between then and now
+ */
+static long long _usec_since(struct timespec *then)
+{
+    // LOCAL VARIABLES
+    struct timespec now = { 0 };  // Current time
+
+    // MEASURE IT
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // DONE
+    return ((long long)(now.tv_sec - then->tv_sec) * 1000000) + ((now.tv_nsec - then->tv_nsec) / 1000);
+}
+
+
+/*
+ *  Is it time to compact journal?  Everything before the checkpoint is dead weight (the
+ *      checkpoint follows the end of the journal whenever nothing is in flight) and so is every
+ *      completed record after it.  Does not validate input.
+ */
+static bool _needs_compaction(Journal *journal)
+{
+    // LOCAL VARIABLES
+    JournalHeader *header = (JournalHeader *)journal->map;  // Journal file header
+
+    // DONE
+    return header->checkpoint > JOURNAL_COMPACT_SIZE || journal->end - header->checkpoint > JOURNAL_COMPACT_SIZE;
+}
+
+
+/*
+ *  Resize journal's file to new_size and map all of it.  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _map_journal(Journal *journal, size_t new_size)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;    // 0 on success, errno on failure
+    char *map = NULL;  // New mapping
+
+    // RESIZE IT
+    if (new_size > journal->map_size && ftruncate(journal->fd, new_size))
+    {
+        errnum = get_errno();
+        syslog_errno(errnum, "Unable to grow the journal %s", journal->filename);
+    }
+
+    // MAP IT
+    if (0 == errnum)
+    {
+        map = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, journal->fd, 0);
+        if (MAP_FAILED == map)
+        {
+            errnum = get_errno();
+            syslog_errno(errnum, "Unable to map the journal %s", journal->filename);
+        }
+        else
+        {
+            if (journal->map)
+            {
+                munmap(journal->map, journal->map_size);
+            }
+            journal->map = map;
+            journal->map_size = new_size;
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Update journal's in-flight table with a record.  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _track(Journal *journal, uint64_t seq, JournalState state, uint8_t flags, char *path, size_t path_len)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;              // 0 on success, errno on failure
+    JournalEntry *entry = NULL;  // Entry for seq
+    JournalEntry *grown = NULL;  // Reallocated in_flight
+    size_t new_capacity = 0;     // Capacity of grown
+    size_t i = 0;                // Iterating variable
+
+    // FIND IT
+    for (i = 0; i < journal->num_in_flight; i++)
+    {
+        if (seq == journal->in_flight[i].seq)
+        {
+            entry = journal->in_flight + i;
+            break;
+        }
+    }
+
+    // TRACK IT
+    if (JOURNAL_RECEIVED == state && !entry)
+    {
+        if (journal->num_in_flight == journal->in_flight_capacity)
+        {
+            new_capacity = journal->in_flight_capacity ? journal->in_flight_capacity * 2 : 16;
+            grown = realloc(journal->in_flight, new_capacity * sizeof(JournalEntry));
+            if (grown)
+            {
+                journal->in_flight = grown;
+                journal->in_flight_capacity = new_capacity;
+            }
+            else
+            {
+                errnum = ENOMEM;
+            }
+        }
+        if (0 == errnum)
+        {
+            entry = journal->in_flight + journal->num_in_flight;
+            entry->source = calloc(path_len + 1, sizeof(char));
+            if (entry->source)
+            {
+                memcpy(entry->source, path, path_len);
+                entry->seq = seq;
+                entry->state = state;
+                entry->flags = flags;
+                journal->num_in_flight++;
+            }
+            else
+            {
+                errnum = ENOMEM;
+            }
+        }
+    }
+    else if (JOURNAL_SCANNED == state && entry)
+    {
+        entry->state = state;
+        entry->flags = flags;
+    }
+    else if (JOURNAL_MOVED == state && entry)
+    {
+        // No longer in flight: replace it with the last entry
+        free(entry->source);
+        journal->num_in_flight--;
+        *entry = journal->in_flight[journal->num_in_flight];
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Append a record to journal's mapping, growing the file as needed.  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _write_record(Journal *journal, uint64_t seq, JournalState state, uint8_t flags, char *path, size_t path_len)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                               // 0 on success, errno on failure
+    size_t record_size = _record_size(path_len);  // Size of the new record
+    size_t new_size = journal->map_size;          // Size the file needs to be
+    JournalRecord *record = NULL;                 // New record
+
+    // MAKE ROOM
+    while (journal->end + record_size > new_size)
+    {
+        new_size *= 2;
+    }
+    if (new_size != journal->map_size)
+    {
+        errnum = _map_journal(journal, new_size);
+    }
+
+    // WRITE IT
+    if (0 == errnum)
+    {
+        record = (JournalRecord *)(journal->map + journal->end);
+        memset(record, 0, record_size);
+        record->length = record_size;
+        record->seq = seq;
+        record->state = state;
+        record->flags = flags;
+        record->path_len = path_len;
+        if (path_len > 0)
+        {
+            memcpy(record + 1, path, path_len);
+        }
+        record->crc = _crc32((uint8_t *)record + sizeof(record->crc), record_size - sizeof(record->crc));
+        journal->end += record_size;
+        if (0 == journal->pending++)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &journal->first_pending);
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Write a record and track it.  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _record(Journal *journal, uint64_t seq, JournalState state, uint8_t flags, char *path)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                               // 0 on success, errno on failure
+    size_t path_len = path ? strlen(path) : 0;    // Length of path
+
+    // RECORD IT
+    if (path_len > PATH_MAX)
+    {
+        errnum = ENAMETOOLONG;
+    }
+    else if (0 == (errnum = _write_record(journal, seq, state, flags, path, path_len)))
+    {
+        errnum = _track(journal, seq, state, flags, path, path_len);
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Read every valid record from the checkpoint on into the in-flight table, stopping at the
+ *      first torn or empty record.  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _replay(Journal *journal)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                                               // 0 on success, errno on failure
+    JournalHeader *header = (JournalHeader *)journal->map;        // Journal file header
+    size_t offset = header->checkpoint;                           // Offset of the current record
+    JournalRecord *record = NULL;                                 // Current record
+    size_t replayed = 0;                                          // Number of records replayed
+
+    // REPLAY IT
+    journal->next_seq = header->next_seq;
+    while (0 == errnum && offset + sizeof(JournalRecord) <= journal->map_size)
+    {
+        record = (JournalRecord *)(journal->map + offset);
+        if (record->length < sizeof(JournalRecord) || 0 != record->length % JOURNAL_ALIGNMENT
+            || record->length > journal->map_size - offset
+            || sizeof(JournalRecord) + record->path_len > record->length
+            || record->crc != _crc32((uint8_t *)record + sizeof(record->crc), record->length - sizeof(record->crc)))
+        {
+            break;  // The end of the journal (or a torn record)
+        }
+        errnum = _track(journal, record->seq, record->state, record->flags, (char *)(record + 1), record->path_len);
+        if (record->seq >= journal->next_seq)
+        {
+            journal->next_seq = record->seq + 1;
+        }
+        offset += record->length;
+        replayed++;
+    }
+    journal->end = offset;
+    journal->synced = offset;
+
+    // DISCARD TORN RECORDS
+    // Pages may reach the disk out of order so clear anything after the end or a later
+    // append could land in front of a stale record that still passes its CRC check
+    if (0 == errnum && offset + sizeof(JournalRecord) <= journal->map_size && 0 != ((JournalRecord *)(journal->map + offset))->length)
+    {
+        syslog_it2(LOG_WARNING, "Discarding a torn record at offset %zu of the journal %s", offset, journal->filename);
+        memset(journal->map + offset, 0, journal->map_size - offset);
+        if (msync(journal->map, journal->map_size, MS_SYNC))
+        {
+            errnum = get_errno();
+        }
+    }
+    if (0 == errnum && replayed > 0)
+    {
+        syslog_it2(LOG_INFO, "Replayed %zu journal records leaving %zu messages in flight", replayed, journal->num_in_flight);
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Flush a directory entry change (e.g., rename()) in filename's directory to disk
+ */
+static void _sync_parent(char *filename)
+{
+    // LOCAL VARIABLES
+    char name_copy[PATH_MAX + 1] = { 0 };  // Modifiable copy of filename for dirname()
+    int dir_fd = INVALID_FD;               // File descriptor for filename's directory
+
+    // SYNC IT
+    strncpy(name_copy, filename, PATH_MAX);
+    dir_fd = open(dirname(name_copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd > INVALID_FD)
+    {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+int journal_append(Journal *journal, uint64_t seq, JournalState state, uint8_t flags, char *path)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;  // 0 on success, -1 on bad input, errno on failure
+
+    // INPUT VALIDATION
+    if (journal && journal->map && (JOURNAL_SCANNED == state || JOURNAL_MOVED == state))
+    {
+        errnum = 0;
+    }
+
+    // APPEND IT
+    if (0 == errnum)
+    {
+        errnum = _record(journal, seq, state, flags, path);
+        if (0 == errnum)
+        {
+            errnum = journal_commit(journal, false);
+        }
+        else
+        {
+            syslog_errno(errnum, "Unable to journal message %llu", (unsigned long long)seq);
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+int journal_begin(Journal *journal, char *source, uint64_t *seq)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;  // 0 on success, -1 on bad input, errno on failure
+
+    // INPUT VALIDATION
+    if (journal && journal->map && source && *source && seq)
+    {
+        errnum = 0;
+    }
+
+    // BEGIN IT
+    if (0 == errnum)
+    {
+        *seq = journal->next_seq++;
+        errnum = _record(journal, *seq, JOURNAL_RECEIVED, 0, source);
+        if (0 == errnum)
+        {
+            errnum = journal_commit(journal, false);
+        }
+        else
+        {
+            syslog_errno(errnum, "Unable to journal the receipt of %s", source);
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+void journal_close(Journal *journal)
+{
+    // LOCAL VARIABLES
+    size_t i = 0;  // Iterating variable
+
+    // CLOSE IT
+    if (journal && journal->filename)  // Never opened (or already closed): fd may be a zeroed 0
+    {
+        if (journal->map)
+        {
+            journal_commit(journal, true);
+            munmap(journal->map, journal->map_size);
+        }
+        if (journal->fd > INVALID_FD)
+        {
+            close(journal->fd);
+        }
+        for (i = 0; i < journal->num_in_flight; i++)
+        {
+            free(journal->in_flight[i].source);
+        }
+        free(journal->in_flight);
+        free(journal->filename);
+        memset(journal, 0, sizeof(Journal));
+        journal->fd = INVALID_FD;
+    }
+}
+
+
+int journal_commit(Journal *journal, bool force)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;                                   // 0 on success, -1 on bad input, errno on failure
+    JournalHeader *header = NULL;                      // Journal file header
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);  // msync() wants page-aligned addresses
+    size_t start = 0;                                  // Page-aligned start of the pending records
+
+    // INPUT VALIDATION
+    if (journal && journal->map)
+    {
+        errnum = 0;
+        header = (JournalHeader *)journal->map;
+    }
+
+    // COMMIT IT
+    if (0 == errnum && journal->pending > 0
+        && (true == force || journal->pending >= JOURNAL_GROUP_RECORDS
+            || _usec_since(&journal->first_pending) >= JOURNAL_GROUP_USEC))
+    {
+        start = journal->synced & ~(page_size - 1);
+        if (msync(journal->map + start, journal->end - start, MS_SYNC))
+        {
+            errnum = get_errno();
+            syslog_errno(errnum, "Unable to commit the journal %s", journal->filename);
+        }
+        else
+        {
+            journal->synced = journal->end;
+            journal->pending = 0;
+        }
+    }
+
+    // CHECKPOINT IT
+    // Nothing in flight means nothing before here will ever need to be replayed
+    if (0 == errnum && 0 == journal->num_in_flight && journal->synced == journal->end
+        && header->checkpoint != journal->end)
+    {
+        header->checkpoint = journal->end;
+        header->next_seq = journal->next_seq;
+        if (msync(journal->map, page_size, MS_SYNC))
+        {
+            errnum = get_errno();
+            syslog_errno(errnum, "Unable to checkpoint the journal %s", journal->filename);
+        }
+    }
+
+    // COMPACT IT
+    if (0 == errnum && true == _needs_compaction(journal))
+    {
+        errnum = journal_compact(journal);
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+int journal_compact(Journal *journal)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;                          // 0 on success, -1 on bad input, errno on failure
+    Journal compacted = { 0 };                // Replacement journal
+    JournalHeader *header = NULL;             // Replacement journal's header
+    JournalEntry *entry = NULL;               // Current in-flight entry
+    char tmp_name[PATH_MAX + 1] = { 0 };      // Replacement journal's filename
+    size_t i = 0;                             // Iterating variable
+
+    // INPUT VALIDATION
+    if (journal && journal->map && journal->filename)
+    {
+        if (snprintf(tmp_name, sizeof(tmp_name), "%s%s", journal->filename, JOURNAL_COMPACT_SUFFIX) < sizeof(tmp_name))
+        {
+            errnum = 0;
+        }
+    }
+
+    // BUILD THE REPLACEMENT
+    if (0 == errnum)
+    {
+        compacted.filename = tmp_name;
+        compacted.fd = open(tmp_name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (compacted.fd < 0)
+        {
+            errnum = get_errno();
+        }
+        else
+        {
+            errnum = _map_journal(&compacted, JOURNAL_INITIAL_SIZE);
+        }
+    }
+    if (0 == errnum)
+    {
+        header = (JournalHeader *)compacted.map;
+        memcpy(header->magic, JOURNAL_MAGIC, sizeof(header->magic));
+        header->checkpoint = sizeof(JournalHeader);
+        header->next_seq = journal->next_seq;
+        compacted.end = sizeof(JournalHeader);
+        for (i = 0; i < journal->num_in_flight && 0 == errnum; i++)
+        {
+            entry = journal->in_flight + i;
+            errnum = _write_record(&compacted, entry->seq, JOURNAL_RECEIVED, 0, entry->source, strlen(entry->source));
+            if (0 == errnum && JOURNAL_SCANNED == entry->state)
+            {
+                errnum = _write_record(&compacted, entry->seq, JOURNAL_SCANNED, entry->flags, NULL, 0);
+            }
+        }
+    }
+    if (0 == errnum && (msync(compacted.map, compacted.map_size, MS_SYNC) || fsync(compacted.fd)))
+    {
+        errnum = get_errno();
+    }
+
+    // REPLACE THE JOURNAL
+    if (0 == errnum)
+    {
+        if (rename(tmp_name, journal->filename))
+        {
+            errnum = get_errno();
+        }
+        else
+        {
+            _sync_parent(journal->filename);
+            syslog_it2(LOG_INFO, "Compacted the journal %s from %zu to %zu bytes",
+                       journal->filename, journal->end, compacted.end);
+            munmap(journal->map, journal->map_size);
+            close(journal->fd);
+            journal->fd = compacted.fd;
+            journal->map = compacted.map;
+            journal->map_size = compacted.map_size;
+            journal->end = compacted.end;
+            journal->synced = compacted.end;
+            journal->pending = 0;
+            compacted.fd = INVALID_FD;
+            compacted.map = NULL;
+        }
+    }
+
+    // CLEANUP
+    if (0 < errnum)
+    {
+        syslog_errno(errnum, "Unable to compact the journal %s", journal->filename);
+        unlink(tmp_name);
+    }
+    if (compacted.map)
+    {
+        munmap(compacted.map, compacted.map_size);
+    }
+    if (compacted.fd > INVALID_FD)
+    {
+        close(compacted.fd);
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+int journal_open(Journal *journal, char *filename)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;                      // 0 on success, -1 on bad input, errno on failure
+    struct stat journal_stat;             // Metadata for filename
+    JournalHeader *header = NULL;         // Journal file header
+    size_t filename_len = 0;              // Length of filename
+
+    // INPUT VALIDATION
+    if (journal && filename && *filename)
+    {
+        memset(journal, 0, sizeof(Journal));
+        journal->fd = INVALID_FD;
+        filename_len = strlen(filename);
+        journal->filename = calloc(filename_len + 1, sizeof(char));
+        if (journal->filename)
+        {
+            memcpy(journal->filename, filename, filename_len);
+            errnum = 0;
+        }
+        else
+        {
+            errnum = ENOMEM;
+        }
+    }
+
+    // OPEN IT
+    if (0 == errnum)
+    {
+        journal->fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (journal->fd < 0 || fstat(journal->fd, &journal_stat))
+        {
+            errnum = get_errno();
+            syslog_errno(errnum, "Unable to open the journal %s", filename);
+        }
+        else if (0 == journal_stat.st_size)
+        {
+            // Brand new journal
+            errnum = _map_journal(journal, JOURNAL_INITIAL_SIZE);
+            if (0 == errnum)
+            {
+                header = (JournalHeader *)journal->map;
+                memcpy(header->magic, JOURNAL_MAGIC, sizeof(header->magic));
+                header->checkpoint = sizeof(JournalHeader);
+                header->next_seq = 1;
+                if (msync(journal->map, sizeof(JournalHeader), MS_SYNC))
+                {
+                    errnum = get_errno();
+                }
+            }
+        }
+        else if (journal_stat.st_size < sizeof(JournalHeader))
+        {
+            errnum = EINVAL;
+        }
+        else
+        {
+            errnum = _map_journal(journal, journal_stat.st_size);
+        }
+    }
+
+    // REPLAY IT
+    if (0 == errnum)
+    {
+        header = (JournalHeader *)journal->map;
+        if (memcmp(header->magic, JOURNAL_MAGIC, sizeof(header->magic))
+            || header->checkpoint < sizeof(JournalHeader) || header->checkpoint > journal->map_size)
+        {
+            errnum = EINVAL;
+        }
+        else
+        {
+            errnum = _replay(journal);
+        }
+        if (EINVAL == errnum)
+        {
+            syslog_it2(LOG_ERR, "%s is not a valid journal", filename);
+        }
+    }
+    if (0 == errnum && true == _needs_compaction(journal))
+    {
+        errnum = journal_compact(journal);
+    }
+
+    // CLEANUP
+    if (0 != errnum && journal)
+    {
+        if (journal->map)
+        {
+            munmap(journal->map, journal->map_size);  // Don't let journal_close() commit to it
+            journal->map = NULL;
+        }
+        journal_close(journal);
+    }
+
+    // DONE
+    return errnum;
+}
@@ -0,0 +1,137 @@
+/*
+ *  Write-ahead processing journal for the HARE daemon.
+ *  Every message is recorded as it moves through received -> scanned -> moved in an
+ *      append-only, mmap()ed file.  Appends are a memcpy() into the mapping and become durable
+ *      in groups (see: journal_commit()) so the processing loop doesn't pay for an fsync() per
+ *      record.  A torn or missing record can't cause a file to be processed twice: recovery
+ *      checks the filesystem for every message that was still in flight.
+ *  The header's checkpoint marks where the last moment with nothing in flight ended, so
+ *      journal_open() only replays the tail written after it.  journal_compact() rewrites the
+ *      journal down to the in-flight records so the file never grows without bound.
+ */
+
+#ifndef __HARE_JOURNAL__
+#define __HARE_JOURNAL__
+
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint*_t
+#include <time.h>       // struct timespec
+
+#define JOURNAL_MAGIC "HAREJNL1"            // Identifies a journal file (no nul terminator on disk)
+#define JOURNAL_ENV_VAR "HARE_JOURNAL"      // Journal filename (see: read_settings())
+#define JOURNAL_INITIAL_SIZE 1048576        // Starting size of a new journal file
+#define JOURNAL_COMPACT_SIZE 4194304        // Compact once this many bytes precede or follow the checkpoint
+#define JOURNAL_GROUP_RECORDS 32            // Commit once this many records are pending...
+#define JOURNAL_GROUP_USEC 10000            // ...or once the oldest pending record is this old
+#define JOURNAL_FLAG_FOUND 0x01             // SCANNED: the file contained the NEEDLE
+#define JOURNAL_FLAG_FAILED 0x02            // MOVED: processing gave up on the file
+
+// Progress of a single message
+typedef enum _JournalState
+{
+    JOURNAL_RECEIVED = 1,  // Read from getINotifyData() (path is the source file)
+    JOURNAL_SCANNED = 2,   // Searched for the NEEDLE
+    JOURNAL_MOVED = 3      // Stamped into the process directory (path is the new filename)
+} JournalState;
+
+// On-disk journal file header
+typedef struct _JournalHeader
+{
+    char magic[8];        // JOURNAL_MAGIC
+    uint64_t checkpoint;  // Offset of the first record replay must read
+    uint64_t next_seq;    // Sequence number of the next message as of checkpoint
+    uint64_t reserved;    // Must be zero
+} JournalHeader;
+
+// On-disk record header (followed by path_len bytes of path, padded to 8 bytes)
+typedef struct _JournalRecord
+{
+    uint32_t crc;       // CRC-32 of everything in the record after this field
+    uint32_t length;    // Size of the whole record, in bytes
+    uint64_t seq;       // Message sequence number
+    uint8_t state;      // JournalState
+    uint8_t flags;      // JOURNAL_FLAG_* macros
+    uint16_t path_len;  // Number of bytes of path
+    uint32_t reserved;  // Must be zero
+} JournalRecord;
+
+// A message that was received but hasn't been moved
+typedef struct _JournalEntry
+{
+    uint64_t seq;        // Message sequence number
+    JournalState state;  // Latest recorded state
+    uint8_t flags;       // Flags from the latest record
+    char *source;        // Source filename (heap-allocated)
+} JournalEntry;
+
+// An open journal
+typedef struct _Journal
+{
+    char *filename;                 // Journal file (heap-allocated)
+    int fd;                         // File descriptor for filename
+    char *map;                      // Mapping of the whole file
+    size_t map_size;                // Size of the file and its mapping
+    size_t end;                     // Offset where the next record goes
+    size_t synced;                  // Everything before this offset is durable
+    uint64_t next_seq;              // Next message sequence number
+    size_t pending;                 // Records appended since the last commit
+    struct timespec first_pending;  // When the oldest pending record was appended
+    JournalEntry *in_flight;        // Messages without a MOVED record
+    size_t num_in_flight;           // Number of entries in in_flight
+    size_t in_flight_capacity;      // Number of entries allocated
+} Journal;
+
+
+/*
+ *  Record the next step for message seq.  The record is durable after the next journal_commit().
+ *  Arguments
+ *      journal - Open journal
+ *      seq - Sequence number from journal_begin()
+ *      state - JOURNAL_SCANNED or JOURNAL_MOVED
+ *      flags - JOURNAL_FLAG_* macros
+ *      path - New filename for JOURNAL_MOVED (may be NULL)
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int journal_append(Journal *journal, uint64_t seq, JournalState state, uint8_t flags, char *path);
+
+
+/*
+ *  Record that source was received and assign it a sequence number
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int journal_begin(Journal *journal, char *source, uint64_t *seq);
+
+
+/*
+ *  Commit every record pending in journal and free its resources
+ */
+void journal_close(Journal *journal);
+
+
+/*
+ *  Make pending records durable with a single msync().  Unless force is true, records are
+ *      left pending until JOURNAL_GROUP_RECORDS accumulate or the oldest is JOURNAL_GROUP_USEC
+ *      old.  Moves the checkpoint forward whenever nothing is in flight and compacts the
+ *      journal once JOURNAL_COMPACT_SIZE bytes precede or follow the checkpoint.
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int journal_commit(Journal *journal, bool force);
+
+
+/*
+ *  Atomically replace journal's file with one holding only the in-flight records
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int journal_compact(Journal *journal);
+
+
+/*
+ *  Open (or create) filename, replay the records after the checkpoint into journal->in_flight,
+ *      discard any torn record at the end, and compact the journal if needed
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int journal_open(Journal *journal, char *filename);
+
+
+#endif  // __HARE_JOURNAL__
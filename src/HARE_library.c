@@ -2,22 +2,43 @@
  *  Implements HARE_library.h functions in a standardized way.
  */
 
-#define _XOPEN_SOURCE 500  // Let's use nftw()
+#define _XOPEN_SOURCE 700  // Let's use nftw() (and st_mtim)
 #include <errno.h>         // errno
 #include <fcntl.h>         // fcntl(), F_GETFL, F_SETFL
 #include <ftw.h>           // nftw(), FTW macros
 #include <libgen.h>        // basename()
+#include <poll.h>          // poll()
+#include <signal.h>        // kill(), SIGKILL, SIGTERM
+#include <limits.h>        // INT_MAX
 #include <linux/limits.h>  // PATH_MAX
 #include <stdarg.h>        // va_end(), va_start()
+#include <stdint.h>        // int32_t, uint*_t
 #include <stdio.h>         // rename(), remove()
-#include <stdlib.h>        // calloc(), free()
+#include <stdlib.h>        // calloc(), free(), getenv(), strtoll()
 #include <string.h>        // strlen(), strstr()
+#include <sys/pidfd.h>     // pidfd_open(), pidfd_send_signal()
 #include <sys/types.h>
 #include <sys/stat.h>      // stat()
-#include <time.h>          // localtime(), time_t
+#include <time.h>          // localtime(), nanosleep(), time_t
 #include <unistd.h>        // close(), read()
-#include <sys/wait.h>      // waitpid(), W* macros
-#include "HARE_library.h"  // be_sure(), Configuration
+#include <sys/wait.h>      // waitid(), waitpid(), W* macros
+#include "HARE_arena.h"      // hare_calloc(), hare_free()
+#include "HARE_backlog.h"    // backlog_*(), BACKLOG_ENV_VAR
+#include "HARE_control.h"    // control_*(), control_socket, ControlSocket, CONTROL_ENV_VAR
+#include "HARE_fanotify.h"   // fan_watcher, fan_watcher_*(), FAN_WATCHER_ENV_VAR
+#include "HARE_filelog.h"    // filelog_flush(), filelog_write()
+#include "HARE_io.h"         // io_nftw(), io_remove(), io_stat()
+#include "HARE_journal.h"    // journal_*()
+#include "HARE_library.h"    // be_sure(), Configuration
+#include "HARE_logger.h"     // logger_vwrite(), logger_write()
+#include "HARE_logsink.h"    // logsink_active(), logsink_publish(), logsink_vpublish()
+#include "HARE_recorder.h"   // recorder_vwrite(), recorder_write()
+#include "HARE_retention.h"  // retention_init(), retention_parse(), retention_step()
+#include "HARE_ring.h"       // message_ring, ring_destroy(), ring_receive(), ring_wait()
+#include "HARE_stats.h"      // latency_stats, stats_*(), STATS_ENV_VAR
+#include "HARE_storage.h"    // clean_store(), dedupe_a_file(), digest_buffer(), get_shard_dir(), migrate_flat_dir()
+#include "HARE_supervisor.h" // supervisor_*(), worker_next(), SUPERVISOR_* macros
+#include "HARE_watcher.h"    // tree_watcher, watcher_*(), WATCHER_*ENV_VAR
 
 // An arbitrarily large maximum log message size has been chosen in an attempt to accommodate
 //  calls to logging functions that take variable length arguments and accept printf()-family
@@ -27,6 +48,23 @@
 
 #define PIPE_BUFF_SIZE 2048  // Size of the local buffer in read_a_pipe()
 
+// What write_result() writes ahead of the source and destination filenames
+typedef struct _ResultHeader
+{
+    int32_t status;            // stamp_a_file() results
+    uint8_t found;             // 1 if the file contained the NEEDLE
+    uint8_t reserved;          // Zero
+    uint16_t source_len;       // Bytes of source that follow
+    uint16_t destination_len;  // Bytes of destination that follow source
+} ResultHeader;
+
+// What _dispatch_backlog_file() needs to hand a backlog file to the workers
+typedef struct _BacklogDispatch
+{
+    Configuration *config;   // Processes the file in the daemon if no worker takes it
+    Supervisor *supervisor;  // Workers that own the files
+} BacklogDispatch;
+
 /*
  * Updated version of code grabbed from bsd syslog header. Reflects SURE values.
  * For reference (from: `man syslog`):
@@ -57,6 +95,10 @@ int pipe_fds[2] = {INVALID_FD, INVALID_FD};  // Intializing global externed vari
 char *base_filename = NULL;                  // Name of the file-based test case created by the test harness
 size_t base_filename_len = 0;                // Length of the base_filename
 char *processed_filename = NULL;             // Absolute filename of a file that matches on base_filename
+int result_fds[2] = {INVALID_FD, INVALID_FD};  // Only opened by a test harness
+static ShardLayout env_shard;                  // SHARD_ENV_VAR's layout (see: read_settings())
+static RetentionPolicy env_retention;          // RETENTION_ENV_VAR's policy (see: read_settings())
+static unsigned long dropped_results = 0;      // Outcomes write_result() couldn't send (e.g., a full pipe)
 
 /*************************************************************************************************/
 /**************************************** LOCAL FUNCTIONS ****************************************/
@@ -126,6 +168,36 @@ char *getPriorityString(int priority)
 }
 
 
+/*
+ *  Log msg with syslog(), reconnecting to the syslog daemon for this one message (the
+ *      fallback when the logger is off or unavailable)
+ */
+static void _syslog_it(int logLevel, char *msg)
+{
+    openlog(BINARY_NAME, LOG_PID, LOG_DAEMON);                        // System call returns void
+    // Log formatted msg
+    syslog(logLevel, "[%s] %s", getPriorityString(logLevel), msg);  // System call returns void
+    closelog();
+}
+
+
+/*
+ *  Log msg with the flight recorder and the logger (falling back to syslog()), but not the log sink
+ */
+static void _log_it(int logLevel, char *msg)
+{
+    int results = 0;  // Return value from logger_write()
+
+    recorder_write(logLevel, getPriorityString(logLevel), "%s", msg);  // In case the process dies first
+    // Queue it for the logger's writer thread (EAGAIN means it was dropped and counted)
+    results = logger_write(logLevel, getPriorityString(logLevel), "%s", msg);
+    if (0 != results && EAGAIN != results)
+    {
+        _syslog_it(logLevel, msg);  // The logger is off or unavailable
+    }
+}
+
+
 /*
  *  Perform input validation on behalf of the _*nul_file_match() functions
  *  Returns -1 on error, 0 otherwise
@@ -232,7 +304,7 @@ static int _file_match(const char *fpath, const struct stat *sb, int tflag, stru
             else if (!memcmp(fpath_base + (fpath_base_len - actual_len), local_base_file, actual_len))
             {
                 fpath_len = strlen(fpath);
-                processed_filename = calloc(fpath_len + 1, sizeof(char));
+                processed_filename = hare_calloc(fpath_len + 1, sizeof(char));
                 if (processed_filename)
                 {
                     if (processed_filename != memcpy(processed_filename, fpath, fpath_len))
@@ -247,7 +319,7 @@ static int _file_match(const char *fpath, const struct stat *sb, int tflag, stru
                 }
                 else
                 {
-                    syslog_errno(errno, "Call to calloc() inside _file_match() failed");
+                    syslog_errno(errno, "Call to hare_calloc() inside _file_match() failed");
                     results = -1;
                 }
             }
@@ -259,7 +331,7 @@ static int _file_match(const char *fpath, const struct stat *sb, int tflag, stru
     {
         if (processed_filename)
         {
-            free(processed_filename);
+            hare_free(processed_filename);
             processed_filename = NULL;
         }
     }
@@ -319,7 +391,7 @@ static int _non_nul_file_match(const char *fpath, const struct stat *sb, int tfl
             else if (!memcmp(fpath_base + (fpath_base_len - actual_len), base_filename, actual_len))
             {
                 fpath_len = strlen(fpath);
-                processed_filename = calloc(fpath_len + 1, sizeof(char));
+                processed_filename = hare_calloc(fpath_len + 1, sizeof(char));
                 if (processed_filename)
                 {
                     if (processed_filename != memcpy(processed_filename, fpath, fpath_len))
@@ -345,7 +417,7 @@ static int _non_nul_file_match(const char *fpath, const struct stat *sb, int tfl
     {
         if (processed_filename)
         {
-            free(processed_filename);
+            hare_free(processed_filename);
             processed_filename = NULL;
         }
     }
@@ -403,7 +475,7 @@ static int _nul_file_match(const char *fpath, const struct stat *sb, int tflag,
                 //  strlen(fpath) + 1 + base_filename_len - strlen(base_file_len) + 1, sizeof(char)
                 //  ...but, when it comes to memory, better to overshoot than undershoot.
                 new_buff_len = strlen(fpath) + 1 + base_filename_len;
-                processed_filename = calloc(new_buff_len + 1, sizeof(char));
+                processed_filename = hare_calloc(new_buff_len + 1, sizeof(char));
                 if (processed_filename)
                 {
                     if (processed_filename != memcpy(processed_filename, fpath, new_buff_len))
@@ -433,7 +505,7 @@ static int _nul_file_match(const char *fpath, const struct stat *sb, int tflag,
     {
         if (processed_filename)
         {
-            free(processed_filename);
+            hare_free(processed_filename);
             processed_filename = NULL;
         }
     }
@@ -490,7 +562,7 @@ int _file_matching(char *dirname, char *filename, size_t filename_len)
     int flags = FTW_DEPTH | FTW_PHYS;  // See: man nftw
 
     // DIRWALK
-    results = nftw(dirname, _file_match, 4, flags);
+    results = io_nftw(dirname, _file_match, 4, flags);
 
     // VERIFY RESULTS
     if (processed_filename)
@@ -530,7 +602,7 @@ int _nul_file_matching(char *dirname, char *filename, size_t filename_len)
     int flags = FTW_DEPTH | FTW_PHYS;  // See: man nftw
 
     // DIRWALK
-    results = nftw(dirname, _nul_file_match, 4, flags);
+    results = io_nftw(dirname, _nul_file_match, 4, flags);
 
     // VERIFY RESULTS
     if (processed_filename)
@@ -569,7 +641,7 @@ int _non_nul_file_matching(char *dirname, char *filename, size_t filename_len)
     int flags = FTW_DEPTH | FTW_PHYS;  // See: man nftw
 
     // DIRWALK
-    results = nftw(dirname, _non_nul_file_match, 4, flags);
+    results = io_nftw(dirname, _non_nul_file_match, 4, flags);
 
     // VERIFY RESULTS
     if (processed_filename)
@@ -596,6 +668,493 @@ int _non_nul_file_matching(char *dirname, char *filename, size_t filename_len)
 }
 
 
+/*
+ *  Determine which existing shard of haystack_dir stamp_a_file() would have moved needle_file
+ *      into.  Only hash-prefixed layouts can answer this without a datetime stamp.  Mirrors
+ *      _file_match() by ignoring leading '/' characters.
+ *  Returns a heap-allocated directory (see: hare_free()) on success, NULL if the shard is unknown
+ */
+static char *_find_needle_shard(char *haystack_dir, char *needle_file)
+{
+    // LOCAL VARIABLES
+    char *shard_dir = NULL;           // Return value
+    char *needle_base = needle_file;  // needle_file's base filename
+    int errnum = 0;                   // Out parameter for get_shard_dir()
+
+    // INPUT VALIDATION
+    if (shard_layout && SHARD_HASH == shard_layout->scheme)
+    {
+        if (strrchr(needle_file, '/'))
+        {
+            needle_base = strrchr(needle_file, '/') + 1;
+        }
+
+        // FIND IT
+        if (*needle_base)
+        {
+            shard_dir = get_shard_dir(haystack_dir, NULL, needle_base, false, &errnum);
+            if (shard_dir && 1 != verify_directory(shard_dir))
+            {
+                hare_free(shard_dir);  // Never created so it can't hold needle_file
+                shard_dir = NULL;
+            }
+        }
+    }
+
+    // DONE
+    return shard_dir;
+}
+
+
+/*
+ *  Search the contents of haystack_file (as read_file() reads them) for the needle substring
+ *      and, if digest isn't NULL, compute the digest of those same contents for dedupe_a_file()
+ *  Arguments
+ *      haystack_file - File to search
+ *      needle - Substring to search for
+ *      digest - Out parameter: digest of haystack_file's contents (may be NULL)
+ *      digested - Out parameter: true if digest holds every byte of haystack_file (may be NULL).
+ *          Contents that read_file() cut short (e.g., at a nul byte) are never digested: two
+ *          different files would share a digest.
+ *  Returns true if found, false otherwise (or on error)
+ */
+static bool _search_and_digest(char *haystack_file, char *needle, uint8_t digest[STORE_DIGEST_SIZE], bool *digested)
+{
+    // LOCAL VARIABLES
+    bool found_it = false;       // Return value: true if found, false otherwise (or on error)
+    bool keep_going = false;     // Flow control
+    char *file_contents = NULL;  // Return value from call to read_file()
+    size_t contents_len = 0;     // Length of file_contents
+    struct stat haystack_stat;   // haystack_file's size
+
+    // INPUT VALIDATION
+    if (digested)
+    {
+        *digested = false;
+    }
+    if (haystack_file && *haystack_file && needle && *needle)
+    {
+        keep_going = true;
+    }
+
+    // DO IT
+    // Read the file
+    if (true == keep_going)
+    {
+        file_contents = read_file(haystack_file);
+        if (!file_contents)
+        {
+            keep_going = false;
+        }
+    }
+    // Search the contents
+    if (true == keep_going)
+    {
+        if (strstr(file_contents, needle))
+        {
+            found_it = true;
+            syslog_it2(LOG_NOTICE, "Found the needle %s in %s", needle, haystack_file);
+        }
+        else
+        {
+            syslog_it2(LOG_INFO, "Failed to find the needle %s in %s", needle, haystack_file);
+        }
+    }
+    // Digest the same contents
+    if (true == keep_going && digest && digested)
+    {
+        contents_len = strlen(file_contents);
+        if (0 == io_stat(haystack_file, &haystack_stat) && contents_len == (size_t)haystack_stat.st_size)
+        {
+            *digested = (0 == digest_buffer(file_contents, contents_len, digest));
+        }
+        else
+        {
+            syslog_it2(LOG_INFO, "Not deduplicating %s: its contents weren't read in full", haystack_file);
+        }
+    }
+
+    // CLEANUP
+    if (file_contents)
+    {
+        hare_free(file_contents);
+        file_contents = NULL;
+    }
+
+    // DONE
+    return found_it;
+}
+
+
+/*
+ *  Search filename for the NEEDLE, stamp it into the process directory, and deduplicate it
+ *      (if configured), recording each step in journal (if not NULL)
+ *  Arguments
+ *      config - Daemon configuration
+ *      filename - File to process
+ *      journal - Open journal or NULL
+ *      seq - Sequence number of an in-flight message being recovered, 0 for a new message
+ *  Returns the results of stamp_a_file(): 0 on success, -1 on bad input, errno on failure
+ */
+static int _process_a_file(Configuration *config, char *filename, Journal *journal, uint64_t seq)
+{
+    // LOCAL VARIABLES
+    int success = 0;                            // Return value from stamp_a_file()
+    bool found = false;                         // Did the file contain the NEEDLE?
+    bool digested = false;                      // Was digest calculated for filename?
+    uint8_t digest[STORE_DIGEST_SIZE] = { 0 };  // Content digest for deduplication
+    bool journaled = false;                     // Is this message in the journal?
+    struct stat landed;                         // filename's stat() (its mtime is when it landed)
+    bool timing = false;                        // Is filename's landing time known?
+    uint64_t started = 0;                       // When the current stage started (see: stats_now())
+    int errnum = 0;                             // Return value from write_result()
+
+    // TIME IT
+    if (latency_stats && 0 == io_stat(filename, &landed))
+    {
+        timing = true;
+        stats_record(STATS_QUEUE_WAIT, stats_age(&landed.st_mtim));
+    }
+
+    // JOURNAL IT
+    if (journal)
+    {
+        journaled = (0 != seq || 0 == journal_begin(journal, filename, &seq));
+    }
+
+    // SEARCH FILE
+    started = stats_now();
+    if (config->inotify_config.store)
+    {
+        // Hash the contents read_file() read for the search instead of reading the file again
+        found = _search_and_digest(filename, NEEDLE, digest, &digested);
+    }
+    else
+    {
+        found = search_a_file(filename, NEEDLE);
+    }
+    stats_record(STATS_SEARCH, stats_now() - started);
+    if (true == found)
+    {
+        syslog_it2(LOG_INFO, "Found the %s needle in the file %s", NEEDLE, filename);
+    }
+    if (true == journaled)
+    {
+        journal_append(journal, seq, JOURNAL_SCANNED, true == found ? JOURNAL_FLAG_FOUND : 0, NULL);
+    }
+
+    // STAMP FILE
+    // syslog_it2(LOG_DEBUG, "Main: Received %s", filename);  // DEBUGGING
+    started = stats_now();
+    success = stamp_a_file(filename, config->inotify_config.process);
+    stats_record(STATS_STAMP, stats_now() - started);
+    // syslog_it2(LOG_DEBUG, "The call to stamp_a_file() returned %d.", success);  // DEBUGGING
+    if (0 != success)
+    {
+        syslog_errno(success, "The call to stamp_a_file() failed");
+    }
+    else if (true == digested && processed_filename)
+    {
+        // DEDUPLICATE FILE
+        dedupe_a_file(processed_filename, config->inotify_config.store, digest);
+    }
+    if (INVALID_FD != result_fds[PIPE_WRITE])
+    {
+        // Tell the test harness exactly where it went
+        errnum = write_result(result_fds[PIPE_WRITE], filename, 0 == success ? processed_filename : NULL, found, success);
+        if (0 != errnum)
+        {
+            dropped_results++;
+            syslog_it2(LOG_WARNING, "Unable to report on %s to the test harness (error %d, %lu reports dropped)",
+                       filename, errnum, dropped_results);
+        }
+    }
+    if (true == journaled)
+    {
+        // A failure is final too: the file stays where it is instead of being retried forever
+        journal_append(journal, seq, JOURNAL_MOVED, 0 == success ? 0 : JOURNAL_FLAG_FAILED,
+                       0 == success ? processed_filename : NULL);
+    }
+    if (true == timing)
+    {
+        stats_record(STATS_END_TO_END, stats_age(&landed.st_mtim));
+    }
+
+    // DONE
+    return success;
+}
+
+
+/*
+ *  Release everything the last message allocated from message_arena (including
+ *      processed_filename, if it came from there)
+ */
+static void _end_message(void)
+{
+    if (true == arena_owns(message_arena, processed_filename))
+    {
+        processed_filename = NULL;  // Its lifetime ends with this message
+    }
+    arena_reset(message_arena);
+}
+
+
+/*
+ *  Resolve every message journal says was in flight when the last daemon stopped.  Messages
+ *      whose source file is gone were already moved so they only need a MOVED record.  The
+ *      rest are processed again.  Does not validate input.
+ */
+static void _recover_in_flight(Configuration *config, Journal *journal)
+{
+    // LOCAL VARIABLES
+    size_t num_recover = journal->num_in_flight;  // Number of messages to recover
+    char source[PATH_MAX + 1] = { 0 };            // Copy of the current entry's source
+    uint64_t seq = 0;                             // Current entry's sequence number
+    size_t i = 0;                                 // Iterating variable
+
+    // RECOVER IT
+    // Resolving an entry removes it from in_flight so always take the first one
+    for (i = 0; i < num_recover && journal->num_in_flight > 0; i++)
+    {
+        seq = journal->in_flight[0].seq;
+        strncpy(source, journal->in_flight[0].source, PATH_MAX);
+        if (1 == verify_filename(source))
+        {
+            syslog_it2(LOG_INFO, "Recovering in-flight message %llu: %s", (unsigned long long)seq, source);
+            _process_a_file(config, source, journal, seq);
+            _end_message();
+        }
+        else
+        {
+            journal_append(journal, seq, JOURNAL_MOVED, 0, NULL);
+        }
+    }
+    journal_commit(journal, true);
+}
+
+
+/*
+ *  Implements a BacklogCallback that processes one backlog file with a config context.
+ *      Backlog files aren't journaled: they're still in the watched directory if the
+ *      drain is interrupted, so the next startup's drain finds them again.
+ *  Returns the results of _process_a_file()
+ */
+static int _process_backlog_file(char *filename, void *context)
+{
+    // LOCAL VARIABLES
+    int success = _process_a_file((Configuration *)context, filename, NULL, 0);  // Return value
+
+    // CLEANUP
+    _end_message();
+
+    // DONE
+    return success;
+}
+
+
+/*
+ *  Implements a BacklogCallback that sends one backlog file to the worker that owns it.  Like
+ *      execute_order(), the daemon processes the file itself if no worker will take it.
+ *  Returns the results of supervisor_dispatch() or _process_backlog_file()
+ */
+static int _dispatch_backlog_file(char *filename, void *context)
+{
+    // LOCAL VARIABLES
+    BacklogDispatch *dispatch = (BacklogDispatch *)context;              // Daemon and its workers
+    int success = supervisor_dispatch(dispatch->supervisor, filename);  // Return value
+
+    // FALL BACK
+    if (0 != success)
+    {
+        success = _process_backlog_file(filename, dispatch->config);
+    }
+
+    // DONE
+    return success;
+}
+
+
+/*
+ *  Wait up to timeout_ms (forever if it's negative) for daemon_pid to exit, without reaping it.
+ *      Polls pidfd or, if it's INVALID_FD, checks waitid() every millisecond.
+ *  Returns true if it exited, false if it's still running
+ */
+static bool _await_exit(pid_t daemon_pid, int pidfd, int timeout_ms)
+{
+    // LOCAL VARIABLES
+    bool exited = false;                                     // Return value
+    struct pollfd waiting = { pidfd, POLLIN, 0 };            // Readable once daemon_pid exits
+    uint64_t deadline = stats_now() + (uint64_t)timeout_ms * 1000000;  // When to give up
+    int64_t remaining = timeout_ms;                          // Milliseconds left
+    siginfo_t info;                                          // Out parameter for waitid()
+    struct timespec nap = { 0, 1000000 };                    // Between waitid() checks
+    int ready = 0;                                           // Return value from poll()
+
+    // WAIT
+    while (false == exited && (timeout_ms < 0 || remaining >= 0))
+    {
+        if (INVALID_FD != pidfd)
+        {
+            ready = poll(&waiting, 1, timeout_ms < 0 ? -1 : (int)remaining);
+            if (0 < ready)
+            {
+                exited = true;
+            }
+            else if (-1 == ready && EINTR != errno)
+            {
+                pidfd = INVALID_FD;  // Fall back to waitid()
+            }
+        }
+        else
+        {
+            memset(&info, 0, sizeof(info));
+            if (0 != waitid(P_PID, daemon_pid, &info, WEXITED | WNOHANG | WNOWAIT) || daemon_pid == info.si_pid)
+            {
+                exited = true;  // waitpid() will report errors
+            }
+            else
+            {
+                nanosleep(&nap, NULL);
+            }
+        }
+        if (timeout_ms >= 0)
+        {
+            remaining = stats_now() < deadline ? (int64_t)((deadline - stats_now()) / 1000000) : -1;
+        }
+    }
+
+    // DONE
+    return exited;
+}
+
+
+/*
+ *  Send signum to daemon_pid (through pidfd, if it's not INVALID_FD) and the rest of its process
+ *      group (daemonize() made it a group leader so its workers are in there too)
+ */
+static void _signal_daemon(pid_t daemon_pid, int pidfd, int signum)
+{
+    if (INVALID_FD == pidfd || 0 != pidfd_send_signal(pidfd, signum, NULL, 0))
+    {
+        kill(daemon_pid, signum);
+    }
+    // It isn't reaped yet so its process group ID can't have been reused
+    kill(-daemon_pid, signum);
+}
+
+
+/*
+ *  Body of a worker process (see: WorkerMain).  Processes every filename the supervisor sends
+ *      into the worker's shard of the process directory, journaling to its own journal file.
+ *  Returns the number of files that failed
+ */
+static int _run_worker(int worker, int read_fd, char *shard_dir, void *context)
+{
+    // LOCAL VARIABLES
+    Configuration worker_config = *(Configuration *)context;  // The daemon's configuration for this shard
+    WorkerInbox inbox = { 0 };                                // Filenames from the supervisor
+    Journal journal = { 0 };                                  // This worker's journal
+    bool journaling = false;                                  // Is the journal active?
+    char journal_name[PATH_MAX + 1] = { 0 };                  // This worker's journal file
+    char *filename = NULL;                                    // Next filename to process
+    int errnum = 0;                                           // Errno value from worker_next()
+    int failures = 0;                                         // Return value
+
+    // SETUP
+    // Only the daemon takes messages: drop its watchers, message transport, and control socket
+    watcher_destroy(tree_watcher);
+    tree_watcher = NULL;
+    fan_watcher_destroy(fan_watcher);
+    fan_watcher = NULL;
+    ring_destroy(message_ring);
+    message_ring = NULL;
+    if (pipe_fds[PIPE_READ] > INVALID_FD)
+    {
+        close(pipe_fds[PIPE_READ]);
+        pipe_fds[PIPE_READ] = INVALID_FD;
+    }
+    control_detach(control_socket);
+    control_socket = NULL;
+    worker_config.inotify_config.process = shard_dir;
+    inbox.read_fd = read_fd;
+    if (worker_config.inotify_config.journal
+        && sizeof(journal_name) > snprintf(journal_name, sizeof(journal_name), "%s.%d",
+                                           worker_config.inotify_config.journal, worker))
+    {
+        journaling = (0 == journal_open(&journal, journal_name));
+    }
+    if (true == journaling)
+    {
+        _recover_in_flight(&worker_config, &journal);  // e.g., this worker's predecessor crashed
+    }
+
+    // WORK
+    while ((filename = worker_next(&inbox, &errnum)))
+    {
+        if (1 != verify_filename(filename))
+        {
+            // e.g., a backlog file's live event, queued behind the backlog entry that moved it
+            syslog_it2(LOG_DEBUG, "Dropping a duplicate filename for %s", filename);
+        }
+        else if (0 != _process_a_file(&worker_config, filename, journaling ? &journal : NULL, 0))
+        {
+            failures++;
+        }
+        hare_free(filename);
+        _end_message();
+        if (true == journaling)
+        {
+            journal_commit(&journal, false == inbox.waiting);  // Don't leave a group waiting while blocked
+        }
+    }
+    if (errnum)
+    {
+        syslog_errno(errnum, "Worker %d stopped reading filenames", worker);
+    }
+
+    // CLEANUP
+    if (true == journaling)
+    {
+        journal_close(&journal);
+    }
+
+    // DONE
+    return failures;
+}
+
+
+/*
+ *  Parse env_var's value (if it's set) as a whole number from 0 through max into *number
+ *  Returns 0 on success (or if env_var isn't set), EINVAL if the value is malformed
+ */
+static int _read_number(char *env_var, long long max, long long *number)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                 // 0 on success, EINVAL on failure
+    char *value = getenv(env_var);  // Value of env_var
+    char *end = NULL;               // End of the number
+    long long parsed = 0;           // value, parsed
+
+    // PARSE IT
+    if (value && *value)
+    {
+        parsed = strtoll(value, &end, 10);
+        if (end == value || *end || parsed < 0 || parsed > max)
+        {
+            errnum = EINVAL;
+            syslog_it2(LOG_ERR, "%s must be a number from 0 through %lld, not %s", env_var, max, value);
+        }
+        else
+        {
+            *number = parsed;
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
 int redirectStdStreams()
 {
     int status = 0;                  // Return value
@@ -751,7 +1310,7 @@ int delete_file(char *filename)
     // DELETE IT
     if (1 == results)
     {
-        results = remove(filename);
+        results = io_remove(filename);
         if (results)
         {
             errnum = errno;
@@ -827,7 +1386,7 @@ int empty_dir(char *dirname)
     // EMPTY DIR
     if (0 == success)
     {
-        success = nftw(dirname, _delete_file, 1, flags);
+        success = io_nftw(dirname, _delete_file, 1, flags);
     }
 
     // DONE
@@ -838,7 +1397,132 @@ int empty_dir(char *dirname)
 void execute_order(Configuration *config)
 {
     // LOCAL VARIABLES
-    int success = 0;  // Holds return value from getInotifyData()
+    int success = 0;           // Holds return value from getInotifyData()
+    Arena arena = { 0 };       // Per-message arena: reset after each message
+    MessagePool pool = { 0 };  // Recycled Message buffers for read_a_pipe()
+    RetentionEngine retention = { 0 };  // Evicts old files from the process directory
+    bool retaining = false;             // Is retention active?
+    Journal journal = { 0 };            // Write-ahead processing journal
+    bool journaling = false;            // Is the journal active?
+    Backlog backlog = { 0 };            // Files already in the watched directory at startup
+    char *skip_dirs[2] = { config->inotify_config.process, config->inotify_config.store };  // Not backlog
+    int failures = 0;                   // Backlog files that failed
+    int removed = 0;                    // Unreferenced objects clean_store() removed
+    Watcher watcher = { 0 };            // Recursive inotify watcher for the watched directory
+    bool watching = false;              // Is the watcher active?
+    FanWatcher fan = { 0 };             // Filesystem-wide fanotify watcher for the watched directory
+    bool fanning = false;               // Is the fanotify watcher active?
+    Supervisor supervisor;              // Worker processes that share the messages
+    bool supervising = false;           // Are the workers active?
+    BacklogDispatch dispatch = { 0 };   // Hands the backlog to the workers
+    LatencyStats stats;                 // Per-stage latency histograms
+    bool measuring = false;             // Are the histograms active?
+    uint64_t intake_started = 0;        // When the current getINotifyData() call started
+    ControlSocket control = { 0 };      // Live introspection and commands (counts even if closed)
+    bool controlling = false;           // Is the control socket active?
+
+    // SETUP MEMORY
+    // Failures are not fatal: the library falls back to the heap
+    if (0 == arena_init(&arena, ARENA_DEFAULT_SIZE))
+    {
+        message_arena = &arena;
+    }
+    if (0 == pool_init(&pool, PIPE_BUFF_SIZE + 1, MESSAGE_POOL_SLOTS))
+    {
+        message_pool = &pool;
+    }
+    shard_layout = config->inotify_config.shard;
+    if (shard_layout && SHARD_FLAT != shard_layout->scheme)
+    {
+        // Files a flat (or differently sharded) daemon left directly in the process directory
+        migrate_flat_dir(config->inotify_config.process);
+    }
+    if (config->inotify_config.store && 1 == verify_directory(config->inotify_config.store))
+    {
+        // Objects orphaned by files that were deleted (or a dedupe that was interrupted) since the last run
+        removed = clean_store(config->inotify_config.store);
+        if (removed > 0)
+        {
+            syslog_it2(LOG_INFO, "Removed %d unreferenced objects from %s", removed, config->inotify_config.store);
+        }
+    }
+    if (config->inotify_config.retention)
+    {
+        retaining = (0 == retention_init(&retention, config->inotify_config.process,
+                                         config->inotify_config.retention));
+    }
+    if (config->inotify_config.journal && config->inotify_config.workers <= 1)
+    {
+        // Workers keep their own journals (see: _run_worker())
+        journaling = (0 == journal_open(&journal, config->inotify_config.journal));
+    }
+    if (config->inotify_config.stats)
+    {
+        // Set up before any process is forked so backlog and supervisor workers share the shards
+        measuring = (0 == stats_open(&stats, config->inotify_config.stats));
+        latency_stats = measuring ? &stats : NULL;
+    }
+    if (true == config->inotify_config.fanotify)
+    {
+        fanning = (0 == fan_watcher_init(&fan, config->inotify_config.watched, skip_dirs, 2));
+        fan_watcher = fanning ? &fan : NULL;
+    }
+    if (true == config->inotify_config.recursive && false == fanning)
+    {
+        watching = (0 == watcher_init(&watcher, config->inotify_config.watched,
+                                      config->inotify_config.max_watches, skip_dirs, 2));
+        tree_watcher = watching ? &watcher : NULL;
+    }
+
+    // RECOVER
+    // Finish whatever a previous daemon left in flight before taking new messages
+    if (true == journaling)
+    {
+        _recover_in_flight(config, &journal);
+    }
+
+    // START THE WORKERS
+    // If they can't be started, the daemon processes messages itself
+    if (config->inotify_config.workers > 1)
+    {
+        supervising = (0 == supervisor_start(&supervisor, config->inotify_config.workers,
+                                             config->inotify_config.process, _run_worker, config));
+    }
+
+    // DRAIN THE BACKLOG
+    // The pipe (and watcher) are already armed so events that arrive in the meantime wait there.
+    // With workers running, the backlog goes to them like any other message so every file
+    // lands in its owner's shard.
+    if (config->inotify_config.backlog_workers > 0
+        && 0 < backlog_scan(&backlog, config->inotify_config.watched, skip_dirs, 2))
+    {
+        if (true == supervising)
+        {
+            dispatch.config = config;
+            dispatch.supervisor = &supervisor;
+            failures = backlog_drain(&backlog, 1, _dispatch_backlog_file, &dispatch);
+        }
+        else
+        {
+            failures = backlog_drain(&backlog, config->inotify_config.backlog_workers, _process_backlog_file,
+                                     config);
+        }
+        syslog_it2(LOG_INFO, "Drained %zu backlog files from %s with %d failures",
+                   backlog.num_files, config->inotify_config.watched, failures);
+    }
+
+    // OPEN THE CONTROL SOCKET
+    if (config->inotify_config.control)
+    {
+        controlling = (0 == control_open(&control, config->inotify_config.control, config));
+    }
+    if (true == controlling)
+    {
+        control.journal = journaling ? &journal : NULL;
+        control.supervisor = supervising ? &supervisor : NULL;
+        control.retention = retaining ? &retention : NULL;
+        control_socket = &control;  // Restarted workers close their copy (see: _run_worker())
+    }
 
     // EXECUTE ORDER 66
     // syslog_it(LOG_DEBUG, "Starting execute_order() while loop...");  // DEBUGGING
@@ -846,49 +1530,119 @@ void execute_order(Configuration *config)
     {
         // syslog_it(LOG_DEBUG, "Top of the execute_order() while loop...");  // DEBUGGING
         // Retrieve the latest data from the message queue
-        success = getINotifyData(config);  // TD: DDN... Implement this function with shared pipes between the test harness
+        intake_started = stats_now();
+        if (true == controlling && true == control.paused)
+        {
+            success = 0;  // Leave messages where they are until a client resumes intake
+        }
+        else
+        {
+            success = getINotifyData(config);  // TD: DDN... Implement this function with shared pipes between the test harness
+        }
         // Returns 0 on success, -1 on error, and errnum on failure
         // syslog_it2(LOG_DEBUG, "Call to getINotifyData() returned %d", success);  // DEBUGGING
         if (0 == success)
         {
             if (config->inotify_message.message.buffer && config->inotify_message.message.size > 0)
             {
-                // SEARCH FILE
-                if (true == search_a_file(config->inotify_message.message.buffer, NEEDLE))
+                stats_record(STATS_INTAKE, stats_now() - intake_started);
+                control.counters.received++;
+                if (true == backlog_contains(&backlog, config->inotify_message.message.buffer)
+                    && 1 != verify_filename(config->inotify_message.message.buffer))
                 {
-                    syslog_it2(LOG_INFO, "Found the %s needle in the file %s", NEEDLE, config->inotify_message.message.buffer);
+                    // The backlog drain already took care of it
+                    syslog_it2(LOG_DEBUG, "Dropping a duplicate event for %s", config->inotify_message.message.buffer);
+                    control.counters.duplicates++;
                 }
-
-                // STAMP FILE
-                // syslog_it2(LOG_DEBUG, "Main: Received %s", config->inotify_message.message.buffer);  // DEBUGGING
-                // Received data, now add it to the jobs queue for the threadpool
-                // thpool_add_work(threadPool, execRunner, allocContext(config, context));
-                success = stamp_a_file(config->inotify_message.message.buffer, config->inotify_config.process);
-                // syslog_it2(LOG_DEBUG, "The call to stamp_a_file() returned %d.", success);  // DEBUGGING
-                if (0 != success)
+                else if (true == supervising
+                         && 0 == supervisor_dispatch(&supervisor, config->inotify_message.message.buffer))
                 {
-                    syslog_errno(success, "The call to stamp_a_file() failed");
+                    // The worker that owns this filename will process it
+                    control.counters.dispatched++;
+                }
+                else
+                {
+                    // Received data, now add it to the jobs queue for the threadpool
+                    // thpool_add_work(threadPool, execRunner, allocContext(config, context));
+                    if (0 != _process_a_file(config, config->inotify_message.message.buffer,
+                                             journaling ? &journal : NULL, 0))
+                    {
+                        control.counters.failed++;
+                    }
+                    control.counters.processed++;
                 }
-                // syslog_it(LOG_DEBUG, "The call to stamp_a_file() returned");  // DEBUGGING
 
                 // Cleanup
-                free(config->inotify_message.message.buffer);
+                hare_free(config->inotify_message.message.buffer);
                 config->inotify_message.message.buffer = NULL;
                 config->inotify_message.message.size = 0;
-                break;
+                _end_message();  // Release everything this message allocated
+                if (true == retaining)
+                {
+                    retention_step(&retention);  // Bounded by the policy's CPU budget
+                }
+                stats_tick(latency_stats);
+                if (true == controlling)
+                {
+                    control_service(&control);  // Answer clients between messages (one accept4() if none)
+                }
             }
             else
             {
                 // No data available. Sleep for a brief moment and try again.
                 // syslog_it(LOG_DEBUG, "Call to getINotifyData() provided no data.");  // DEBUGGING
-                sleep(1);
-                // syslog_it(LOG_DEBUG, "Exiting (until the test harness' getINotifyData() is implemented).");  // TD: DDN... remove once getINotifyData() is implemented
-                // break;  // TD: DDN... remove once getINotifyData() is implemented
+                if (true == retaining)
+                {
+                    retention_step(&retention);  // Use the idle time
+                }
+                if (true == journaling)
+                {
+                    journal_commit(&journal, false);  // Don't leave a group waiting on the next message
+                }
+                if (true == supervising)
+                {
+                    supervisor_check(&supervisor);  // Restart crashed workers
+                }
+                stats_tick(latency_stats);  // Publish a snapshot at most once a second
+                filelog_flush();  // Don't leave buffered log lines waiting on the next message
+                if (true == controlling)
+                {
+                    control_service(&control);  // Answer clients while idle
+                }
+                if (true == controlling && true == control.paused)
+                {
+                    control_wait(&control, INVALID_FD, 1000);  // Only a client can end the pause
+                }
+                else if (message_ring)
+                {
+                    // Sleep on the ring's doorbell (and the watcher, if any)
+                    ring_wait(message_ring, fanning ? fan.fd : watching ? watcher.fd : INVALID_FD, 1000);
+                }
+                else if (true == fanning)
+                {
+                    fan_watcher_wait(&fan, pipe_fds[PIPE_READ], 1000);  // Wake up for the next event
+                }
+                else if (true == watching)
+                {
+                    watcher_wait(&watcher, pipe_fds[PIPE_READ], 1000);  // Wake up for the next event
+                }
+                else if (true == controlling)
+                {
+                    control_wait(&control, pipe_fds[PIPE_READ], 1000);  // Wake up for a message or a client
+                }
+                else
+                {
+                    sleep(1);
+                }
             }
         }
         else
         {
-            if (0 < success)
+            if (EPIPE == success)
+            {
+                syslog_it(LOG_INFO, "The test harness closed the message transport.  Exiting.");
+            }
+            else if (0 < success)
             {
                 syslog_errno(success, "Call to getINotifyData() failed");
             }
@@ -900,6 +1654,52 @@ void execute_order(Configuration *config)
             break;  // Yes
         }
     }
+
+    // CLEANUP
+    if (true == controlling)
+    {
+        control_socket = NULL;
+        control_close(&control);
+    }
+    if (true == supervising)
+    {
+        // Let the workers finish everything they were sent
+        failures = supervisor_stop(&supervisor);
+        if (failures > 0)
+        {
+            syslog_it2(LOG_ERR, "%d workers failed to process all of their files", failures);
+        }
+    }
+    if (true == arena_owns(message_arena, processed_filename))
+    {
+        processed_filename = NULL;
+    }
+    message_arena = NULL;
+    message_pool = NULL;
+    shard_layout = NULL;
+    tree_watcher = NULL;
+    fan_watcher = NULL;
+    latency_stats = NULL;
+    retention_destroy(&retention);
+    backlog_destroy(&backlog);
+    if (true == journaling)
+    {
+        journal_close(&journal);
+    }
+    if (true == watching)
+    {
+        watcher_destroy(&watcher);
+    }
+    if (true == fanning)
+    {
+        fan_watcher_destroy(&fan);
+    }
+    if (true == measuring)
+    {
+        stats_close(&stats);  // Final snapshot
+    }
+    arena_destroy(&arena);
+    pool_destroy(&pool);
 }
 
 
@@ -936,7 +1736,7 @@ char *get_datetime_stamp(int *errnum)
 
         // STAMP IT
         // Allocate
-        stamp = calloc(stamp_len + 1, sizeof(char));
+        stamp = hare_calloc(stamp_len + 1, sizeof(char));
 
         if (!stamp)
         {
@@ -947,7 +1747,7 @@ char *get_datetime_stamp(int *errnum)
                                        time.tm_hour, time.tm_min, time.tm_sec))
         {
             *errnum = errno;
-            free(stamp);
+            hare_free(stamp);
             stamp = NULL;
         }
     }
@@ -971,15 +1771,47 @@ int getINotifyData(Configuration *config)
         success = 0;
     }
 
+    // WATCH IT
+    // Events from a watcher come first; the pipe remains the test harness' injection point
+    if (0 == success && (tree_watcher || fan_watcher))
+    {
+        if (tree_watcher)
+        {
+            watcher_next(tree_watcher, &data);
+        }
+        else
+        {
+            fan_watcher_next(fan_watcher, &data);
+        }
+        if (data)
+        {
+            config->inotify_message.message.buffer = data;
+            config->inotify_message.message.size = strlen(data);
+            data = NULL;
+            success = 1;  // Skip the pipe
+        }
+    }
+
     // GET IT
     if (0 == success)
     {
         // syslog_it(LOG_DEBUG, "About to call read_a_pipe()...");  // DEBUGGING
-        data = read_a_pipe(pipe_fds[PIPE_READ], &msg_len, &errnum);
+        if (message_ring)
+        {
+            data = ring_receive(message_ring, &msg_len, &errnum);  // Shared-memory transport
+        }
+        else
+        {
+            data = read_a_pipe(pipe_fds[PIPE_READ], &msg_len, &errnum);
+        }
         // syslog_it(LOG_DEBUG, "The call to read_a_pipe() completed.");  // DEBUGGING
         // syslog_it2(LOG_DEBUG, "The untested call to read_a_pipe() returned %s", data);  // DEBUGGING
 
-        if (errnum)
+        if (EPIPE == errnum)
+        {
+            success = errnum;  // The test harness is done sending
+        }
+        else if (errnum)
         {
             success = errnum;
             syslog_errno(errnum, "The call to read_a_pipe() failed.");
@@ -1002,6 +1834,10 @@ int getINotifyData(Configuration *config)
             config->inotify_message.message.size = msg_len;
         }
     }
+    else if (1 == success)
+    {
+        success = ENOERR;
+    }
 
     // DONE
     return success;
@@ -1014,30 +1850,23 @@ bool isRootUser()
 }
 
 
-void log_it(char *log_entry, char *log_filename)
+int get_errno(void)
 {
-    // LOCAL VARIABLES
-    FILE *fp = NULL;
+    return errno ? errno : EIO;
+}
+
 
+void log_it(char *log_entry, char *log_filename)
+{
     // INPUT VALIDATION
-    if (log_filename && *log_filename)
+    if (log_filename && *log_filename && log_entry)
     {
-        fp = fopen("source07_log.txt", "a");
-        
         // WRITE IT
-        if (fp && log_entry)
-        {
-            fputs(log_entry, fp);
-            fputs("\n", fp);  // Add a newline
-        }
+        // Buffered on a persistent descriptor, so AFL DEBUGGING lines don't skew exec timing
+        filelog_write(log_filename, log_entry);
     }
-    
+
     // DONE
-    if (fp)
-    {
-        fclose(fp);
-        fp = NULL;
-    }
     return;
 }
 
@@ -1217,6 +2046,11 @@ char *read_a_pipe(int read_fd, int *msg_len, int *errnum)
         }
         else if (0 == read_retval)
         {
+            if (0 == read_count)
+            {
+                *errnum = EPIPE;  // Every writer closed its end and the pipe is drained
+                success = false;
+            }
             break;  // End of file
         }
         else
@@ -1229,7 +2063,7 @@ char *read_a_pipe(int read_fd, int *msg_len, int *errnum)
     // COPY DATA
     if (true == success)
     {
-        retval = calloc(read_count + 1, sizeof(char));
+        retval = hare_message_alloc(read_count + 1);
 
         if (!retval)
         {
@@ -1252,7 +2086,7 @@ char *read_a_pipe(int read_fd, int *msg_len, int *errnum)
     {
         if (retval)
         {
-            free(retval);
+            hare_free(retval);
             retval = NULL;
         }
         if (msg_len)
@@ -1266,52 +2100,153 @@ char *read_a_pipe(int read_fd, int *msg_len, int *errnum)
 }
 
 
-bool search_a_file(char *haystack_file, char *needle)
+int read_result(int read_fd, ProcessResult *result)
 {
     // LOCAL VARIABLES
-    bool found_it = false;       // Return value: true if found, false otherwise (or on error)
-    bool keep_going = false;     // Flow control
-    char *file_contents = NULL;  // Return value from call to read_file()
+    int errnum = -1;                            // 0 on success, -1 on bad input, errno on failure
+    char record[PIPE_BUF] = { 0 };              // One outcome, exactly as write_result() wrote it
+    ResultHeader header = { 0 };                // record's header
+    ssize_t read_count = 0;                     // Return value from read()
 
     // INPUT VALIDATION
-    if (haystack_file && *haystack_file && needle && *needle)
+    if (read_fd >= 0 && result)
     {
-        keep_going = true;
+        memset(result, 0, sizeof(*result));
+        errnum = 0;
     }
 
-    // DO IT
-    // Read the file
-    if (true == keep_going)
+    // READ IT
+    // Each outcome was one write() no larger than PIPE_BUF so it's read whole or not at all
+    if (0 == errnum)
     {
-        file_contents = read_file(haystack_file);
-        if (!file_contents)
+        read_count = read(read_fd, record, sizeof(header));
+        if (0 == read_count || (-1 == read_count && EAGAIN == errno))
         {
-            keep_going = false;
+            errnum = ENODATA;
+        }
+        else if (-1 == read_count)
+        {
+            errnum = get_errno();
+        }
+        else if (sizeof(header) != read_count)
+        {
+            errnum = EPROTO;
+        }
+        else
+        {
+            memcpy(&header, record, sizeof(header));
         }
     }
-    // Search the contents
-    if (true == keep_going)
+    if (0 == errnum && header.source_len + header.destination_len > 0)
     {
-        if (strstr(file_contents, needle))
+        if (header.source_len > PATH_MAX || header.destination_len > PATH_MAX
+            || sizeof(header) + header.source_len + header.destination_len > sizeof(record))
         {
-            found_it = true;
-            syslog_it2(LOG_NOTICE, "Found the needle %s in %s", needle, haystack_file);
+            errnum = EPROTO;
         }
         else
         {
-            syslog_it2(LOG_INFO, "Failed to find the needle %s in %s", needle, haystack_file);
+            read_count = read(read_fd, record, header.source_len + header.destination_len);
+            if (read_count != header.source_len + header.destination_len)
+            {
+                errnum = -1 == read_count && errno ? errno : EPROTO;
+            }
         }
     }
 
-    // CLEANUP
-    if (file_contents)
+    // UNPACK IT
+    if (0 == errnum)
     {
-        free(file_contents);
-        file_contents = NULL;
+        result->status = header.status;
+        result->found = (0 != header.found);
+        memcpy(result->source, record, header.source_len);
+        memcpy(result->destination, record + header.source_len, header.destination_len);
     }
 
     // DONE
-    return found_it;
+    return errnum;
+}
+
+
+int read_settings(INotifySettings *settings)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;       // 0 on success, -1 on bad input, errno on failure
+    char *value = NULL;    // Value of the current environment variable
+    long long number = 0;  // Value of the current numeric environment variable
+
+    // INPUT VALIDATION
+    if (settings)
+    {
+        errnum = 0;
+    }
+
+    // READ THEM
+    if (0 == errnum && (value = getenv(STORE_ENV_VAR)) && *value)
+    {
+        settings->store = value;
+    }
+    if (0 == errnum && (value = getenv(SHARD_ENV_VAR)) && *value)
+    {
+        errnum = parse_shard_layout(value, &env_shard);
+        settings->shard = 0 == errnum ? &env_shard : settings->shard;
+    }
+    if (0 == errnum && (value = getenv(RETENTION_ENV_VAR)) && *value)
+    {
+        errnum = retention_parse(value, &env_retention);
+        settings->retention = 0 == errnum ? &env_retention : settings->retention;
+    }
+    if (0 == errnum && (value = getenv(JOURNAL_ENV_VAR)) && *value)
+    {
+        settings->journal = value;
+    }
+    if (0 == errnum && (value = getenv(CONTROL_ENV_VAR)) && *value)
+    {
+        settings->control = value;
+    }
+    if (0 == errnum && (value = getenv(STATS_ENV_VAR)) && *value)
+    {
+        settings->stats = value;
+    }
+    if (0 == errnum)
+    {
+        number = settings->backlog_workers;  // Unless it's set
+        errnum = _read_number(BACKLOG_ENV_VAR, BACKLOG_MAX_WORKERS, &number);
+        settings->backlog_workers = (int)number;
+    }
+    if (0 == errnum)
+    {
+        number = true == settings->recursive ? 1 : 0;
+        errnum = _read_number(WATCHER_ENV_VAR, 1, &number);
+        settings->recursive = (1 == number);
+    }
+    if (0 == errnum)
+    {
+        number = (long long)settings->max_watches;
+        errnum = _read_number(WATCHER_MAX_ENV_VAR, INT_MAX, &number);
+        settings->max_watches = (size_t)number;
+    }
+    if (0 == errnum)
+    {
+        number = true == settings->fanotify ? 1 : 0;
+        errnum = _read_number(FAN_WATCHER_ENV_VAR, 1, &number);
+        settings->fanotify = (1 == number);
+    }
+    if (0 == errnum)
+    {
+        number = settings->workers;
+        errnum = _read_number(SUPERVISOR_ENV_VAR, SUPERVISOR_MAX_WORKERS, &number);
+        settings->workers = (int)number;
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+bool search_a_file(char *haystack_file, char *needle)
+{
+    return _search_and_digest(haystack_file, needle, NULL, NULL);
 }
 
 
@@ -1319,6 +2254,7 @@ char *search_dir(char *haystack_dir, char *needle_file, size_t needle_file_len)
 {
     // LOCAL VARIABLES
     char *matching_file = NULL;  // Filename that matches needle_file
+    char *shard_dir = NULL;      // The shard needle_file was stamped into, if known
     int results = 0;             // Return value from internal function calls
 
     // INPUT VALIDATION
@@ -1344,7 +2280,18 @@ char *search_dir(char *haystack_dir, char *needle_file, size_t needle_file_len)
     // DIR WALK
     else
     {
-        results = _file_matching(haystack_dir, needle_file, needle_file_len);
+        // A hash-prefixed layout pins needle_file to a single shard so try that one first
+        shard_dir = _find_needle_shard(haystack_dir, needle_file);
+        if (shard_dir)
+        {
+            results = _file_matching(shard_dir, needle_file, needle_file_len);
+            hare_free(shard_dir);
+            shard_dir = NULL;
+        }
+        if (1 != results)
+        {
+            results = _file_matching(haystack_dir, needle_file, needle_file_len);
+        }
         // What happened?
         if (1 == results)
         {
@@ -1366,7 +2313,7 @@ off_t size_file(char *filename)
     // INPUT VALIDATION
     if (filename && *filename)
     {
-        if (0 == stat(filename, &response))
+        if (0 == io_stat(filename, &response))
         {
             size = response.st_size;
         }        
@@ -1425,6 +2372,7 @@ int stamp_a_file(char *source_file, char *dest_dir)
     // char new_filename[FILE_MAX + 1] = { 0 };      // New stamped filename
     // char new_abs_filename[PATH_MAX + 1] = { 0 };  // Concatenated dest_dir and new stamped filename
     char *new_abs_filename = NULL;                // Concatenated dest_dir and new stamped filename
+    char *shard_dir = NULL;                       // dest_dir's subdirectory for the new filename
     size_t stamp_len = 0;                         // Length of datetime_stamp
     size_t dest_len = 0;                          // Length of dest_dir
     size_t source_len = 0;                        // Length of source_file
@@ -1461,18 +2409,23 @@ int stamp_a_file(char *source_file, char *dest_dir)
             syslog_errno(errnum, "Call to get_datetime_stamp() failed");
         }
     }
+    // Find (or lazily create) the shard
+    if (0 == errnum)
+    {
+        shard_dir = get_shard_dir(dest_dir, datetime_stamp, basename(source_file), true, &errnum);
+    }
     // Concatenate New Filename
     if (0 == errnum)
     {
         // Measure everything
         stamp_len = strlen(datetime_stamp);
-        dest_len = strlen(dest_dir);
+        dest_len = strlen(shard_dir);
         source_len = strlen(basename(source_file));
         // Allocate memory
-        new_abs_filename = calloc(dest_len + stamp_len + source_len + 2, sizeof(char));
+        new_abs_filename = hare_calloc(dest_len + stamp_len + source_len + 2, sizeof(char));
         if (new_abs_filename)
         {
-            memcpy(new_abs_filename, dest_dir, dest_len);
+            memcpy(new_abs_filename, shard_dir, dest_len);
             nafn_len = strlen(new_abs_filename);
             if ('/' != new_abs_filename[nafn_len - 1])
             {
@@ -1490,12 +2443,12 @@ int stamp_a_file(char *source_file, char *dest_dir)
             errnum = errno;
             if (0 == errnum)
             {
-                syslog_it(LOG_ERR, "Call to calloc() failed with an unspecified error");
+                syslog_it(LOG_ERR, "Call to hare_calloc() failed with an unspecified error");
                 errnum = ENOMEM;
             }
             else
             {
-                syslog_errno(errnum, "Call to calloc() failed");
+                syslog_errno(errnum, "Call to hare_calloc() failed");
             }
         }
     }
@@ -1527,87 +2480,118 @@ int stamp_a_file(char *source_file, char *dest_dir)
     if (0 != errnum && new_abs_filename)
     {
         processed_filename = NULL;
-        free(new_abs_filename);
+        hare_free(new_abs_filename);
         new_abs_filename = NULL;
     }
     if (datetime_stamp)
     {
-        free(datetime_stamp);
+        hare_free(datetime_stamp);
         datetime_stamp = NULL;
     }
+    if (shard_dir)
+    {
+        hare_free(shard_dir);
+        shard_dir = NULL;
+    }
 
     // DONE
     return errnum;
 }
 
 
-void syslog_it(int logLevel, char *msg)
+void (syslog_it)(int logLevel, char *msg)
 {
-    openlog(BINARY_NAME, LOG_PID, LOG_DAEMON);                        // System call returns void
-    // Log formatted msg
-    syslog(logLevel, "[%s] %s", getPriorityString(logLevel), msg);  // System call returns void
-    closelog();
+    logsink_publish(logLevel, 0, msg, msg);  // For a harness watching the log
+    _log_it(logLevel, msg);
 }
 
 
-void syslog_it2(int logLevel, char *msg, ...)
+void (syslog_it2)(int logLevel, char *msg, ...)
 {
     // LOCAL VARIABLES
-    char message[MAX_LOG_SIZE] = {0};  // Holds the output version of the message
+    int results = 0;                   // Return value from logger_vwrite()
     va_list args;                      // Needed for variable length arguments
+    va_list retry_args;                // Copy of args in case the logger can't take it
+    va_list record_args;               // Copy of args for the flight recorder and log sink
 
     // DO IT
     va_start(args, msg);
-    // Use n version to prevent buffer overflow
-    vsnprintf(message, sizeof(message), msg, args);
-    syslog_it(logLevel, message);
+    va_copy(retry_args, args);
+    if (logsink_active())
+    {
+        // For a harness watching the log
+        va_copy(record_args, args);
+        logsink_vpublish(logLevel, 0, msg, record_args);
+        va_end(record_args);
+    }
+    // In case the process dies before the logger sends it
+    va_copy(record_args, args);
+    recorder_vwrite(logLevel, getPriorityString(logLevel), msg, record_args);
+    va_end(record_args);
+    // Format straight into the logger's ring
+    results = logger_vwrite(logLevel, getPriorityString(logLevel), msg, args);
+    if (0 != results && EAGAIN != results)
+    {
+        // Only the fallback needs a buffer (vsnprintf() terminates it, so don't pay to zero 32 KB)
+        char message[MAX_LOG_SIZE];  // Holds the output version of the message
+
+        // Use n version to prevent buffer overflow
+        vsnprintf(message, sizeof(message), msg, retry_args);
+        _syslog_it(logLevel, message);
+    }
+    va_end(retry_args);
     va_end(args);
 }
 
 
-void syslog_errno(int errNum, char *msg, ...)
+void (syslog_errno)(int errNum, char *msg, ...)
 {
     // LOCAL VARIABLES
-    char tempMsg[256] = {0};           // Holds the temporary errno string
-    char message[MAX_LOG_SIZE] = {0};  // Holds the output version of the message
+    char tempMsg[256];                 // Holds the temporary errno string (snprintf() terminates it)
+    char message[MAX_LOG_SIZE];        // Holds the output version of the message (vsnprintf() terminates it)
     char *buffer = NULL;               // Malloced buffer if message is exceeded
     size_t msgLen = 0;                 // Holds temporary string length
     size_t tmpLen = 0;                 // Holds the message length
     va_list args;                      // Needed for variable length arguments
 
     // DO IT
-    va_start(args, msg);
-
-    // Use n version to prevent buffer overflow
-    vsnprintf(message, sizeof(message), msg, args);
-    snprintf(tempMsg, sizeof(tempMsg), " ERRNO: %d Reason: %s", errNum, strerror(errNum));
-    tmpLen = strlen(tempMsg);
-    msgLen = strlen(message);
-    if (sizeof(message) > (msgLen + tmpLen))
-    {
-        strcat(message, tempMsg);
-        syslog_it(LOG_ERR, message);
-    }
-    else
+    // Same gate as the macro so calling (syslog_errno)() directly can't format a message nobody logs
+    if (LOG_ENABLED(LOG_ERR))
     {
-        buffer = calloc(msgLen + tmpLen + 1, sizeof(char));
-        if (buffer)
+        va_start(args, msg);
+
+        // Use n version to prevent buffer overflow
+        vsnprintf(message, sizeof(message), msg, args);
+        logsink_publish(LOG_ERR, errNum, msg, message);  // Keeps errNum out of the message text
+        snprintf(tempMsg, sizeof(tempMsg), " ERRNO: %d Reason: %s", errNum, strerror(errNum));
+        tmpLen = strlen(tempMsg);
+        msgLen = strlen(message);
+        if (sizeof(message) > (msgLen + tmpLen))
         {
-            strcpy(buffer, message);
-            strcat(buffer, tempMsg);
-            syslog_it(LOG_ERR, buffer);
-            free(buffer);
-            buffer = NULL;
+            strcat(message, tempMsg);
+            _log_it(LOG_ERR, message);
         }
         else
         {
-            syslog_it(LOG_ERR, message);
-            syslog_it(LOG_ERR, tempMsg);
+            buffer = calloc(msgLen + tmpLen + 1, sizeof(char));
+            if (buffer)
+            {
+                strcpy(buffer, message);
+                strcat(buffer, tempMsg);
+                _log_it(LOG_ERR, buffer);
+                free(buffer);
+                buffer = NULL;
+            }
+            else
+            {
+                _log_it(LOG_ERR, message);
+                _log_it(LOG_ERR, tempMsg);
+            }
         }
-    }
 
-    // CLEANUP
-    va_end(args);
+        // CLEANUP
+        va_end(args);
+    }
 }
 
 
@@ -1653,7 +2637,7 @@ int verify_directory(char *directory)
     {
         exists = verify_pathname(directory);
 
-        if (1 == exists && 0 == stat(directory, &response))
+        if (1 == exists && 0 == io_stat(directory, &response))
         {
             if (S_IFDIR != (response.st_mode & S_IFMT))
             {
@@ -1682,7 +2666,7 @@ int verify_filename(char *filename)
     {
         exists = verify_pathname(filename);
 
-        if (1 == exists && 0 == stat(filename, &response))
+        if (1 == exists && 0 == io_stat(filename, &response))
         {
             if (S_IFREG != (response.st_mode & S_IFMT))
             {
@@ -1696,77 +2680,78 @@ int verify_filename(char *filename)
 }
 
 
-int wait_daemon(pid_t daemon_pid, int *daemon_exit)
+int wait_daemon(pid_t daemon_pid, int *daemon_exit, int timeout_ms)
 {
     // LOCAL VARIABLES
-    int success = 0;        // 0 on success, -1 on error, or errno
-    int wait_status = 0;    // Out parameter for the call to waitpid()
-    int wait_options = 0;   // Argument to waitpid()
-    pid_t wait_retval = 0;  // Return value from the call to waitpid()
+    int success = -1;            // 0 on success, -1 on error, ETIMEDOUT on a hang, or errno
+    int wait_status = 0;         // Out parameter for the call to waitpid()
+    pid_t wait_retval = 0;       // Return value from the call to waitpid()
+    int pidfd = INVALID_FD;      // Becomes readable when daemon_pid exits (INVALID_FD if unavailable)
+    bool hung = false;           // Did daemon_pid miss its deadline?
 
-    // WAIT
-    if (daemon_exit)
+    // INPUT VALIDATION
+    if (daemon_exit && daemon_pid > 0)
     {
-        wait_options = WUNTRACED | WCONTINUED;
         *daemon_exit = 0;
+        success = 0;
+        pidfd = pidfd_open(daemon_pid, 0);  // Falls back to polling waitid() (e.g., ENOSYS)
+    }
+
+    // WAIT
+    if (0 == success && false == _await_exit(daemon_pid, pidfd, timeout_ms))
+    {
+        // It hung: ask it to stop, then make it stop
+        hung = true;
+        syslog_it2(LOG_WARNING, "PID %ld missed its %d ms deadline.  Sending SIGTERM.", (long)daemon_pid, timeout_ms);
+        _signal_daemon(daemon_pid, pidfd, SIGTERM);
+        if (false == _await_exit(daemon_pid, pidfd, WAIT_DAEMON_GRACE_MS))
+        {
+            syslog_it2(LOG_WARNING, "PID %ld ignored SIGTERM for %d ms.  Sending SIGKILL.", (long)daemon_pid,
+                       WAIT_DAEMON_GRACE_MS);
+            _signal_daemon(daemon_pid, pidfd, SIGKILL);
+        }
+    }
+
+    // REAP IT
+    if (0 == success)
+    {
         do
         {
-            wait_retval = waitpid(daemon_pid, &wait_status, wait_options);
+            wait_retval = waitpid(daemon_pid, &wait_status, 0);
+        } while (-1 == wait_retval && EINTR == errno);
 
-            if (-1 == wait_retval)
+        if (-1 == wait_retval)
+        {
+            if (errno)
             {
-                if (errno)
-                {
-                    success = errno;
-                    syslog_errno(success, "The call to waitpid(%ld) failed", daemon_pid);
-                }
-                else
-                {
-                    success = -1;
-                    syslog_errno(success, "The call to waitpid(%ld) failed with an unspecified error", daemon_pid);
-                }
-                break;  // Error encountered.  Time to exit.
+                success = errno;
+                syslog_errno(success, "The call to waitpid(%ld) failed", (long)daemon_pid);
             }
             else
             {
-                // Test return value
-                if (0 == wait_retval)
-                {
-                    // syslog_it2(LOG_DEBUG, "PID %ld has not yet changed state", daemon_pid);  // DEBUGGING
-                }
-                else
-                {
-                    // syslog_it2(LOG_DEBUG, "PID %ld has changed state", daemon_pid);  // DEBUGGING
-                }
-
-                // Test status
-                // WIFEXITED
-                if (WIFEXITED(wait_status))
-                {
-                    *daemon_exit = WEXITSTATUS(wait_status);
-                    // syslog_it2(LOG_DEBUG, "PID %ld has exited with status %d", daemon_pid, *daemon_exit);  // DEBUGGING
-                }
-                // WIFSIGNALED
-                if (WIFSIGNALED(wait_status))
-                {
-                    // syslog_it2(LOG_DEBUG, "PID %ld was killed by signal %d", daemon_pid, WTERMSIG(wait_status));  // DEBUGGING
-                }
-                // WIFSTOPPED
-                if (WIFSTOPPED(wait_status))
-                {
-                    // syslog_it2(LOG_DEBUG, "PID %ld was stopped by signal %d", daemon_pid, WSTOPSIG(wait_status));  // DEBUGGING
-                }
-                // WIFCONTINUED
-                if (WIFCONTINUED(wait_status))
-                {
-                    // syslog_it2(LOG_DEBUG, "PID %ld continued", daemon_pid);  // DEBUGGING
-                }
+                success = -1;
+                syslog_it2(LOG_ERR, "The call to waitpid(%ld) failed with an unspecified error", (long)daemon_pid);
             }
-        } while (!WIFEXITED(wait_status) && !WIFSIGNALED(wait_status));
+        }
+        else if (WIFEXITED(wait_status))
+        {
+            *daemon_exit = WEXITSTATUS(wait_status);
+            // syslog_it2(LOG_DEBUG, "PID %ld has exited with status %d", daemon_pid, *daemon_exit);  // DEBUGGING
+        }
+        else if (WIFSIGNALED(wait_status))
+        {
+            // syslog_it2(LOG_DEBUG, "PID %ld was killed by signal %d", daemon_pid, WTERMSIG(wait_status));  // DEBUGGING
+        }
     }
-    else
+    if (0 == success && true == hung)
+    {
+        success = ETIMEDOUT;
+    }
+
+    // CLEANUP
+    if (INVALID_FD != pidfd)
     {
-        success = -1;  // NULL Pointer
+        close(pidfd);
     }
 
     // DONE
@@ -1785,7 +2770,7 @@ int verify_pathname(char *pathname)
     {
         exists = -1;
     }
-    else if (0 == stat(pathname, &response))
+    else if (0 == io_stat(pathname, &response))
     {
         exists = 1;
     }
@@ -1850,3 +2835,45 @@ int write_a_pipe(int write_fd, void *write_buff, size_t num_bytes)
     }
     return errnum;
 }
+
+
+int write_result(int write_fd, char *source, char *destination, bool found, int status)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;                   // 0 on success, -1 on bad input, errno on failure
+    char record[PIPE_BUF] = { 0 };     // Header, source, and destination in one write()
+    ResultHeader header = { 0 };       // record's header
+    size_t source_len = 0;             // Length of source
+    size_t destination_len = 0;        // Length of destination
+
+    // INPUT VALIDATION
+    if (write_fd >= 0 && source && *source)
+    {
+        source_len = strlen(source);
+        destination_len = destination ? strlen(destination) : 0;
+        errnum = 0;
+        if (sizeof(header) + source_len + destination_len > sizeof(record))
+        {
+            errnum = ENAMETOOLONG;
+        }
+    }
+
+    // WRITE IT
+    if (0 == errnum)
+    {
+        header.status = status;
+        header.found = (true == found);
+        header.source_len = source_len;
+        header.destination_len = destination_len;
+        memcpy(record, &header, sizeof(header));
+        memcpy(record + sizeof(header), source, source_len);
+        if (destination_len)
+        {
+            memcpy(record + sizeof(header) + source_len, destination, destination_len);
+        }
+        errnum = write_a_pipe(write_fd, record, sizeof(header) + source_len + destination_len);
+    }
+
+    // DONE
+    return errnum;
+}
@@ -5,19 +5,32 @@
 #ifndef __HARE_LIBRARY__
 #define __HARE_LIBRARY__
 
+#include <linux/limits.h>  // PATH_MAX
 #include <stdbool.h>    // bool
 #include <stdio.h>      // NULL
 #include <sys/types.h>  // off_t
 #include <syslog.h>     // syslog(), LOG_* macros
+#include "HARE_logger.h"     // logger_level
+#include "HARE_retention.h"  // RetentionPolicy
+#include "HARE_storage.h"    // ShardLayout
 
 #ifndef ENOERR
 #define ENOERR 0
 #endif  // ENOERR
 
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL LOG_DEBUG  // Build with -DLOG_COMPILED_LEVEL=LOG_INFO to compile out DEBUG calls
+#endif  // LOG_COMPILED_LEVEL
+
+// Would a message at logLevel be logged?  Checked before syslog_it*() format anything.
+#define LOG_ENABLED(logLevel) ((logLevel) <= LOG_COMPILED_LEVEL && (logLevel) <= logger_level)
+
 #define FILE_MAX 255  // Maximum length for a Linux filename
 
 #define NEEDLE "???"  // Needle to search for in the test case file
 
+#define WAIT_DAEMON_GRACE_MS 100  // How long wait_daemon() lets a hung daemon handle SIGTERM before SIGKILL
+
 /*
  * Stolen from https://opensource.apple.com/source/xnu/xnu-344/bsd/sys/syslog.h.auto.html
  */
@@ -51,6 +64,17 @@ typedef struct _INotifySettings
 {
     char *watched;       // Dir(s) to watch
     char *process;     // Directory (rel to watch) to move processed files into
+    char *store;       // Content-addressed store for processed files (NULL disables deduplication)
+    ShardLayout *shard;  // Layout of the process directory (NULL keeps it flat)
+    RetentionPolicy *retention;  // Limits enforced on the process directory (NULL keeps everything)
+    char *journal;     // Write-ahead journal file (NULL disables journaling)
+    int backlog_workers;  // Processes that drain files already in watched at startup (0 disables)
+    bool recursive;       // Watch watched and all of its subdirectories with inotify (false relies on the pipe)
+    size_t max_watches;   // Cap on recursive watches (0 uses most of fs.inotify.max_user_watches)
+    bool fanotify;        // Watch watched's whole filesystem with fanotify instead (falls back to recursive)
+    int workers;          // Worker processes that share the messages (0 or 1 processes them in the daemon)
+    char *stats;          // mmap()ed file of per-stage latency histograms (NULL disables them)
+    char *control;        // Unix domain socket for live introspection and commands (NULL disables it)
 } INotifySettings;
 
 // Holds the configuration data
@@ -60,6 +84,15 @@ typedef struct _Configuration
     INotifyMessage inotify_message;  // INotify message
 } Configuration;
 
+// Outcome of processing one file, as the daemon reports it on result_fds
+typedef struct _ProcessResult
+{
+    int status;                       // stamp_a_file() results: 0 on success, -1 on bad input, errno on failure
+    bool found;                       // Did the file contain the NEEDLE?
+    char source[PATH_MAX + 1];        // File the daemon was told about
+    char destination[PATH_MAX + 1];   // Where the daemon moved it (empty unless status is 0)
+} ProcessResult;
+
 // MACROs to help properly access int array indices
 #define PIPE_READ 0
 #define PIPE_WRITE 1
@@ -68,6 +101,8 @@ extern int pipe_fds[2];           // Pipe used to send data from the test harnes
 extern char *base_filename;       // Name of the file-based test case created by the test harness
 extern size_t base_filename_len;  // Length of the base_filename
 extern char *processed_filename;  // Absolute filename of a file that matches on base_filename
+extern int result_fds[2];         // Pipe the daemon reports each processed file's outcome on (see: read_result())
+extern CODE priorityNames[];      // syslog priority names and values (NULL name terminated)
 
 
 /*
@@ -131,6 +166,7 @@ int empty_dir(char *dirname);
 
 /*
  * Loosely based on SURE's execute() in that it executes the main process loop
+ *      Processes messages until the test harness closes the message transport or getINotifyData() fails
  */
 void execute_order(Configuration *config);
 
@@ -141,6 +177,12 @@ void execute_order(Configuration *config);
 char *get_datetime_stamp(int *errnum);
 
 
+/*
+ *  Translate errno into a return value, guaranteeing a non-zero result (EIO if errno is 0)
+ */
+int get_errno(void);
+
+
 /*
  *  Return the filename argument
  */
@@ -153,6 +195,7 @@ char *get_filename(int argc, char *argv[]);
  * Returns 0 on success, -1 on error, and errnum on failure
  * Notes
  *      Returns 0 even if there's no data to read
+ *      Returns EPIPE once the test harness has closed the transport and every message was read
  */
 int getINotifyData(Configuration *config);
 
@@ -165,7 +208,7 @@ bool isRootUser();
 
 
 /*
- *  Append a newline-terminated entry to "log_filename"
+ *  Append a newline-terminated entry to "log_filename" (buffered: see HARE_filelog.h)
  */
 void log_it(char *log_entry, char *log_filename);
 
@@ -208,11 +251,37 @@ void print_usage(void);
  *  Arguments
  *      read_fd - File descriptor to read from
  *      msg_len - Out parameter to store the number of bytes read into the return value
- *      errnum - Out parameter to store errno in the event of an error
+ *      errnum - Out parameter to store errno in the event of an error (EPIPE at end of file)
  */
 char *read_a_pipe(int read_fd, int *msg_len, int *errnum);
 
 
+/*
+ *  Read the next outcome write_result() sent on read_fd (e.g., result_fds[PIPE_READ]).  Make
+ *      read_fd non-blocking to drain whatever is waiting.
+ *  Returns 0 on success, -1 on bad input, ENODATA if nothing is waiting, errno on failure
+ */
+int read_result(int read_fd, ProcessResult *result);
+
+
+/*
+ *  Turn on the daemon's optional features that are named in the environment:
+ *      STORE_ENV_VAR - Content-addressed store directory (see: HARE_storage.h)
+ *      SHARD_ENV_VAR - Processed directory layout (see: parse_shard_layout())
+ *      RETENTION_ENV_VAR - Limits on the process directory (see: retention_parse())
+ *      JOURNAL_ENV_VAR - Write-ahead journal file (see: HARE_journal.h)
+ *      BACKLOG_ENV_VAR - Processes that drain files already in the watch directory (see: HARE_backlog.h)
+ *      WATCHER_ENV_VAR, WATCHER_MAX_ENV_VAR - Recursive inotify watcher (see: HARE_watcher.h)
+ *      FAN_WATCHER_ENV_VAR - Filesystem-wide fanotify watcher (see: HARE_fanotify.h)
+ *      SUPERVISOR_ENV_VAR - Worker processes that share the messages (see: HARE_supervisor.h)
+ *      CONTROL_ENV_VAR - Control socket for live introspection and commands (see: HARE_control.h)
+ *      STATS_ENV_VAR - Latency histogram file for hare_stats.bin (see: HARE_stats.h)
+ *  Anything that isn't set is left alone.
+ *  Returns 0 on success, -1 on bad input, errno on failure (EINVAL for a malformed value)
+ */
+int read_settings(INotifySettings *settings);
+
+
 /*
  *  Read filename into a custom-sized, heap-allocated buffer
  */
@@ -221,6 +290,7 @@ char *read_file(char *filename);
 
 /*
  *  Recursively searches haystack_dir for a filename whose ending matches needle_file
+ *      If shard_layout is hash-prefixed, needle_file's own shard is searched first.
  *  Returns absolute filename on success, NULL on failure or "no match"
  */
 char *search_dir(char *haystack_dir, char *needle_file, size_t needle_file_len);
@@ -259,7 +329,8 @@ int split_path(LinuxPath *nix_path);
 
 
 /*
- *  Move filename to dest and prepend the filename with a datetime stamp
+ *  Move filename to dest (or dest's shard, see: shard_layout) and prepend the filename
+ *      with a datetime stamp
  *  Arguments
  *      source_file - Filename to move
  *      dest_dir - Directory to move filename to
@@ -300,6 +371,7 @@ void syslog_it2(int logLevel, char *msg, ...);
 
 /*
  *  Minimally mirrors logErrno() from SURE_logging.h
+ *  The log sink gets errNum in the record instead of in the message (see: HARE_logsink.h)
  */
 void syslog_errno(int errNum, char *msg, ...);
 
@@ -329,10 +401,12 @@ int verify_pathname(char *pathname);
 
 
 /*
- *  Wait for the PID to change state and provide the exit code if applicable
- *  Returns 0 on success, -1 on error, or errno
+ *  Wait for the PID to exit and provide the exit code if applicable.  A daemon still running
+ *      after timeout_ms (negative waits forever) hung: it gets SIGTERM, then SIGKILL if it's still
+ *      running WAIT_DAEMON_GRACE_MS later (along with the rest of its process group).
+ *  Returns 0 on success, -1 on error, ETIMEDOUT if it hung (and was killed), or errno
  */
-int wait_daemon(pid_t daemon_pid, int *daemon_exit);
+int wait_daemon(pid_t daemon_pid, int *daemon_exit, int timeout_ms);
 
 
 /*
@@ -350,4 +424,32 @@ int wait_daemon(pid_t daemon_pid, int *daemon_exit);
 int write_a_pipe(int write_fd, void *write_buff, size_t num_bytes);
 
 
+/*
+ *  Report the outcome of processing source on write_fd (e.g., result_fds[PIPE_WRITE]) with a
+ *      single write() of at most PIPE_BUF bytes, so outcomes from several processes sharing the
+ *      pipe never interleave.  A full non-blocking pipe drops the outcome (EAGAIN): size the pipe
+ *      for the outcomes a harness expects (e.g., F_SETPIPE_SZ) or read it while the daemon runs.
+ *  Arguments
+ *      write_fd - The pipe's write file descriptor
+ *      source - File the daemon was told about
+ *      destination - Where it was moved (NULL if it wasn't)
+ *      found - Did the file contain the NEEDLE?
+ *      status - stamp_a_file() results
+ *  Returns 0 on success, -1 on bad input, errno on failure (ENAMETOOLONG if it won't fit in PIPE_BUF)
+ */
+int write_result(int write_fd, char *source, char *destination, bool found, int status);
+
+
+/*
+ *  Skip the call (and its arguments) unless the level is enabled.  Parenthesize the name, as in
+ *      (syslog_it)(logLevel, msg), to call the function directly.
+ */
+#define syslog_it(logLevel, msg) \
+    do { if (LOG_ENABLED(logLevel)) (syslog_it)(logLevel, msg); } while (0)
+#define syslog_it2(logLevel, ...) \
+    do { if (LOG_ENABLED(logLevel)) (syslog_it2)(logLevel, __VA_ARGS__); } while (0)
+#define syslog_errno(errNum, ...) \
+    do { if (LOG_ENABLED(LOG_ERR)) (syslog_errno)(errNum, __VA_ARGS__); } while (0)
+
+
 #endif  // __HARE_LIBRARY__
@@ -17,9 +17,13 @@
 #include <stdlib.h>        // calloc(), free()
 #include <string.h>        // strlen(), strstr()
 #include <unistd.h>        // close(), read()
+#include "HARE_arena.h"    // hare_calloc(), hare_free()
+#include "HARE_io.h"       // io_close(), io_open(), io_read(), io_rename()
 #include "HARE_library.h"
+#include "HARE_storage.h"  // move_across_filesystems()
 
 #define BAD_MAX 128  // Buffer size macro
+#define BAD_READ_SIZE 4096  // Bytes read_file() asks io_read() for at a time
 
 /*************************************************************************************************/
 /*************************************** LIBRARY FUNCTIONS ***************************************/
@@ -84,7 +88,7 @@ int do_it(char *filename)
     // DONE
     if (file_contents)
     {
-        free(file_contents);
+        hare_free(file_contents);
         file_contents = NULL;
     }
     return success;
@@ -100,11 +104,16 @@ int move_file(char *source, char *destination)
     // MOVE IT
     if (0 == errnum)
     {
-        errnum = rename(source, destination);
+        errnum = io_rename(source, destination);
 
         if (-1 == errnum)
         {
             errnum = errno;
+            if (EXDEV == errnum)
+            {
+                // Different filesystems so rename() can't do it
+                errnum = move_across_filesystems(source, destination);
+            }
         }
     }
 
@@ -119,7 +128,10 @@ char *read_file(char *filename)
     // LOCAL VARIABLES
     char *file_contents = NULL;  // Allocate mem and return
     off_t file_size = BAD_MAX;   // Size of buffer in bytes
-    FILE *fp = NULL;             // File pointer to filename
+    int fd = -1;                 // File descriptor of filename
+    unsigned char chunk[BAD_READ_SIZE];  // Bytes read by io_read() but not yet copied
+    ssize_t chunk_len = 0;       // Number of bytes in chunk
+    ssize_t chunk_index = 0;     // Index of the next byte in chunk
     char *curr_char_ptr = NULL;  // Temporary pointer
     char curr_char = 0x0;        // Temporary read character
     
@@ -131,17 +143,23 @@ char *read_file(char *filename)
         if (file_size > -1)
         {
             // Allocate it
-            file_contents = calloc(file_size + 1, 1);
+            file_contents = hare_calloc(file_size + 1, 1);
             // Read it
             if (file_contents)
             {
-                fp = fopen(filename, "r");
-                if (fp)
+                fd = io_open(filename, O_RDONLY, 0);
+                if (fd > -1)
                 {
                     curr_char_ptr = file_contents;
                     while(1)
                     {
-                        curr_char = getc(fp);
+                        if (chunk_index >= chunk_len)
+                        {
+                            // Refill: one io_read() per chunk instead of per byte
+                            chunk_len = io_read(fd, chunk, sizeof(chunk));
+                            chunk_index = 0;
+                        }
+                        curr_char = chunk_index < chunk_len ? chunk[chunk_index++] : EOF;  // Like getc()
                         if (EOF == curr_char)
                         {
                             break;
@@ -162,10 +180,10 @@ char *read_file(char *filename)
     }
     
     // DONE
-    if (fp)
+    if (fd > -1)
     {
-        fclose(fp);
-        fp = NULL;
+        io_close(fd);
+        fd = -1;
     }
     return file_contents;
 }
@@ -17,7 +17,10 @@
 #include <stdlib.h>        // calloc(), free()
 #include <string.h>        // strlen(), strstr()
 #include <unistd.h>        // close(), read()
+#include "HARE_arena.h"    // hare_calloc(), hare_free()
+#include "HARE_io.h"       // io_close(), io_open(), io_read(), io_rename()
 #include "HARE_library.h"
+#include "HARE_storage.h"  // move_across_filesystems()
 
 
 /*************************************************************************************************/
@@ -131,7 +134,7 @@ int do_it(char *filename)
     // DONE
     if (file_contents)
     {
-        free(file_contents);
+        hare_free(file_contents);
         file_contents = NULL;
     }
     return success;
@@ -155,11 +158,16 @@ int move_file(char *source, char *destination)
     // MOVE IT
     if (0 == errnum)
     {
-        errnum = rename(source, destination);
+        errnum = io_rename(source, destination);
 
         if (-1 == errnum)
         {
             errnum = errno;
+            if (EXDEV == errnum)
+            {
+                // Different filesystems so rename() can't do it
+                errnum = move_across_filesystems(source, destination);
+            }
         }
     }
 
@@ -184,18 +192,18 @@ char *read_file(char *filename)
         if (file_size > -1)
         {
             // Allocate it
-            file_contents = calloc(file_size + 1, 1);
+            file_contents = hare_calloc(file_size + 1, 1);
             // Read it
             if (file_contents)
             {
-                fd = open(filename, O_RDONLY);
+                fd = io_open(filename, O_RDONLY, 0);
                 if (fd > -1)
                 {
-                    read_bytes = read(fd, file_contents, file_size);
+                    read_bytes = io_read(fd, file_contents, file_size);
                     if (-1 == read_bytes)
                     {
                         // Error
-                        free(file_contents);
+                        hare_free(file_contents);
                         file_contents = NULL;
                     }
                 }
@@ -206,7 +214,7 @@ char *read_file(char *filename)
     // DONE
     if (fd)
     {
-        close(fd);
+        io_close(fd);
         fd = 0;
     }
     return file_contents;
@@ -0,0 +1,1033 @@
+/*
+ *  Implements HARE_logger.h functions.
+ */
+
+#define _GNU_SOURCE          // dl_iterate_phdr(), sendmmsg(), struct mmsghdr
+#include <errno.h>           // errno
+#include <fcntl.h>           // open(), O_* macros
+#include <link.h>            // dl_iterate_phdr(), struct dl_phdr_info
+#include <paths.h>           // _PATH_LOG
+#include <poll.h>            // poll(), struct pollfd
+#include <pthread.h>         // pthread_atfork(), pthread_create(), pthread_sigmask()
+#include <signal.h>          // sigfillset(), sigset_t
+#include <stdatomic.h>       // atomic_*(), _Atomic
+#include <stdbool.h>         // bool
+#include <stdio.h>           // snprintf(), vsnprintf()
+#include <stdlib.h>          // atexit(), getenv(), strtol()
+#include <string.h>          // memcpy(), memset(), strchr(), strcmp(), strlen()
+#include <strings.h>         // strcasecmp()
+#include <sys/eventfd.h>     // eventfd(), EFD_* macros
+#include <sys/socket.h>      // connect(), sendmmsg(), socket()
+#include <sys/uio.h>         // writev(), struct iovec
+#include <sys/un.h>          // struct sockaddr_un
+#include <syslog.h>          // setlogmask(), LOG_* macros
+#include <time.h>            // clock_gettime(), gmtime_r(), localtime_r(), nanosleep(), strftime()
+#include <unistd.h>          // close(), gethostname(), getpid(), read(), readlink(), write()
+#include "HARE_library.h"    // priorityNames, INVALID_FD, get_errno()
+#include "HARE_logger.h"
+
+#define LOGGER_STAMP_SIZE 32     // Room for either timestamp format
+#define LOGGER_HOST_SIZE 256     // Room for an RFC 5424 HOSTNAME
+#define LOGGER_FLAGS "-+ #0'I"   // printf() flag characters
+#define LOGGER_LENGTHS "hlLqjzZt"  // printf() length modifier characters
+#define LOGGER_NAP_MS 1000       // Longest the writer sleeps before checking the ring again
+
+// Lifecycle of the logger in this process
+typedef enum _LoggerState
+{
+    LOGGER_STOPPED = 0,   // Not started yet
+    LOGGER_STARTING = 1,  // A thread is in logger_open()
+    LOGGER_RUNNING = 2,   // Writer thread is draining the ring
+    LOGGER_DISABLED = 3,  // Turned off (or /dev/log is unavailable): use syslog()
+    LOGGER_FORKED = 4     // Inherited across fork(): the writer thread stayed in the parent
+} LoggerState;
+
+// One queued frame
+typedef struct _LoggerSlot
+{
+    _Atomic uint64_t sequence;      // Position + 1 once the frame is ready, position + LOGGER_SLOTS once it's sent
+    uint32_t length;                // Bytes of frame in use
+    char frame[LOGGER_FRAME_SIZE];  // Complete syslog frame
+} LoggerSlot;
+
+// The logger (one per process)
+typedef struct _Logger
+{
+    _Atomic uint64_t enqueue;           // Next position a producer claims
+    char enqueue_pad[56];               // Keeps dequeue off enqueue's cache line
+    _Atomic uint64_t dequeue;           // Next position the writer sends
+    char dequeue_pad[56];               // Keeps the rest off dequeue's cache line
+    _Atomic uint32_t sleeping;          // Non-zero while the writer waits on the doorbell
+    _Atomic uint64_t dropped;           // Records lost to a full ring or a failed send
+    LoggerFormat format;                // Frame format
+    int fd;                             // Datagram socket connected to _PATH_LOG (or the binary log)
+    int doorbell;                       // eventfd producers ring when the writer is asleep
+    pid_t pid;                          // PROCID in every frame
+    char hostname[LOGGER_HOST_SIZE];    // HOSTNAME in RFC 5424 frames
+    uintptr_t image_base;               // Executable's load bias (binary mode)
+    uintptr_t image_start;              // Lowest address the executable's segments use
+    uintptr_t image_end;                // Highest address the executable's segments use
+    LoggerSlot slots[LOGGER_SLOTS];     // The ring
+} Logger;
+
+int logger_level = LOG_DEBUG;
+static Logger _logger = { .fd = INVALID_FD, .doorbell = INVALID_FD };
+static _Atomic int _state = LOGGER_STOPPED;  // LoggerState
+static _Thread_local time_t _stamp_second = -1;            // Second _stamp describes
+static _Thread_local LoggerFormat _stamp_format;           // Format _stamp is in
+static _Thread_local char _stamp[LOGGER_STAMP_SIZE];       // Cached timestamp (without fractions)
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Wake the writer thread, retrying if interrupted.  EAGAIN means the counter is already
+ *      non-zero (it would overflow), so the writer is certain to wake anyway.
+ *  Returns 0 on success, errno on failure
+ */
+static int _ring_doorbell(void)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;     // 0 on success, errno on failure
+    uint64_t ding = 1;  // Doorbell value
+
+    // RING IT
+    while (sizeof(ding) != write(_logger.doorbell, &ding, sizeof(ding)))
+    {
+        if (EINTR != errno)
+        {
+            errnum = EAGAIN == errno ? 0 : get_errno();
+            break;
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Reset the doorbell after a nap, retrying if interrupted.  EAGAIN means nobody rang.
+ *  Returns 0 on success, errno on failure
+ */
+static int _reset_doorbell(void)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;      // 0 on success, errno on failure
+    uint64_t dings = 0;  // Doorbell value
+
+    // RESET IT
+    while (sizeof(dings) != read(_logger.doorbell, &dings, sizeof(dings)))
+    {
+        if (EINTR != errno)
+        {
+            errnum = EAGAIN == errno ? 0 : get_errno();
+            break;
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Remember the logger was inherited across fork() (registered with pthread_atfork())
+ */
+static void _after_fork(void)
+{
+    if (LOGGER_RUNNING == atomic_load(&_state))
+    {
+        atomic_store(&_state, LOGGER_FORKED);
+    }
+}
+
+
+/*
+ *  (Re)connect fd to _PATH_LOG
+ *  Returns 0 on success, errno on failure
+ */
+static int _connect(int fd)
+{
+    // LOCAL VARIABLES
+    int results = 0;                                  // 0 on success, errno on failure
+    struct sockaddr_un address = { AF_UNIX, _PATH_LOG };  // Syslog daemon's socket
+
+    // CONNECT
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)))
+    {
+        results = get_errno();
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Record the address range of the executable's segments (a dl_iterate_phdr() callback)
+ *  Returns 1 to stop after the first object, which is always the executable
+ */
+static int _find_image(struct dl_phdr_info *info, size_t size, void *data)
+{
+    // LOCAL VARIABLES
+    uintptr_t start = UINTPTR_MAX;  // Lowest segment address
+    uintptr_t end = 0;              // Highest segment address
+    int i = 0;                      // Iterating variable
+
+    // FIND IT
+    (void)size;
+    (void)data;
+    for (i = 0; i < info->dlpi_phnum; i++)
+    {
+        if (PT_LOAD == info->dlpi_phdr[i].p_type)
+        {
+            if (info->dlpi_addr + info->dlpi_phdr[i].p_vaddr < start)
+            {
+                start = info->dlpi_addr + info->dlpi_phdr[i].p_vaddr;
+            }
+            if (info->dlpi_addr + info->dlpi_phdr[i].p_vaddr + info->dlpi_phdr[i].p_memsz > end)
+            {
+                end = info->dlpi_addr + info->dlpi_phdr[i].p_vaddr + info->dlpi_phdr[i].p_memsz;
+            }
+        }
+    }
+    _logger.image_base = info->dlpi_addr;
+    _logger.image_start = start;
+    _logger.image_end = end;
+
+    // DONE
+    return 1;
+}
+
+
+/*
+ *  Send what's queued before the process exits (registered with atexit())
+ */
+static void _flush_at_exit(void)
+{
+    logger_flush(LOGGER_FLUSH_MS);
+}
+
+
+/*
+ *  Milliseconds on CLOCK_MONOTONIC
+ */
+static uint64_t _now_ms(void)
+{
+    // LOCAL VARIABLES
+    struct timespec now = { 0 };  // Current time
+
+    // DONE
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+/*
+ *  Write the frame header for priority (ending with a space) into frame
+ *  Returns the number of bytes written
+ */
+static int _write_header(char *frame, int priority)
+{
+    // LOCAL VARIABLES
+    int length = 0;             // Return value
+    struct timespec now;        // Current time
+    struct tm broken_down;      // now in calendar form
+
+    // STAMP IT
+    // strftime() is slow enough to matter so each thread formats each second once
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (now.tv_sec != _stamp_second || _logger.format != _stamp_format)
+    {
+        if (LOGGER_RFC5424 == _logger.format)
+        {
+            gmtime_r(&now.tv_sec, &broken_down);
+            strftime(_stamp, sizeof(_stamp), "%Y-%m-%dT%H:%M:%S", &broken_down);
+        }
+        else
+        {
+            localtime_r(&now.tv_sec, &broken_down);
+            strftime(_stamp, sizeof(_stamp), "%b %e %H:%M:%S", &broken_down);
+        }
+        _stamp_second = now.tv_sec;
+        _stamp_format = _logger.format;
+    }
+
+    // FRAME IT
+    if (LOGGER_RFC5424 == _logger.format)
+    {
+        length = snprintf(frame, LOGGER_FRAME_SIZE, "<%d>1 %s.%06ldZ %s %s %ld - - ", priority, _stamp,
+                          now.tv_nsec / 1000, _logger.hostname, BINARY_NAME, (long)_logger.pid);
+    }
+    else
+    {
+        length = snprintf(frame, LOGGER_FRAME_SIZE, "<%d>%s %s[%ld]: ", priority, _stamp, BINARY_NAME,
+                          (long)_logger.pid);
+    }
+
+    // DONE
+    return length < 0 ? 0 : length >= LOGGER_FRAME_SIZE ? LOGGER_FRAME_SIZE - 1 : length;
+}
+
+
+/*
+ *  Create the binary log (LOGGER_BINLOG_ENV_VAR or /tmp/<binary>.<pid>.binlog) and write its header
+ *  Returns 0 on success, errno on failure
+ */
+static int _open_binlog(void)
+{
+    // LOCAL VARIABLES
+    int results = 0;                         // 0 on success, errno on failure
+    char *filename = getenv(LOGGER_BINLOG_ENV_VAR);  // Binary log
+    char default_name[PATH_MAX + 1] = { 0 }; // Binary log if filename isn't set
+    LoggerBinlogHeader header = { { 0 } };   // Start of the file
+
+    // OPEN IT
+    if (!filename || !*filename)
+    {
+        snprintf(default_name, sizeof(default_name), "/tmp/%s.%ld.binlog", BINARY_NAME, (long)_logger.pid);
+        filename = default_name;
+    }
+    _logger.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (_logger.fd < 0)
+    {
+        results = get_errno();
+    }
+
+    // WRITE THE HEADER
+    if (0 == results)
+    {
+        dl_iterate_phdr(_find_image, NULL);
+        memcpy(header.magic, LOGGER_BINLOG_MAGIC, sizeof(header.magic));
+        header.version = 1;
+        header.header_size = sizeof(header);
+        header.image_base = _logger.image_base;
+        if (readlink("/proc/self/exe", header.executable, sizeof(header.executable) - 1) < 0)
+        {
+            strcpy(header.executable, "-");  // hare_binlog.bin needs to be told
+        }
+        if (sizeof(header) != write(_logger.fd, &header, sizeof(header)))
+        {
+            results = get_errno();
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Append size bytes of data to frame (at length) if they fit
+ *  Returns true if they did
+ */
+static bool _put_bytes(char *frame, size_t *length, const void *data, size_t size)
+{
+    // LOCAL VARIABLES
+    bool fits = (*length + size <= LOGGER_FRAME_SIZE);  // Return value
+
+    // PUT IT
+    if (true == fits)
+    {
+        memcpy(frame + *length, data, size);
+        *length += size;
+    }
+
+    // DONE
+    return fits;
+}
+
+
+/*
+ *  Append string (or "(null)") to frame (at length) as a uint16_t length and its bytes,
+ *      truncating it to fit
+ *  Returns true if all of it fit
+ */
+static bool _put_string(char *frame, size_t *length, const char *string)
+{
+    // LOCAL VARIABLES
+    size_t string_len = strlen(string ? string : "(null)");  // Bytes to copy
+    uint16_t stored_len = 0;                                 // Bytes that fit
+    bool fits = (*length + sizeof(stored_len) + string_len <= LOGGER_FRAME_SIZE);  // Return value
+
+    // PUT IT
+    if (*length + sizeof(stored_len) <= LOGGER_FRAME_SIZE)
+    {
+        stored_len = fits ? string_len : LOGGER_FRAME_SIZE - *length - sizeof(stored_len);
+        memcpy(frame + *length, &stored_len, sizeof(stored_len));
+        memcpy(frame + *length + sizeof(stored_len), string ? string : "(null)", stored_len);
+        *length += sizeof(stored_len) + stored_len;
+    }
+
+    // DONE
+    return fits;
+}
+
+
+/*
+ *  Encode format and its arguments (see: LoggerBinlogRecord) into frame
+ *  Returns the number of bytes used
+ */
+static uint32_t _encode_record(char *frame, int priority, const char *label, const char *format, va_list args)
+{
+    // LOCAL VARIABLES
+    int errnum = errno;                  // For %m
+    LoggerBinlogRecord record = { 0 };   // Fixed part of the record
+    size_t length = sizeof(record);      // Bytes of frame used
+    bool fits = true;                    // Has everything fit so far?
+    struct timespec now;                 // Current time
+    LoggerConversion conversion;         // Current conversion specification
+    const char *cursor = format;         // Remainder of format
+    int64_t number = 0;                  // Integer (or pointer) argument
+    double real = 0;                     // Floating point argument
+    int32_t star = 0;                    // Field width or precision argument
+    int i = 0;                           // Iterating variable
+
+    // HEADER
+    clock_gettime(CLOCK_REALTIME, &now);
+    record.priority = priority;
+    record.pid = _logger.pid;
+    record.realtime_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    if ((uintptr_t)format >= _logger.image_start && (uintptr_t)format < _logger.image_end)
+    {
+        record.format = (uintptr_t)format - _logger.image_base;
+    }
+    else
+    {
+        record.flags |= LOGGER_RECORD_INLINE;  // e.g., built at runtime: the decoder can't look it up
+    }
+    fits = _put_string(frame, &length, label ? label : "");
+    if (true == fits && (record.flags & LOGGER_RECORD_INLINE))
+    {
+        fits = _put_string(frame, &length, format);
+    }
+
+    // ARGUMENTS
+    while (true == fits && (cursor = logger_next_conversion(cursor, &conversion)))
+    {
+        for (i = 0; i < conversion.stars && true == fits; i++)
+        {
+            star = va_arg(args, int);
+            fits = _put_bytes(frame, &length, &star, sizeof(star));
+        }
+        switch (conversion.type)
+        {
+            case LOGGER_ARG_INT:
+                number = va_arg(args, int);
+                fits = fits && _put_bytes(frame, &length, &number, sizeof(number));
+                break;
+            case LOGGER_ARG_LONG:
+                number = va_arg(args, long long);
+                fits = fits && _put_bytes(frame, &length, &number, sizeof(number));
+                break;
+            case LOGGER_ARG_DOUBLE:
+                real = va_arg(args, double);
+                fits = fits && _put_bytes(frame, &length, &real, sizeof(real));
+                break;
+            case LOGGER_ARG_LONG_DOUBLE:
+                real = (double)va_arg(args, long double);
+                fits = fits && _put_bytes(frame, &length, &real, sizeof(real));
+                break;
+            case LOGGER_ARG_STRING:
+                fits = fits && _put_string(frame, &length, va_arg(args, const char *));
+                break;
+            case LOGGER_ARG_POINTER:
+                number = (uintptr_t)va_arg(args, void *);
+                fits = fits && _put_bytes(frame, &length, &number, sizeof(number));
+                break;
+            case LOGGER_ARG_COUNT:
+                va_arg(args, int *);  // Never written through
+                break;
+            case LOGGER_ARG_ERRNO:
+                number = errnum;
+                fits = fits && _put_bytes(frame, &length, &number, sizeof(number));
+                break;
+            default:
+                break;
+        }
+    }
+    if (false == fits)
+    {
+        record.flags |= LOGGER_RECORD_TRUNCATED;
+    }
+
+    // DONE
+    record.length = length;
+    memcpy(frame, &record, sizeof(record));
+    return record.length;
+}
+
+
+/*
+ *  Empty the ring (nothing else may be using it)
+ */
+static void _reset_ring(void)
+{
+    // LOCAL VARIABLES
+    uint64_t i = 0;  // Iterating variable
+
+    // RESET IT
+    for (i = 0; i < LOGGER_SLOTS; i++)
+    {
+        atomic_store_explicit(&_logger.slots[i].sequence, i, memory_order_relaxed);
+    }
+    atomic_store(&_logger.enqueue, 0);
+    atomic_store(&_logger.dequeue, 0);
+    atomic_store(&_logger.sleeping, 0);
+}
+
+
+/*
+ *  Send count frames, reconnecting once if the syslog daemon went away.  Frames that can't be
+ *      sent are counted as dropped.
+ */
+static void _send_batch(struct mmsghdr *messages, int count)
+{
+    // LOCAL VARIABLES
+    int sent = 0;           // Frames sent
+    int num_sent = 0;       // Return value from sendmmsg()
+    bool retried = false;   // Did we reconnect already?
+
+    // SEND IT
+    while (sent < count)
+    {
+        num_sent = sendmmsg(_logger.fd, messages + sent, count - sent, MSG_NOSIGNAL);
+        if (num_sent > 0)
+        {
+            sent += num_sent;
+        }
+        else if (EINTR == errno)
+        {
+            continue;
+        }
+        else if (false == retried
+                 && (ECONNREFUSED == errno || ENOTCONN == errno || ENOENT == errno)
+                 && 0 == _connect(_logger.fd))
+        {
+            retried = true;  // The syslog daemon restarted
+        }
+        else
+        {
+            atomic_fetch_add_explicit(&_logger.dropped, count - sent, memory_order_relaxed);
+            break;
+        }
+    }
+}
+
+
+/*
+ *  Start the writer thread with every signal blocked (they belong to the daemon's threads)
+ *  Returns 0 on success, errno on failure
+ */
+static int _start_writer(void *(*writer)(void *))
+{
+    // LOCAL VARIABLES
+    int results = 0;        // 0 on success, errno on failure
+    pthread_t thread;       // Writer thread
+    pthread_attr_t attr;    // Detached thread attributes
+    sigset_t all_signals;   // Mask for the writer
+    sigset_t old_signals;   // Caller's mask
+
+    // START IT
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    results = pthread_create(&thread, &attr, writer, NULL);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Append count binary records to the binary log.  Records that can't be written are counted
+ *      as dropped.
+ */
+static void _write_batch(struct iovec *vectors, int count)
+{
+    // LOCAL VARIABLES
+    ssize_t expected = 0;  // Bytes in the batch
+    ssize_t written = 0;   // Return value from writev()
+    int i = 0;             // Iterating variable
+
+    // WRITE IT
+    // O_APPEND keeps each batch whole even when forked processes share the file
+    for (i = 0; i < count; i++)
+    {
+        expected += vectors[i].iov_len;
+    }
+    do
+    {
+        written = writev(_logger.fd, vectors, count);
+    } while (written < 0 && EINTR == errno);
+    if (written != expected)
+    {
+        atomic_fetch_add_explicit(&_logger.dropped, count, memory_order_relaxed);
+    }
+}
+
+
+/*
+ *  Writer thread: send ready frames in batches, sleeping on the doorbell when the ring is empty
+ */
+static void *_writer_main(void *unused)
+{
+    // LOCAL VARIABLES
+    struct mmsghdr messages[LOGGER_BATCH];  // Frames for sendmmsg()
+    struct iovec vectors[LOGGER_BATCH];     // One per frame
+    struct pollfd doorbell = { 0 };         // Wait for a producer
+    uint64_t position = 0;                  // First position in the batch
+    int nap_ms = LOGGER_NAP_MS;             // Longest wait for the doorbell
+    LoggerSlot *slot = NULL;                // Current slot
+    int count = 0;                          // Frames in the batch
+    int i = 0;                              // Iterating variable
+
+    // WRITE
+    (void)unused;
+    memset(messages, 0, sizeof(messages));
+    doorbell.fd = _logger.doorbell;
+    doorbell.events = POLLIN;
+    while (1)
+    {
+        // Gather the ready frames
+        position = atomic_load_explicit(&_logger.dequeue, memory_order_relaxed);
+        for (count = 0; count < LOGGER_BATCH; count++)
+        {
+            slot = &_logger.slots[(position + count) & (LOGGER_SLOTS - 1)];
+            if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != position + count + 1)
+            {
+                break;  // Not published yet
+            }
+            vectors[count].iov_base = slot->frame;
+            vectors[count].iov_len = slot->length;
+            messages[count].msg_hdr.msg_iov = &vectors[count];
+            messages[count].msg_hdr.msg_iovlen = 1;
+        }
+        if (count > 0)
+        {
+            // Send them and hand the slots back to the producers
+            if (LOGGER_BINARY == _logger.format)
+            {
+                _write_batch(vectors, count);
+            }
+            else
+            {
+                _send_batch(messages, count);
+            }
+            for (i = 0; i < count; i++)
+            {
+                slot = &_logger.slots[(position + i) & (LOGGER_SLOTS - 1)];
+                atomic_store_explicit(&slot->sequence, position + i + LOGGER_SLOTS, memory_order_release);
+            }
+            atomic_store_explicit(&_logger.dequeue, position + count, memory_order_release);
+            continue;
+        }
+        // Announce the nap, then look once more so a frame published in between isn't missed
+        atomic_store_explicit(&_logger.sleeping, 1, memory_order_seq_cst);
+        slot = &_logger.slots[position & (LOGGER_SLOTS - 1)];
+        if (atomic_load_explicit(&slot->sequence, memory_order_seq_cst) != position + 1)
+        {
+            poll(&doorbell, 1, nap_ms);
+        }
+        atomic_store_explicit(&_logger.sleeping, 0, memory_order_relaxed);
+        if (doorbell.fd > INVALID_FD && 0 != _reset_doorbell())
+        {
+            // A broken doorbell would wake poll() forever: ignore it and check the ring instead
+            doorbell.fd = INVALID_FD;
+            nap_ms = 1;
+        }
+    }
+
+    // DONE
+    return NULL;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+uint64_t logger_dropped(void)
+{
+    return atomic_load_explicit(&_logger.dropped, memory_order_relaxed);
+}
+
+
+int logger_flush(int timeout_ms)
+{
+    // LOCAL VARIABLES
+    int results = -1;                            // 0 on success, -1 on bad input, ETIMEDOUT
+    uint64_t target = 0;                         // Everything claimed before now
+    uint64_t deadline = 0;                       // When to give up
+    struct timespec nap = { 0, 1000000 };        // Time between checks
+
+    // INPUT VALIDATION
+    if (timeout_ms >= 0)
+    {
+        results = 0;
+    }
+
+    // WAIT
+    if (0 == results && LOGGER_RUNNING == atomic_load(&_state))
+    {
+        target = atomic_load(&_logger.enqueue);
+        deadline = _now_ms() + timeout_ms;
+        if (atomic_load(&_logger.dequeue) < target)
+        {
+            _ring_doorbell();  // If it fails, the writer still checks every LOGGER_NAP_MS
+        }
+        while (atomic_load(&_logger.dequeue) < target)
+        {
+            if (_now_ms() >= deadline)
+            {
+                results = ETIMEDOUT;
+                break;
+            }
+            nanosleep(&nap, NULL);
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+const char *logger_next_conversion(const char *format, LoggerConversion *conversion)
+{
+    // LOCAL VARIABLES
+    const char *next = NULL;  // Return value
+    const char *cursor = format ? strchr(format, '%') : NULL;  // Current character
+    int longs = 0;            // 'l' and other 64-bit length modifiers
+    bool long_double = false; // Saw 'L' (or 'q')
+
+    // INPUT VALIDATION
+    if (cursor && conversion)
+    {
+        memset(conversion, 0, sizeof(LoggerConversion));
+        conversion->start = cursor;
+        cursor++;
+    }
+    else
+    {
+        cursor = NULL;
+    }
+
+    // PARSE IT
+    if (cursor)
+    {
+        while (*cursor && strchr(LOGGER_FLAGS, *cursor))
+        {
+            cursor++;
+        }
+        for ( ; '*' == *cursor || ('0' <= *cursor && *cursor <= '9') || '.' == *cursor; cursor++)
+        {
+            conversion->stars += ('*' == *cursor);
+        }
+        for ( ; *cursor && strchr(LOGGER_LENGTHS, *cursor); cursor++)
+        {
+            longs += ('h' != *cursor);
+            long_double = long_double || 'L' == *cursor || 'q' == *cursor;
+        }
+        switch (*cursor)
+        {
+            case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+                conversion->type = longs ? LOGGER_ARG_LONG : LOGGER_ARG_INT;
+                break;
+            case 'c': case 'C':
+                conversion->type = LOGGER_ARG_INT;
+                break;
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+                conversion->type = long_double ? LOGGER_ARG_LONG_DOUBLE : LOGGER_ARG_DOUBLE;
+                break;
+            case 's':
+                conversion->type = longs ? LOGGER_ARG_POINTER : LOGGER_ARG_STRING;
+                break;
+            case 'S': case 'p':
+                conversion->type = LOGGER_ARG_POINTER;
+                break;
+            case 'n':
+                conversion->type = LOGGER_ARG_COUNT;
+                break;
+            case 'm':
+                conversion->type = LOGGER_ARG_ERRNO;
+                break;
+            default:
+                conversion->type = LOGGER_ARG_NONE;  // %% (or something printf() won't print either)
+                break;
+        }
+        next = *cursor ? cursor + 1 : cursor;
+        conversion->length = next - conversion->start;
+    }
+
+    // DONE
+    return next;
+}
+
+
+int logger_open(LoggerFormat format)
+{
+    // LOCAL VARIABLES
+    int results = -1;                           // 0 on success, -1 on bad input, errno on failure
+    int expected = LOGGER_STOPPED;              // State this call may start from
+    bool starting = false;                      // Did this call claim the logger?
+    char *setting = getenv(LOGGER_ENV_VAR);     // Format requested by the environment
+    char *level = getenv(LOGGER_LEVEL_ENV_VAR); // Level requested by the environment
+    static bool registered = false;             // Are the atexit() and atfork handlers in place?
+
+    // INPUT VALIDATION
+    if (format >= LOGGER_OFF && format <= LOGGER_BINARY)
+    {
+        results = 0;
+    }
+
+    // CLAIM IT
+    if (0 == results)
+    {
+        starting = atomic_compare_exchange_strong(&_state, &expected, LOGGER_STARTING);
+        if (false == starting && LOGGER_FORKED == expected)
+        {
+            // A forked child restarts its parent's logger with its own doorbell and thread
+            starting = atomic_compare_exchange_strong(&_state, &expected, LOGGER_STARTING);
+            if (true == starting)
+            {
+                format = _logger.format;
+                close(_logger.doorbell);
+                _logger.doorbell = INVALID_FD;
+            }
+        }
+        if (false == starting)
+        {
+            results = LOGGER_RUNNING == expected ? 0 : LOGGER_DISABLED == expected ? ENOTSUP : EBUSY;
+        }
+    }
+    if (true == starting && LOGGER_OFF == format)
+    {
+        if (level)
+        {
+            logger_set_level(logger_parse_level(level));
+        }
+        if (setting && 0 == strcmp(setting, "off"))
+        {
+            results = ENOTSUP;
+        }
+        else if (setting && 0 == strcmp(setting, "binary"))
+        {
+            format = LOGGER_BINARY;
+        }
+        else
+        {
+            format = (setting && 0 == strcmp(setting, "5424")) ? LOGGER_RFC5424 : LOGGER_RFC3164;
+        }
+    }
+
+    // START IT
+    if (true == starting && 0 == results)
+    {
+        _logger.format = format;
+        _logger.pid = getpid();
+        if (gethostname(_logger.hostname, sizeof(_logger.hostname) - 1) || !_logger.hostname[0])
+        {
+            strcpy(_logger.hostname, "-");  // RFC 5424 NILVALUE
+        }
+        _reset_ring();
+        if (_logger.fd < 0 && LOGGER_BINARY == format)
+        {
+            results = _open_binlog();
+        }
+        else if (_logger.fd < 0)
+        {
+            _logger.fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+            results = _logger.fd < 0 ? get_errno() : _connect(_logger.fd);
+        }
+    }
+    if (true == starting && 0 == results)
+    {
+        _logger.doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        results = _logger.doorbell < 0 ? get_errno() : _start_writer(_writer_main);
+    }
+    if (true == starting && 0 == results)
+    {
+        if (false == registered)
+        {
+            atexit(_flush_at_exit);
+            pthread_atfork(NULL, NULL, _after_fork);
+            registered = true;
+        }
+        atomic_store(&_state, LOGGER_RUNNING);
+    }
+
+    // CLEANUP
+    if (true == starting && 0 != results)
+    {
+        // Fall back to syslog() for good (reported by the caller, which can still log)
+        if (_logger.fd > INVALID_FD)
+        {
+            close(_logger.fd);
+            _logger.fd = INVALID_FD;
+        }
+        if (_logger.doorbell > INVALID_FD)
+        {
+            close(_logger.doorbell);
+            _logger.doorbell = INVALID_FD;
+        }
+        atomic_store(&_state, LOGGER_DISABLED);
+    }
+
+    // DONE
+    return results;
+}
+
+
+int logger_parse_level(const char *name)
+{
+    // LOCAL VARIABLES
+    int level = -1;                  // Return value
+    CODE *priority = priorityNames;  // Iterating variable
+    char *end = NULL;                // End of a numeric level
+
+    // PARSE IT
+    if (name && name[0] >= '0' && name[0] <= '9')
+    {
+        level = (int)strtol(name, &end, 10);
+        if (*end || level < LOG_EMERG || level > LOG_DEBUG)
+        {
+            level = -1;
+        }
+    }
+    else if (name)
+    {
+        for (priority = priorityNames; priority->name; priority++)
+        {
+            if (priority->value >= LOG_EMERG && 0 == strcasecmp(priority->name, name))
+            {
+                level = priority->value;
+                break;
+            }
+        }
+    }
+
+    // DONE
+    return level;
+}
+
+
+void logger_set_level(int level)
+{
+    if (level >= LOG_EMERG && level <= LOG_DEBUG)
+    {
+        logger_level = level;
+        setlogmask(LOG_UPTO(level));  // For syslog() if the logger is off
+    }
+}
+
+
+int logger_write(int priority, const char *label, const char *format, ...)
+{
+    // LOCAL VARIABLES
+    int results = 0;  // Return value from logger_vwrite()
+    va_list args;     // Needed for variable length arguments
+
+    // DO IT
+    va_start(args, format);
+    results = logger_vwrite(priority, label, format, args);
+    va_end(args);
+
+    // DONE
+    return results;
+}
+
+
+int logger_vwrite(int priority, const char *label, const char *format, va_list args)
+{
+    // LOCAL VARIABLES
+    int results = -1;          // 0 on success, -1 on bad input, EAGAIN if dropped, errno on failure
+    bool queuing = false;      // Does priority pass the syslog mask?
+    uint64_t position = 0;     // Ring position claimed for this record
+    int64_t difference = 0;    // Slot sequence minus position
+    LoggerSlot *slot = NULL;   // Claimed slot
+    int length = 0;            // Bytes of frame used
+    int written = 0;           // Return value from snprintf()/vsnprintf()
+
+    // INPUT VALIDATION
+    if (format && priority >= LOG_EMERG && priority <= LOG_DEBUG)
+    {
+        results = 0;
+        if (LOGGER_RUNNING != atomic_load_explicit(&_state, memory_order_acquire))
+        {
+            results = logger_open(LOGGER_OFF);
+        }
+    }
+    if (0 == results)
+    {
+        // What syslog() would have checked (logger_level is usually checked by LOG_ENABLED() already)
+        queuing = (priority <= logger_level && 0 != (setlogmask(0) & LOG_MASK(priority)));
+    }
+
+    // CLAIM A SLOT
+    if (true == queuing)
+    {
+        position = atomic_load_explicit(&_logger.enqueue, memory_order_relaxed);
+        while (1)
+        {
+            slot = &_logger.slots[position & (LOGGER_SLOTS - 1)];
+            difference = (int64_t)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - position);
+            if (0 == difference)
+            {
+                if (atomic_compare_exchange_weak_explicit(&_logger.enqueue, &position, position + 1,
+                                                          memory_order_relaxed, memory_order_relaxed))
+                {
+                    break;  // It's ours
+                }
+            }
+            else if (difference < 0)
+            {
+                results = EAGAIN;  // Full: drop it rather than wait on the writer
+                atomic_fetch_add_explicit(&_logger.dropped, 1, memory_order_relaxed);
+                break;
+            }
+            else
+            {
+                position = atomic_load_explicit(&_logger.enqueue, memory_order_relaxed);
+            }
+        }
+    }
+
+    // FRAME IT
+    if (true == queuing && 0 == results && LOGGER_BINARY == _logger.format)
+    {
+        slot->length = _encode_record(slot->frame, priority, label, format, args);
+    }
+    else if (true == queuing && 0 == results)
+    {
+        length = _write_header(slot->frame, LOG_DAEMON | priority);
+        if (label)
+        {
+            written = snprintf(slot->frame + length, LOGGER_FRAME_SIZE - length, "[%s] ", label);
+            length += written > 0 ? written : 0;
+            length = length >= LOGGER_FRAME_SIZE ? LOGGER_FRAME_SIZE - 1 : length;
+        }
+        written = vsnprintf(slot->frame + length, LOGGER_FRAME_SIZE - length, format, args);
+        length += written > 0 ? written : 0;
+        slot->length = length >= LOGGER_FRAME_SIZE ? LOGGER_FRAME_SIZE - 1 : length;
+    }
+    if (true == queuing && 0 == results)
+    {
+        // Publish before checking sleeping: paired with _writer_main(), one side always sees the other
+        atomic_store_explicit(&slot->sequence, position + 1, memory_order_seq_cst);
+        if (atomic_load_explicit(&_logger.sleeping, memory_order_seq_cst))
+        {
+            _ring_doorbell();  // If it fails, the writer still checks every LOGGER_NAP_MS
+        }
+    }
+
+    // DONE
+    return results;
+}
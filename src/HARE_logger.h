@@ -0,0 +1,160 @@
+/*
+ *  Batched syslog transport for the HARE library.
+ *  syslog_it() used to openlog(), syslog(), and closelog() for every line, reconnecting to
+ *      /dev/log each time.  The logger instead keeps one connected datagram socket open, builds
+ *      the RFC 3164 (or RFC 5424) frame itself, and queues it in a bounded multi-producer ring.
+ *      A writer thread drains the ring with sendmmsg(), up to LOGGER_BATCH frames per system
+ *      call.  Logging never blocks: when the ring is full the record is dropped and counted
+ *      (see: logger_dropped()).
+ *  The logger starts on first use.  A forked child starts its own writer thread on its first
+ *      log line (records queued in the parent at the time of the fork stay with the parent).
+ *      Queued records are flushed at exit(); call logger_flush() before _exit().
+ *  Set LOGGER_ENV_VAR to "5424" for RFC 5424 frames or "off" to go back to syslog().
+ *  LEVEL GATING
+ *      LOG_ENABLED() (see: HARE_library.h) checks logger_level before syslog_it*() format
+ *      anything, and calls below LOG_COMPILED_LEVEL are compiled out.  Set the level at
+ *      startup with LOGGER_LEVEL_ENV_VAR or at runtime with logger_set_level() (e.g., through
+ *      the control socket), so DEBUG calls can stay in the code.
+ *  BINARY MODE
+ *      Set LOGGER_ENV_VAR to "binary" to skip formatting altogether: each record holds the
+ *      address of its format string in the executable and the raw arguments (strings are
+ *      copied).  The writer thread appends records to LOGGER_BINLOG_ENV_VAR (or
+ *      /tmp/<binary>.<pid>.binlog) and hare_binlog.bin formats them offline.
+ */
+
+#ifndef __HARE_LOGGER__
+#define __HARE_LOGGER__
+
+#include <linux/limits.h>  // PATH_MAX
+#include <stdarg.h>     // va_list
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint*_t
+
+#define LOGGER_ENV_VAR "HARE_SYSLOG"  // "3164" (default), "5424", "binary", or "off"
+#define LOGGER_LEVEL_ENV_VAR "HARE_LOG_LEVEL"  // Starting logger_level (e.g., "INFO")
+#define LOGGER_BINLOG_ENV_VAR "HARE_BINLOG"    // Binary mode's output file
+#define LOGGER_BINLOG_MAGIC "HAREBLG1"         // Identifies a binary log (no nul terminator on disk)
+#define LOGGER_SLOTS 512              // Records the ring holds (a power of two)
+#define LOGGER_FRAME_SIZE 2048        // Longest frame (RFC 5424 receivers should accept 2048 bytes)
+#define LOGGER_BATCH 64               // Most frames the writer sends per sendmmsg()
+#define LOGGER_FLUSH_MS 1000          // Longest logger_flush() waits at exit()
+
+// Syslog frame formats
+typedef enum _LoggerFormat
+{
+    LOGGER_OFF = 0,       // Use syslog() instead
+    LOGGER_RFC3164 = 1,   // <PRI>Mmm dd hh:mm:ss TAG[PID]: MSG (what syslog() sends)
+    LOGGER_RFC5424 = 2,   // <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID - - MSG
+    LOGGER_BINARY = 3     // LoggerBinlogRecord (formatted offline)
+} LoggerFormat;
+
+// Argument a printf() conversion consumes
+typedef enum _LoggerArgType
+{
+    LOGGER_ARG_NONE = 0,         // None (e.g., %%)
+    LOGGER_ARG_INT = 1,          // int (and anything promoted to it)
+    LOGGER_ARG_LONG = 2,         // long, long long, size_t, intmax_t, or ptrdiff_t
+    LOGGER_ARG_DOUBLE = 3,       // double
+    LOGGER_ARG_LONG_DOUBLE = 4,  // long double (recorded as a double)
+    LOGGER_ARG_STRING = 5,       // char * (recorded as a copy)
+    LOGGER_ARG_POINTER = 6,      // void * (including wide strings, recorded as addresses)
+    LOGGER_ARG_COUNT = 7,        // %n's int * (consumed but not recorded)
+    LOGGER_ARG_ERRNO = 8         // None, but %m prints errno (recorded as an int)
+} LoggerArgType;
+
+// One conversion specification in a printf() format string
+typedef struct _LoggerConversion
+{
+    const char *start;    // The '%' that begins it
+    size_t length;        // Length through the conversion character
+    int stars;            // '*' field widths and precisions (each consumes an int first)
+    LoggerArgType type;   // Argument the conversion itself consumes
+} LoggerConversion;
+
+// Start of a binary log file
+typedef struct _LoggerBinlogHeader
+{
+    char magic[8];              // LOGGER_BINLOG_MAGIC
+    uint32_t version;           // Layout version (1)
+    uint32_t header_size;       // sizeof(LoggerBinlogHeader)
+    uint64_t image_base;        // Executable's load bias: format addresses minus this are ELF addresses
+    char executable[PATH_MAX];  // Executable that wrote the log (nul-terminated)
+} LoggerBinlogHeader;
+
+// Binary log record, followed by the label, the inline format (if any), and the arguments.
+//  Strings are a uint16_t length and that many bytes.  Each '*' is an int32_t.  Integers,
+//  doubles, and pointers are 8 bytes.  Nothing is aligned.
+typedef struct _LoggerBinlogRecord
+{
+    uint32_t length;        // Bytes in the record, including this header
+    uint8_t priority;       // LOG_* level
+    uint8_t flags;          // LOGGER_RECORD_* macros
+    uint16_t reserved;      // Must be zero
+    uint32_t pid;           // Process that logged it
+    uint32_t reserved2;     // Must be zero
+    uint64_t realtime_ns;   // When it was logged (CLOCK_REALTIME)
+    uint64_t format;        // ELF address of the format string (unless LOGGER_RECORD_INLINE)
+} LoggerBinlogRecord;
+
+#define LOGGER_RECORD_INLINE 0x01     // The format string isn't in the executable so it follows the label
+#define LOGGER_RECORD_TRUNCATED 0x02  // The arguments didn't all fit in LOGGER_FRAME_SIZE
+
+extern int logger_level;  // Lowest priority (highest LOG_* value) logged, LOG_DEBUG by default
+
+
+/*
+ *  Records dropped because the ring was full (or the socket failed) since the logger started
+ */
+uint64_t logger_dropped(void);
+
+
+/*
+ *  Wait up to timeout_ms milliseconds for the writer thread to send everything queued so far
+ *  Returns 0 on success, -1 on bad input, ETIMEDOUT if records are still queued
+ */
+int logger_flush(int timeout_ms);
+
+
+/*
+ *  Find the next conversion specification in format
+ *  Returns a pointer just past it (and fills in conversion), NULL if there are no more
+ */
+const char *logger_next_conversion(const char *format, LoggerConversion *conversion);
+
+
+/*
+ *  Connect to /dev/log (or create the binary log) and start the writer thread using format.
+ *      Called by the first logger_write() with LOGGER_OFF, which reads the format from
+ *      LOGGER_ENV_VAR.  Also applies LOGGER_LEVEL_ENV_VAR.
+ *  Returns 0 on success, -1 on bad input, errno on failure (ENOTSUP if the logger is off)
+ */
+int logger_open(LoggerFormat format);
+
+
+/*
+ *  Translate a priority name (e.g., "debug") or number (0 through 7) into a LOG_* value
+ *  Returns the level, -1 if name isn't one
+ */
+int logger_parse_level(const char *name);
+
+
+/*
+ *  Log priorities up to level from now on (in this process and any it forks afterwards)
+ */
+void logger_set_level(int level);
+
+
+/*
+ *  Queue a syslog record without blocking
+ *  Arguments
+ *      priority - LOG_* level (LOG_DAEMON is added)
+ *      label - Written as "[label] " before the message (may be NULL)
+ *      format - printf()-style format string for the message
+ *  Returns 0 on success, -1 on bad input, EAGAIN if the record was dropped, errno on
+ *      failure (e.g., ENOTSUP if the logger is off; call syslog() instead)
+ */
+int logger_write(int priority, const char *label, const char *format, ...);
+int logger_vwrite(int priority, const char *label, const char *format, va_list args);
+
+
+#endif  // __HARE_LOGGER__
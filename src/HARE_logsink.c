@@ -0,0 +1,218 @@
+/*
+ *  Implements HARE_logsink.h functions.
+ */
+
+#include <errno.h>           // errno
+#include <stdbool.h>         // bool
+#include <stdio.h>           // snprintf(), vsnprintf()
+#include <string.h>          // memcpy()
+#include <sys/mman.h>        // mmap(), munmap()
+#include <time.h>            // clock_gettime()
+#include <unistd.h>          // getpid()
+#include "HARE_logsink.h"
+
+LogSinkRing *log_sink_ring = NULL;
+
+static LogSinkCallback _callback = NULL;       // Registered callback (NULL if none)
+static void *_callback_context = NULL;         // Passed to _callback
+static _Thread_local bool _publishing = false; // Keeps a callback that logs from recursing
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Fill in record's header, then give it to the ring and the callback (message is already in it)
+ */
+static void _deliver(LogSinkRecord *record, int level, int errnum, const char *format)
+{
+    // LOCAL VARIABLES
+    struct timespec now = { 0 };       // Current time
+    uint64_t position = 0;             // record's position in log_sink_ring
+    LogSinkRecord *slot = NULL;        // record's slot in log_sink_ring
+    LogSinkRing *ring = log_sink_ring; // Ring to publish to (NULL if none)
+
+    // FILL IT IN
+    clock_gettime(CLOCK_REALTIME, &now);
+    record->realtime_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    record->pid = getpid();
+    record->level = level;
+    record->errnum = errnum;
+    record->message_id = logsink_message_id(format);
+
+    // PUBLISH IT
+    if (ring)
+    {
+        position = atomic_fetch_add_explicit(&ring->next, 1, memory_order_relaxed);
+        slot = ring->records + position % LOGSINK_SLOTS;
+        atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);  // Torn until it's copied
+        memcpy((char *)slot + sizeof(slot->sequence), (char *)record + sizeof(record->sequence),
+               sizeof(LogSinkRecord) - sizeof(record->sequence));
+        atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+        if (level >= 0 && level < LOGSINK_LEVELS)
+        {
+            atomic_fetch_add_explicit(&ring->levels[level], 1, memory_order_relaxed);
+        }
+    }
+    if (_callback)
+    {
+        _callback(record, _callback_context);
+    }
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+int logsink_active(void)
+{
+    return (log_sink_ring || _callback) && false == _publishing;
+}
+
+
+int logsink_create(LogSinkRing **ring)
+{
+    // LOCAL VARIABLES
+    int results = -1;            // 0 on success, -1 on bad input, errno on failure
+    void *mapping = MAP_FAILED;  // Return value from mmap()
+
+    // INPUT VALIDATION
+    if (ring)
+    {
+        *ring = NULL;
+        results = 0;
+    }
+
+    // MAP IT
+    if (0 == results)
+    {
+        // Anonymous shared memory starts zeroed, which is an empty ring
+        mapping = mmap(NULL, sizeof(LogSinkRing), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == mapping)
+        {
+            results = errno ? errno : ENOMEM;
+        }
+        else
+        {
+            *ring = mapping;
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+void logsink_destroy(LogSinkRing *ring)
+{
+    if (ring)
+    {
+        if (log_sink_ring == ring)
+        {
+            log_sink_ring = NULL;
+        }
+        munmap(ring, sizeof(LogSinkRing));
+    }
+}
+
+
+uint32_t logsink_message_id(const char *format)
+{
+    // LOCAL VARIABLES
+    uint32_t hash = 2166136261u;  // FNV offset basis
+
+    // HASH IT
+    while (format && *format)
+    {
+        hash ^= (unsigned char)*format++;
+        hash *= 16777619u;  // FNV prime
+    }
+
+    // DONE
+    return hash;
+}
+
+
+int logsink_next(LogSinkRing *ring, uint64_t *cursor, LogSinkRecord *record)
+{
+    // LOCAL VARIABLES
+    int results = -1;              // 1 if a record was copied, 0 if there are no more, -1 on bad input
+    uint64_t next = 0;             // Records published so far
+    LogSinkRecord *slot = NULL;    // Slot *cursor lives in
+
+    // INPUT VALIDATION
+    if (ring && cursor && record)
+    {
+        results = 0;
+        next = atomic_load_explicit(&ring->next, memory_order_acquire);
+        if (next > LOGSINK_SLOTS && *cursor < next - LOGSINK_SLOTS)
+        {
+            *cursor = next - LOGSINK_SLOTS;  // The older ones were overwritten
+        }
+    }
+
+    // COPY IT
+    while (0 == results && *cursor < next)
+    {
+        slot = ring->records + *cursor % LOGSINK_SLOTS;
+        (*cursor)++;
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) == *cursor)
+        {
+            memcpy((char *)record + sizeof(record->sequence), (char *)slot + sizeof(slot->sequence),
+                   sizeof(LogSinkRecord) - sizeof(record->sequence));
+            atomic_store_explicit(&record->sequence, *cursor, memory_order_relaxed);
+            // Make sure it wasn't overwritten while it was copied
+            if (atomic_load_explicit(&slot->sequence, memory_order_acquire) == *cursor)
+            {
+                results = 1;
+            }
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+void logsink_publish(int level, int errnum, const char *format, const char *message)
+{
+    // LOCAL VARIABLES
+    LogSinkRecord record;  // Record being published
+
+    // PUBLISH IT
+    if (logsink_active() && message)
+    {
+        _publishing = true;
+        snprintf(record.message, sizeof(record.message), "%s", message);
+        _deliver(&record, level, errnum, format);
+        _publishing = false;
+    }
+}
+
+
+void logsink_vpublish(int level, int errnum, const char *format, va_list args)
+{
+    // LOCAL VARIABLES
+    LogSinkRecord record;  // Record being published
+
+    // PUBLISH IT
+    if (logsink_active() && format)
+    {
+        _publishing = true;
+        vsnprintf(record.message, sizeof(record.message), format, args);
+        _deliver(&record, level, errnum, format);
+        _publishing = false;
+    }
+}
+
+
+void logsink_set_callback(LogSinkCallback callback, void *context)
+{
+    _callback = NULL;  // Never pair callback with the old context
+    _callback_context = context;
+    _callback = callback;
+}
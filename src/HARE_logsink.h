@@ -0,0 +1,104 @@
+/*
+ *  In-process log capture for test harness oracles.
+ *  syslog_it(), syslog_it2(), and syslog_errno() hand each record (level, errno, message ID,
+ *      and the formatted message) to the log sink, which passes it to:
+ *      - a callback registered with logsink_set_callback() (in the process that logged it)
+ *      - the shared ring at log_sink_ring, if a harness created one before forking the daemon
+ *  A harness reads the ring with logsink_next() after the daemon exits, so it can assert on
+ *      the daemon's ERR and CRIT records without a round trip through syslog.
+ *  Records are only captured if their level is enabled (see: LOG_ENABLED()).  The message ID
+ *      is a hash of the format string, so it's the same for every call from one log statement
+ *      (see: logsink_message_id()).
+ */
+
+#ifndef __HARE_LOGSINK__
+#define __HARE_LOGSINK__
+
+#include <stdarg.h>     // va_list
+#include <stdatomic.h>  // _Atomic
+#include <stdint.h>     // uint*_t
+
+#define LOGSINK_SLOTS 256            // Records the ring holds (older records are overwritten)
+#define LOGSINK_MESSAGE_SIZE 224     // Longest message (including the nul terminator)
+#define LOGSINK_LEVELS 8             // LOG_EMERG through LOG_DEBUG
+#define LOGSINK_ENV_VAR "HARE_LOG_ORACLE"  // Harnesses abort() if the daemon logs at this level or worse
+
+// One log record
+typedef struct _LogSinkRecord
+{
+    _Atomic uint64_t sequence;              // Position + 1 once complete (ring only)
+    uint64_t realtime_ns;                   // When it was logged (CLOCK_REALTIME)
+    uint32_t pid;                           // Process that logged it
+    int32_t level;                          // LOG_* level
+    int32_t errnum;                         // errno passed to syslog_errno() (0 for other calls)
+    uint32_t message_id;                    // logsink_message_id() of the format string
+    char message[LOGSINK_MESSAGE_SIZE];     // Formatted message (nul-terminated, maybe truncated)
+} LogSinkRecord;
+
+// Shared ring of records (MAP_SHARED so forked processes publish to it)
+typedef struct _LogSinkRing
+{
+    _Atomic uint64_t next;                      // Records ever published
+    _Atomic uint64_t levels[LOGSINK_LEVELS];    // Records ever published at each level
+    LogSinkRecord records[LOGSINK_SLOTS];       // Record n is in records[n % LOGSINK_SLOTS]
+} LogSinkRing;
+
+// Receives each record in the process that logged it (anything it logs isn't captured)
+typedef void (*LogSinkCallback)(const LogSinkRecord *record, void *context);
+
+extern LogSinkRing *log_sink_ring;  // Ring syslog_it*() publish to (NULL means none)
+
+
+/*
+ *  Does the log sink want records (so syslog_it*() should format them)?
+ */
+int logsink_active(void);
+
+
+/*
+ *  Map a shared ring into *ring.  Create it before daemonize() so the daemon inherits it, then
+ *      set log_sink_ring.
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int logsink_create(LogSinkRing **ring);
+
+
+/*
+ *  Unmap ring (clearing log_sink_ring if it's ring)
+ */
+void logsink_destroy(LogSinkRing *ring);
+
+
+/*
+ *  Stable ID for a log statement's format string (32-bit FNV-1a)
+ */
+uint32_t logsink_message_id(const char *format);
+
+
+/*
+ *  Copy the record at *cursor (start at 0) out of ring and advance *cursor.  Records that were
+ *      overwritten before they were read are skipped.
+ *  Returns 1 if a record was copied, 0 if there are no more, -1 on bad input
+ */
+int logsink_next(LogSinkRing *ring, uint64_t *cursor, LogSinkRecord *record);
+
+
+/*
+ *  Hand a record to the callback and the ring
+ *  Arguments
+ *      level - LOG_* level
+ *      errnum - errno the record reports (0 if none)
+ *      format - Format string (for the message ID)
+ *      message - The formatted message (logsink_publish()) or format's arguments (logsink_vpublish())
+ */
+void logsink_publish(int level, int errnum, const char *format, const char *message);
+void logsink_vpublish(int level, int errnum, const char *format, va_list args);
+
+
+/*
+ *  Pass every record logged by this process to callback (NULL stops)
+ */
+void logsink_set_callback(LogSinkCallback callback, void *context);
+
+
+#endif  // __HARE_LOGSINK__
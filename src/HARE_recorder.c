@@ -0,0 +1,477 @@
+/*
+ *  Implements HARE_recorder.h functions.
+ */
+
+#define _GNU_SOURCE          // dl_iterate_phdr(), REG_RIP
+#include <errno.h>           // errno
+#include <execinfo.h>        // backtrace()
+#include <fcntl.h>           // open(), posix_fallocate(), O_* macros
+#include <link.h>            // dl_iterate_phdr(), struct dl_phdr_info
+#include <pthread.h>         // pthread_atfork()
+#include <stdbool.h>         // bool
+#include <stdio.h>           // rename(), snprintf(), vsnprintf()
+#include <stdlib.h>          // getenv()
+#include <string.h>          // memcpy(), memset(), strcmp(), strcpy()
+#include <sys/mman.h>        // mmap(), munmap()
+#include <sys/stat.h>        // fstat(), stat(), S_I* macros
+#include <time.h>            // clock_gettime()
+#include <ucontext.h>        // ucontext_t
+#include <unistd.h>          // close(), getpid(), readlink(), unlink()
+#include "HARE_filelog.h"    // filelog_flush_from_signal()
+#include "HARE_library.h"    // INVALID_FD, get_errno()
+#include "HARE_recorder.h"
+
+#define RECORDER_SIGNAL_VALUES 4  // Values in a RECORDER_SIGNAL record
+
+_Static_assert(sizeof(RecorderRecord) == RECORDER_RECORD_SIZE, "RECORDER_DATA_SIZE is out of date");
+
+static RecorderHeader *_header = NULL;   // Mapped recorder file (NULL until recorder_open())
+static RecorderRecord *_records = NULL;  // The ring (just past the header)
+static size_t _mapped_size = 0;          // Bytes mapped at _header
+static void *_alt_stack = NULL;          // Alternate signal stack (NULL if someone else's is in use)
+static const int _fatal_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT, SIGTRAP, SIGSYS };
+static struct sigaction _old_actions[sizeof(_fatal_signals) / sizeof(_fatal_signals[0])];  // Replaced dispositions
+static bool _installed = false;          // Are the fatal signal handlers in place?
+static pid_t _pid = 0;                   // Cached getpid() for records (see: _refresh_pid())
+static pid_t _owner = 0;                 // Process that opened the recorder (the only one to remove it)
+static char _path[PATH_MAX + 1];         // Recorder filename
+static struct stat _file_stat;           // Identifies the recorder file (filename may be replaced)
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Re-cache the pid in a forked child (registered with pthread_atfork())
+ */
+static void _refresh_pid(void)
+{
+    _pid = getpid();
+}
+
+
+/*
+ *  Claim the next slot in the ring and stamp it (async-signal-safe)
+ *  Returns the record, with its position in position, to be completed with _publish()
+ */
+static RecorderRecord *_claim(uint8_t kind, uint8_t priority, uint64_t *position)
+{
+    // LOCAL VARIABLES
+    RecorderRecord *record = NULL;  // Return value
+    struct timespec now = { 0 };    // Current time
+
+    // CLAIM IT
+    *position = atomic_fetch_add_explicit(&_header->next, 1, memory_order_relaxed);
+    record = _records + *position % RECORDER_SLOTS;
+    atomic_store_explicit(&record->sequence, 0, memory_order_relaxed);  // Torn until _publish()
+    clock_gettime(CLOCK_REALTIME, &now);
+    record->realtime_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    record->pid = _pid;
+    record->kind = kind;
+    record->priority = priority;
+    record->length = 0;
+
+    // DONE
+    return record;
+}
+
+
+/*
+ *  Find the executable's load bias (a dl_iterate_phdr() callback: the first object is the executable)
+ */
+static int _find_image(struct dl_phdr_info *info, size_t size, void *data)
+{
+    (void)size;
+    *(uint64_t *)data = info->dlpi_addr;
+    return 1;
+}
+
+
+/*
+ *  Mark record, claimed at position, complete (async-signal-safe)
+ */
+static void _publish(RecorderRecord *record, uint64_t position)
+{
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+}
+
+
+/*
+ *  Instruction pointer when the signal arrived (0 if context doesn't say)
+ */
+static uint64_t _signal_pc(void *context)
+{
+    // LOCAL VARIABLES
+    uint64_t pc = 0;  // Return value
+
+    // FIND IT
+    if (context)
+    {
+#if defined(__x86_64__)
+        pc = (uint64_t)((ucontext_t *)context)->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+        pc = (uint64_t)((ucontext_t *)context)->uc_mcontext.pc;
+#endif  // __x86_64__
+    }
+
+    // DONE
+    return pc;
+}
+
+
+/*
+ *  Record a fatal signal, then hand it to the disposition recorder_open() replaced
+ */
+static void _fatal_handler(int signum, siginfo_t *info, void *context)
+{
+    // LOCAL VARIABLES
+    int errnum = errno;  // Restored before returning
+    size_t i = 0;        // Iterating variable
+    // Faults re-execute the faulting instruction on return, which raises the signal again
+    bool faulted = info && info->si_code > 0
+                   && (SIGSEGV == signum || SIGBUS == signum || SIGILL == signum || SIGFPE == signum);
+
+    // RECORD IT
+    recorder_signal(signum, info, context);
+    filelog_flush_from_signal();  // The process won't get to exit()
+
+    // PASS IT ON
+    for (i = 0; i < sizeof(_fatal_signals) / sizeof(_fatal_signals[0]); i++)
+    {
+        if (_fatal_signals[i] == signum)
+        {
+            sigaction(signum, &_old_actions[i], NULL);
+            break;
+        }
+    }
+    if (false == faulted)
+    {
+        raise(signum);  // Blocked until this handler returns
+    }
+
+    // DONE
+    errno = errnum;
+}
+
+
+/*
+ *  Install _fatal_handler() (on an alternate signal stack, unless one is already in place)
+ *  Returns 0 on success, errno on failure
+ */
+static int _install_handlers(void)
+{
+    // LOCAL VARIABLES
+    int results = 0;                // 0 on success, errno on failure
+    stack_t stack = { 0 };          // Alternate signal stack
+    struct sigaction action;        // Disposition for the fatal signals
+    size_t i = 0;                   // Iterating variable
+
+    // ALTERNATE STACK
+    // Sanitizers install their own: keep it
+    if (0 == sigaltstack(NULL, &stack) && (stack.ss_flags & SS_DISABLE))
+    {
+        _alt_stack = mmap(NULL, RECORDER_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == _alt_stack)
+        {
+            _alt_stack = NULL;
+            results = get_errno();
+        }
+        else
+        {
+            stack.ss_sp = _alt_stack;
+            stack.ss_size = RECORDER_STACK_SIZE;
+            stack.ss_flags = 0;
+            if (sigaltstack(&stack, NULL))
+            {
+                results = get_errno();
+                munmap(_alt_stack, RECORDER_STACK_SIZE);
+                _alt_stack = NULL;
+            }
+        }
+    }
+
+    // HANDLERS
+    if (0 == results)
+    {
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = _fatal_handler;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+        sigemptyset(&action.sa_mask);
+        for (i = 0; i < sizeof(_fatal_signals) / sizeof(_fatal_signals[0]); i++)
+        {
+            sigaddset(&action.sa_mask, _fatal_signals[i]);  // One crash report at a time
+        }
+        for (i = 0; i < sizeof(_fatal_signals) / sizeof(_fatal_signals[0]); i++)
+        {
+            if (sigaction(_fatal_signals[i], &action, &_old_actions[i]))
+            {
+                results = get_errno();
+                break;
+            }
+        }
+        // Put back any that were replaced before the failure
+        while (0 != results && i-- > 0)
+        {
+            sigaction(_fatal_signals[i], &_old_actions[i], NULL);
+        }
+        _installed = (0 == results);
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+void recorder_close(void)
+{
+    // LOCAL VARIABLES
+    stack_t stack = { .ss_flags = SS_DISABLE };  // Turns the alternate signal stack off
+    struct stat current;                          // What the recorder filename is now
+    size_t i = 0;                                 // Iterating variable
+
+    // RESTORE
+    if (true == _installed)
+    {
+        for (i = 0; i < sizeof(_fatal_signals) / sizeof(_fatal_signals[0]); i++)
+        {
+            sigaction(_fatal_signals[i], &_old_actions[i], NULL);
+        }
+        _installed = false;
+    }
+    if (_alt_stack)
+    {
+        sigaltstack(&stack, NULL);
+        munmap(_alt_stack, RECORDER_STACK_SIZE);
+        _alt_stack = NULL;
+    }
+
+    // UNMAP
+    if (_header)
+    {
+        munmap(_header, _mapped_size);
+        _header = NULL;
+        _records = NULL;
+        _mapped_size = 0;
+    }
+
+    // REMOVE IT
+    // A clean exit leaves nothing to read, but forked children and later processes that
+    //  replaced the file don't own it
+    if (getpid() == _owner && 0 == stat(_path, &current)
+        && current.st_dev == _file_stat.st_dev && current.st_ino == _file_stat.st_ino)
+    {
+        unlink(_path);
+    }
+    _owner = 0;
+}
+
+
+int recorder_open(const char *filename)
+{
+    // LOCAL VARIABLES
+    int results = 0;                               // 0 on success, errno on failure
+    char *setting = getenv(RECORDER_ENV_VAR);      // Filename requested by the environment
+    char default_name[PATH_MAX + 1] = { 0 };       // Recorder file if nothing else names one
+    char temp_name[PATH_MAX + 1] = { 0 };          // New recorder file, until it's renamed to filename
+    static bool registered = false;                // Has _refresh_pid() been registered with pthread_atfork()?
+    size_t header_size = (sizeof(RecorderHeader) + 63) & ~(size_t)63;  // Keeps the records aligned
+    size_t size = header_size + (size_t)RECORDER_SLOTS * RECORDER_RECORD_SIZE;  // Recorder file size
+    int fd = INVALID_FD;                           // Recorder file
+    void *mapping = MAP_FAILED;                    // Return value from mmap()
+    void *frame = NULL;                            // backtrace() warm-up
+
+    // INPUT VALIDATION
+    if (_header)
+    {
+        filename = NULL;  // Already open (perhaps inherited from the parent)
+    }
+    else if (!filename && setting && 0 == strcmp(setting, "off"))
+    {
+        results = ENOTSUP;
+    }
+    else if (!filename && setting && *setting)
+    {
+        filename = setting;
+    }
+    else if (!filename)
+    {
+        snprintf(default_name, sizeof(default_name), "/tmp/%s.flight", BINARY_NAME);
+        filename = default_name;
+    }
+
+    // MAP IT
+    // Build a new file and rename it over filename: truncating a file another process still has
+    //  mapped (e.g., a harness running alongside this one) would SIGBUS that process
+    if (0 == results && filename)
+    {
+        if (snprintf(temp_name, sizeof(temp_name), "%s.%ld", filename, (long)getpid()) >= (int)sizeof(temp_name))
+        {
+            results = ENAMETOOLONG;
+        }
+        else if ((fd = open(temp_name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR)) < 0)
+        {
+            results = get_errno();
+        }
+        else
+        {
+            // Allocate every block now: a full disk would otherwise SIGBUS a later record
+            results = posix_fallocate(fd, 0, size);
+        }
+        if (0 == results)
+        {
+            mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            results = MAP_FAILED == mapping ? get_errno() : 0;
+        }
+        if (0 == results && fstat(fd, &_file_stat))
+        {
+            results = get_errno();
+        }
+        if (0 == results && rename(temp_name, filename))
+        {
+            results = get_errno();
+        }
+        if (fd > INVALID_FD)
+        {
+            close(fd);  // The mapping keeps the file
+            if (results)
+            {
+                unlink(temp_name);
+            }
+        }
+    }
+    if (results && MAP_FAILED != mapping)
+    {
+        munmap(mapping, size);
+        mapping = MAP_FAILED;
+    }
+
+    // INITIALIZE IT
+    if (0 == results && MAP_FAILED != mapping)
+    {
+        _pid = getpid();
+        _owner = _pid;
+        strcpy(_path, filename);
+        if (false == registered)
+        {
+            registered = (0 == pthread_atfork(NULL, NULL, _refresh_pid));
+        }
+        _header = mapping;
+        _records = (RecorderRecord *)((char *)mapping + header_size);
+        _mapped_size = size;
+        memcpy(_header->magic, RECORDER_MAGIC, sizeof(_header->magic));
+        _header->version = 1;
+        _header->header_size = header_size;
+        _header->record_size = RECORDER_RECORD_SIZE;
+        _header->slots = RECORDER_SLOTS;
+        dl_iterate_phdr(_find_image, &_header->image_base);
+        if (readlink("/proc/self/exe", _header->executable, sizeof(_header->executable) - 1) < 0)
+        {
+            strcpy(_header->executable, "-");  // hare_flight.bin needs to be told
+        }
+        // The first backtrace() loads libgcc, which isn't async-signal-safe, so get it out of the way
+        backtrace(&frame, 1);
+        results = _install_handlers();
+        if (0 != results)
+        {
+            recorder_close();
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+void recorder_signal(int signum, siginfo_t *info, void *context)
+{
+    // LOCAL VARIABLES
+    RecorderRecord *record = NULL;         // Record being written
+    uint64_t position = 0;                 // record's position in the ring
+    void *frames[RECORDER_FRAMES] = { 0 }; // Backtrace
+    int depth = 0;                         // Frames in the backtrace
+    int i = 0;                             // Iterating variable: frames
+    int count = 0;                         // Frames in the current record
+    int j = 0;                             // Iterating variable: values
+
+    // SIGNAL
+    if (_header)
+    {
+        record = _claim(RECORDER_SIGNAL, 0, &position);
+        record->data.values[0] = (uint64_t)signum;
+        record->data.values[1] = info ? (uint64_t)(int64_t)info->si_code : 0;
+        record->data.values[2] = info ? (uint64_t)(uintptr_t)info->si_addr : 0;
+        record->data.values[3] = _signal_pc(context);
+        record->length = RECORDER_SIGNAL_VALUES;
+        _publish(record, position);
+    }
+
+    // BACKTRACE
+    if (_header)
+    {
+        depth = backtrace(frames, RECORDER_FRAMES);
+        for (i = 0; i < depth; i += count)
+        {
+            count = depth - i;
+            if (count > (int)(sizeof(record->data.values) / sizeof(record->data.values[0])))
+            {
+                count = sizeof(record->data.values) / sizeof(record->data.values[0]);
+            }
+            record = _claim(RECORDER_BACKTRACE, 0, &position);
+            for (j = 0; j < count; j++)
+            {
+                record->data.values[j] = (uint64_t)(uintptr_t)frames[i + j];
+            }
+            record->length = count;
+            _publish(record, position);
+        }
+    }
+}
+
+
+void recorder_write(int priority, const char *label, const char *format, ...)
+{
+    // LOCAL VARIABLES
+    va_list args;  // Needed for variable length arguments
+
+    // DO IT
+    va_start(args, format);
+    recorder_vwrite(priority, label, format, args);
+    va_end(args);
+}
+
+
+void recorder_vwrite(int priority, const char *label, const char *format, va_list args)
+{
+    // LOCAL VARIABLES
+    int errnum = errno;             // Preserved for the caller's own %m
+    RecorderRecord *record = NULL;  // Record being written
+    uint64_t position = 0;          // record's position in the ring
+    int length = 0;                 // Bytes of text written
+    int written = 0;                // Return value from snprintf() and vsnprintf()
+
+    // WRITE IT
+    if (_header && format)
+    {
+        record = _claim(RECORDER_LOG, priority, &position);
+        if (label)
+        {
+            written = snprintf(record->data.text, RECORDER_DATA_SIZE, "[%s] ", label);
+            length = written < 0 ? 0 : written >= RECORDER_DATA_SIZE ? RECORDER_DATA_SIZE - 1 : written;
+        }
+        errno = errnum;
+        written = vsnprintf(record->data.text + length, RECORDER_DATA_SIZE - length, format, args);
+        length += written < 0 ? 0 : written;
+        record->length = length >= RECORDER_DATA_SIZE ? RECORDER_DATA_SIZE - 1 : length;
+        _publish(record, position);
+    }
+
+    // DONE
+    errno = errnum;
+}
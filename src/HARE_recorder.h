@@ -0,0 +1,112 @@
+/*
+ *  Crash-surviving flight recorder for the HARE harnesses and daemon.
+ *  The recorder is a fixed-size ring of records in a MAP_SHARED file.  syslog_it*() append each
+ *      message to it with plain memory writes (no system calls), so the last RECORDER_SLOTS
+ *      messages are in the page cache even if the process dies before the logger sends them.
+ *  recorder_open() also installs a fatal signal handler (SIGSEGV, SIGBUS, SIGILL, SIGFPE,
+ *      SIGABRT, SIGTRAP, and SIGSYS) that runs on an alternate signal stack, so it works after a
+ *      stack overflow.  The handler appends the signal, fault address, faulting instruction, and
+ *      a backtrace, flushes buffered file logs (see: HARE_filelog.h), then hands the signal to the
+ *      previous disposition (e.g., a sanitizer's handler or the default action, so fuzzers still
+ *      see the crash).
+ *  Forked processes (e.g., the daemon and its workers) share their parent's recorder.  Each
+ *      record carries the pid that wrote it.  The alternate signal stack only covers the thread
+ *      that called recorder_open() (and the main thread of forked children).
+ *  hare_flight.bin prints a recorder file, symbolizing backtraces with the executable.
+ */
+
+#ifndef __HARE_RECORDER__
+#define __HARE_RECORDER__
+
+#include <linux/limits.h>  // PATH_MAX
+#include <signal.h>     // siginfo_t
+#include <stdarg.h>     // va_list
+#include <stdatomic.h>  // _Atomic
+#include <stdint.h>     // uint*_t
+
+#define RECORDER_ENV_VAR "HARE_RECORDER"  // Recorder filename (or "off")
+#define RECORDER_MAGIC "HAREFLT1"         // Identifies a recorder file (no nul terminator on disk)
+#define RECORDER_SLOTS 1024               // Records the ring holds
+#define RECORDER_RECORD_SIZE 256          // Bytes per record
+#define RECORDER_DATA_SIZE (RECORDER_RECORD_SIZE - 24)  // Bytes of text (or addresses) per record
+#define RECORDER_FRAMES 64                // Deepest backtrace recorded
+#define RECORDER_STACK_SIZE 65536         // Alternate signal stack size
+
+// What a record holds
+typedef enum _RecorderKind
+{
+    RECORDER_EMPTY = 0,     // Never written
+    RECORDER_LOG = 1,       // A log message (text)
+    RECORDER_SIGNAL = 2,    // A signal (values: number, si_code, si_addr, instruction pointer)
+    RECORDER_BACKTRACE = 3  // The next part of a backtrace (values: return addresses)
+} RecorderKind;
+
+// Start of a recorder file
+typedef struct _RecorderHeader
+{
+    char magic[8];               // RECORDER_MAGIC
+    uint32_t version;            // Layout version (1)
+    uint32_t header_size;        // Offset of the first record
+    uint32_t record_size;        // RECORDER_RECORD_SIZE
+    uint32_t slots;              // RECORDER_SLOTS
+    uint64_t image_base;         // Executable's load bias: addresses minus this are ELF addresses
+    _Atomic uint64_t next;       // Position of the next record (its slot is next % slots)
+    char executable[PATH_MAX];   // Executable that opened the recorder (nul-terminated)
+} RecorderHeader;
+
+// One slot in the ring
+typedef struct _RecorderRecord
+{
+    _Atomic uint64_t sequence;   // Position + 1 once the record is complete, 0 while it's written
+    uint64_t realtime_ns;        // When it was written (CLOCK_REALTIME)
+    uint32_t pid;                // Process that wrote it
+    uint8_t kind;                // RecorderKind
+    uint8_t priority;            // LOG_* level (RECORDER_LOG)
+    uint16_t length;             // Bytes of text or number of values
+    union
+    {
+        char text[RECORDER_DATA_SIZE];                          // RECORDER_LOG
+        uint64_t values[RECORDER_DATA_SIZE / sizeof(uint64_t)]; // RECORDER_SIGNAL and RECORDER_BACKTRACE
+    } data;
+} RecorderRecord;
+
+
+/*
+ *  Restore the signal dispositions recorder_open() replaced and unmap the recorder.  The process
+ *      that opened it also deletes the file (unless another process has replaced it): only a
+ *      fatal signal, which never gets here, leaves a file behind for hare_flight.bin.
+ */
+void recorder_close(void);
+
+
+/*
+ *  Create (or replace) the recorder file, map it, and install the fatal signal handler.
+ *      filename defaults to RECORDER_ENV_VAR, then /tmp/<binary>.flight.  An existing file
+ *      is replaced by renaming a new one over it (never truncated), so a process that still has
+ *      it mapped keeps writing to the old copy instead of faulting.
+ *  Returns 0 on success (or if it's already open), errno on failure (ENOTSUP if
+ *      RECORDER_ENV_VAR is "off")
+ */
+int recorder_open(const char *filename);
+
+
+/*
+ *  Append a signal record and a backtrace of the current thread.  Async-signal-safe, so signal
+ *      handlers may call it (info and context may be NULL).  Does nothing unless the recorder is
+ *      open.
+ */
+void recorder_signal(int signum, siginfo_t *info, void *context);
+
+
+/*
+ *  Append "[label] message" (truncated to fit a record).  Does nothing unless the recorder is open.
+ *  Arguments
+ *      priority - LOG_* level
+ *      label - Written as "[label] " before the message (may be NULL)
+ *      format - printf()-style format string for the message
+ */
+void recorder_write(int priority, const char *label, const char *format, ...);
+void recorder_vwrite(int priority, const char *label, const char *format, va_list args);
+
+
+#endif  // __HARE_RECORDER__
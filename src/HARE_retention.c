@@ -0,0 +1,627 @@
+/*
+ *  Implements HARE_retention.h functions.
+ */
+
+#include <errno.h>           // errno
+#include <fcntl.h>           // AT_* macros
+#include <libgen.h>          // dirname()
+#include <linux/limits.h>    // PATH_MAX
+#include <stdio.h>           // snprintf()
+#include <stdlib.h>          // calloc(), free(), realloc(), strtoll()
+#include <string.h>          // memcpy(), strchr(), strcmp(), strlen(), strncmp()
+#include <sys/stat.h>        // fstatat(), S_IS* macros
+#include <unistd.h>          // rmdir(), unlink()
+#include "HARE_library.h"    // syslog_*(), get_errno()
+#include "HARE_retention.h"
+#include "HARE_storage.h"    // has_datetime_stamp(), STAMP_LEN
+
+#define RETENTION_CHECK_INTERVAL 16      // Units of work between checks of the CPU budget
+#define RETENTION_INITIAL_ENTRIES 1024   // Starting capacity of a sweep's entries
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Microseconds of CPU time used by the calling thread
+ */
+static long long _cpu_usec(void)
+{
+    // LOCAL VARIABLES
+    struct timespec now = { 0 };  // Current thread CPU time
+
+    // MEASURE IT
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+    // DONE
+    return ((long long)now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+}
+
+
+/*
+ *  Order RetentionEntry structs oldest-first by their datetime stamp
+ */
+static int _compare_entries(const RetentionEntry *left, const RetentionEntry *right)
+{
+    return strcmp(left->name, right->name);
+}
+
+
+/*
+ *  Move the entry at index toward the root of engine's heap until its parent is older.
+ *      Does not validate input.
+ */
+static void _sift_up(RetentionEngine *engine, size_t index)
+{
+    // LOCAL VARIABLES
+    RetentionEntry moving = engine->entries[index];  // Entry being placed
+    size_t parent = 0;                               // Index of index's parent
+
+    // SIFT IT
+    while (index > 0)
+    {
+        parent = (index - 1) / 2;
+        if (_compare_entries(engine->entries + parent, &moving) <= 0)
+        {
+            break;
+        }
+        engine->entries[index] = engine->entries[parent];
+        index = parent;
+    }
+    engine->entries[index] = moving;
+}
+
+
+/*
+ *  Move the entry at index away from the root of engine's heap until both its children are
+ *      newer.  Does not validate input.
+ */
+static void _sift_down(RetentionEngine *engine, size_t index)
+{
+    // LOCAL VARIABLES
+    RetentionEntry moving = engine->entries[index];  // Entry being placed
+    size_t child = 0;                                // Index of index's older child
+
+    // SIFT IT
+    while ((child = (2 * index) + 1) < engine->num_entries)
+    {
+        if (child + 1 < engine->num_entries
+            && _compare_entries(engine->entries + child + 1, engine->entries + child) < 0)
+        {
+            child++;
+        }
+        if (_compare_entries(&moving, engine->entries + child) <= 0)
+        {
+            break;
+        }
+        engine->entries[index] = engine->entries[child];
+        index = child;
+    }
+    engine->entries[index] = moving;
+}
+
+
+/*
+ *  Close every directory left open by a scan and free every entry.  Does not validate input.
+ */
+static void _end_sweep(RetentionEngine *engine)
+{
+    // LOCAL VARIABLES
+    size_t i = 0;  // Iterating variable
+
+    // CLOSE DIRS
+    while (engine->depth > 0)
+    {
+        engine->depth--;
+        closedir(engine->dir_stack[engine->depth]);
+        engine->dir_stack[engine->depth] = NULL;
+        free(engine->path_stack[engine->depth]);
+        engine->path_stack[engine->depth] = NULL;
+    }
+
+    // FREE ENTRIES
+    for (i = 0; i < engine->num_entries; i++)
+    {
+        free(engine->entries[i].path);
+    }
+    free(engine->entries);
+    engine->entries = NULL;
+    engine->num_entries = 0;
+    engine->capacity = 0;
+    engine->total_bytes = 0;
+
+    // SCHEDULE THE NEXT ONE
+    engine->phase = RETENTION_IDLE;
+    engine->next_sweep = time(NULL) + engine->policy.interval;
+}
+
+
+/*
+ *  Write the stamp get_datetime_stamp() would have produced max_age seconds ago into
+ *      engine->cutoff.  The format (zero-based month included) must match exactly since
+ *      stamps are compared as strings.  Does not validate input.
+ */
+static void _make_cutoff(RetentionEngine *engine)
+{
+    // LOCAL VARIABLES
+    time_t T = time(NULL) - engine->policy.max_age;  // Oldest acceptable time
+    struct tm when = { 0 };                          // Broken-down T
+    char stamp[64] = { 0 };                          // Roomy enough for any int fields
+
+    // FORMAT IT
+    engine->cutoff[0] = '\0';
+    if (engine->policy.max_age > 0 && localtime_r(&T, &when))
+    {
+        snprintf(stamp, sizeof(stamp), "%04d%02d%02d_%02d%02d%02d_",
+                 when.tm_year + 1900, when.tm_mon, when.tm_mday, when.tm_hour, when.tm_min, when.tm_sec);
+        memcpy(engine->cutoff, stamp, STAMP_LEN);
+        engine->cutoff[STAMP_LEN] = '\0';
+    }
+}
+
+
+/*
+ *  Open dir_path and push it onto engine's directory stack.  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _push_dir(RetentionEngine *engine, char *dir_path)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                      // 0 on success, errno on failure
+    size_t path_len = strlen(dir_path);  // Length of dir_path
+    char *path_copy = NULL;              // Heap-allocated copy of dir_path
+    DIR *dir_stream = NULL;              // Directory stream for dir_path
+
+    // OPEN IT
+    path_copy = calloc(path_len + 1, sizeof(char));
+    if (!path_copy)
+    {
+        errnum = get_errno();
+    }
+    else if (NULL == (dir_stream = opendir(dir_path)))
+    {
+        errnum = get_errno();
+        free(path_copy);
+    }
+    else
+    {
+        memcpy(path_copy, dir_path, path_len);
+        engine->dir_stack[engine->depth] = dir_stream;
+        engine->path_stack[engine->depth] = path_copy;
+        engine->depth++;
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Record the stamped file dir_path/name as a candidate for eviction.  Entries are kept as a
+ *      min-heap on the stamp so no sweep ever pays for a full sort in one step.  Does not
+ *      validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _add_entry(RetentionEngine *engine, char *dir_path, char *name, off_t size)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                     // 0 on success, errno on failure
+    RetentionEntry *grown = NULL;       // Reallocated entries
+    size_t new_capacity = 0;            // Capacity of grown
+    size_t dir_len = strlen(dir_path);  // Length of dir_path
+    size_t name_len = strlen(name);     // Length of name
+    char *path = NULL;                  // dir_path/name
+
+    // MAKE ROOM
+    if (engine->num_entries == engine->capacity)
+    {
+        new_capacity = engine->capacity ? engine->capacity * 2 : RETENTION_INITIAL_ENTRIES;
+        grown = realloc(engine->entries, new_capacity * sizeof(RetentionEntry));
+        if (grown)
+        {
+            engine->entries = grown;
+            engine->capacity = new_capacity;
+        }
+        else
+        {
+            errnum = ENOMEM;
+        }
+    }
+
+    // ADD IT
+    if (0 == errnum)
+    {
+        path = calloc(dir_len + name_len + 2, sizeof(char));
+        if (path)
+        {
+            memcpy(path, dir_path, dir_len);
+            if (dir_len > 0 && '/' != path[dir_len - 1])
+            {
+                path[dir_len++] = '/';
+            }
+            memcpy(path + dir_len, name, name_len);
+            engine->entries[engine->num_entries].path = path;
+            engine->entries[engine->num_entries].name = path + dir_len;
+            engine->entries[engine->num_entries].size = size;
+            engine->num_entries++;
+            engine->total_bytes += size;
+            _sift_up(engine, engine->num_entries - 1);
+        }
+        else
+        {
+            errnum = ENOMEM;
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Read one directory entry from the top of engine's directory stack.  Descends into shards,
+ *      records stamped files, and pops finished directories.  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _scan_one(RetentionEngine *engine)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                          // 0 on success, errno on failure
+    int top = engine->depth - 1;             // Index of the directory being read
+    struct dirent *entry = NULL;             // Current directory entry
+    struct stat entry_stat = { 0 };          // Current entry's metadata (if needed)
+    bool need_stat = false;                  // Does entry require fstatat()?
+    unsigned char entry_type = DT_UNKNOWN;   // Type of entry
+    char sub_path[PATH_MAX + 1] = { 0 };     // Path to a shard directory
+
+    // READ IT
+    entry = readdir(engine->dir_stack[top]);
+    if (!entry)
+    {
+        // Finished with this directory
+        closedir(engine->dir_stack[top]);
+        engine->dir_stack[top] = NULL;
+        free(engine->path_stack[top]);
+        engine->path_stack[top] = NULL;
+        engine->depth--;
+    }
+    else if ('.' != entry->d_name[0])  // Skip ".", "..", and hidden (e.g., temporary) files
+    {
+        // Only stat() what d_type can't answer (or when sizes matter)
+        entry_type = entry->d_type;
+        need_stat = (DT_UNKNOWN == entry_type)
+                    || (DT_REG == entry_type && engine->policy.max_bytes > 0
+                        && true == has_datetime_stamp(entry->d_name));
+        if (true == need_stat)
+        {
+            if (fstatat(dirfd(engine->dir_stack[top]), entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW))
+            {
+                entry_type = DT_UNKNOWN;  // Vanished: skip it
+            }
+            else
+            {
+                entry_type = S_ISDIR(entry_stat.st_mode) ? DT_DIR : S_ISREG(entry_stat.st_mode) ? DT_REG : DT_UNKNOWN;
+            }
+        }
+
+        if (DT_DIR == entry_type && engine->depth < RETENTION_MAX_DEPTH)
+        {
+            if (snprintf(sub_path, sizeof(sub_path), "%s/%s", engine->path_stack[top], entry->d_name) < sizeof(sub_path))
+            {
+                if (_push_dir(engine, sub_path))
+                {
+                    syslog_errno(errno, "Retention is unable to open %s", sub_path);
+                }
+            }
+        }
+        else if (DT_REG == entry_type && true == has_datetime_stamp(entry->d_name))
+        {
+            errnum = _add_entry(engine, engine->path_stack[top], entry->d_name,
+                                engine->policy.max_bytes > 0 ? entry_stat.st_size : 0);
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Should the oldest remaining entry be evicted?  Does not validate input.
+ */
+static bool _over_limit(RetentionEngine *engine)
+{
+    // LOCAL VARIABLES
+    bool over = false;                         // Return value
+    size_t remaining = engine->num_entries;    // Files left
+    RetentionEntry *oldest = engine->entries;  // Oldest remaining entry (the heap's root)
+
+    // CHECK IT
+    if (remaining > 0)
+    {
+        if (engine->policy.max_files > 0 && remaining > engine->policy.max_files)
+        {
+            over = true;
+        }
+        else if (engine->policy.max_bytes > 0 && engine->total_bytes > engine->policy.max_bytes)
+        {
+            over = true;
+        }
+        else if (engine->cutoff[0] && strncmp(oldest->name, engine->cutoff, STAMP_LEN) < 0)
+        {
+            over = true;
+        }
+    }
+
+    // DONE
+    return over;
+}
+
+
+/*
+ *  Remove directories above filename, up to (but not including) process_dir, until one
+ *      isn't empty.  Keeps time-bucket shards from accumulating forever.  Does not validate input.
+ */
+static void _prune_empty_dirs(char *filename, char *process_dir)
+{
+    // LOCAL VARIABLES
+    char dir_path[PATH_MAX + 1] = { 0 };       // Directory being pruned
+    char *parent = NULL;                       // Return value from dirname()
+    size_t process_len = strlen(process_dir);  // Length of process_dir
+
+    // PRUNE IT
+    while (process_len > 0 && '/' == process_dir[process_len - 1])
+    {
+        process_len--;  // Compare without trailing '/'s
+    }
+    strncpy(dir_path, filename, PATH_MAX);
+    parent = dirname(dir_path);
+    while (strlen(parent) > process_len && !strncmp(parent, process_dir, process_len))
+    {
+        if (rmdir(parent))
+        {
+            break;  // Not empty (or in use): the rest of the way up won't be either
+        }
+        parent = dirname(parent);
+    }
+}
+
+
+/*
+ *  Evict the oldest remaining entry and pop it off the heap.  Does not validate input.
+ *  Returns 1 if a file was removed, 0 otherwise
+ */
+static int _evict_one(RetentionEngine *engine)
+{
+    // LOCAL VARIABLES
+    int removed = 0;                           // Return value
+    RetentionEntry *oldest = engine->entries;  // Entry to evict (the heap's root)
+
+    // EVICT IT
+    if (0 == unlink(oldest->path))
+    {
+        removed = 1;
+        _prune_empty_dirs(oldest->path, engine->process_dir);
+    }
+    else if (ENOENT != errno)
+    {
+        syslog_errno(errno, "Retention is unable to remove %s", oldest->path);
+    }
+    // Either way, it no longer counts against the limits
+    engine->total_bytes -= oldest->size;
+    free(oldest->path);
+    engine->num_entries--;
+    if (engine->num_entries > 0)
+    {
+        engine->entries[0] = engine->entries[engine->num_entries];
+        _sift_down(engine, 0);
+    }
+
+    // DONE
+    return removed;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+void retention_destroy(RetentionEngine *engine)
+{
+    if (engine)
+    {
+        _end_sweep(engine);
+        engine->process_dir = NULL;
+    }
+}
+
+
+int retention_init(RetentionEngine *engine, char *process_dir, RetentionPolicy *policy)
+{
+    // LOCAL VARIABLES
+    int results = -1;  // 0 on success, -1 on bad input
+
+    // INPUT VALIDATION
+    if (engine && process_dir && *process_dir && policy)
+    {
+        results = 0;
+    }
+
+    // INITIALIZE IT
+    if (0 == results)
+    {
+        memset(engine, 0, sizeof(RetentionEngine));
+        engine->policy = *policy;
+        if (engine->policy.budget_usec <= 0)
+        {
+            engine->policy.budget_usec = RETENTION_DEFAULT_BUDGET;
+        }
+        if (engine->policy.interval <= 0)
+        {
+            engine->policy.interval = RETENTION_DEFAULT_INTERVAL;
+        }
+        engine->process_dir = process_dir;
+        engine->phase = RETENTION_IDLE;
+        engine->next_sweep = 0;  // Sweep on the first step
+    }
+
+    // DONE
+    return results;
+}
+
+
+int retention_parse(char *spec, RetentionPolicy *policy)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;                   // 0 on success, -1 on bad input, errno on failure
+    RetentionPolicy parsed = { 0 };    // Limits listed in spec
+    char *key = spec;                  // Current "key=value" pair
+    char *value = NULL;                // Current value
+    char *end = NULL;                  // End of the current value
+    long long number = 0;              // Current value, parsed
+
+    // INPUT VALIDATION
+    if (spec && *spec && policy)
+    {
+        errnum = 0;
+    }
+
+    // PARSE IT
+    while (0 == errnum && key && *key)
+    {
+        value = strchr(key, '=');
+        number = value ? strtoll(value + 1, &end, 10) : -1;
+        if (!value || end == value + 1 || (',' != *end && '\0' != *end) || number < 0)
+        {
+            errnum = EINVAL;
+        }
+        else if (!strncmp(key, "age=", 4))
+        {
+            parsed.max_age = (time_t)number;
+        }
+        else if (!strncmp(key, "bytes=", 6))
+        {
+            parsed.max_bytes = (off_t)number;
+        }
+        else if (!strncmp(key, "files=", 6))
+        {
+            parsed.max_files = (size_t)number;
+        }
+        else if (!strncmp(key, "budget=", 7))
+        {
+            parsed.budget_usec = (long)number;
+        }
+        else if (!strncmp(key, "interval=", 9))
+        {
+            parsed.interval = (time_t)number;
+        }
+        else
+        {
+            errnum = EINVAL;
+        }
+        key = (0 == errnum && ',' == *end) ? end + 1 : NULL;
+    }
+    if (0 == errnum)
+    {
+        *policy = parsed;
+    }
+    else if (EINVAL == errnum)
+    {
+        syslog_it2(LOG_ERR, "Unable to parse the retention policy %s", spec);
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+int retention_step(RetentionEngine *engine)
+{
+    // LOCAL VARIABLES
+    int results = -1;              // Count on success, -1 on bad input, -errno on failure
+    int errnum = 0;                // Errors from local functions
+    long long deadline = 0;        // CPU time at which this step must yield
+    unsigned int work = 0;         // Units of work done during this step
+
+    // INPUT VALIDATION
+    if (engine && engine->process_dir)
+    {
+        results = 0;
+        deadline = _cpu_usec() + engine->policy.budget_usec;
+    }
+
+    // START A SWEEP
+    if (0 == results && RETENTION_IDLE == engine->phase && time(NULL) >= engine->next_sweep)
+    {
+        _make_cutoff(engine);
+        errnum = _push_dir(engine, engine->process_dir);
+        if (errnum)
+        {
+            syslog_errno(errnum, "Retention is unable to open %s", engine->process_dir);
+            results = -errnum;
+            _end_sweep(engine);
+        }
+        else
+        {
+            engine->phase = RETENTION_SCANNING;
+        }
+    }
+
+    // DO IT
+    while (0 <= results && RETENTION_IDLE != engine->phase)
+    {
+        // Yield once the budget is spent
+        if (0 == (++work % RETENTION_CHECK_INTERVAL) && _cpu_usec() >= deadline)
+        {
+            break;
+        }
+
+        if (RETENTION_SCANNING == engine->phase)
+        {
+            if (engine->depth > 0)
+            {
+                errnum = _scan_one(engine);
+                if (errnum)
+                {
+                    syslog_errno(errnum, "Retention sweep of %s failed", engine->process_dir);
+                    results = -errnum;
+                    _end_sweep(engine);
+                }
+            }
+            else
+            {
+                // Done scanning: the heap already has the oldest stamp at its root
+                engine->phase = RETENTION_EVICTING;
+            }
+        }
+        else if (true == _over_limit(engine))
+        {
+            results += _evict_one(engine);
+        }
+        else
+        {
+            // Policy satisfied
+            _end_sweep(engine);
+        }
+    }
+
+    // DONE
+    if (results > 0)
+    {
+        engine->evicted += results;
+        syslog_it2(LOG_INFO, "Retention evicted %d files from %s", results, engine->process_dir);
+    }
+    return results;
+}
+
+
+void retention_trigger(RetentionEngine *engine)
+{
+    if (engine)
+    {
+        engine->next_sweep = 0;
+    }
+}
@@ -0,0 +1,108 @@
+/*
+ *  Retention and eviction engine for the HARE daemon's processed directory.
+ *  The engine enforces age, total-byte, and file-count limits by evicting stamped files
+ *      oldest-first.  Age and ordering come from the "YYYYMMDD_HHMMSS_" prefix that
+ *      get_datetime_stamp() puts on every processed filename so no stat() sweep is needed
+ *      to find the oldest files (sizes are only stat()ed when a byte limit is set).
+ *  Work is split into small steps: each call to retention_step() stops once it has used its
+ *      CPU budget and picks up where it left off on the next call, so a sweep of millions of
+ *      files never stalls the processing loop.  Scanned files go straight into a min-heap and
+ *      evictions pop it, so ordering them costs O(log n) per unit of work instead of a sort.
+ */
+
+#ifndef __HARE_RETENTION__
+#define __HARE_RETENTION__
+
+#include <dirent.h>     // DIR
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+#include <sys/types.h>  // off_t
+#include <time.h>       // time_t
+#include "HARE_storage.h"  // SHARD_MAX_LEVELS
+
+#define RETENTION_DEFAULT_BUDGET 2000    // Default CPU budget, in microseconds, per retention_step()
+#define RETENTION_DEFAULT_INTERVAL 60    // Default number of seconds between sweeps
+#define RETENTION_MAX_DEPTH (SHARD_MAX_LEVELS + 2)  // Directory levels a sweep will descend (incl. worker shards)
+#define RETENTION_ENV_VAR "HARE_RETENTION"  // Retention policy (see: retention_parse())
+
+// Limits for the processed directory (0 means "no limit" for each)
+typedef struct _RetentionPolicy
+{
+    time_t max_age;      // Evict files stamped more than this many seconds ago
+    off_t max_bytes;     // Evict the oldest files while the total size exceeds this
+    size_t max_files;    // Evict the oldest files while there are more than this many
+    long budget_usec;    // CPU time each retention_step() may use (0 for RETENTION_DEFAULT_BUDGET)
+    time_t interval;     // Seconds between sweeps (0 for RETENTION_DEFAULT_INTERVAL)
+} RetentionPolicy;
+
+// A stamped file found during a sweep
+typedef struct _RetentionEntry
+{
+    char *path;   // Absolute filename (heap-allocated)
+    char *name;   // Base filename inside path (begins with the datetime stamp)
+    off_t size;   // Size in bytes (only measured when the policy has max_bytes)
+} RetentionEntry;
+
+// Where a sweep is in its cycle
+typedef enum _RetentionPhase
+{
+    RETENTION_IDLE = 0,  // Waiting for next_sweep
+    RETENTION_SCANNING,  // Walking the processed directory into entries
+    RETENTION_EVICTING   // Removing the oldest entries until the policy is satisfied
+} RetentionPhase;
+
+// Incremental state for one processed directory
+typedef struct _RetentionEngine
+{
+    RetentionPolicy policy;                     // Limits to enforce
+    char *process_dir;                          // Processed directory (not owned)
+    RetentionPhase phase;                       // Current phase
+    time_t next_sweep;                          // When the next sweep starts (0 for "now")
+    DIR *dir_stack[RETENTION_MAX_DEPTH];        // Open directories while scanning
+    char *path_stack[RETENTION_MAX_DEPTH];      // Names of the open directories
+    int depth;                                  // Number of entries in dir_stack
+    RetentionEntry *entries;                    // Min-heap (by stamp) of files not yet evicted
+    size_t num_entries;                         // Number of entries in use
+    size_t capacity;                            // Number of entries allocated
+    off_t total_bytes;                          // Size of every entry not yet evicted
+    char cutoff[STAMP_LEN + 1];                 // Stamps that sort before this are too old
+    size_t evicted;                             // Files evicted since retention_init()
+} RetentionEngine;
+
+
+/*
+ *  Free all memory held by engine and close any directories left open by a sweep
+ */
+void retention_destroy(RetentionEngine *engine);
+
+
+/*
+ *  Prepare engine to enforce policy on process_dir.  The first sweep starts on the first step.
+ *  Returns 0 on success, -1 on bad input
+ */
+int retention_init(RetentionEngine *engine, char *process_dir, RetentionPolicy *policy);
+
+
+/*
+ *  Parse a comma-separated list of limits into policy (anything not listed is 0): age=<seconds>,
+ *      bytes=<bytes>, files=<count>, budget=<microseconds>, interval=<seconds>
+ *      (e.g., "age=86400,files=10000")
+ *  Returns 0 on success, -1 on bad input, EINVAL if spec is malformed
+ */
+int retention_parse(char *spec, RetentionPolicy *policy);
+
+
+/*
+ *  Advance engine's sweep until it completes or the policy's CPU budget is spent
+ *  Returns the number of files evicted on success, -1 on bad input, -errno on failure
+ */
+int retention_step(RetentionEngine *engine);
+
+
+/*
+ *  Start a new sweep on the next retention_step(), even if the interval hasn't elapsed
+ */
+void retention_trigger(RetentionEngine *engine);
+
+
+#endif  // __HARE_RETENTION__
@@ -0,0 +1,305 @@
+/*
+ *  Implements HARE_ring.h functions.
+ */
+
+#define _GNU_SOURCE          // memfd_create()
+#include <errno.h>           // errno
+#include <poll.h>            // poll(), struct pollfd
+#include <string.h>          // memcpy(), memset()
+#include <sys/eventfd.h>     // eventfd(), EFD_* macros
+#include <sys/mman.h>        // memfd_create(), mmap(), munmap()
+#include <unistd.h>          // close(), ftruncate(), read(), write()
+#include "HARE_arena.h"      // hare_message_alloc()
+#include "HARE_library.h"    // INVALID_FD, get_errno()
+#include "HARE_ring.h"
+
+#define RING_PAD(length) (((length) + RING_ALIGN - 1) & ~((uint64_t)RING_ALIGN - 1))  // Round up to RING_ALIGN
+
+MessageRing *message_ring = NULL;
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+int ring_create(MessageRing *ring, size_t capacity)
+{
+    // LOCAL VARIABLES
+    int results = -1;           // 0 on success, -1 on bad input, errno on failure
+    size_t rounded = RING_ALIGN * 2;  // Capacity rounded up to a power of two
+    void *mapping = MAP_FAILED;  // Return value from mmap()
+
+    // INPUT VALIDATION
+    if (ring && capacity <= ((size_t)1 << 31))
+    {
+        memset(ring, 0, sizeof(MessageRing));
+        ring->memfd = INVALID_FD;
+        ring->doorbell = INVALID_FD;
+        capacity = capacity ? capacity : RING_DEFAULT_SIZE;
+        while (rounded < capacity)
+        {
+            rounded <<= 1;
+        }
+        ring->map_size = sizeof(RingHeader) + rounded;
+        results = 0;
+    }
+
+    // CREATE IT
+    if (0 == results)
+    {
+        ring->memfd = memfd_create("hare_ring", MFD_CLOEXEC);
+        ring->doorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ring->memfd < 0 || ring->doorbell < 0 || ftruncate(ring->memfd, ring->map_size))
+        {
+            results = get_errno();
+        }
+    }
+    if (0 == results)
+    {
+        mapping = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->memfd, 0);
+        if (MAP_FAILED == mapping)
+        {
+            results = get_errno();
+        }
+        else
+        {
+            // The memfd is zero-filled, so head, tail, sleeping, and closed start at zero
+            ring->header = mapping;
+            ring->header->capacity = rounded;
+            ring->data = (char *)mapping + sizeof(RingHeader);
+        }
+    }
+
+    // CLEANUP
+    if (results > 0)
+    {
+        syslog_errno(results, "Unable to create a %zu byte message ring", rounded);
+        ring_destroy(ring);
+    }
+
+    // DONE
+    return results;
+}
+
+
+int ring_close(MessageRing *ring)
+{
+    // LOCAL VARIABLES
+    int results = -1;   // 0 on success, -1 on bad input, errno on failure
+    uint64_t ding = 1;  // Doorbell value
+
+    // INPUT VALIDATION
+    if (ring && ring->header)
+    {
+        results = 0;
+    }
+
+    // CLOSE IT
+    if (0 == results)
+    {
+        // After every ring_send() so a consumer that sees closed also sees the last tail
+        atomic_store_explicit(&ring->header->closed, 1, memory_order_seq_cst);
+        if (sizeof(ding) != write(ring->doorbell, &ding, sizeof(ding)) && EAGAIN != errno)
+        {
+            results = get_errno();  // Wake the consumer whether or not it announced a nap
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+void ring_destroy(MessageRing *ring)
+{
+    if (ring)
+    {
+        if (ring->header)
+        {
+            munmap(ring->header, ring->map_size);
+        }
+        if (ring->memfd > INVALID_FD)
+        {
+            close(ring->memfd);
+        }
+        if (ring->doorbell > INVALID_FD)
+        {
+            close(ring->doorbell);
+        }
+        memset(ring, 0, sizeof(MessageRing));
+        ring->memfd = INVALID_FD;
+        ring->doorbell = INVALID_FD;
+    }
+}
+
+
+char *ring_receive(MessageRing *ring, int *msg_len, int *errnum)
+{
+    // LOCAL VARIABLES
+    char *message = NULL;     // Return value
+    uint64_t head = 0;        // Consumer position
+    uint64_t tail = 0;        // Producer position
+    uint64_t offset = 0;      // Offset of head in the ring data
+    RingRecord record;        // Header of the oldest record
+    bool receiving = false;   // Flow control
+    bool closed = false;      // Has the producer finished?
+
+    // INPUT VALIDATION
+    if (ring && ring->header && msg_len && errnum)
+    {
+        *msg_len = 0;
+        *errnum = 0;
+        // Check closed before tail: the producer closes after its last send
+        closed = (0 != atomic_load_explicit(&ring->header->closed, memory_order_acquire));
+        head = atomic_load_explicit(&ring->header->head, memory_order_relaxed);
+        tail = atomic_load_explicit(&ring->header->tail, memory_order_acquire);
+        receiving = (head != tail);
+        if (head == tail && true == closed)
+        {
+            *errnum = EPIPE;  // Drained and nothing else is coming
+        }
+    }
+
+    // RECEIVE IT
+    while (true == receiving)
+    {
+        offset = head & (ring->header->capacity - 1);
+        memcpy(&record, ring->data + offset, sizeof(record));
+        if (RING_WRAP == record.length)
+        {
+            head += ring->header->capacity - offset;  // The rest of the ring was too short
+            receiving = (head != tail);
+            continue;
+        }
+        message = hare_message_alloc(record.length + 1);
+        if (message)
+        {
+            memcpy(message, ring->data + offset + sizeof(record), record.length);
+            *msg_len = record.length;
+            head += sizeof(record) + RING_PAD(record.length);
+        }
+        else
+        {
+            *errnum = ENOMEM;  // Leave it in the ring
+        }
+        receiving = false;
+    }
+    if (ring && ring->header && msg_len && errnum)
+    {
+        // Hand the space back to the producer
+        atomic_store_explicit(&ring->header->head, head, memory_order_release);
+    }
+
+    // DONE
+    return message;
+}
+
+
+int ring_send(MessageRing *ring, char *message, size_t length)
+{
+    // LOCAL VARIABLES
+    int results = -1;                         // 0 on success, -1 on bad input, errno on failure
+    uint64_t capacity = 0;                    // Bytes of ring data
+    uint64_t head = 0;                        // Consumer position
+    uint64_t tail = 0;                        // Producer position
+    uint64_t offset = 0;                      // Offset of tail in the ring data
+    uint64_t needed = 0;                      // Bytes the record needs
+    uint64_t skipped = 0;                     // Bytes wasted by wrapping around
+    RingRecord record = { 0 };                // Header for the new record
+    uint64_t ding = 1;                        // Doorbell value
+
+    // INPUT VALIDATION
+    if (ring && ring->header && message && length > 0 && length < ring->header->capacity / 2)
+    {
+        capacity = ring->header->capacity;
+        results = 0;
+    }
+
+    // MAKE ROOM
+    if (0 == results)
+    {
+        head = atomic_load_explicit(&ring->header->head, memory_order_acquire);
+        tail = atomic_load_explicit(&ring->header->tail, memory_order_relaxed);
+        offset = tail & (capacity - 1);
+        needed = sizeof(record) + RING_PAD(length);
+        if (needed > capacity - offset)
+        {
+            skipped = capacity - offset;  // Records never straddle the end of the ring
+        }
+        if (skipped + needed > capacity - (tail - head))
+        {
+            results = EAGAIN;  // Full
+        }
+    }
+
+    // SEND IT
+    if (0 == results)
+    {
+        if (skipped > 0)
+        {
+            record.length = RING_WRAP;
+            memcpy(ring->data + offset, &record, sizeof(record));
+            tail += skipped;
+            offset = 0;
+        }
+        record.length = length;
+        memcpy(ring->data + offset, &record, sizeof(record));
+        memcpy(ring->data + offset + sizeof(record), message, length);
+        // Publish before checking sleeping: paired with ring_wait(), one side always sees the other
+        atomic_store_explicit(&ring->header->tail, tail + needed, memory_order_seq_cst);
+        if (atomic_load_explicit(&ring->header->sleeping, memory_order_seq_cst)
+            && sizeof(ding) != write(ring->doorbell, &ding, sizeof(ding)) && EAGAIN != errno)
+        {
+            results = get_errno();
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+int ring_wait(MessageRing *ring, int other_fd, int timeout_ms)
+{
+    // LOCAL VARIABLES
+    int results = -1;                       // 0 on success, -1 on bad input, errno on failure
+    struct pollfd poll_fds[2] = { { 0 } };  // Doorbell and other_fd
+    nfds_t num_fds = 1;                     // Number of entries in poll_fds
+    uint64_t dings = 0;                     // Doorbell value
+
+    // INPUT VALIDATION
+    if (ring && ring->header)
+    {
+        results = 0;
+    }
+
+    // WAIT
+    if (0 == results)
+    {
+        // Announce the nap, then look once more so a message sent in between isn't missed
+        atomic_store_explicit(&ring->header->sleeping, 1, memory_order_seq_cst);
+        if (atomic_load_explicit(&ring->header->head, memory_order_relaxed)
+            == atomic_load_explicit(&ring->header->tail, memory_order_seq_cst)
+            && 0 == atomic_load_explicit(&ring->header->closed, memory_order_seq_cst))
+        {
+            poll_fds[0].fd = ring->doorbell;
+            poll_fds[0].events = POLLIN;
+            if (other_fd > INVALID_FD)
+            {
+                poll_fds[1].fd = other_fd;
+                poll_fds[1].events = POLLIN;
+                num_fds = 2;
+            }
+            if (-1 == poll(poll_fds, num_fds, timeout_ms) && EINTR != errno)
+            {
+                results = get_errno();
+            }
+        }
+        atomic_store_explicit(&ring->header->sleeping, 0, memory_order_relaxed);
+        read(ring->doorbell, &dings, sizeof(dings));  // Reset it (EAGAIN if nobody rang)
+    }
+
+    // DONE
+    return results;
+}
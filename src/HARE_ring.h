@@ -0,0 +1,106 @@
+/*
+ *  Shared-memory message transport between the test harness and the HARE daemon.
+ *  A single-producer/single-consumer ring lives in a memfd mapping created before
+ *      daemonize(), so the daemon inherits it across fork().  Sending and receiving are a
+ *      memcpy() and an atomic store, so a busy daemon drains thousands of messages without a
+ *      system call.  The producer only rings the eventfd doorbell when the consumer has
+ *      announced that it's about to sleep (see: ring_wait()).
+ *  Set message_ring to use the ring instead of pipe_fds behind getINotifyData().
+ */
+
+#ifndef __HARE_RING__
+#define __HARE_RING__
+
+#include <stdatomic.h>  // _Atomic
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint*_t
+
+#define RING_DEFAULT_SIZE 1048576   // Default bytes of ring data (a power of two)
+#define RING_ALIGN 8                // Every record starts on this boundary
+#define RING_WRAP UINT32_MAX        // Record length marking the unused end of the ring
+#define RING_ENV_VAR "HARE_TRANSPORT"  // Test harnesses use the ring if this is set to "ring"
+
+// Shared state at the start of the mapping (head and tail live on separate cache lines)
+typedef struct _RingHeader
+{
+    _Atomic uint64_t head;        // Bytes ever consumed (written only by the consumer)
+    char head_pad[56];            // Keeps tail off head's cache line
+    _Atomic uint64_t tail;        // Bytes ever produced (written only by the producer)
+    char tail_pad[56];            // Keeps sleeping off tail's cache line
+    _Atomic uint32_t sleeping;    // Non-zero while the consumer waits on the doorbell
+    _Atomic uint32_t closed;      // Non-zero once the producer is done sending (see: ring_close())
+    uint64_t capacity;            // Bytes of ring data that follow the header
+} RingHeader;
+
+// Per-record header in the ring data (followed by length bytes, padded to RING_ALIGN)
+typedef struct _RingRecord
+{
+    uint32_t length;    // Message length or RING_WRAP
+    uint32_t reserved;  // Must be zero
+} RingRecord;
+
+// One process' view of a ring
+typedef struct _MessageRing
+{
+    int memfd;             // memfd backing the ring
+    int doorbell;          // eventfd the producer signals
+    RingHeader *header;    // Start of the mapping
+    char *data;            // Ring data (header->capacity bytes)
+    size_t map_size;       // Size of the mapping
+} MessageRing;
+
+extern MessageRing *message_ring;  // Transport used by getINotifyData() (NULL means pipe_fds)
+
+
+/*
+ *  Create a ring with capacity bytes of data (rounded up to a power of two, 0 uses
+ *      RING_DEFAULT_SIZE).  Create it before daemonize() so the daemon inherits it.
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int ring_create(MessageRing *ring, size_t capacity);
+
+
+/*
+ *  Tell the consumer nothing else is coming (producer only).  The consumer still receives
+ *      every message already in the ring before ring_receive() reports EPIPE.
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int ring_close(MessageRing *ring);
+
+
+/*
+ *  Unmap ring and close its file descriptors
+ */
+void ring_destroy(MessageRing *ring);
+
+
+/*
+ *  Take the oldest message off ring (consumer only)
+ *  Arguments
+ *      ring - Ring from ring_create()
+ *      msg_len - [Out] Length of the message
+ *      errnum - [Out] 0 on success (or empty ring), EPIPE if the ring is empty and closed,
+ *          errno on failure
+ *  Returns a nul-terminated copy from hare_message_alloc(), NULL if the ring is empty or on error
+ */
+char *ring_receive(MessageRing *ring, int *msg_len, int *errnum);
+
+
+/*
+ *  Append length bytes of message to ring (producer only) and ring the doorbell if the
+ *      consumer is asleep
+ *  Returns 0 on success, -1 on bad input, errno on failure (EAGAIN if the ring is full)
+ */
+int ring_send(MessageRing *ring, char *message, size_t length);
+
+
+/*
+ *  Sleep until the producer rings the doorbell, other_fd (if valid) is readable, or
+ *      timeout_ms milliseconds pass (consumer only).  Returns immediately if ring isn't empty
+ *      or is closed.
+ *  Returns 0 on success (or timeout), -1 on bad input, errno on failure
+ */
+int ring_wait(MessageRing *ring, int other_fd, int timeout_ms);
+
+
+#endif  // __HARE_RING__
@@ -3,7 +3,7 @@
  */
 
 #include <errno.h>           // errno
-#include <stdlib.h>          // getenv()
+#include <stdlib.h>          // calloc(), free(), getenv()
 #include <string.h>          // strstr()
 #include "HARE_library.h"    // syslog_*()
 #include "HARE_sanitizer.h"
@@ -85,6 +85,31 @@ int fill_sanitizer_logs(SanitizerLogs *san_logs)
 }
 
 
+void free_sanitizer_logs(SanitizerLogs *san_logs)
+{
+    // INPUT VALIDATION
+    if (san_logs)
+    {
+        // CLEANUP
+        // ASAN
+        if (san_logs->asan_log)
+        {
+            free(san_logs->asan_log);
+            san_logs->asan_log = NULL;
+        }
+        // Memwatch
+        if (san_logs->memwatch_log)
+        {
+            free(san_logs->memwatch_log);
+            san_logs->memwatch_log = NULL;
+        }
+    }
+
+    // DONE
+    return;
+}
+
+
 /*************************************************************************************************/
 /**************************************** LOCAL FUNCTIONS ****************************************/
 /*************************************************************************************************/
@@ -23,8 +23,8 @@ char *get_env_var(char *var_name);
 
 /*
  *  Parses environment variables for external sanitizer environment variables.  Populates
- *  san_logs with what it finds.  Function will error if the struct contains anything.  Caller is
- *  responsible for freeing the heap-allocated pointers in the struct's members.
+ *  san_logs with what it finds.  Function will error if the struct contains anything.  Release the
+ *  struct's members with free_sanitizer_logs().
  *      Address Sanitizer (ASAN) = "ASAN_OPTIONS"
  *      Memwatch = 
  *  Returns 0 on success, -1 on bad input, -2 if no envs were found.
@@ -32,6 +32,13 @@ char *get_env_var(char *var_name);
 int fill_sanitizer_logs(SanitizerLogs *san_logs);
 
 
+/*
+ *  Free the members fill_sanitizer_logs() allocated and NULL them.  Don't free() them yourself:
+ *      callers built with Memwatch would free() memory Memwatch never allocated.
+ */
+void free_sanitizer_logs(SanitizerLogs *san_logs);
+
+
 /*
  *  Create directories necessary to hold the sanitizer logs
  *  Returns 0 on success, -1 on bad input, errno on failure
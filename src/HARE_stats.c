@@ -0,0 +1,436 @@
+/*
+ *  Implements HARE_stats.h functions.
+ */
+
+#include <errno.h>           // errno
+#include <fcntl.h>           // open(), O_* macros
+#include <pthread.h>         // pthread_atfork()
+#include <stdbool.h>         // bool
+#include <string.h>          // memcmp(), memcpy(), memset(), strncpy()
+#include <sys/mman.h>        // mmap(), munmap()
+#include <time.h>            // clock_gettime()
+#include <unistd.h>          // close(), ftruncate(), getpid()
+#include "HARE_library.h"    // INVALID_FD, syslog_errno(), get_errno()
+#include "HARE_stats.h"
+
+#define STATS_READ_TRIES 1000  // stats_read() gives up on a snapshot that never settles
+
+LatencyStats *latency_stats = NULL;
+
+static _Thread_local int _thread_shard = -1;  // This thread's shard (-1 until its first record)
+
+// Names of the stages in the stats file
+static const char *_stage_names[STATS_NUM_STAGES] = { "intake", "queue_wait", "search", "stamp",
+                                                       "end_to_end" };
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Forked children start over with a shard of their own
+ */
+static void _forget_shard(void)
+{
+    _thread_shard = -1;
+}
+
+
+/*
+ *  Bucket that value lands in
+ */
+static int _bucket_index(uint64_t value)
+{
+    // LOCAL VARIABLES
+    int index = value;   // Return value (values below STATS_SUB_BUCKETS get a bucket each)
+    int exponent = 0;    // Position of value's most significant bit
+
+    // BUCKET IT
+    if (value >= STATS_SUB_BUCKETS)
+    {
+        if (value >= (1ULL << STATS_MAX_EXPONENT))
+        {
+            value = (1ULL << STATS_MAX_EXPONENT) - 1;
+        }
+        exponent = 63 - __builtin_clzll(value);
+        index = (exponent - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS
+                + ((value >> (exponent - STATS_SUB_BITS)) & (STATS_SUB_BUCKETS - 1));
+    }
+
+    // DONE
+    return index;
+}
+
+
+/*
+ *  Largest value that lands in bucket index
+ */
+static uint64_t _bucket_ceiling(int index)
+{
+    uint64_t ceiling = UINT64_MAX;  // Return value (the last bucket holds everything bigger)
+
+    if (index < STATS_BUCKETS - 1)
+    {
+        ceiling = stats_bucket_floor(index + 1) - 1;
+    }
+    return ceiling;
+}
+
+
+/*
+ *  Nanoseconds on clock_id
+ */
+static uint64_t _clock_ns(clockid_t clock_id)
+{
+    struct timespec now = { 0 };  // Current time
+
+    clock_gettime(clock_id, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+/*
+ *  Fill in a stage's summary from its buckets
+ */
+static void _summarize(StatsStageSnapshot *stage)
+{
+    // LOCAL VARIABLES
+    uint64_t seen = 0;                                     // Values in the buckets so far
+    uint64_t p50_rank = (stage->count * 500 + 999) / 1000;  // Rank of the 50th percentile
+    uint64_t p99_rank = (stage->count * 990 + 999) / 1000;  // Rank of the 99th percentile
+    uint64_t p999_rank = (stage->count * 999 + 999) / 1000; // Rank of the 99.9th percentile
+    int i = 0;                                             // Iterating variable
+
+    // SUMMARIZE IT
+    stage->min_ns = 0;
+    stage->max_ns = 0;
+    stage->p50_ns = 0;
+    stage->p99_ns = 0;
+    stage->p999_ns = 0;
+    for (i = 0; i < STATS_BUCKETS && stage->count; i++)
+    {
+        if (0 == stage->buckets[i])
+        {
+            continue;
+        }
+        if (0 == seen)
+        {
+            stage->min_ns = stats_bucket_floor(i);
+        }
+        seen += stage->buckets[i];
+        if (0 == stage->p50_ns && seen >= p50_rank)
+        {
+            stage->p50_ns = _bucket_ceiling(i);
+        }
+        if (0 == stage->p99_ns && seen >= p99_rank)
+        {
+            stage->p99_ns = _bucket_ceiling(i);
+        }
+        if (0 == stage->p999_ns && seen >= p999_rank)
+        {
+            stage->p999_ns = _bucket_ceiling(i);
+        }
+        stage->max_ns = _bucket_ceiling(i);
+    }
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+uint64_t stats_bucket_floor(int index)
+{
+    // LOCAL VARIABLES
+    uint64_t floor = index;  // Return value (the first STATS_SUB_BUCKETS buckets are exact)
+    int exponent = 0;        // Power of two the bucket belongs to
+
+    // FIND IT
+    if (index >= STATS_SUB_BUCKETS)
+    {
+        exponent = index / STATS_SUB_BUCKETS + STATS_SUB_BITS - 1;
+        floor = (uint64_t)(STATS_SUB_BUCKETS + index % STATS_SUB_BUCKETS) << (exponent - STATS_SUB_BITS);
+    }
+
+    // DONE
+    return floor;
+}
+
+
+uint64_t stats_age(const struct timespec *when)
+{
+    uint64_t then = when ? (uint64_t)when->tv_sec * 1000000000ULL + when->tv_nsec : 0;  // when in nanoseconds
+    uint64_t now = _clock_ns(CLOCK_REALTIME);  // Current time
+
+    return now > then ? now - then : 0;
+}
+
+
+void stats_close(LatencyStats *stats)
+{
+    if (stats && stats->file)
+    {
+        stats_snapshot(stats);
+        msync(stats->file, sizeof(StatsFile), MS_ASYNC);
+        munmap(stats->file, sizeof(StatsFile));
+        stats->file = NULL;
+        close(stats->fd);
+        stats->fd = INVALID_FD;
+        munmap(stats->shared, sizeof(StatsShared));
+        stats->shared = NULL;
+    }
+}
+
+
+uint64_t stats_now(void)
+{
+    return _clock_ns(CLOCK_MONOTONIC);
+}
+
+
+int stats_open(LatencyStats *stats, const char *filename)
+{
+    // LOCAL VARIABLES
+    int results = -1;             // 0 on success, -1 on bad input, errno on failure
+    void *mapping = MAP_FAILED;   // Return value from mmap()
+    int i = 0;                    // Iterating variable
+    static bool registered = false;  // Has _forget_shard() been registered with pthread_atfork()?
+
+    // INPUT VALIDATION
+    if (stats && filename && *filename)
+    {
+        memset(stats, 0, sizeof(LatencyStats));
+        stats->fd = INVALID_FD;
+        results = 0;
+    }
+
+    // OPEN IT
+    if (0 == results)
+    {
+        // Shared so forked workers record into the same histograms
+        mapping = mmap(NULL, sizeof(StatsShared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        stats->shared = MAP_FAILED == mapping ? NULL : mapping;
+        stats->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (!stats->shared || stats->fd < 0 || ftruncate(stats->fd, sizeof(StatsFile)))
+        {
+            results = get_errno();
+        }
+        else if (false == registered)
+        {
+            registered = (0 == pthread_atfork(NULL, NULL, _forget_shard));
+        }
+    }
+    if (0 == results)
+    {
+        mapping = mmap(NULL, sizeof(StatsFile), PROT_READ | PROT_WRITE, MAP_SHARED, stats->fd, 0);
+        if (MAP_FAILED == mapping)
+        {
+            results = get_errno();
+        }
+        else
+        {
+            stats->file = mapping;
+        }
+    }
+
+    // INITIALIZE IT
+    if (0 == results)
+    {
+        stats->file->version = 1;
+        stats->file->num_stages = STATS_NUM_STAGES;
+        stats->file->num_buckets = STATS_BUCKETS;
+        stats->file->sub_bits = STATS_SUB_BITS;
+        stats->file->pid = getpid();
+        stats->file->started_ns = _clock_ns(CLOCK_REALTIME);
+        for (i = 0; i < STATS_NUM_STAGES; i++)
+        {
+            strncpy(stats->file->stages[i].name, _stage_names[i], STATS_NAME_SIZE - 1);
+        }
+        stats->last_tick_ns = stats_now();
+        stats_snapshot(stats);
+        // Readers trust the file once the magic shows up
+        atomic_thread_fence(memory_order_release);
+        memcpy(stats->file->magic, STATS_MAGIC, sizeof(stats->file->magic));
+    }
+
+    // CLEANUP
+    if (results > 0)
+    {
+        syslog_errno(results, "Unable to open the stats file %s", filename);
+        if (stats->fd > INVALID_FD)
+        {
+            close(stats->fd);
+            stats->fd = INVALID_FD;
+        }
+        if (stats->shared)
+        {
+            munmap(stats->shared, sizeof(StatsShared));
+            stats->shared = NULL;
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+int stats_read(const char *filename, StatsFile *snapshot)
+{
+    // LOCAL VARIABLES
+    int results = -1;             // 0 on success, -1 on bad input, errno on failure
+    int fd = INVALID_FD;          // filename's file descriptor
+    StatsFile *file = NULL;       // filename's mapping
+    void *mapping = MAP_FAILED;   // Return value from mmap()
+    uint64_t before = 0;          // Sequence before the copy
+    uint64_t after = 1;           // Sequence after the copy
+    int tries = 0;                // Copies attempted
+
+    // INPUT VALIDATION
+    if (filename && *filename && snapshot)
+    {
+        results = 0;
+    }
+
+    // MAP IT
+    if (0 == results)
+    {
+        fd = open(filename, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            results = get_errno();
+        }
+        else if (MAP_FAILED == (mapping = mmap(NULL, sizeof(StatsFile), PROT_READ, MAP_SHARED, fd, 0)))
+        {
+            results = get_errno();
+        }
+        else
+        {
+            file = mapping;
+        }
+    }
+
+    // COPY IT
+    // Retry until a copy starts and ends on the same even sequence
+    while (0 == results && before != after && tries++ < STATS_READ_TRIES)
+    {
+        before = atomic_load_explicit(&file->sequence, memory_order_acquire);
+        if (before & 1)
+        {
+            after = before + 1;  // A snapshot is being written
+            continue;
+        }
+        memcpy(snapshot, file, sizeof(StatsFile));
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&file->sequence, memory_order_relaxed);
+    }
+    if (0 == results && before != after)
+    {
+        results = EAGAIN;
+    }
+    else if (0 == results && (memcmp(snapshot->magic, STATS_MAGIC, sizeof(snapshot->magic))
+                              || 1 != snapshot->version || STATS_NUM_STAGES != snapshot->num_stages
+                              || STATS_BUCKETS != snapshot->num_buckets))
+    {
+        results = EPROTO;
+    }
+
+    // CLEANUP
+    if (file)
+    {
+        munmap(file, sizeof(StatsFile));
+    }
+    if (fd > INVALID_FD)
+    {
+        close(fd);
+    }
+
+    // DONE
+    return results;
+}
+
+
+void stats_record(StatsStage stage, uint64_t nanoseconds)
+{
+    // LOCAL VARIABLES
+    LatencyStats *stats = latency_stats;  // Histograms to add to
+    StatsShard *shard = NULL;             // This thread's shard
+
+    // RECORD IT
+    if (stats && stats->shared && stage >= 0 && stage < STATS_NUM_STAGES)
+    {
+        if (_thread_shard < 0)
+        {
+            _thread_shard = atomic_fetch_add_explicit(&stats->shared->next_shard, 1, memory_order_relaxed)
+                            % STATS_MAX_SHARDS;
+        }
+        shard = stats->shared->shards + _thread_shard;
+        atomic_fetch_add_explicit(&shard->counts[stage][_bucket_index(nanoseconds)], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&shard->sums[stage], nanoseconds, memory_order_relaxed);
+    }
+}
+
+
+int stats_snapshot(LatencyStats *stats)
+{
+    // LOCAL VARIABLES
+    int results = -1;                  // 0 on success, -1 on bad input
+    StatsStageSnapshot *stage = NULL;  // Stage being written
+    uint64_t sequence = 0;             // Sequence lock
+    int i = 0;                         // Iterating variable: stages
+    int j = 0;                         // Iterating variable: buckets
+    int k = 0;                         // Iterating variable: shards
+
+    // INPUT VALIDATION
+    if (stats && stats->file && stats->shared)
+    {
+        results = 0;
+    }
+
+    // SNAPSHOT IT
+    if (0 == results)
+    {
+        sequence = atomic_load_explicit(&stats->file->sequence, memory_order_relaxed);
+        atomic_store_explicit(&stats->file->sequence, sequence + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        for (i = 0; i < STATS_NUM_STAGES; i++)
+        {
+            stage = stats->file->stages + i;
+            stage->count = 0;
+            stage->sum_ns = 0;
+            for (j = 0; j < STATS_BUCKETS; j++)
+            {
+                stage->buckets[j] = 0;
+                for (k = 0; k < STATS_MAX_SHARDS; k++)
+                {
+                    stage->buckets[j] += atomic_load_explicit(&stats->shared->shards[k].counts[i][j], memory_order_relaxed);
+                }
+                stage->count += stage->buckets[j];
+            }
+            for (k = 0; k < STATS_MAX_SHARDS; k++)
+            {
+                stage->sum_ns += atomic_load_explicit(&stats->shared->shards[k].sums[i], memory_order_relaxed);
+            }
+            _summarize(stage);
+        }
+        stats->file->snapshot_ns = _clock_ns(CLOCK_REALTIME);
+        atomic_store_explicit(&stats->file->sequence, sequence + 2, memory_order_release);
+    }
+
+    // DONE
+    return results;
+}
+
+
+void stats_tick(LatencyStats *stats)
+{
+    uint64_t now = stats_now();  // Current time
+
+    if (stats && stats->file && now - stats->last_tick_ns >= STATS_INTERVAL_NS)
+    {
+        stats_snapshot(stats);
+        stats->last_tick_ns = now;
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ *  Latency histograms for every stage of the HARE daemon.
+ *  Each stage has an HDR-style histogram: values (nanoseconds) land in log-spaced buckets,
+ *      STATS_SUB_BUCKETS per power of two, so every bucket is within ~6% of the values in it.
+ *  Recording is lock-free: each thread adds to its own shard with relaxed atomics.  The shards
+ *      are shared with forked processes (e.g., backlog and supervisor workers) so the daemon's
+ *      stats cover them too.  stats_tick() periodically merges the shards into an mmap()ed stats
+ *      file that external tools read (see: stats_read()) without stopping the daemon.  Snapshots
+ *      are published under a sequence lock and carry precomputed p50/p99/p999 values.
+ */
+
+#ifndef __HARE_STATS__
+#define __HARE_STATS__
+
+#include <stdatomic.h>  // _Atomic
+#include <stdint.h>     // uint*_t
+#include <time.h>       // struct timespec
+
+#define STATS_MAGIC "HARESTA1"       // Identifies a stats file (no nul terminator on disk)
+#define STATS_SUB_BITS 4             // log2(STATS_SUB_BUCKETS)
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)  // Buckets per power of two
+#define STATS_MAX_EXPONENT 40        // Values of 2^40 ns (~18 minutes) or more share the last bucket
+#define STATS_BUCKETS ((STATS_MAX_EXPONENT - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS)  // Buckets per stage
+#define STATS_MAX_SHARDS 16          // Threads beyond this many share shards
+#define STATS_INTERVAL_NS 1000000000 // stats_tick() snapshots at most this often
+#define STATS_NAME_SIZE 16           // Size of a stage name in the stats file
+#define STATS_ENV_VAR "HARE_STATS"   // Stats file the daemon writes (see: read_settings())
+
+// Stages of the daemon
+typedef enum _StatsStage
+{
+    STATS_INTAKE = 0,      // getINotifyData() returning a message
+    STATS_QUEUE_WAIT = 1,  // From the file's last modification until processing began
+    STATS_SEARCH = 2,      // search_a_file() (and the digest for the store)
+    STATS_STAMP = 3,       // stamp_a_file() (including move_file())
+    STATS_END_TO_END = 4,  // From the file's last modification until it was processed
+    STATS_NUM_STAGES = 5   // Number of stages
+} StatsStage;
+
+// A stage's histogram in the stats file
+typedef struct _StatsStageSnapshot
+{
+    char name[STATS_NAME_SIZE];      // Stage name (nul-terminated)
+    uint64_t count;                  // Values recorded
+    uint64_t sum_ns;                 // Sum of the values
+    uint64_t min_ns;                 // Smallest value (lower bound of its bucket)
+    uint64_t max_ns;                 // Largest value (upper bound of its bucket)
+    uint64_t p50_ns;                 // 50th percentile (upper bound of its bucket)
+    uint64_t p99_ns;                 // 99th percentile
+    uint64_t p999_ns;                // 99.9th percentile
+    uint64_t buckets[STATS_BUCKETS]; // Values per bucket (see: stats_bucket_floor())
+} StatsStageSnapshot;
+
+// On-disk stats file
+typedef struct _StatsFile
+{
+    char magic[8];                               // STATS_MAGIC
+    uint32_t version;                            // Layout version (1)
+    uint32_t num_stages;                         // STATS_NUM_STAGES
+    uint32_t num_buckets;                        // STATS_BUCKETS
+    uint32_t sub_bits;                           // STATS_SUB_BITS
+    int64_t pid;                                 // Process writing the file
+    _Atomic uint64_t sequence;                   // Odd while a snapshot is being written
+    uint64_t started_ns;                         // When recording began (CLOCK_REALTIME)
+    uint64_t snapshot_ns;                        // When the last snapshot was taken (CLOCK_REALTIME)
+    StatsStageSnapshot stages[STATS_NUM_STAGES]; // One histogram per stage
+} StatsFile;
+
+// One thread's counts
+typedef struct _StatsShard
+{
+    _Atomic uint64_t counts[STATS_NUM_STAGES][STATS_BUCKETS];  // Values per bucket
+    _Atomic uint64_t sums[STATS_NUM_STAGES];                   // Sum of the values
+} StatsShard;
+
+// Counts every process recording into a LatencyStats shares (an anonymous shared mapping)
+typedef struct _StatsShared
+{
+    StatsShard shards[STATS_MAX_SHARDS];  // One per thread, across processes
+    _Atomic int next_shard;               // Next shard to hand to a new thread in any process
+} StatsShared;
+
+// A process' histograms
+typedef struct _LatencyStats
+{
+    int fd;                        // Stats file descriptor
+    StatsFile *file;               // Stats file mapping
+    StatsShared *shared;           // Shards and their allocator (shared with forked processes)
+    uint64_t last_tick_ns;         // When stats_tick() last snapshotted (CLOCK_MONOTONIC)
+} LatencyStats;
+
+extern LatencyStats *latency_stats;  // Histograms stats_record() adds to (NULL disables recording)
+
+
+/*
+ *  Smallest value that lands in bucket index
+ */
+uint64_t stats_bucket_floor(int index);
+
+
+/*
+ *  Nanoseconds since when (a CLOCK_REALTIME time such as a file's st_mtim), 0 if it's in the future
+ */
+uint64_t stats_age(const struct timespec *when);
+
+
+/*
+ *  Unmap and close stats after a final snapshot (call it from the process that opened stats)
+ */
+void stats_close(LatencyStats *stats);
+
+
+/*
+ *  Current CLOCK_MONOTONIC time in nanoseconds (use it to time a stage)
+ */
+uint64_t stats_now(void);
+
+
+/*
+ *  Create (or truncate) the stats file filename and start recording
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int stats_open(LatencyStats *stats, const char *filename);
+
+
+/*
+ *  Copy a consistent snapshot out of the stats file filename (for external tools)
+ *  Returns 0 on success, -1 on bad input, errno on failure (EPROTO if it isn't a stats file)
+ */
+int stats_read(const char *filename, StatsFile *snapshot);
+
+
+/*
+ *  Add nanoseconds to stage's histogram in latency_stats (if it's active).  Lock-free.
+ */
+void stats_record(StatsStage stage, uint64_t nanoseconds);
+
+
+/*
+ *  Merge every shard of stats into its stats file
+ *  Returns 0 on success, -1 on bad input
+ */
+int stats_snapshot(LatencyStats *stats);
+
+
+/*
+ *  Snapshot stats if STATS_INTERVAL_NS have passed since the last snapshot.  Call regularly.
+ */
+void stats_tick(LatencyStats *stats);
+
+
+#endif  // __HARE_STATS__
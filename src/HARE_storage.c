@@ -0,0 +1,1085 @@
+/*
+ *  Implements HARE_storage.h functions.
+ */
+
+#define _GNU_SOURCE          // copy_file_range(), splice(), O_TMPFILE, AT_EMPTY_PATH
+#include <errno.h>           // errno
+#include <fcntl.h>           // open(), splice(), O_* macros, AT_* macros
+#include <libgen.h>          // dirname()
+#include <linux/limits.h>    // PATH_MAX
+#include <ctype.h>           // isdigit()
+#include <dirent.h>          // opendir(), readdir(), closedir()
+#include <stdbool.h>         // bool
+#include <stdio.h>           // rename(), snprintf()
+#include <stdlib.h>          // calloc(), free(), strtol()
+#include <string.h>          // strchr(), strlen(), strncmp(), strncpy()
+#include <sys/sendfile.h>    // sendfile()
+#include <sys/stat.h>        // fstat(), fchmod(), futimens(), mkdir()
+#include <unistd.h>          // close(), copy_file_range(), fchown(), link(), linkat(), unlink()
+#include "HARE_arena.h"      // hare_calloc(), hare_free()
+#include "HARE_io.h"         // io_mkdir()
+#include "HARE_library.h"    // syslog_*(), get_errno()
+#include "HARE_storage.h"
+
+#define STORAGE_TMP_PREFIX ".hare_tmp_"  // Prefix for hidden temporary files in a destination dir
+#define SPLICE_CHUNK_SIZE 65536          // Maximum bytes moved by one splice() call
+#define SHARD_DIR_MODE (S_IRWXU | S_IRWXG | S_IRWXO)  // Matches the processed directory itself
+#define SHARD_LEVEL_MAX 9                // Longest single level ("YYYYMMDD/")
+#define FNV_OFFSET_BASIS 2166136261U     // 32-bit FNV-1a starting value
+#define FNV_PRIME 16777619U              // 32-bit FNV-1a multiplier
+
+ShardLayout *shard_layout = NULL;  // Active processed directory layout (NULL means flat)
+
+// Running state of a SHA-256 computation
+typedef struct _Sha256Context
+{
+    uint32_t state[8];   // Intermediate hash value
+    uint64_t bit_len;    // Total number of bits processed
+    uint8_t block[64];   // Partial input block
+    size_t block_len;    // Number of bytes in block
+} Sha256Context;
+
+// SHA-256 round constants (FIPS 180-4)
+static const uint32_t sha256_k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  Does errnum mean "this copy mechanism isn't available here, try the next one"?
+ */
+static bool _try_next_copy(int errnum)
+{
+    return (EXDEV == errnum || ENOSYS == errnum || EINVAL == errnum || EOPNOTSUPP == errnum);
+}
+
+
+/*
+ *  Copy with copy_file_range().  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _copy_with_copy_file_range(int in_fd, int out_fd, off_t length, off_t *copied)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;        // 0 on success, errno on failure
+    ssize_t retval = 0;    // Return value from copy_file_range()
+
+    // COPY IT
+    while (0 == errnum && *copied < length)
+    {
+        retval = copy_file_range(in_fd, NULL, out_fd, NULL, length - *copied, 0);
+        if (retval < 0)
+        {
+            errnum = get_errno();
+            if (EINTR == errnum)
+            {
+                errnum = 0;  // Try again
+            }
+        }
+        else if (0 == retval)
+        {
+            errnum = EOPNOTSUPP;  // Some filesystems (e.g., procfs) report 0 instead of failing
+        }
+        else
+        {
+            *copied += retval;
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Copy with sendfile().  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _copy_with_sendfile(int in_fd, int out_fd, off_t length, off_t *copied)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;        // 0 on success, errno on failure
+    ssize_t retval = 0;    // Return value from sendfile()
+
+    // COPY IT
+    while (0 == errnum && *copied < length)
+    {
+        retval = sendfile(out_fd, in_fd, NULL, length - *copied);
+        if (retval < 0)
+        {
+            errnum = get_errno();
+            if (EINTR == errnum)
+            {
+                errnum = 0;  // Try again
+            }
+        }
+        else if (0 == retval)
+        {
+            errnum = ENODATA;  // Source shrank underneath us
+        }
+        else
+        {
+            *copied += retval;
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Copy with splice() through an anonymous pipe.  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _copy_with_splice(int in_fd, int out_fd, off_t length, off_t *copied)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                                   // 0 on success, errno on failure
+    int splice_pipe[2] = { INVALID_FD, INVALID_FD };  // Kernel-side staging buffer
+    ssize_t in_pipe = 0;                              // Bytes currently sitting in the pipe
+    ssize_t retval = 0;                               // Return value from splice()
+    size_t chunk = 0;                                 // Bytes to move this iteration
+
+    // SETUP
+    if (pipe2(splice_pipe, O_CLOEXEC))
+    {
+        errnum = get_errno();
+    }
+
+    // COPY IT
+    while (0 == errnum && *copied < length)
+    {
+        chunk = (length - *copied) > SPLICE_CHUNK_SIZE ? SPLICE_CHUNK_SIZE : (length - *copied);
+        in_pipe = splice(in_fd, NULL, splice_pipe[PIPE_WRITE], NULL, chunk, SPLICE_F_MOVE);
+        if (in_pipe < 0)
+        {
+            errnum = get_errno();
+        }
+        else if (0 == in_pipe)
+        {
+            errnum = ENODATA;  // Source shrank underneath us
+        }
+        while (0 == errnum && in_pipe > 0)
+        {
+            retval = splice(splice_pipe[PIPE_READ], NULL, out_fd, NULL, in_pipe, SPLICE_F_MOVE);
+            if (retval < 0)
+            {
+                errnum = get_errno();
+            }
+            else
+            {
+                in_pipe -= retval;
+                *copied += retval;
+            }
+        }
+        if (EINTR == errnum)
+        {
+            errnum = 0;  // Try again
+        }
+    }
+
+    // CLEANUP
+    if (INVALID_FD != splice_pipe[PIPE_READ])
+    {
+        close(splice_pipe[PIPE_READ]);
+    }
+    if (INVALID_FD != splice_pipe[PIPE_WRITE])
+    {
+        close(splice_pipe[PIPE_WRITE]);
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  32-bit FNV-1a hash (with a MurmurHash3 finalizer) of the nul-terminated filename
+ */
+static uint32_t _hash_filename(const char *filename)
+{
+    // LOCAL VARIABLES
+    uint32_t hash = FNV_OFFSET_BASIS;  // Return value
+
+    // HASH IT
+    while (*filename)
+    {
+        hash ^= (unsigned char)*filename++;
+        hash *= FNV_PRIME;
+    }
+    // FNV-1a barely mixes the last byte into the high bits, so finish with an avalanche
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BU;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35U;
+    hash ^= hash >> 16;
+
+    // DONE
+    return hash;
+}
+
+
+/*
+ *  Write the name of shard level (0 is the top) for filename/stamp into level_name.  Does not
+ *      validate input.
+ *  Returns true if the level exists, false if filename belongs directly in the processed directory
+ */
+static bool _name_shard_level(int level, char *stamp, char *filename, char level_name[SHARD_LEVEL_MAX + 1])
+{
+    // LOCAL VARIABLES
+    bool exists = false;  // Return value
+    uint32_t hash = 0;    // Hash of filename
+
+    // NAME IT
+    if (SHARD_HASH == shard_layout->scheme)
+    {
+        hash = _hash_filename(filename);
+        snprintf(level_name, SHARD_LEVEL_MAX + 1, "%0*x/", SHARD_HASH_WIDTH,
+                 (unsigned int)((hash >> (24 - (level * 8))) & 0xFF));
+        exists = true;
+    }
+    else if (SHARD_TIME == shard_layout->scheme && stamp && true == has_datetime_stamp(stamp))
+    {
+        // YYYYMMDD_HHMMSS_ buckets into YYYYMMDD/HH/MM/
+        if (0 == level)
+        {
+            snprintf(level_name, SHARD_LEVEL_MAX + 1, "%.8s/", stamp);
+        }
+        else
+        {
+            snprintf(level_name, SHARD_LEVEL_MAX + 1, "%.2s/", stamp + 9 + ((level - 1) * 2));
+        }
+        exists = true;
+    }
+
+    // DONE
+    return exists;
+}
+
+
+/*
+ *  Rotate a 32-bit value right by bits
+ */
+static uint32_t _rotr(uint32_t value, unsigned int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+
+/*
+ *  Process one 64-byte block.  Does not validate input.
+ */
+static void _sha256_transform(Sha256Context *ctx, const uint8_t block[64])
+{
+    // LOCAL VARIABLES
+    uint32_t w[64];                 // Message schedule
+    uint32_t v[8];                  // Working variables a-h
+    uint32_t temp1 = 0;             // T1
+    uint32_t temp2 = 0;             // T2
+    int i = 0;                      // Iterating variable
+
+    // SCHEDULE
+    for (i = 0; i < 16; i++)
+    {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16)
+               | ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (i = 16; i < 64; i++)
+    {
+        w[i] = (_rotr(w[i - 2], 17) ^ _rotr(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7]
+               + (_rotr(w[i - 15], 7) ^ _rotr(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+    }
+
+    // COMPRESS
+    memcpy(v, ctx->state, sizeof(v));
+    for (i = 0; i < 64; i++)
+    {
+        temp1 = v[7] + (_rotr(v[4], 6) ^ _rotr(v[4], 11) ^ _rotr(v[4], 25))
+                + ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256_k[i] + w[i];
+        temp2 = (_rotr(v[0], 2) ^ _rotr(v[0], 13) ^ _rotr(v[0], 22))
+                + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = v[3] + temp1;
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = temp1 + temp2;
+    }
+    for (i = 0; i < 8; i++)
+    {
+        ctx->state[i] += v[i];
+    }
+}
+
+
+/*
+ *  Start a new SHA-256 computation.  Does not validate input.
+ */
+static void _sha256_init(Sha256Context *ctx)
+{
+    const uint32_t initial[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->bit_len = 0;
+    ctx->block_len = 0;
+}
+
+
+/*
+ *  Feed data_len bytes of data into ctx.  Does not validate input.
+ */
+static void _sha256_update(Sha256Context *ctx, const uint8_t *data, size_t data_len)
+{
+    // LOCAL VARIABLES
+    size_t take = 0;  // Bytes copied into the partial block
+
+    // CONSUME
+    ctx->bit_len += (uint64_t)data_len * 8;
+    while (data_len > 0)
+    {
+        take = 64 - ctx->block_len;
+        if (take > data_len)
+        {
+            take = data_len;
+        }
+        memcpy(ctx->block + ctx->block_len, data, take);
+        ctx->block_len += take;
+        data += take;
+        data_len -= take;
+        if (64 == ctx->block_len)
+        {
+            _sha256_transform(ctx, ctx->block);
+            ctx->block_len = 0;
+        }
+    }
+}
+
+
+/*
+ *  Pad the final block and write the digest.  Does not validate input.
+ */
+static void _sha256_final(Sha256Context *ctx, uint8_t digest[STORE_DIGEST_SIZE])
+{
+    // LOCAL VARIABLES
+    uint64_t bit_len = ctx->bit_len;  // Message length before padding
+    int i = 0;                        // Iterating variable
+
+    // PAD
+    ctx->block[ctx->block_len++] = 0x80;
+    if (ctx->block_len > 56)
+    {
+        memset(ctx->block + ctx->block_len, 0, 64 - ctx->block_len);
+        _sha256_transform(ctx, ctx->block);
+        ctx->block_len = 0;
+    }
+    memset(ctx->block + ctx->block_len, 0, 56 - ctx->block_len);
+    for (i = 0; i < 8; i++)
+    {
+        ctx->block[63 - i] = (uint8_t)(bit_len >> (i * 8));
+    }
+    _sha256_transform(ctx, ctx->block);
+
+    // DIGEST
+    for (i = 0; i < 8; i++)
+    {
+        digest[i * 4] = (uint8_t)(ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (uint8_t)(ctx->state[i]);
+    }
+}
+
+
+/*
+ *  Apply source_stat's mode, ownership, and timestamps to fd.  Does not validate input.
+ *  Returns 0 on success, errno on failure
+ */
+static int _copy_metadata(int fd, struct stat *source_stat)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                                                   // 0 on success, errno on failure
+    struct timespec times[2] = { source_stat->st_atim, source_stat->st_mtim };  // atime, mtime
+
+    // PRESERVE IT
+    // Ownership first since fchown() may clear set-user-ID/set-group-ID mode bits
+    if (fchown(fd, source_stat->st_uid, source_stat->st_gid))
+    {
+        errnum = get_errno();
+        syslog_errno(errnum, "Unable to preserve ownership during a cross-filesystem move");
+    }
+    else if (fchmod(fd, source_stat->st_mode & 07777))
+    {
+        errnum = get_errno();
+        syslog_errno(errnum, "Unable to preserve the mode during a cross-filesystem move");
+    }
+    else if (futimens(fd, times))
+    {
+        errnum = get_errno();
+        syslog_errno(errnum, "Unable to preserve timestamps during a cross-filesystem move");
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Give the unnamed O_TMPFILE tmp_fd the name destination.  If destination already exists,
+ *      mirror rename() by linking a temporary name in dest_dir and renaming it over destination.
+ *  Returns 0 on success, errno on failure
+ */
+static int _link_tmpfile(int tmp_fd, char *dest_dir, char *destination)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                           // 0 on success, errno on failure
+    char proc_path[64] = { 0 };               // /proc/self/fd/ path for tmp_fd
+    char tmp_name[PATH_MAX + 1] = { 0 };      // Temporary name used when destination exists
+    char *link_name = destination;            // Name to link tmp_fd to
+
+    // LINK IT
+    snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", tmp_fd);
+    do
+    {
+        // AT_EMPTY_PATH requires CAP_DAC_READ_SEARCH but be_sure() already requires root
+        if (0 == linkat(tmp_fd, "", AT_FDCWD, link_name, AT_EMPTY_PATH)
+            || 0 == linkat(AT_FDCWD, proc_path, AT_FDCWD, link_name, AT_SYMLINK_FOLLOW))
+        {
+            errnum = 0;
+            break;
+        }
+        errnum = get_errno();
+        if (EEXIST == errnum && link_name == destination)
+        {
+            snprintf(tmp_name, sizeof(tmp_name), "%s/%s%d_%d", dest_dir, STORAGE_TMP_PREFIX, getpid(), tmp_fd);
+            link_name = tmp_name;
+        }
+        else
+        {
+            break;
+        }
+    } while (1);
+
+    // REPLACE IT
+    if (0 == errnum && link_name != destination)
+    {
+        if (rename(link_name, destination))
+        {
+            errnum = get_errno();
+            unlink(link_name);
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+int clean_store(char *store_dir)
+{
+    // LOCAL VARIABLES
+    int results = -1;                         // Count on success, -1 on bad input, -errno on failure
+    DIR *dir_stream = NULL;                   // Directory stream for store_dir
+    int dir_fd = INVALID_FD;                  // File descriptor for store_dir
+    struct dirent *entry = NULL;              // Current directory entry
+    struct stat entry_stat;                   // Current entry's metadata
+    size_t prefix_len = strlen(STORAGE_TMP_PREFIX);  // Length of the temporary file prefix
+
+    // INPUT VALIDATION
+    if (store_dir && *store_dir)
+    {
+        dir_stream = opendir(store_dir);
+        if (dir_stream)
+        {
+            dir_fd = dirfd(dir_stream);
+            results = 0;
+        }
+        else
+        {
+            results = -get_errno();
+            syslog_errno(-results, "Unable to open the content-addressed store %s", store_dir);
+        }
+    }
+
+    // CLEAN IT
+    while (results >= 0 && NULL != (entry = readdir(dir_stream)))
+    {
+        if ('.' == entry->d_name[0] && strncmp(entry->d_name, STORAGE_TMP_PREFIX, prefix_len))
+        {
+            continue;  // Skip ".", "..", and anything that isn't ours
+        }
+        if (fstatat(dir_fd, entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW) || !S_ISREG(entry_stat.st_mode))
+        {
+            continue;  // Vanished or not an object
+        }
+        // An object whose only link is the store itself is no longer referenced
+        if (1 == entry_stat.st_nlink || !strncmp(entry->d_name, STORAGE_TMP_PREFIX, prefix_len))
+        {
+            if (0 == unlinkat(dir_fd, entry->d_name, 0))
+            {
+                results++;
+            }
+            else
+            {
+                syslog_errno(errno, "Unable to remove %s from the content-addressed store", entry->d_name);
+            }
+        }
+    }
+
+    // CLEANUP
+    if (dir_stream)
+    {
+        closedir(dir_stream);
+        dir_stream = NULL;
+    }
+
+    // DONE
+    return results;
+}
+
+
+int copy_fd_contents(int in_fd, int out_fd, off_t length)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;    // 0 on success, -1 on bad input, errno on failure
+    off_t copied = 0;   // Number of bytes copied so far
+
+    // INPUT VALIDATION
+    if (in_fd > INVALID_FD && out_fd > INVALID_FD && length >= 0)
+    {
+        errnum = 0;
+    }
+
+    // COPY IT
+    if (0 == errnum)
+    {
+        errnum = _copy_with_copy_file_range(in_fd, out_fd, length, &copied);
+        if (0 != errnum && true == _try_next_copy(errnum))
+        {
+            errnum = _copy_with_sendfile(in_fd, out_fd, length, &copied);
+        }
+        if (0 != errnum && true == _try_next_copy(errnum))
+        {
+            errnum = _copy_with_splice(in_fd, out_fd, length, &copied);
+        }
+        if (0 == errnum && copied != length)
+        {
+            errnum = ENODATA;  // Never report a partial copy as a success
+        }
+        if (errnum)
+        {
+            syslog_errno(errnum, "Unable to copy file contents in-kernel after %lld of %lld bytes", (long long)copied,
+                         (long long)length);
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+int dedupe_a_file(char *stamped_file, char *store_dir, uint8_t digest[STORE_DIGEST_SIZE])
+{
+    // LOCAL VARIABLES
+    int errnum = -1;                          // 0 on success, -1 on bad input, errno on failure
+    char object[PATH_MAX + 1] = { 0 };        // store_dir/<hex digest>
+    char hex_digest[(STORE_DIGEST_SIZE * 2) + 1] = { 0 };  // Printable digest
+    char stamped_copy[PATH_MAX + 1] = { 0 };  // Modifiable copy of stamped_file for dirname()
+    char tmp_name[PATH_MAX + 1] = { 0 };      // Temporary link next to stamped_file
+    struct stat object_stat;                  // Metadata for the stored object
+    struct stat stamped_stat;                 // Metadata for stamped_file
+    int i = 0;                                // Iterating variable
+
+    // INPUT VALIDATION
+    if (stamped_file && *stamped_file && store_dir && *store_dir && digest
+        && strlen(stamped_file) <= PATH_MAX)
+    {
+        for (i = 0; i < STORE_DIGEST_SIZE; i++)
+        {
+            snprintf(hex_digest + (i * 2), 3, "%02x", digest[i]);
+        }
+        if (snprintf(object, sizeof(object), "%s/%s", store_dir, hex_digest) < sizeof(object))
+        {
+            errnum = 0;
+        }
+    }
+
+    // PREPARE THE STORE
+    if (0 == errnum && mkdir(store_dir, S_IRWXU) && EEXIST != errno)
+    {
+        errnum = get_errno();
+        syslog_errno(errnum, "Unable to create the content-addressed store %s", store_dir);
+    }
+
+    // STORE IT
+    if (0 == errnum)
+    {
+        if (0 == link(stamped_file, object))
+        {
+            // First time we've seen these contents
+            syslog_it2(LOG_INFO, "Stored %s as %s", stamped_file, object);
+        }
+        else if (EEXIST != (errnum = get_errno()))
+        {
+            // Fall through to log the failure
+        }
+        else if (0 == stat(object, &object_stat) && 0 == stat(stamped_file, &stamped_stat)
+                 && object_stat.st_dev == stamped_stat.st_dev && object_stat.st_ino == stamped_stat.st_ino)
+        {
+            errnum = 0;  // Already a link to the stored object
+        }
+        else
+        {
+            // Duplicate: swap stamped_file for a hardlink to the stored object
+            errnum = 0;
+            strncpy(stamped_copy, stamped_file, PATH_MAX);
+            snprintf(tmp_name, sizeof(tmp_name), "%s/%s%d_%s", dirname(stamped_copy), STORAGE_TMP_PREFIX,
+                     getpid(), hex_digest);
+            if (link(object, tmp_name))
+            {
+                errnum = get_errno();
+            }
+            else if (rename(tmp_name, stamped_file))
+            {
+                errnum = get_errno();
+                unlink(tmp_name);
+            }
+            else
+            {
+                syslog_it2(LOG_INFO, "Deduplicated %s against %s", stamped_file, object);
+            }
+        }
+        if (errnum)
+        {
+            syslog_errno(errnum, "Unable to deduplicate %s into %s", stamped_file, store_dir);
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+int digest_buffer(const char *buffer, size_t length, uint8_t digest[STORE_DIGEST_SIZE])
+{
+    // LOCAL VARIABLES
+    int errnum = -1;    // 0 on success, -1 on bad input
+    Sha256Context ctx;  // Running digest
+
+    // INPUT VALIDATION
+    if ((buffer || 0 == length) && digest)
+    {
+        errnum = 0;
+    }
+
+    // DIGEST IT
+    if (0 == errnum)
+    {
+        _sha256_init(&ctx);
+        _sha256_update(&ctx, (const uint8_t *)buffer, length);
+        _sha256_final(&ctx, digest);
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+char *get_shard_dir(char *process_dir, char *stamp, char *filename, bool create, int *errnum)
+{
+    // LOCAL VARIABLES
+    char *shard_dir = NULL;                          // Return value
+    char level_name[SHARD_LEVEL_MAX + 1] = { 0 };    // Name of one shard level
+    size_t dir_len = 0;                              // Length of shard_dir so far
+    int levels = 0;                                  // Number of levels in the active layout
+    int i = 0;                                       // Iterating variable
+
+    // INPUT VALIDATION
+    if (errnum)
+    {
+        *errnum = -1;
+        if (process_dir && *process_dir && filename && *filename)
+        {
+            *errnum = 0;
+        }
+    }
+
+    // ALLOCATE IT
+    if (errnum && 0 == *errnum)
+    {
+        if (shard_layout && SHARD_FLAT != shard_layout->scheme)
+        {
+            levels = shard_layout->levels;
+            levels = levels < 1 ? 1 : levels > SHARD_MAX_LEVELS ? SHARD_MAX_LEVELS : levels;
+        }
+        dir_len = strlen(process_dir);
+        shard_dir = hare_calloc(dir_len + 2 + (levels * SHARD_LEVEL_MAX), sizeof(char));
+        if (shard_dir)
+        {
+            memcpy(shard_dir, process_dir, dir_len);
+            if ('/' != shard_dir[dir_len - 1])
+            {
+                shard_dir[dir_len++] = '/';
+            }
+        }
+        else
+        {
+            *errnum = get_errno();
+            syslog_errno(*errnum, "Call to hare_calloc() inside get_shard_dir() failed");
+        }
+    }
+
+    // BUILD IT
+    for (i = 0; i < levels && shard_dir && 0 == *errnum; i++)
+    {
+        if (false == _name_shard_level(i, stamp, filename, level_name))
+        {
+            break;  // Nothing to shard on: filename stays in process_dir
+        }
+        memcpy(shard_dir + dir_len, level_name, strlen(level_name) + 1);
+        dir_len += strlen(level_name);
+        // Shards are created lazily, the first time a file lands in them
+        if (true == create && io_mkdir(shard_dir, SHARD_DIR_MODE) && EEXIST != errno)
+        {
+            *errnum = get_errno();
+            syslog_errno(*errnum, "Unable to create the shard directory %s", shard_dir);
+        }
+    }
+
+    // CLEANUP
+    if (shard_dir && 0 != *errnum)
+    {
+        hare_free(shard_dir);
+        shard_dir = NULL;
+    }
+
+    // DONE
+    return shard_dir;
+}
+
+
+bool has_datetime_stamp(char *name)
+{
+    // LOCAL VARIABLES
+    bool has_stamp = (NULL != name);  // Assume it does until we find otherwise
+    int i = 0;                        // Iterating variable
+
+    // CHECK IT
+    for (i = 0; i < STAMP_LEN && true == has_stamp; i++)
+    {
+        if (8 == i || STAMP_LEN - 1 == i)
+        {
+            has_stamp = ('_' == name[i]);
+        }
+        else
+        {
+            has_stamp = (0 != isdigit((unsigned char)name[i]));  // Also stops at a nul terminator
+        }
+    }
+
+    // DONE
+    return has_stamp;
+}
+
+
+int migrate_flat_dir(char *process_dir)
+{
+    // LOCAL VARIABLES
+    int results = -1;                         // Count on success, -1 on bad input, -errno on failure
+    int errnum = 0;                           // Errors from get_shard_dir() and renameat()
+    DIR *dir_stream = NULL;                   // Directory stream for process_dir
+    int dir_fd = INVALID_FD;                  // File descriptor for process_dir
+    struct dirent *entry = NULL;              // Current directory entry
+    struct stat entry_stat;                   // Current entry's metadata
+    char *shard_dir = NULL;                   // Destination shard for the current entry
+    char destination[PATH_MAX + 1] = { 0 };   // shard_dir/entry
+    char *stamp = NULL;                       // Datetime stamp of the current entry
+    char *filename = NULL;                    // Current entry's name without the datetime stamp
+
+    // INPUT VALIDATION
+    if (process_dir && *process_dir)
+    {
+        if (!shard_layout || SHARD_FLAT == shard_layout->scheme)
+        {
+            results = 0;  // Already flat
+        }
+        else if (NULL != (dir_stream = opendir(process_dir)))
+        {
+            dir_fd = dirfd(dir_stream);
+            results = 0;
+        }
+        else
+        {
+            results = -get_errno();
+            syslog_errno(-results, "Unable to open the processed directory %s", process_dir);
+        }
+    }
+
+    // MIGRATE IT
+    while (results >= 0 && dir_stream && NULL != (entry = readdir(dir_stream)))
+    {
+        if ('.' == entry->d_name[0])
+        {
+            continue;  // Skip ".", "..", and hidden (e.g., temporary) files
+        }
+        if (fstatat(dir_fd, entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW) || !S_ISREG(entry_stat.st_mode))
+        {
+            continue;  // Vanished, a shard, or not a processed file
+        }
+        stamp = NULL;
+        filename = entry->d_name;
+        if (true == has_datetime_stamp(entry->d_name) && entry->d_name[STAMP_LEN])
+        {
+            stamp = entry->d_name;
+            filename = entry->d_name + STAMP_LEN;
+        }
+        else if (SHARD_TIME == shard_layout->scheme)
+        {
+            continue;  // No time bucket to move it into
+        }
+        shard_dir = get_shard_dir(process_dir, stamp, filename, true, &errnum);
+        if (!shard_dir)
+        {
+            results = errnum > 0 ? -errnum : -EINVAL;
+        }
+        else if (snprintf(destination, sizeof(destination), "%s%s", shard_dir, entry->d_name) >= sizeof(destination))
+        {
+            syslog_it2(LOG_ERR, "Unable to migrate %s: the sharded filename is too long", entry->d_name);
+        }
+        else if (renameat(dir_fd, entry->d_name, AT_FDCWD, destination))
+        {
+            results = -get_errno();
+            syslog_errno(-results, "Unable to migrate %s to %s", entry->d_name, destination);
+        }
+        else
+        {
+            results++;
+        }
+        if (shard_dir)
+        {
+            hare_free(shard_dir);
+            shard_dir = NULL;
+        }
+    }
+
+    // CLEANUP
+    if (dir_stream)
+    {
+        closedir(dir_stream);
+        dir_stream = NULL;
+    }
+    if (results > 0)
+    {
+        syslog_it2(LOG_INFO, "Migrated %d files in %s to the sharded layout", results, process_dir);
+    }
+
+    // DONE
+    return results;
+}
+
+
+int move_across_filesystems(char *source, char *destination)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;                          // 0 on success, -1 on bad input, errno on failure
+    int src_fd = INVALID_FD;                  // File descriptor for source
+    int tmp_fd = INVALID_FD;                  // File descriptor for the copy
+    struct stat src_stat;                     // Source's metadata
+    char dest_copy[PATH_MAX + 1] = { 0 };     // Modifiable copy of destination for dirname()
+    char *dest_dir = NULL;                    // Destination's directory
+    char tmp_name[PATH_MAX + 1] = { 0 };      // Named temporary file (if O_TMPFILE is unsupported)
+    bool named_tmp = false;                   // True if tmp_name needs to be renamed/cleaned up
+
+    // INPUT VALIDATION
+    if (source && *source && destination && *destination && strlen(destination) <= PATH_MAX)
+    {
+        errnum = 0;
+        strncpy(dest_copy, destination, PATH_MAX);
+        dest_dir = dirname(dest_copy);
+    }
+
+    // OPEN SOURCE
+    if (0 == errnum)
+    {
+        src_fd = open(source, O_RDONLY | O_CLOEXEC);
+        if (src_fd < 0 || fstat(src_fd, &src_stat))
+        {
+            errnum = get_errno();
+            syslog_errno(errnum, "Unable to open %s for a cross-filesystem move", source);
+        }
+        else if (!S_ISREG(src_stat.st_mode))
+        {
+            errnum = EINVAL;  // Only regular files are moved
+        }
+    }
+
+    // CREATE THE COPY
+    if (0 == errnum)
+    {
+        tmp_fd = open(dest_dir, O_TMPFILE | O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (tmp_fd < 0)
+        {
+            errnum = get_errno();
+            if (EOPNOTSUPP == errnum || EISDIR == errnum || EINVAL == errnum)
+            {
+                // This filesystem doesn't support O_TMPFILE so use a hidden name instead
+                snprintf(tmp_name, sizeof(tmp_name), "%s/%sXXXXXX", dest_dir, STORAGE_TMP_PREFIX);
+                tmp_fd = mkostemp(tmp_name, O_CLOEXEC);
+                if (tmp_fd < 0)
+                {
+                    errnum = get_errno();
+                }
+                else
+                {
+                    errnum = 0;
+                    named_tmp = true;
+                }
+            }
+            if (errnum)
+            {
+                syslog_errno(errnum, "Unable to create a temporary file in %s", dest_dir);
+            }
+        }
+    }
+
+    // COPY IT
+    if (0 == errnum)
+    {
+        errnum = copy_fd_contents(src_fd, tmp_fd, src_stat.st_size);
+    }
+    if (0 == errnum)
+    {
+        errnum = _copy_metadata(tmp_fd, &src_stat);
+    }
+    if (0 == errnum && fsync(tmp_fd))
+    {
+        errnum = get_errno();
+        syslog_errno(errnum, "Unable to synchronize the copy of %s", source);
+    }
+
+    // PUBLISH IT
+    if (0 == errnum)
+    {
+        if (true == named_tmp)
+        {
+            if (rename(tmp_name, destination))
+            {
+                errnum = get_errno();
+            }
+            else
+            {
+                named_tmp = false;  // Nothing left to clean up
+            }
+        }
+        else
+        {
+            errnum = _link_tmpfile(tmp_fd, dest_dir, destination);
+        }
+        if (errnum)
+        {
+            syslog_errno(errnum, "Unable to link the copy of %s to %s", source, destination);
+        }
+    }
+
+    // REMOVE THE ORIGINAL
+    if (0 == errnum && unlink(source))
+    {
+        errnum = get_errno();
+        syslog_errno(errnum, "Copied %s to %s but unable to remove the original", source, destination);
+    }
+
+    // CLEANUP
+    if (src_fd > INVALID_FD)
+    {
+        close(src_fd);
+    }
+    if (tmp_fd > INVALID_FD)
+    {
+        close(tmp_fd);  // An unlinked O_TMPFILE simply vanishes
+    }
+    if (true == named_tmp)
+    {
+        unlink(tmp_name);
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+int parse_shard_layout(char *spec, ShardLayout *layout)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;                // 0 on success, -1 on bad input, errno on failure
+    ShardLayout parsed = { 0, 1 };  // Layout described by spec
+    char *levels = NULL;            // spec's ":levels" suffix
+    char *end = NULL;               // End of the levels number
+
+    // INPUT VALIDATION
+    if (spec && *spec && layout)
+    {
+        errnum = 0;
+    }
+
+    // PARSE IT
+    if (0 == errnum)
+    {
+        levels = strchr(spec, ':');
+        if (!strncmp(spec, "flat", 4) && (4 == strlen(spec)))
+        {
+            parsed.scheme = SHARD_FLAT;
+        }
+        else if (!strncmp(spec, "hash", 4) && (spec + 4 == levels || '\0' == spec[4]))
+        {
+            parsed.scheme = SHARD_HASH;
+        }
+        else if (!strncmp(spec, "time", 4) && (spec + 4 == levels || '\0' == spec[4]))
+        {
+            parsed.scheme = SHARD_TIME;
+        }
+        else
+        {
+            errnum = EINVAL;
+        }
+    }
+    if (0 == errnum && levels)
+    {
+        parsed.levels = (int)strtol(levels + 1, &end, 10);
+        if (end == levels + 1 || *end || parsed.levels < 1 || parsed.levels > SHARD_MAX_LEVELS)
+        {
+            errnum = EINVAL;
+        }
+    }
+    if (0 == errnum)
+    {
+        *layout = parsed;
+    }
+    else if (EINVAL == errnum)
+    {
+        syslog_it2(LOG_ERR, "Unable to parse the processed directory layout %s", spec);
+    }
+
+    // DONE
+    return errnum;
+}
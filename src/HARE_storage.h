@@ -0,0 +1,129 @@
+/*
+ *  Processed-directory storage functionality for the HARE daemon.
+ */
+
+#ifndef __HARE_STORAGE__
+#define __HARE_STORAGE__
+
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint8_t
+#include <sys/types.h>  // off_t
+
+#define STORE_DIGEST_SIZE 32        // Size of a SHA-256 digest in bytes
+#define STORE_ENV_VAR "HARE_STORE"  // Content-addressed store directory (see: read_settings())
+#define SHARD_MAX_LEVELS 3          // Maximum number of subdirectory levels in a sharded layout
+#define SHARD_HASH_WIDTH 2          // Hex characters (256 subdirectories) per hash-prefix level
+#define SHARD_ENV_VAR "HARE_SHARD"  // Processed directory layout (see: parse_shard_layout())
+#define STAMP_LEN 16                // Length of a "YYYYMMDD_HHMMSS_" datetime stamp prefix
+
+// How stamped files are spread across subdirectories of the processed directory
+typedef enum _ShardScheme
+{
+    SHARD_FLAT = 0,  // Every file lives directly in the processed directory
+    SHARD_HASH,      // Hex prefixes of a hash of the original filename (e.g., 3f/a2/)
+    SHARD_TIME       // Time buckets taken from the datetime stamp (e.g., 20240131/23/59/)
+} ShardScheme;
+
+// Layout of the processed directory
+typedef struct _ShardLayout
+{
+    ShardScheme scheme;  // How to shard
+    int levels;          // Number of subdirectory levels (1 through SHARD_MAX_LEVELS)
+} ShardLayout;
+
+extern ShardLayout *shard_layout;  // Active processed directory layout (NULL means flat)
+
+
+/*
+ *  Remove every object in store_dir that is no longer referenced by a stamped filename
+ *      (its link count has dropped to 1) along with any abandoned temporary files.
+ *  Returns the number of objects removed on success, -1 on bad input, -errno on failure
+ */
+int clean_store(char *store_dir);
+
+
+/*
+ *  Copy the contents of in_fd into out_fd without passing the data through user-space
+ *      buffers.  Tries copy_file_range(), falls back to sendfile(), then to splice().  There is
+ *      no user-space fallback: if none of them can copy every byte, the last one's error (e.g.,
+ *      EXDEV or EINVAL) is returned, and a short copy (e.g., source shrank) fails with ENODATA.
+ *  Arguments
+ *      in_fd - File descriptor to read from (starting at offset 0)
+ *      out_fd - File descriptor to write to (starting at offset 0)
+ *      length - Number of bytes to copy
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int copy_fd_contents(int in_fd, int out_fd, off_t length);
+
+
+/*
+ *  Deduplicate stamped_file against the content-addressed store in store_dir (which must be
+ *      on the same filesystem).  The first file with a given digest is hardlinked into the store
+ *      as store_dir/<hex digest>.  Later files with the same digest have their stamped name
+ *      atomically replaced by a hardlink to the stored object, releasing the duplicate copy.
+ *      store_dir is created if it doesn't exist.
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int dedupe_a_file(char *stamped_file, char *store_dir, uint8_t digest[STORE_DIGEST_SIZE]);
+
+
+/*
+ *  Compute the SHA-256 digest of length bytes of buffer (e.g., the contents read_file() returned
+ *      for the needle search, so the file is only read once)
+ *  Returns 0 on success, -1 on bad input
+ */
+int digest_buffer(const char *buffer, size_t length, uint8_t digest[STORE_DIGEST_SIZE]);
+
+
+/*
+ *  Determine which subdirectory of process_dir holds filename under the active shard_layout.
+ *      Hash-prefix shards depend only on filename.  Time-bucket shards depend only on stamp
+ *      and fall back to process_dir when stamp is missing or malformed.
+ *  Arguments
+ *      process_dir - Processed directory
+ *      stamp - Datetime stamp prefix of the stamped filename (may be NULL)
+ *      filename - Original filename, without the datetime stamp
+ *      create - If true, create any missing shard directories
+ *      errnum - Out parameter: 0 on success, -1 on bad input, errno on failure
+ *  Returns a heap-allocated, '/'-terminated directory (see: hare_free()) on success, NULL on failure
+ */
+char *get_shard_dir(char *process_dir, char *stamp, char *filename, bool create, int *errnum);
+
+
+/*
+ *  Does name begin with a "YYYYMMDD_HHMMSS_" datetime stamp (see: get_datetime_stamp())?
+ */
+bool has_datetime_stamp(char *name);
+
+
+/*
+ *  Move every stamped file found directly inside process_dir into its shard under the active
+ *      shard_layout.  Hidden files and subdirectories are left alone so a partially migrated
+ *      directory can be migrated again.
+ *  Returns the number of files moved on success, -1 on bad input, -errno on failure
+ */
+int migrate_flat_dir(char *process_dir);
+
+
+/*
+ *  Move source to destination when they live on different filesystems (see: EXDEV).
+ *      The data is copied in-kernel into an unnamed O_TMPFILE inside destination's
+ *      directory, source's mode, ownership, and timestamps are applied, the copy is
+ *      atomically linkat()ed into place, and then source is unlinked (only once every byte
+ *      was copied).  Filesystems without O_TMPFILE support fall back to a hidden temporary
+ *      file and rename().
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int move_across_filesystems(char *source, char *destination);
+
+
+/*
+ *  Parse a processed directory layout: "flat", "hash[:levels]", or "time[:levels]" (levels
+ *      defaults to 1 and runs from 1 through SHARD_MAX_LEVELS)
+ *  Returns 0 on success, -1 on bad input, EINVAL if spec is malformed
+ */
+int parse_shard_layout(char *spec, ShardLayout *layout);
+
+
+#endif  // __HARE_STORAGE__
@@ -0,0 +1,764 @@
+/*
+ *  Implements HARE_supervisor.h functions.
+ */
+
+#define _GNU_SOURCE          // sched_getaffinity(), sched_setaffinity(), CPU_* macros
+#include <errno.h>           // errno
+#include <fcntl.h>           // fcntl(), F_SETFL, O_NONBLOCK
+#include <poll.h>            // poll(), struct pollfd
+#include <sched.h>           // sched_getaffinity(), sched_setaffinity(), cpu_set_t
+#include <signal.h>          // sigaction(), SIGPIPE
+#include <stdio.h>           // snprintf()
+#include <stdlib.h>          // calloc(), free(), qsort()
+#include <string.h>          // memchr(), memcpy(), memset(), strlen(), strnlen()
+#include <sys/ioctl.h>       // ioctl(), FIONREAD
+#include <sys/socket.h>      // recv(), send(), socketpair(), MSG_* macros, SOCK_* macros
+#include <sys/stat.h>        // mkdir()
+#include <sys/wait.h>        // waitpid(), W* macros
+#include <unistd.h>          // close(), fork(), _exit()
+#include "HARE_arena.h"      // hare_message_alloc()
+#include "HARE_filelog.h"    // filelog_flush()
+#include "HARE_library.h"    // syslog_*(), verify_filename(), INVALID_FD, PIPE_* macros, get_errno()
+#include "HARE_logger.h"     // logger_flush()
+#include "HARE_supervisor.h"
+
+#define SUPERVISOR_DIR_MODE 0777        // Permissions for new shard directories (before umask)
+#define SUPERVISOR_FNV_OFFSET 2166136261U  // FNV-1a 32-bit offset basis
+#define SUPERVISOR_FNV_PRIME 16777619U     // FNV-1a 32-bit prime
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+/*
+ *  MurmurHash3's 32-bit finalizer: spreads every input bit across the whole result
+ */
+static uint32_t _mix(uint32_t hash)
+{
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+
+/*
+ *  Position of filename on the ring
+ */
+static uint32_t _hash_filename(char *filename)
+{
+    // LOCAL VARIABLES
+    uint32_t hash = SUPERVISOR_FNV_OFFSET;  // Return value
+
+    // HASH IT
+    while (*filename)
+    {
+        hash = (hash ^ (unsigned char)*filename++) * SUPERVISOR_FNV_PRIME;
+    }
+
+    // DONE
+    return _mix(hash);
+}
+
+
+/*
+ *  Sort RingPoints by hash (see: qsort())
+ */
+static int _compare_points(const void *left, const void *right)
+{
+    uint32_t left_hash = ((const RingPoint *)left)->hash;    // Left point's position
+    uint32_t right_hash = ((const RingPoint *)right)->hash;  // Right point's position
+
+    return (left_hash > right_hash) - (left_hash < right_hash);
+}
+
+
+/*
+ *  Rebuild the ring from the workers that can take files.  A worker's points depend only on
+ *      its index, so workers joining or leaving never move files between the others.
+ */
+static void _build_ring(Supervisor *supervisor)
+{
+    // LOCAL VARIABLES
+    int worker = 0;      // Iterating variable
+    uint32_t vnode = 0;  // Iterating variable
+
+    // BUILD IT
+    supervisor->ring_len = 0;
+    for (worker = 0; worker < supervisor->num_workers; worker++)
+    {
+        if (supervisor->workers[worker].pid > 0 && supervisor->workers[worker].write_fd > INVALID_FD)
+        {
+            for (vnode = 0; vnode < SUPERVISOR_VNODES; vnode++)
+            {
+                supervisor->ring[supervisor->ring_len].hash = _mix(((uint32_t)worker << 16 | vnode) * 0x9e3779b9U);
+                supervisor->ring[supervisor->ring_len].worker = worker;
+                supervisor->ring_len++;
+            }
+        }
+    }
+    qsort(supervisor->ring, supervisor->ring_len, sizeof(RingPoint), _compare_points);
+}
+
+
+/*
+ *  Find the worker that owns filename: the first point at or after its hash, wrapping around
+ *  Returns the worker's index, -1 if the ring is empty
+ */
+static int _find_owner(Supervisor *supervisor, char *filename)
+{
+    // LOCAL VARIABLES
+    uint32_t hash = _hash_filename(filename);  // Position of filename
+    size_t low = 0;                            // Lowest candidate index
+    size_t high = supervisor->ring_len;        // One past the highest candidate index
+    size_t middle = 0;                         // Index being compared
+
+    // FIND IT
+    while (low < high)
+    {
+        middle = low + ((high - low) / 2);
+        if (supervisor->ring[middle].hash < hash)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    // DONE
+    return supervisor->ring_len ? supervisor->ring[low % supervisor->ring_len].worker : -1;
+}
+
+
+/*
+ *  Fork worker, pinned to its CPUs and reading a new socket pair
+ *  Returns 0 on success, errno on failure
+ */
+static int _spawn_worker(Supervisor *supervisor, int worker)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                                   // 0 on success, errno on failure
+    WorkerSlot *slot = supervisor->workers + worker;  // Worker being started
+    int fds[2] = { INVALID_FD, INVALID_FD };          // Worker's socket pair
+    cpu_set_t cpu_set;                                // CPUs the worker is pinned to
+    int status = 0;                                   // Worker's exit status
+    int i = 0;                                        // Iterating variable
+
+    // CONNECT IT
+    // One filename per message: the worker takes exactly one at a time and the rest stay queued
+    // in the socket.  The worker blocks on its read end, but the supervisor never blocks on the
+    // write end.
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds))
+    {
+        errnum = get_errno();
+        syslog_errno(errnum, "Unable to create a socket pair for worker %d", worker);
+    }
+    else if (fcntl(fds[PIPE_WRITE], F_SETFL, O_NONBLOCK))
+    {
+        errnum = get_errno();
+        syslog_errno(errnum, "Unable to create a socket pair for worker %d", worker);
+        close(fds[PIPE_READ]);
+        close(fds[PIPE_WRITE]);
+    }
+
+    // FORK IT
+    if (0 == errnum)
+    {
+        slot->pid = fork();
+        if (0 == slot->pid)
+        {
+            // Worker: keep nothing that belongs to the supervisor or the other workers
+            close(fds[PIPE_WRITE]);
+            for (i = 0; i < supervisor->num_workers; i++)
+            {
+                if (supervisor->workers[i].write_fd > INVALID_FD)
+                {
+                    close(supervisor->workers[i].write_fd);
+                }
+                if (supervisor->workers[i].read_fd > INVALID_FD)
+                {
+                    close(supervisor->workers[i].read_fd);
+                }
+            }
+            CPU_ZERO(&cpu_set);
+            for (i = slot->first_cpu; i < slot->first_cpu + slot->num_cpus; i++)
+            {
+                CPU_SET(supervisor->cpus[i], &cpu_set);
+            }
+            if (slot->num_cpus > 0 && sched_setaffinity(0, sizeof(cpu_set), &cpu_set))
+            {
+                syslog_errno(errno, "Unable to pin worker %d to its CPUs", worker);
+            }
+            status = supervisor->worker_main(worker, fds[PIPE_READ], slot->shard_dir, supervisor->context);
+            logger_flush(LOGGER_FLUSH_MS);  // _exit() skips the atexit() flushes
+            filelog_flush();
+            _exit(status < 0 || status > 255 ? 255 : status);
+        }
+        else if (slot->pid < 0)
+        {
+            errnum = get_errno();
+            syslog_errno(errnum, "Unable to fork worker %d", worker);
+            slot->pid = 0;
+            close(fds[PIPE_WRITE]);
+            close(fds[PIPE_READ]);
+        }
+        else
+        {
+            slot->write_fd = fds[PIPE_WRITE];
+            slot->read_fd = fds[PIPE_READ];  // Keeps what the worker hasn't read if it crashes
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Take every filename still queued in a reaped worker's socket and close the supervisor's
+ *      read end
+ *  Returns a heap-allocated copy (length bytes of nul-terminated filenames), NULL if the socket
+ *      was empty or on error
+ */
+static char *_drain_worker(WorkerSlot *slot, size_t *length)
+{
+    // LOCAL VARIABLES
+    char *queued = NULL;                     // Return value
+    char *grown = NULL;                      // Return value from realloc()
+    size_t size = 0;                         // Size of queued
+    char record[SUPERVISOR_INBOX_SIZE];      // One filename
+    ssize_t received = 0;                    // Return value from recv()
+
+    // DRAIN IT
+    // Nothing else reads the socket once its worker is gone, and these reads never block
+    *length = 0;
+    while (slot->read_fd > INVALID_FD)
+    {
+        received = recv(slot->read_fd, record, sizeof(record), MSG_DONTWAIT);
+        if (received < 0 && EINTR == errno)
+        {
+            continue;
+        }
+        else if (received <= 0)
+        {
+            break;  // Empty (EAGAIN)
+        }
+        if (*length + received > size)
+        {
+            size = 2 * (*length + received);
+            grown = realloc(queued, size);
+            if (!grown)
+            {
+                syslog_errno(ENOMEM, "Unable to hold the filenames left in a worker's socket");
+                break;
+            }
+            queued = grown;
+        }
+        memcpy(queued + *length, record, received);
+        *length += received;
+    }
+
+    // CLEANUP
+    if (slot->read_fd > INVALID_FD)
+    {
+        close(slot->read_fd);
+        slot->read_fd = INVALID_FD;
+    }
+
+    // DONE
+    return queued;
+}
+
+
+/*
+ *  Send each nul-terminated filename a reaped worker left in its socket to the filename's new owner
+ */
+static void _requeue(Supervisor *supervisor, int worker, char *queued, size_t length)
+{
+    // LOCAL VARIABLES
+    char *filename = queued;  // Current filename
+    char *terminator = NULL;  // End of the current filename
+    int requeued = 0;         // Filenames sent on
+    int dropped = 0;          // Filenames that weren't
+
+    // REQUEUE THEM
+    // Every message is a whole filename, so the memchr() only guards against a malformed record
+    while ((terminator = memchr(filename, '\0', queued + length - filename)))
+    {
+        if (1 != verify_filename(filename))
+        {
+            // e.g., removed while it waited in the queue
+            syslog_it2(LOG_WARNING, "Dropping %s from worker %d's queue: it isn't a file", filename, worker);
+            dropped++;
+        }
+        else if (0 == supervisor_dispatch(supervisor, filename))
+        {
+            requeued++;
+        }
+        else
+        {
+            dropped++;
+        }
+        filename = terminator + 1;
+    }
+    if (requeued + dropped > 0)
+    {
+        syslog_it2(dropped ? LOG_ERR : LOG_NOTICE, "Requeued %d of the %d filenames worker %d left unread",
+                   requeued, requeued + dropped, worker);
+    }
+}
+
+
+/*
+ *  Wait for worker's full socket to drain, checking the workers every SUPERVISOR_POLL_MS
+ *  Returns 0 once the socket is writable, EPIPE if the worker died, errno on failure
+ */
+static int _wait_for_worker(Supervisor *supervisor, int worker)
+{
+    // LOCAL VARIABLES
+    int errnum = EAGAIN;                               // 0 on success, errno on failure
+    pid_t pid = supervisor->workers[worker].pid;       // The worker being waited on
+    struct pollfd poll_fd = { 0 };                     // The worker's write end
+    int ready = 0;                                     // Return value from poll()
+
+    // WAIT
+    poll_fd.fd = supervisor->workers[worker].write_fd;
+    poll_fd.events = POLLOUT;
+    while (EAGAIN == errnum)
+    {
+        ready = poll(&poll_fd, 1, SUPERVISOR_POLL_MS);
+        if (ready > 0)
+        {
+            errnum = 0;
+        }
+        else if (ready < 0 && EINTR != errno)
+        {
+            errnum = get_errno();
+        }
+        else
+        {
+            // A crashed worker never drains its socket: supervisor_check() reaps it and requeues its files
+            supervisor_check(supervisor);
+            if (pid != supervisor->workers[worker].pid)
+            {
+                errnum = EPIPE;
+            }
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+int supervisor_check(Supervisor *supervisor)
+{
+    // LOCAL VARIABLES
+    int running = -1;         // Number of workers running, -1 on bad input
+    bool changed = false;     // Did any worker leave or join the ring?
+    WorkerSlot *slot = NULL;  // Current worker
+    int status = 0;           // Worker's exit status
+    time_t now = 0;           // Current time
+    char *orphans[SUPERVISOR_MAX_WORKERS] = { NULL };  // Filenames each reaped worker left unread
+    size_t orphan_lens[SUPERVISOR_MAX_WORKERS] = { 0 };  // Length of each entry in orphans
+    int i = 0;                // Iterating variable
+
+    // INPUT VALIDATION
+    if (supervisor && supervisor->worker_main)
+    {
+        running = 0;
+        now = time(NULL);
+    }
+
+    // REAP THEM
+    for (i = 0; running > -1 && i < supervisor->num_workers; i++)
+    {
+        slot = supervisor->workers + i;
+        if (slot->pid > 0 && slot->pid == waitpid(slot->pid, &status, WNOHANG))
+        {
+            if (WIFSIGNALED(status))
+            {
+                syslog_it2(LOG_ERR, "Worker %d (PID %ld) was killed by signal %d", i, (long)slot->pid,
+                           WTERMSIG(status));
+            }
+            else
+            {
+                syslog_it2(LOG_ERR, "Worker %d (PID %ld) exited early with status %d", i, (long)slot->pid,
+                           WEXITSTATUS(status));
+            }
+            slot->pid = 0;
+            if (slot->write_fd > INVALID_FD)
+            {
+                close(slot->write_fd);
+                slot->write_fd = INVALID_FD;
+            }
+            orphans[i] = _drain_worker(slot, orphan_lens + i);  // Before a restart replaces the socket
+            changed = true;
+        }
+    }
+
+    // RESTART THEM
+    for (i = 0; running > -1 && i < supervisor->num_workers; i++)
+    {
+        slot = supervisor->workers + i;
+        if (0 == slot->pid && false == slot->retired)
+        {
+            if (now - slot->window_start >= SUPERVISOR_RESTART_WINDOW)
+            {
+                slot->window_start = now;
+                slot->restarts = 0;
+            }
+            if (slot->restarts >= SUPERVISOR_MAX_RESTARTS)
+            {
+                syslog_it2(LOG_CRIT, "Retiring worker %d after %d restarts in %d seconds; its files move to the others",
+                           i, slot->restarts, SUPERVISOR_RESTART_WINDOW);
+                slot->retired = true;
+            }
+            else
+            {
+                slot->restarts++;
+                if (0 == _spawn_worker(supervisor, i))
+                {
+                    syslog_it2(LOG_NOTICE, "Restarted worker %d (PID %ld)", i, (long)slot->pid);
+                    changed = true;
+                }
+            }
+        }
+        if (slot->pid > 0 && slot->write_fd > INVALID_FD)
+        {
+            running++;
+        }
+    }
+
+    // REBALANCE
+    if (true == changed)
+    {
+        _build_ring(supervisor);
+    }
+
+    // REQUEUE
+    // After the ring is rebuilt so nothing goes back to a dead worker
+    for (i = 0; running > -1 && i < supervisor->num_workers; i++)
+    {
+        if (orphans[i])
+        {
+            _requeue(supervisor, i, orphans[i], orphan_lens[i]);
+            free(orphans[i]);
+        }
+    }
+
+    // DONE
+    return running;
+}
+
+
+int supervisor_dispatch(Supervisor *supervisor, char *filename)
+{
+    // LOCAL VARIABLES
+    int results = -1;          // 0 on success, -1 on bad input, errno on failure
+    int worker = -1;           // Worker that owns filename
+    size_t length = 0;         // Bytes to send, including the nul terminator
+    bool sending = false;      // Flow control
+    int attempts = 0;          // Workers tried
+
+    // INPUT VALIDATION
+    if (supervisor && supervisor->worker_main && filename && *filename)
+    {
+        length = strlen(filename) + 1;
+        results = EAGAIN;
+    }
+
+    // SEND IT
+    while (EAGAIN == results && attempts++ <= supervisor->num_workers)
+    {
+        if (0 == supervisor->ring_len)
+        {
+            supervisor_check(supervisor);
+        }
+        worker = _find_owner(supervisor, filename);
+        if (worker < 0)
+        {
+            results = ECHILD;  // Every worker is retired
+            break;
+        }
+        // A message is sent whole or not at all
+        for (results = 0, sending = true; true == sending; )
+        {
+            if ((ssize_t)length == send(supervisor->workers[worker].write_fd, filename, length, MSG_NOSIGNAL))
+            {
+                sending = false;
+            }
+            else if (EAGAIN == errno)
+            {
+                results = _wait_for_worker(supervisor, worker);  // Its socket is full
+                sending = (0 == results);
+            }
+            else if (EINTR != errno)
+            {
+                results = get_errno();
+                sending = false;
+            }
+        }
+        if (EPIPE == results)
+        {
+            // The worker died: supervisor_check() took it off the ring and requeued its socket
+            syslog_it2(LOG_WARNING, "Worker %d stopped reading; sending %s elsewhere", worker, filename);
+            results = EAGAIN;
+        }
+    }
+    if (results > 0)
+    {
+        syslog_errno(results, "Unable to send %s to a worker", filename);
+    }
+
+    // DONE
+    return results;
+}
+
+
+int supervisor_start(Supervisor *supervisor, int num_workers, char *process_dir, WorkerMain worker_main,
+                     void *context)
+{
+    // LOCAL VARIABLES
+    int results = -1;                    // 0 on success, -1 on bad input, errno on failure
+    struct sigaction ignore;             // Disposition for SIGPIPE
+    cpu_set_t cpu_set;                   // CPUs the supervisor may run on
+    size_t dir_len = 0;                  // Length of process_dir
+    size_t shard_len = 0;                // Length of a shard directory
+    WorkerSlot *slot = NULL;             // Current worker
+    int running = 0;                     // Workers started
+    int i = 0;                           // Iterating variable
+
+    // INPUT VALIDATION
+    if (supervisor && num_workers > 0 && num_workers <= SUPERVISOR_MAX_WORKERS && process_dir && *process_dir
+        && worker_main)
+    {
+        memset(supervisor, 0, sizeof(Supervisor));
+        supervisor->num_workers = num_workers;
+        supervisor->worker_main = worker_main;
+        supervisor->context = context;
+        dir_len = strlen(process_dir);
+        results = 0;
+    }
+
+    // SETUP
+    // A dead worker must show up as EPIPE, not kill the supervisor
+    if (0 == results)
+    {
+        memset(&ignore, 0, sizeof(ignore));
+        ignore.sa_handler = SIG_IGN;
+        sigaction(SIGPIPE, &ignore, NULL);
+        CPU_ZERO(&cpu_set);
+        if (0 == sched_getaffinity(0, sizeof(cpu_set), &cpu_set))
+        {
+            for (i = 0; i < CPU_SETSIZE && supervisor->num_cpus < SUPERVISOR_MAX_CPUS; i++)
+            {
+                if (CPU_ISSET(i, &cpu_set))
+                {
+                    supervisor->cpus[supervisor->num_cpus++] = i;
+                }
+            }
+        }
+    }
+    for (i = 0; 0 == results && i < num_workers; i++)
+    {
+        slot = supervisor->workers + i;
+        slot->write_fd = INVALID_FD;
+        slot->read_fd = INVALID_FD;
+        slot->window_start = time(NULL);
+        // Split the CPUs into contiguous slices (or share them round-robin if there are too few)
+        if (supervisor->num_cpus >= num_workers)
+        {
+            slot->first_cpu = i * supervisor->num_cpus / num_workers;
+            slot->num_cpus = (i + 1) * supervisor->num_cpus / num_workers - slot->first_cpu;
+        }
+        else if (supervisor->num_cpus > 0)
+        {
+            slot->first_cpu = i % supervisor->num_cpus;
+            slot->num_cpus = 1;
+        }
+        shard_len = dir_len + 1 + strlen(SUPERVISOR_SHARD_FORMAT) + 8;
+        slot->shard_dir = calloc(shard_len + 1, sizeof(char));
+        if (!slot->shard_dir)
+        {
+            results = ENOMEM;
+        }
+        else
+        {
+            snprintf(slot->shard_dir, shard_len + 1, "%s%s" SUPERVISOR_SHARD_FORMAT, process_dir,
+                     '/' == process_dir[dir_len - 1] ? "" : "/", i);
+            if (mkdir(slot->shard_dir, SUPERVISOR_DIR_MODE) && EEXIST != errno)
+            {
+                results = get_errno();
+                syslog_errno(results, "Unable to create the worker directory %s", slot->shard_dir);
+            }
+        }
+    }
+
+    // START THEM
+    for (i = 0; 0 == results && i < num_workers; i++)
+    {
+        if (0 == _spawn_worker(supervisor, i))
+        {
+            running++;
+        }
+    }
+    if (0 == results)
+    {
+        _build_ring(supervisor);
+        if (0 == running)
+        {
+            results = ECHILD;
+        }
+        else
+        {
+            syslog_it2(LOG_INFO, "Started %d of %d workers across %d CPUs", running, num_workers,
+                       supervisor->num_cpus);
+        }
+    }
+
+    // CLEANUP
+    if (results > 0)
+    {
+        supervisor_stop(supervisor);
+    }
+
+    // DONE
+    return results;
+}
+
+
+int supervisor_stop(Supervisor *supervisor)
+{
+    // LOCAL VARIABLES
+    int failures = 0;         // Return value
+    WorkerSlot *slot = NULL;  // Current worker
+    int status = 0;           // Worker's exit status
+    pid_t reaped = 0;         // Return value from waitpid()
+    char *orphans = NULL;     // Filenames a failed worker left unread
+    size_t orphans_len = 0;   // Length of orphans
+    char *filename = NULL;    // Iterating variable
+    int i = 0;                // Iterating variable
+
+    // STOP THEM
+    // Closing every socket first lets the workers finish in parallel
+    for (i = 0; supervisor && i < supervisor->num_workers; i++)
+    {
+        slot = supervisor->workers + i;
+        if (slot->write_fd > INVALID_FD)
+        {
+            close(slot->write_fd);
+            slot->write_fd = INVALID_FD;
+        }
+    }
+    for (i = 0; supervisor && i < supervisor->num_workers; i++)
+    {
+        slot = supervisor->workers + i;
+        if (slot->pid > 0)
+        {
+            while (-1 == (reaped = waitpid(slot->pid, &status, 0)) && EINTR == errno);
+            if (reaped != slot->pid)
+            {
+                syslog_errno(errno, "Unable to wait for worker %d (PID %ld)", i, (long)slot->pid);
+                failures++;
+            }
+            else if (!WIFEXITED(status) || 0 != WEXITSTATUS(status))
+            {
+                failures++;
+            }
+        }
+        // Whether or not it was reaped, the slot no longer has a worker
+        slot->pid = 0;
+        slot->retired = true;
+        // A worker that read to the end left nothing; anything else is lost (report it)
+        orphans = _drain_worker(slot, &orphans_len);
+        for (filename = orphans; filename && filename < orphans + orphans_len; filename += strnlen(filename, orphans + orphans_len - filename) + 1)
+        {
+            syslog_it2(LOG_ERR, "Worker %d exited without processing %.*s", i,
+                       (int)(orphans + orphans_len - filename), filename);
+        }
+        free(orphans);
+        free(slot->shard_dir);
+        slot->shard_dir = NULL;
+    }
+    if (supervisor)
+    {
+        supervisor->ring_len = 0;
+        supervisor->worker_main = NULL;
+    }
+
+    // DONE
+    return failures;
+}
+
+
+char *worker_next(WorkerInbox *inbox, int *errnum)
+{
+    // LOCAL VARIABLES
+    char *filename = NULL;    // Return value
+    size_t length = 0;        // Length of the filename
+    ssize_t received = 0;     // Return value from recv()
+    int pending = 0;          // Size of the next queued message
+    bool reading = false;     // Flow control
+
+    // INPUT VALIDATION
+    if (inbox && errnum && inbox->read_fd > INVALID_FD)
+    {
+        *errnum = 0;
+        reading = true;
+    }
+
+    // READ IT
+    // Exactly one filename per recv(): everything after it stays in the socket, where the
+    // supervisor can take it back if this worker crashes
+    while (true == reading)
+    {
+        if (false == inbox->waiting)
+        {
+            filelog_flush();  // recv() may block until the next filename
+        }
+        received = recv(inbox->read_fd, inbox->buffer, SUPERVISOR_INBOX_SIZE, 0);
+        if (received > 0)
+        {
+            length = strnlen(inbox->buffer, received);
+            filename = hare_message_alloc(length + 1);
+            if (filename)
+            {
+                memcpy(filename, inbox->buffer, length);
+            }
+            else
+            {
+                *errnum = ENOMEM;
+            }
+            reading = false;
+        }
+        else if (0 == received)
+        {
+            reading = false;  // The supervisor closed the socket
+        }
+        else if (EINTR != errno)
+        {
+            *errnum = get_errno();
+            reading = false;
+        }
+    }
+    if (inbox && errnum)
+    {
+        // For a SOCK_SEQPACKET socket FIONREAD reports the size of the next message
+        inbox->waiting = (filename && 0 == ioctl(inbox->read_fd, FIONREAD, &pending) && pending > 0);
+    }
+
+    // DONE
+    return filename;
+}
@@ -0,0 +1,139 @@
+/*
+ *  Multi-process supervisor for the HARE daemon.
+ *  The supervisor forks shared-nothing worker processes, each pinned to its own slice of the
+ *      CPUs it may run on and each owning a subdirectory of the process directory.  Filenames
+ *      are sharded across workers with a consistent-hash ring so a worker leaving (or
+ *      rejoining) the ring only moves the files that hashed to it.
+ *  Each worker reads nul-terminated filenames, one per message, from its own SOCK_SEQPACKET
+ *      socket pair until the supervisor closes it.  Crashed workers are taken off the ring
+ *      (their files rebalance onto the others) and restarted.  A worker that keeps crashing
+ *      stays off the ring.
+ *  What survives a worker crash:
+ *      - Filenames the worker hadn't received yet: the supervisor keeps its own copy of each
+ *          socket's read end and sends them on to the workers that take over its share.
+ *      - The one filename the worker had received: replayed from the worker's journal
+ *          (<journal>.N) when the worker restarts, but only if journaling is enabled and the
+ *          worker recorded it before crashing.  Otherwise it stays in the watched directory
+ *          until the next startup's backlog drain finds it.
+ *      Filenames the supervisor couldn't send at all are logged by supervisor_dispatch().
+ */
+
+#ifndef __HARE_SUPERVISOR__
+#define __HARE_SUPERVISOR__
+
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t
+#include <sys/types.h>  // pid_t
+#include <time.h>       // time_t
+
+#define SUPERVISOR_MAX_WORKERS 64         // Maximum number of worker processes
+#define SUPERVISOR_VNODES 64              // Points each worker owns on the hash ring
+#define SUPERVISOR_MAX_RESTARTS 5         // Restarts allowed per window before a worker is retired...
+#define SUPERVISOR_RESTART_WINDOW 60      // ...where the window is this many seconds
+#define SUPERVISOR_SHARD_FORMAT "worker%02d/"  // Worker subdirectory of the process directory
+#define SUPERVISOR_INBOX_SIZE 8192        // Largest message a worker reads (holds a full PATH_MAX name)
+#define SUPERVISOR_MAX_CPUS 1024          // Maximum number of CPUs divided among the workers
+#define SUPERVISOR_POLL_MS 100            // How often a dispatch blocked on a full socket checks the workers
+#define SUPERVISOR_ENV_VAR "HARE_WORKERS" // Number of worker processes (see: read_settings())
+
+/*
+ *  Body of a worker process.  Read filenames with worker_next() until it returns NULL.
+ *  Arguments
+ *      worker - Index of the worker
+ *      read_fd - Read end of the worker's socket pair
+ *      shard_dir - The worker's subdirectory of the process directory (ends in '/')
+ *      context - Caller's context
+ *  Returns the worker's exit status
+ */
+typedef int (*WorkerMain)(int worker, int read_fd, char *shard_dir, void *context);
+
+// A point on the consistent-hash ring
+typedef struct _RingPoint
+{
+    uint32_t hash;  // Position on the ring
+    int worker;     // Worker that owns it
+} RingPoint;
+
+// Bookkeeping for a single worker
+typedef struct _WorkerSlot
+{
+    pid_t pid;                 // Process ID (0 if not running)
+    int write_fd;              // Write end of the worker's socket pair (non-blocking)
+    int read_fd;               // Supervisor's copy of the read end (to requeue what a crashed worker left)
+    char *shard_dir;           // Worker's subdirectory of the process directory (heap-allocated)
+    int first_cpu;             // First CPU (index into the supervisor's CPU list) it's pinned to
+    int num_cpus;              // Number of CPUs it's pinned to
+    bool retired;              // Won't be restarted (crashed too often, or supervisor_stop())
+    int restarts;              // Restarts in the current window
+    time_t window_start;       // When the current restart window began
+} WorkerSlot;
+
+// A supervisor and its workers
+typedef struct _Supervisor
+{
+    WorkerSlot workers[SUPERVISOR_MAX_WORKERS];                  // Worker processes
+    int num_workers;                                             // Number of entries in workers
+    RingPoint ring[SUPERVISOR_MAX_WORKERS * SUPERVISOR_VNODES];  // Sorted by hash
+    size_t ring_len;                                             // Number of points in ring
+    int cpus[SUPERVISOR_MAX_CPUS];                               // CPUs the supervisor may run on
+    int num_cpus;                                                // Number of entries in cpus
+    WorkerMain worker_main;                                      // Worker process body
+    void *context;                                               // Context for worker_main
+} Supervisor;
+
+// Reader for a worker's socket pair
+typedef struct _WorkerInbox
+{
+    int read_fd;                          // Read end of the worker's socket pair
+    char buffer[SUPERVISOR_INBOX_SIZE];   // The last message read
+    bool waiting;                         // Was another filename queued behind the last one?
+} WorkerInbox;
+
+
+/*
+ *  Reap workers that exited, take them off the ring, restart them (unless they crash too
+ *      often), and send the filenames they never read to the workers that own them now.
+ *      Call regularly (e.g., while idle).
+ *  Returns the number of workers running, -1 on bad input
+ */
+int supervisor_check(Supervisor *supervisor);
+
+
+/*
+ *  Send filename to the worker that owns it on the ring.  While that worker's socket is full,
+ *      the supervisor checks its workers every SUPERVISOR_POLL_MS; if the worker died, the
+ *      filename goes to the new owner.
+ *  Returns 0 on success, -1 on bad input, errno on failure (ECHILD if no worker is running)
+ */
+int supervisor_dispatch(Supervisor *supervisor, char *filename);
+
+
+/*
+ *  Create num_workers shard directories under process_dir and fork a worker for each
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int supervisor_start(Supervisor *supervisor, int num_workers, char *process_dir, WorkerMain worker_main,
+                     void *context);
+
+
+/*
+ *  Close every worker's socket, wait for the workers to finish what they were sent, and free
+ *      supervisor's resources.  Logs filenames a failed worker left unread.
+ *  Returns the number of workers that failed
+ */
+int supervisor_stop(Supervisor *supervisor);
+
+
+/*
+ *  Read the next filename sent to a worker, one message at a time, blocking until one arrives
+ *      (after flushing buffered log lines if nothing was queued, see: HARE_filelog.h)
+ *  Arguments
+ *      inbox - Zero-initialized inbox whose read_fd has been set
+ *      errnum - [Out] 0 on success or end of input, errno on failure
+ *  Returns a filename from hare_message_alloc(), NULL once the supervisor closes the socket
+ */
+char *worker_next(WorkerInbox *inbox, int *errnum);
+
+
+#endif  // __HARE_SUPERVISOR__
@@ -0,0 +1,921 @@
+/*
+ *  Implements HARE_watcher.h functions.
+ */
+
+#define _GNU_SOURCE          // dirfd()
+#include <dirent.h>          // closedir(), opendir(), readdir(), DT_* macros
+#include <errno.h>           // errno
+#include <fcntl.h>           // AT_* macros
+#include <linux/limits.h>    // PATH_MAX
+#include <poll.h>            // poll(), struct pollfd
+#include <stdint.h>          // uint32_t
+#include <stdio.h>           // fclose(), fopen(), fscanf()
+#include <stdlib.h>          // calloc(), free(), realloc()
+#include <string.h>          // memcpy(), memset(), strcmp(), strlen(), strncmp()
+#include <sys/inotify.h>     // inotify_*(), IN_* macros
+#include <sys/stat.h>        // fstatat(), stat()
+#include <unistd.h>          // access(), close(), read()
+#include "HARE_arena.h"      // hare_message_alloc()
+#include "HARE_library.h"    // syslog_*(), INVALID_FD, get_errno()
+#include "HARE_watcher.h"
+
+#define WATCHER_INITIAL_SLOTS 1024  // Starting size of a Watcher's table
+#define WATCHER_INITIAL_READY 256   // Starting capacity of a Watcher's ready ring
+#define WATCHER_DEDUPE_WINDOW 64    // Newest ready entries checked for a duplicate filename
+// Events every watched directory reports
+#define WATCHER_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_ONLYDIR \
+                      | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+#define WATCHER_LIMIT_FILE "/proc/sys/fs/inotify/max_user_watches"
+
+Watcher *tree_watcher = NULL;
+
+
+/*************************************************************************************************/
+/**************************************** LOCAL FUNCTIONS ****************************************/
+/*************************************************************************************************/
+
+
+static int _watch_tree(Watcher *watcher, char *path, size_t path_len, bool report);
+
+
+/*
+ *  Home slot for wd in a table of table_size (a power of two) slots
+ */
+static size_t _hash_wd(int wd, size_t table_size)
+{
+    return ((uint32_t)wd * 2654435761U) & (table_size - 1);  // Knuth's multiplicative hash
+}
+
+
+/*
+ *  Find wd in watcher's table
+ *  Returns a pointer to its entry, NULL if wd isn't watched
+ */
+static WatchEntry *_find_watch(Watcher *watcher, int wd)
+{
+    // LOCAL VARIABLES
+    WatchEntry *entry = NULL;                           // Return value
+    size_t slot = _hash_wd(wd, watcher->table_size);    // Slot being probed
+
+    // FIND IT
+    while (0 != watcher->table[slot].wd)
+    {
+        if (wd == watcher->table[slot].wd)
+        {
+            entry = watcher->table + slot;
+            break;
+        }
+        slot = (slot + 1) & (watcher->table_size - 1);
+    }
+
+    // DONE
+    return entry;
+}
+
+
+/*
+ *  Add wd to watcher's table, doubling it first if it would be more than half full.
+ *      Takes ownership of path.
+ *  Returns 0 on success, errno on failure
+ */
+static int _insert_watch(Watcher *watcher, int wd, char *path, struct timespec *mtime)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;              // 0 on success, errno on failure
+    WatchEntry *grown = NULL;    // Replacement table
+    size_t grown_size = 0;       // Number of slots in grown
+    size_t slot = 0;             // Slot being probed
+    size_t i = 0;                // Iterating variable
+
+    // MAKE ROOM
+    if ((watcher->num_watches + 1) * 2 > watcher->table_size)
+    {
+        grown_size = watcher->table_size * 2;
+        grown = calloc(grown_size, sizeof(WatchEntry));
+        if (!grown)
+        {
+            errnum = ENOMEM;
+        }
+        for (i = 0; grown && i < watcher->table_size; i++)
+        {
+            if (0 != watcher->table[i].wd)
+            {
+                slot = _hash_wd(watcher->table[i].wd, grown_size);
+                while (0 != grown[slot].wd)
+                {
+                    slot = (slot + 1) & (grown_size - 1);
+                }
+                grown[slot] = watcher->table[i];
+            }
+        }
+        if (grown)
+        {
+            free(watcher->table);
+            watcher->table = grown;
+            watcher->table_size = grown_size;
+        }
+    }
+
+    // ADD IT
+    if (0 == errnum)
+    {
+        slot = _hash_wd(wd, watcher->table_size);
+        while (0 != watcher->table[slot].wd)
+        {
+            slot = (slot + 1) & (watcher->table_size - 1);
+        }
+        watcher->table[slot].wd = wd;
+        watcher->table[slot].path = path;
+        watcher->table[slot].mtime = *mtime;
+        watcher->num_watches++;
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Remove wd from watcher's table (if present).  Later entries in the probe sequence are
+ *      shifted back so lookups never need tombstones.
+ */
+static void _remove_watch(Watcher *watcher, int wd)
+{
+    // LOCAL VARIABLES
+    WatchEntry *entry = _find_watch(watcher, wd);  // Entry to remove
+    size_t mask = watcher->table_size - 1;         // Wraps slot indices
+    size_t hole = 0;                               // Empty slot
+    size_t slot = 0;                               // Slot being probed
+    size_t home = 0;                               // Home slot of the entry being probed
+
+    // REMOVE IT
+    if (entry)
+    {
+        free(entry->path);
+        hole = entry - watcher->table;
+        watcher->table[hole].wd = 0;
+        watcher->table[hole].path = NULL;
+        watcher->num_watches--;
+        for (slot = (hole + 1) & mask; 0 != watcher->table[slot].wd; slot = (slot + 1) & mask)
+        {
+            // Move the entry into the hole unless its home lies cyclically in (hole, slot]
+            home = _hash_wd(watcher->table[slot].wd, watcher->table_size);
+            if (((slot - home) & mask) >= ((slot - hole) & mask))
+            {
+                watcher->table[hole] = watcher->table[slot];
+                watcher->table[slot].wd = 0;
+                watcher->table[slot].path = NULL;
+                hole = slot;
+            }
+        }
+    }
+}
+
+
+/*
+ *  Translate the caller's cap into the number of watches a Watcher may hold
+ */
+static size_t _get_watch_limit(size_t requested)
+{
+    // LOCAL VARIABLES
+    size_t limit = requested ? requested : WATCHER_DEFAULT_MAX;  // Return value
+    FILE *limit_file = fopen(WATCHER_LIMIT_FILE, "r");           // fs.inotify.max_user_watches
+    unsigned long max_user_watches = 0;                          // Value of limit_file
+
+    // READ IT
+    if (limit_file)
+    {
+        if (1 == fscanf(limit_file, "%lu", &max_user_watches) && max_user_watches > 0)
+        {
+            // The limit is per user, so leave room for everything else the user runs
+            max_user_watches -= max_user_watches * WATCHER_HEADROOM / 100;
+            if (0 == requested || max_user_watches < requested)
+            {
+                limit = max_user_watches;
+            }
+        }
+        fclose(limit_file);
+    }
+
+    // DONE
+    return limit;
+}
+
+
+/*
+ *  Is dir_stat one of watcher's skip directories?
+ */
+static bool _is_skipped(Watcher *watcher, struct stat *dir_stat)
+{
+    // LOCAL VARIABLES
+    bool skipped = false;  // Return value
+    size_t i = 0;          // Iterating variable
+
+    // CHECK IT
+    for (i = 0; i < watcher->num_skip && false == skipped; i++)
+    {
+        skipped = (watcher->skip[i].dev == dir_stat->st_dev && watcher->skip[i].ino == dir_stat->st_ino);
+    }
+
+    // DONE
+    return skipped;
+}
+
+
+/*
+ *  Append dir_path/name to watcher's ready ring unless one of the newest entries already
+ *      holds it (e.g., a file reported by both a new directory's scan and its own event)
+ *  Returns 0 on success, errno on failure
+ */
+static int _queue_file(Watcher *watcher, char *dir_path, size_t dir_len, char *name)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                              // 0 on success, errno on failure
+    size_t name_len = strlen(name);              // Length of name
+    char *filename = NULL;                       // dir_path/name (heap-allocated)
+    char **grown = NULL;                         // Replacement ring
+    size_t grown_size = 0;                       // Number of entries in grown
+    size_t slot = 0;                             // Index into ready
+    size_t i = 0;                                // Iterating variable
+
+    // BUILD IT
+    filename = calloc(dir_len + name_len + 1, sizeof(char));
+    if (filename)
+    {
+        memcpy(filename, dir_path, dir_len);
+        memcpy(filename + dir_len, name, name_len);
+    }
+    else
+    {
+        errnum = ENOMEM;
+    }
+
+    // DEDUPLICATE IT
+    for (i = 0; 0 == errnum && i < watcher->ready_count && i < WATCHER_DEDUPE_WINDOW; i++)
+    {
+        slot = (watcher->ready_head + watcher->ready_count - 1 - i) % watcher->ready_capacity;
+        if (0 == strcmp(filename, watcher->ready[slot]))
+        {
+            free(filename);
+            filename = NULL;
+            break;
+        }
+    }
+
+    // MAKE ROOM
+    if (0 == errnum && filename && watcher->ready_count == watcher->ready_capacity)
+    {
+        grown_size = watcher->ready_capacity ? watcher->ready_capacity * 2 : WATCHER_INITIAL_READY;
+        grown = calloc(grown_size, sizeof(char *));
+        if (grown)
+        {
+            for (i = 0; i < watcher->ready_count; i++)
+            {
+                grown[i] = watcher->ready[(watcher->ready_head + i) % watcher->ready_capacity];
+            }
+            free(watcher->ready);
+            watcher->ready = grown;
+            watcher->ready_capacity = grown_size;
+            watcher->ready_head = 0;
+        }
+        else
+        {
+            errnum = ENOMEM;
+        }
+    }
+
+    // QUEUE IT
+    if (0 == errnum && filename)
+    {
+        watcher->ready[(watcher->ready_head + watcher->ready_count) % watcher->ready_capacity] = filename;
+        watcher->ready_count++;
+        filename = NULL;
+    }
+
+    // CLEANUP
+    free(filename);
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Remove the oldest filename from watcher's ready ring.  Does not validate input.
+ *  Returns the filename, which the caller must free()
+ */
+static char *_pop_ready(Watcher *watcher)
+{
+    // LOCAL VARIABLES
+    char *oldest = watcher->ready[watcher->ready_head];  // Return value
+
+    // POP IT
+    watcher->ready[watcher->ready_head] = NULL;
+    watcher->ready_head = (watcher->ready_head + 1) % watcher->ready_capacity;
+    watcher->ready_count--;
+
+    // DONE
+    return oldest;
+}
+
+
+/*
+ *  Read the directory path (a PATH_MAX + 1 buffer ending in '/'), queueing its files if
+ *      report is true and watching any subdirectory that isn't already watched.
+ *  Returns 0 on success, errno on failure
+ */
+static int _read_dir(Watcher *watcher, char *path, size_t path_len, bool report)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                 // 0 on success, errno on failure
+    DIR *dir = NULL;                // Directory stream for path
+    struct dirent *entry = NULL;    // Current entry
+    unsigned char entry_type = 0;   // Type of entry
+    struct stat entry_stat;         // Metadata for DT_UNKNOWN entries
+    char *subdirs = NULL;           // Subdirectory names, nul-separated
+    size_t subdirs_len = 0;         // Bytes of subdirs in use
+    size_t subdirs_size = 0;        // Bytes of subdirs allocated
+    size_t name_len = 0;            // Length of a name
+    char *grown = NULL;             // Reallocated subdirs
+    size_t i = 0;                   // Iterating variable
+
+    // READ IT
+    dir = opendir(path);
+    if (!dir)
+    {
+        errnum = get_errno();
+    }
+    while (0 == errnum && dir && (entry = readdir(dir)))
+    {
+        if ('.' == entry->d_name[0])
+        {
+            continue;  // Skip ".", "..", and hidden (e.g., temporary) files
+        }
+        entry_type = entry->d_type;
+        if (DT_UNKNOWN == entry_type)
+        {
+            if (fstatat(dirfd(dir), entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW))
+            {
+                continue;  // Vanished
+            }
+            entry_type = S_ISDIR(entry_stat.st_mode) ? DT_DIR : S_ISREG(entry_stat.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (DT_REG == entry_type && true == report)
+        {
+            errnum = _queue_file(watcher, path, path_len, entry->d_name);
+        }
+        else if (DT_DIR == entry_type)
+        {
+            // Remember it for later so this directory can be closed first
+            name_len = strlen(entry->d_name) + 1;
+            if (subdirs_len + name_len > subdirs_size)
+            {
+                subdirs_size = (subdirs_size + name_len) * 2;
+                grown = realloc(subdirs, subdirs_size);
+                if (grown)
+                {
+                    subdirs = grown;
+                }
+                else
+                {
+                    errnum = ENOMEM;
+                }
+            }
+            if (0 == errnum)
+            {
+                memcpy(subdirs + subdirs_len, entry->d_name, name_len);
+                subdirs_len += name_len;
+            }
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+        dir = NULL;
+    }
+
+    // DESCEND
+    for (i = 0; 0 == errnum && i < subdirs_len; i += name_len + 1)
+    {
+        name_len = strlen(subdirs + i);
+        if (path_len + name_len + 1 > PATH_MAX)
+        {
+            syslog_it2(LOG_WARNING, "Not watching %s%s: the path is too long", path, subdirs + i);
+            continue;
+        }
+        memcpy(path + path_len, subdirs + i, name_len);
+        path[path_len + name_len] = '/';
+        path[path_len + name_len + 1] = '\0';
+        errnum = _watch_tree(watcher, path, path_len + name_len + 1, report);
+        path[path_len] = '\0';
+        if (EACCES == errnum || ENOENT == errnum || ENOTDIR == errnum)
+        {
+            errnum = 0;  // One unreadable (or vanished) subdirectory shouldn't stop the others
+        }
+    }
+
+    // CLEANUP
+    free(subdirs);
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Watch the directory path (a PATH_MAX + 1 buffer ending in '/') and everything beneath it.
+ *      The watch is added before the directory is read so nothing created in between is missed.
+ *      Directories that are skipped, already watched, or past the cap are left alone.
+ *  Returns 0 on success, errno on failure
+ */
+static int _watch_tree(Watcher *watcher, char *path, size_t path_len, bool report)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;           // 0 on success, errno on failure
+    struct stat dir_stat;     // Metadata for path
+    int wd = -1;              // Watch descriptor for path
+    char *path_copy = NULL;   // Heap copy of path for the table
+    bool watched = false;     // Was a new watch added?
+
+    // CHECK IT
+    if (stat(path, &dir_stat))
+    {
+        errnum = get_errno();
+    }
+    else if (!S_ISDIR(dir_stat.st_mode))
+    {
+        errnum = ENOTDIR;
+    }
+    else if (true == _is_skipped(watcher, &dir_stat))
+    {
+        // e.g., the process directory: moving files into it mustn't generate events
+    }
+    else if (watcher->num_watches >= watcher->max_watches)
+    {
+        if (false == watcher->capped)
+        {
+            syslog_it2(LOG_WARNING, "Reached the limit of %zu watches so %s (and others) will not be watched",
+                       watcher->max_watches, path);
+            watcher->capped = true;
+        }
+    }
+
+    // WATCH IT
+    else if ((wd = inotify_add_watch(watcher->fd, path, WATCHER_MASK)) < 0)
+    {
+        errnum = get_errno();
+        if (ENOSPC == errnum)
+        {
+            // Other processes are using more of max_user_watches than the headroom allowed for
+            syslog_it2(LOG_WARNING, "Ran out of inotify watches after %zu so %s will not be watched",
+                       watcher->num_watches, path);
+            watcher->capped = true;
+            errnum = 0;
+        }
+    }
+    else if (!_find_watch(watcher, wd))
+    {
+        // inotify_add_watch() returns the existing descriptor for a directory already watched
+        path_copy = calloc(path_len + 1, sizeof(char));
+        if (path_copy)
+        {
+            memcpy(path_copy, path, path_len);
+            errnum = _insert_watch(watcher, wd, path_copy, &dir_stat.st_mtim);
+        }
+        else
+        {
+            errnum = ENOMEM;
+        }
+        if (errnum)
+        {
+            inotify_rm_watch(watcher->fd, wd);
+            free(path_copy);
+        }
+        else
+        {
+            watched = true;
+        }
+    }
+
+    // READ IT
+    if (0 == errnum && true == watched)
+    {
+        errnum = _read_dir(watcher, path, path_len, report);
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Stop watching the directory path (ending in '/') and everything beneath it
+ *  Returns 0 on success, errno on failure
+ */
+static int _unwatch_tree(Watcher *watcher, char *path, size_t path_len)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;           // 0 on success, errno on failure
+    int *doomed = NULL;       // Watch descriptors to remove
+    size_t num_doomed = 0;    // Number of entries in doomed
+    size_t i = 0;             // Iterating variable
+
+    // FIND THEM
+    // Removal shifts entries around, so collect first
+    doomed = calloc(watcher->num_watches + 1, sizeof(int));
+    if (!doomed)
+    {
+        errnum = ENOMEM;
+    }
+    for (i = 0; 0 == errnum && i < watcher->table_size; i++)
+    {
+        if (0 != watcher->table[i].wd && 0 == strncmp(watcher->table[i].path, path, path_len))
+        {
+            doomed[num_doomed++] = watcher->table[i].wd;
+        }
+    }
+
+    // REMOVE THEM
+    for (i = 0; i < num_doomed; i++)
+    {
+        inotify_rm_watch(watcher->fd, doomed[i]);  // The IN_IGNORED event finds nothing
+        _remove_watch(watcher, doomed[i]);
+    }
+
+    // CLEANUP
+    free(doomed);
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Recover from a lost event queue by re-reading only the watched directories whose mtime
+ *      changed since they were last read.  New and renamed entries always change their
+ *      directory's mtime, so nothing that could have generated a lost event is skipped.
+ *  Returns 0 on success, errno on failure
+ */
+static int _rescan(Watcher *watcher)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                  // 0 on success, errno on failure
+    char **stale = NULL;             // Paths of directories to re-read (heap-allocated)
+    size_t num_stale = 0;            // Number of entries in stale
+    int *gone = NULL;                // Watch descriptors of vanished directories
+    size_t num_gone = 0;             // Number of entries in gone
+    char path[PATH_MAX + 1] = { 0 }; // Path buffer for _read_dir()
+    size_t path_len = 0;             // Length of path
+    struct stat dir_stat;            // Metadata for a watched directory
+    WatchEntry *entry = NULL;        // Current table entry
+    size_t i = 0;                    // Iterating variable
+
+    // FIND THEM
+    // Reading a directory can add watches (and grow the table), so collect first
+    stale = calloc(watcher->num_watches + 1, sizeof(char *));
+    gone = calloc(watcher->num_watches + 1, sizeof(int));
+    if (!stale || !gone)
+    {
+        errnum = ENOMEM;
+    }
+    for (i = 0; 0 == errnum && i < watcher->table_size; i++)
+    {
+        entry = watcher->table + i;
+        if (0 == entry->wd)
+        {
+            continue;
+        }
+        if (stat(entry->path, &dir_stat))
+        {
+            gone[num_gone++] = entry->wd;  // Its IN_IGNORED was probably lost with the queue
+        }
+        else if (dir_stat.st_mtim.tv_sec != entry->mtime.tv_sec || dir_stat.st_mtim.tv_nsec != entry->mtime.tv_nsec)
+        {
+            stale[num_stale++] = entry->path;
+            entry->mtime = dir_stat.st_mtim;  // Before reading, so later changes still look stale
+        }
+    }
+
+    // RE-READ THEM
+    for (i = 0; i < num_stale; i++)
+    {
+        // Copy before reading: a grown table still owns the same path pointers
+        path_len = strlen(stale[i]);
+        memcpy(path, stale[i], path_len + 1);
+        if (0 == errnum)
+        {
+            errnum = _read_dir(watcher, path, path_len, true);
+            if (EACCES == errnum || ENOENT == errnum)
+            {
+                errnum = 0;
+            }
+        }
+    }
+    for (i = 0; i < num_gone; i++)
+    {
+        inotify_rm_watch(watcher->fd, gone[i]);
+        _remove_watch(watcher, gone[i]);
+    }
+    syslog_it2(LOG_INFO, "Rescanned %zu of %zu watched directories after an inotify queue overflow",
+               num_stale, watcher->num_watches);
+
+    // CLEANUP
+    free(stale);
+    free(gone);
+
+    // DONE
+    return errnum;
+}
+
+
+/*
+ *  Act on a single inotify event
+ *  Returns 0 on success, errno on failure
+ */
+static int _handle_event(Watcher *watcher, struct inotify_event *event)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;                   // 0 on success, errno on failure
+    WatchEntry *entry = NULL;         // Directory the event happened in
+    char path[PATH_MAX + 1] = { 0 };  // Absolute name of the event's subject
+    size_t path_len = 0;              // Length of path
+    size_t name_len = 0;              // Length of event->name
+
+    // HANDLE IT
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+        syslog_it(LOG_WARNING, "The inotify event queue overflowed");
+        errnum = _rescan(watcher);
+    }
+    else if (event->mask & IN_IGNORED)
+    {
+        _remove_watch(watcher, event->wd);  // The directory was deleted or unmounted
+    }
+    else if (event->len > 0 && '.' != event->name[0] && (entry = _find_watch(watcher, event->wd)))
+    {
+        path_len = strlen(entry->path);
+        name_len = strlen(event->name);
+        if (path_len + name_len + 1 > PATH_MAX)
+        {
+            syslog_it2(LOG_WARNING, "Ignoring an event for %s%s: the path is too long", entry->path, event->name);
+        }
+        else if (event->mask & IN_ISDIR)
+        {
+            memcpy(path, entry->path, path_len);
+            memcpy(path + path_len, event->name, name_len);
+            path[path_len + name_len] = '/';
+            if (event->mask & (IN_CREATE | IN_MOVED_TO))
+            {
+                errnum = _watch_tree(watcher, path, path_len + name_len + 1, true);
+                if (EACCES == errnum || ENOENT == errnum || ENOTDIR == errnum)
+                {
+                    errnum = 0;  // It was gone (or replaced) before the watch was added
+                }
+            }
+            else if (event->mask & IN_MOVED_FROM)
+            {
+                errnum = _unwatch_tree(watcher, path, path_len + name_len + 1);
+            }
+        }
+        else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+        {
+            errnum = _queue_file(watcher, entry->path, path_len, event->name);
+        }
+    }
+
+    // DONE
+    return errnum;
+}
+
+
+/*************************************************************************************************/
+/*************************************** LIBRARY FUNCTIONS ***************************************/
+/*************************************************************************************************/
+
+
+void watcher_destroy(Watcher *watcher)
+{
+    // LOCAL VARIABLES
+    size_t i = 0;  // Iterating variable
+
+    // DESTROY IT
+    if (watcher && watcher->table)
+    {
+        close(watcher->fd);  // Removes every watch
+        for (i = 0; i < watcher->table_size; i++)
+        {
+            free(watcher->table[i].path);
+        }
+        for (i = 0; i < watcher->ready_count; i++)
+        {
+            free(watcher->ready[(watcher->ready_head + i) % watcher->ready_capacity]);
+        }
+        free(watcher->table);
+        free(watcher->ready);
+        free(watcher->events);
+        memset(watcher, 0, sizeof(Watcher));
+        watcher->fd = INVALID_FD;
+    }
+}
+
+
+int watcher_init(Watcher *watcher, char *root_dir, size_t max_watches, char *skip_dirs[], size_t num_skip)
+{
+    // LOCAL VARIABLES
+    int results = -1;                 // 0 on success, -1 on bad input, errno on failure
+    char path[PATH_MAX + 1] = { 0 };  // Path buffer for _watch_tree()
+    size_t path_len = 0;              // Length of path
+    struct stat skip_stat;            // Metadata for a skip directory
+    size_t i = 0;                     // Iterating variable
+
+    // INPUT VALIDATION
+    if (watcher && root_dir && *root_dir && num_skip <= WATCHER_MAX_SKIP && (skip_dirs || 0 == num_skip))
+    {
+        path_len = strlen(root_dir);
+        if (path_len + 1 < PATH_MAX)
+        {
+            memset(watcher, 0, sizeof(Watcher));
+            watcher->fd = INVALID_FD;
+            results = 0;
+        }
+    }
+
+    // SETUP
+    if (0 == results)
+    {
+        watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (watcher->fd < 0)
+        {
+            results = get_errno();
+            syslog_errno(results, "Unable to create an inotify instance");
+        }
+    }
+    if (0 == results)
+    {
+        watcher->table = calloc(WATCHER_INITIAL_SLOTS, sizeof(WatchEntry));
+        watcher->events = calloc(WATCHER_EVENTS_SIZE, sizeof(char));
+        if (!watcher->table || !watcher->events)
+        {
+            results = ENOMEM;
+            free(watcher->table);
+            free(watcher->events);
+            close(watcher->fd);
+            memset(watcher, 0, sizeof(Watcher));
+            watcher->fd = INVALID_FD;
+        }
+        else
+        {
+            watcher->table_size = WATCHER_INITIAL_SLOTS;
+            watcher->max_watches = _get_watch_limit(max_watches);
+        }
+    }
+    for (i = 0; 0 == results && i < num_skip; i++)
+    {
+        if (skip_dirs[i] && 0 == stat(skip_dirs[i], &skip_stat))
+        {
+            watcher->skip[watcher->num_skip].dev = skip_stat.st_dev;
+            watcher->skip[watcher->num_skip].ino = skip_stat.st_ino;
+            watcher->num_skip++;
+        }
+    }
+
+    // WATCH IT
+    if (0 == results)
+    {
+        memcpy(path, root_dir, path_len);
+        if ('/' != path[path_len - 1])
+        {
+            path[path_len++] = '/';
+        }
+        results = _watch_tree(watcher, path, path_len, false);
+        if (0 == results)
+        {
+            syslog_it2(LOG_INFO, "Watching %zu directories under %s", watcher->num_watches, root_dir);
+        }
+        else
+        {
+            syslog_errno(results, "Unable to watch %s", root_dir);
+            watcher_destroy(watcher);
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+int watcher_next(Watcher *watcher, char **filename)
+{
+    // LOCAL VARIABLES
+    int results = -1;                     // 0 on success, -1 on bad input, errno on failure
+    ssize_t bytes_read = 0;               // Return value from read()
+    struct inotify_event *event = NULL;   // Event being handled
+    char *next = NULL;                    // Oldest ready filename
+
+    // INPUT VALIDATION
+    if (watcher && watcher->table && filename)
+    {
+        *filename = NULL;
+        results = 0;
+    }
+
+    // FILL IT
+    while (0 == results)
+    {
+        if (watcher->ready_count > 0 && 0 != access(watcher->ready[watcher->ready_head], F_OK))
+        {
+            free(_pop_ready(watcher));  // Already processed (e.g., reported twice) or deleted
+        }
+        else if (watcher->ready_count > 0)
+        {
+            break;
+        }
+        else if (watcher->events_pos < watcher->events_len)
+        {
+            event = (struct inotify_event *)(watcher->events + watcher->events_pos);
+            watcher->events_pos += sizeof(struct inotify_event) + event->len;
+            results = _handle_event(watcher, event);
+        }
+        else
+        {
+            watcher->events_pos = 0;
+            watcher->events_len = 0;
+            bytes_read = read(watcher->fd, watcher->events, WATCHER_EVENTS_SIZE);
+            if (bytes_read > 0)
+            {
+                watcher->events_len = bytes_read;
+            }
+            else if (bytes_read < 0 && EINTR == errno)
+            {
+                continue;
+            }
+            else if (bytes_read < 0 && EAGAIN != errno)
+            {
+                results = get_errno();
+                syslog_errno(results, "Unable to read inotify events");
+            }
+            else
+            {
+                break;  // Nothing to read right now
+            }
+        }
+    }
+
+    // TAKE ONE
+    if (0 == results && watcher->ready_count > 0)
+    {
+        next = watcher->ready[watcher->ready_head];
+        *filename = hare_message_alloc(strlen(next) + 1);
+        if (*filename)
+        {
+            memcpy(*filename, next, strlen(next));
+            free(_pop_ready(watcher));
+        }
+        else
+        {
+            results = ENOMEM;  // Leave it queued for the next call
+        }
+    }
+
+    // DONE
+    return results;
+}
+
+
+int watcher_wait(Watcher *watcher, int other_fd, int timeout_ms)
+{
+    // LOCAL VARIABLES
+    int results = -1;                      // 0 on success, -1 on bad input, errno on failure
+    struct pollfd poll_fds[2] = { { 0 } }; // Watcher's inotify instance and other_fd
+    nfds_t num_fds = 1;                    // Number of entries in poll_fds
+
+    // INPUT VALIDATION
+    if (watcher && watcher->table)
+    {
+        results = 0;
+    }
+
+    // WAIT
+    if (0 == results && (watcher->ready_count > 0 || watcher->events_pos < watcher->events_len))
+    {
+        // Already something to do
+    }
+    else if (0 == results)
+    {
+        poll_fds[0].fd = watcher->fd;
+        poll_fds[0].events = POLLIN;
+        if (other_fd > INVALID_FD)
+        {
+            poll_fds[1].fd = other_fd;
+            poll_fds[1].events = POLLIN;
+            num_fds = 2;
+        }
+        if (-1 == poll(poll_fds, num_fds, timeout_ms) && EINTR != errno)
+        {
+            results = get_errno();
+        }
+    }
+
+    // DONE
+    return results;
+}
@@ -0,0 +1,107 @@
+/*
+ *  Recursive inotify watcher for the HARE daemon.
+ *  Every directory under the watched directory gets its own watch.  A hash map translates
+ *      watch descriptors back into directory paths so events can be turned into absolute
+ *      filenames without touching the filesystem.
+ *  New subdirectories are watched as soon as their IN_CREATE (or IN_MOVED_TO) event arrives.
+ *      Files can land in a new subdirectory before its watch exists, so the subdirectory is
+ *      read after the watch is added and anything already there is reported too.
+ *  If the kernel's event queue overflows (IN_Q_OVERFLOW), only the watched directories whose
+ *      mtime changed since they were last read are rescanned.
+ *  The number of watches is capped (see: watcher_init()) so the daemon can't exhaust the
+ *      user's max_user_watches.  Directories past the cap are logged and left unwatched.
+ */
+
+#ifndef __HARE_WATCHER__
+#define __HARE_WATCHER__
+
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+#include <sys/types.h>  // dev_t, ino_t
+#include <time.h>       // struct timespec
+
+#define WATCHER_EVENTS_SIZE 65536   // Size of the inotify read buffer
+#define WATCHER_DEFAULT_MAX 8192    // Watch cap if max_user_watches can't be read
+#define WATCHER_HEADROOM 10         // Percent of max_user_watches left for other processes
+#define WATCHER_MAX_SKIP 4          // Maximum number of directories watcher_init() can skip
+#define WATCHER_ENV_VAR "HARE_RECURSIVE"        // 1 watches the whole tree (see: read_settings())
+#define WATCHER_MAX_ENV_VAR "HARE_MAX_WATCHES"  // Cap on recursive watches (see: read_settings())
+
+// A watched directory
+typedef struct _WatchEntry
+{
+    int wd;                 // Watch descriptor (0 marks an empty slot)
+    char *path;             // Absolute path, ending in '/' (heap-allocated)
+    struct timespec mtime;  // Modification time when path was last read
+} WatchEntry;
+
+// Identity of a directory the Watcher must not enter
+typedef struct _WatchSkip
+{
+    dev_t dev;  // Device
+    ino_t ino;  // Inode
+} WatchSkip;
+
+// Recursive inotify watcher
+typedef struct _Watcher
+{
+    int fd;                               // inotify instance (non-blocking)
+    WatchEntry *table;                    // Open-addressed map of watch descriptors to paths
+    size_t table_size;                    // Number of slots in table (a power of two)
+    size_t num_watches;                   // Number of slots in use
+    size_t max_watches;                   // Most watches this Watcher will hold
+    bool capped;                          // Has max_watches been reached?
+    WatchSkip skip[WATCHER_MAX_SKIP];     // Directories (and their subtrees) to leave unwatched
+    size_t num_skip;                      // Number of entries in skip
+    char *events;                         // inotify read buffer
+    size_t events_len;                    // Bytes of events read
+    size_t events_pos;                    // Offset of the next event to handle
+    char **ready;                         // Ring of absolute filenames waiting for watcher_next()
+    size_t ready_head;                    // Index of the oldest entry in ready
+    size_t ready_count;                   // Number of entries in ready
+    size_t ready_capacity;                // Number of entries allocated for ready
+} Watcher;
+
+extern Watcher *tree_watcher;  // Active recursive watcher (NULL means only the pipe feeds the daemon)
+
+
+/*
+ *  Remove every watch and free all memory held by watcher
+ */
+void watcher_destroy(Watcher *watcher);
+
+
+/*
+ *  Watch root_dir and every subdirectory beneath it, except the num_skip directories in
+ *      skip_dirs (entries may be NULL).  Files already in root_dir are not reported.
+ *  Arguments
+ *      watcher - Watcher to initialize
+ *      root_dir - Directory to watch
+ *      max_watches - Cap on the number of watches (0 uses all but WATCHER_HEADROOM percent of
+ *          fs.inotify.max_user_watches, which also limits any other value)
+ *      skip_dirs - Directories to leave unwatched (e.g., the process directory)
+ *      num_skip - Number of entries in skip_dirs (maximum: WATCHER_MAX_SKIP)
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int watcher_init(Watcher *watcher, char *root_dir, size_t max_watches, char *skip_dirs[], size_t num_skip);
+
+
+/*
+ *  Fetch the next file that was closed after writing, or moved, into a watched directory.
+ *      Files that no longer exist (e.g., reported twice) are skipped.
+ *  Arguments
+ *      watcher - Initialized Watcher
+ *      filename - [Out] Absolute filename from hare_message_alloc() or NULL if nothing is ready
+ *  Returns 0 on success (even if nothing is ready), -1 on bad input, errno on failure
+ */
+int watcher_next(Watcher *watcher, char **filename);
+
+
+/*
+ *  Wait up to timeout_ms milliseconds for watcher, or other_fd (if valid), to become readable
+ *  Returns 0 on success (or timeout), -1 on bad input, errno on failure
+ */
+int watcher_wait(Watcher *watcher, int other_fd, int timeout_ms);
+
+
+#endif  // __HARE_WATCHER__
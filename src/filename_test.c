@@ -6,13 +6,18 @@
 
 #include <errno.h>         // errno
 #include <fcntl.h>         // open()
+#include <linux/limits.h>  // PATH_MAX
 #include <stdint.h>        // SIZE_MAX
-#include <stdlib.h>        // calloc(), free()
-#include <string.h>        // strerror()
+#include <stdio.h>         // snprintf()
+#include <stdlib.h>        // calloc(), free(), getenv()
+#include <string.h>        // strerror(), strlen()
 #include <sys/stat.h>      // stat(), S_xxxx
 #include <unistd.h>        // close(), write()
+#include "HARE_forkserver.h" // forkserver_serve(), forkserver_track()
 #include "HARE_library.h"  // be_sure()
 
+#define WATCH_ENV_VAR "HARE_WATCH_DIR"  // Absolute watch directory, ending in '/' (e.g., one per campaign worker)
+
 
 /*
  *  Check to see if dirname exists: Returns 1 if exists, 0 if not, -1 on error
@@ -73,8 +78,15 @@ int main(int argc, char *argv[])
     mode_t old_umask = 0;          // Store umask() value here and restore it
     pid_t daemon = 0;              // PID if parent, 0 if child, -1 on failure
     int errnum = 0;                // Store errno values
+    char *watch_dir = getenv(WATCH_ENV_VAR);  // Value of WATCH_ENV_VAR
+    char process_dir[PATH_MAX + 1] = { 0 };  // watch_dir's process directory
 
     // INPUT VALIDATION
+    // A driver (see: HARE_forkserver.h) passes each input's filename to a forked child instead
+    if (0 != forkserver_serve(&filename))
+    {
+        filename = NULL;
+    }
     if (filename && *filename)
     {
         success = 0;  // Good so far
@@ -84,7 +96,14 @@ int main(int argc, char *argv[])
     // PREPARE
     if (0 == success)
     {
-        if (1 == check_dir("/ramdisk"))
+        if (watch_dir && '/' == *watch_dir && '/' == watch_dir[strlen(watch_dir) - 1]
+            && snprintf(process_dir, sizeof(process_dir), "%sprocessed/", watch_dir) < (int)sizeof(process_dir))
+        {
+            test_filename = prepend_test_input(filename, watch_dir, &test_filename_len);
+            config.inotify_config.watched = watch_dir;
+            config.inotify_config.process = process_dir;
+        }
+        else if (1 == check_dir("/ramdisk"))
         {
             test_filename = prepend_test_input(filename, "/ramdisk/watch/", &test_filename_len);
             config.inotify_config.watched = "/ramdisk/watch/";
@@ -102,6 +121,12 @@ int main(int argc, char *argv[])
             config.inotify_config.watched = "./watch/";
             config.inotify_config.process = "./watch/processed/";
         }
+        // The daemon's optional features (see: read_settings())
+        if (0 != read_settings(&config.inotify_config))
+        {
+            syslog_it(LOG_ERR, "(TEST HARNESS) Call to read_settings() failed");
+            success = -1;
+        }
         // Verify
         if (test_filename)
         {
@@ -206,6 +231,9 @@ int main(int argc, char *argv[])
         {
             syslog_errno(success, "(TEST HARNESS) Unable to write to pipe.");
         }
+        // Before be_sure() so the daemon reads end of file once it drains the pipe
+        close(pipe_fds[PIPE_WRITE]);
+        pipe_fds[PIPE_WRITE] = INVALID_FD;
     }
 
     // Start the "daemon"
@@ -217,13 +245,18 @@ int main(int argc, char *argv[])
             syslog_it(LOG_ERR, "(TEST HARNESS) The call to be_sure() failed");
             success = -1;
         }
+        else if (0 < daemon)
+        {
+            forkserver_track(daemon);  // A driver's timeout kills the daemon, not this process
+        }
     }
 
     // Test results
     if (0 == success && 0 < daemon)
     {
         // WAIT FOR THE DAEMON TO EXIT
-        errnum = wait_daemon(daemon, &success);
+        errnum = wait_daemon(daemon, &success, -1);  // As long as it takes
+        forkserver_track(0);  // Reaped
         if (-1 == errnum)
         {
             syslog_it2(LOG_ERR, "(TEST HARNESS) Call to wait_daemon(%ld) failed with an unspecified error", daemon);
@@ -0,0 +1,428 @@
+/*
+ *  Formats a binary log written by the HARE logger (HARE_SYSLOG=binary, see: HARE_logger.h).
+ *      Format strings are read from the executable that wrote the log, so it must be the same
+ *      build (its path is recorded in the log's header).
+ *  Usage: hare_binlog.bin <binary log> [executable]
+ */
+
+#include <elf.h>             // Elf64_Ehdr, Elf64_Phdr, ELFMAG, PT_LOAD
+#include <errno.h>           // errno
+#include <fcntl.h>           // open()
+#include <inttypes.h>        // PRIu32, PRIx64
+#include <stdbool.h>         // bool
+#include <stdio.h>           // fprintf(), printf(), snprintf()
+#include <string.h>          // memchr(), memcmp(), memcpy(), strerror(), strrchr()
+#include <sys/mman.h>        // mmap(), munmap()
+#include <sys/stat.h>        // fstat(), struct stat
+#include <time.h>            // localtime_r(), strftime()
+#include <unistd.h>          // close()
+#include "HARE_logger.h"     // logger_next_conversion(), LoggerBinlog*
+
+#define SPEC_SIZE 64          // Longest conversion specification (with the stars filled in)
+
+// A read-only file mapping
+typedef struct _Mapping
+{
+    const char *data;  // Start of the file (NULL if unmapped)
+    size_t size;       // Length of the file
+} Mapping;
+
+// Unread part of a record
+typedef struct _Cursor
+{
+    const char *next;  // Next unread byte
+    const char *end;   // End of the record
+} Cursor;
+
+
+/*
+ *  Map filename into memory
+ *  Returns 0 on success, errno on failure
+ */
+static int _map_file(const char *filename, Mapping *mapping)
+{
+    // LOCAL VARIABLES
+    int results = 0;          // 0 on success, errno on failure
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);  // File to map
+    struct stat file_stat;    // Size of the file
+    void *data = MAP_FAILED;  // Return value from mmap()
+
+    // MAP IT
+    if (fd < 0 || fstat(fd, &file_stat))
+    {
+        results = errno ? errno : EIO;
+    }
+    else if (0 == file_stat.st_size)
+    {
+        results = ENODATA;
+    }
+    else
+    {
+        data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == data)
+        {
+            results = errno ? errno : EIO;
+        }
+        else
+        {
+            mapping->data = data;
+            mapping->size = file_stat.st_size;
+        }
+    }
+
+    // CLEANUP
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Find the nul-terminated string at ELF address in executable
+ *  Returns the string, NULL if it isn't there
+ */
+static const char *_lookup(Mapping *executable, uint64_t address)
+{
+    // LOCAL VARIABLES
+    const char *string = NULL;     // Return value
+    const Elf64_Ehdr *elf = (const Elf64_Ehdr *)executable->data;  // ELF header
+    const Elf64_Phdr *segment = NULL;  // Current program header
+    uint64_t offset = 0;           // File offset of address
+    int i = 0;                     // Iterating variable
+
+    // INPUT VALIDATION
+    if (!elf || executable->size < sizeof(Elf64_Ehdr) || memcmp(elf->e_ident, ELFMAG, SELFMAG)
+        || ELFCLASS64 != elf->e_ident[EI_CLASS]
+        || elf->e_phoff + (uint64_t)elf->e_phnum * sizeof(Elf64_Phdr) > executable->size)
+    {
+        elf = NULL;
+    }
+
+    // FIND IT
+    for (i = 0; elf && i < elf->e_phnum && !string; i++)
+    {
+        segment = (const Elf64_Phdr *)(executable->data + elf->e_phoff) + i;
+        if (PT_LOAD == segment->p_type && address >= segment->p_vaddr
+            && address < segment->p_vaddr + segment->p_filesz)
+        {
+            offset = segment->p_offset + (address - segment->p_vaddr);
+            if (offset < executable->size && memchr(executable->data + offset, '\0', executable->size - offset))
+            {
+                string = executable->data + offset;
+            }
+        }
+    }
+
+    // DONE
+    return string;
+}
+
+
+/*
+ *  Take size bytes from cursor into data
+ *  Returns 0 on success, ENODATA if the record ran out
+ */
+static int _take_bytes(Cursor *cursor, void *data, size_t size)
+{
+    // LOCAL VARIABLES
+    int results = ENODATA;  // 0 on success, ENODATA if the record ran out
+
+    // TAKE IT
+    if (cursor->end - cursor->next >= (ptrdiff_t)size)
+    {
+        memcpy(data, cursor->next, size);
+        cursor->next += size;
+        results = 0;
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Take a string from cursor into buffer (nul-terminated, truncated to fit)
+ *  Returns 0 on success, ENODATA if the record ran out
+ */
+static int _take_string(Cursor *cursor, char *buffer, size_t buffer_size)
+{
+    // LOCAL VARIABLES
+    uint16_t length = 0;  // Stored length
+    int results = _take_bytes(cursor, &length, sizeof(length));  // 0 on success, ENODATA
+
+    // TAKE IT
+    if (0 == results && cursor->end - cursor->next < length)
+    {
+        results = ENODATA;
+    }
+    if (0 == results)
+    {
+        snprintf(buffer, buffer_size, "%.*s", (int)length, cursor->next);
+        cursor->next += length;
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Copy conversion into spec with each '*' replaced by the next star value from cursor
+ *      (a negative precision is dropped, as printf() would ignore it)
+ *  Returns 0 on success, ENODATA if the record ran out
+ */
+static int _fill_stars(const LoggerConversion *conversion, Cursor *cursor, char *spec)
+{
+    // LOCAL VARIABLES
+    int results = 0;       // 0 on success, ENODATA if the record ran out
+    size_t used = 0;       // Bytes of spec used
+    size_t i = 0;          // Iterating variable
+    int32_t star = 0;      // Field width or precision
+    bool precision = false;  // Is this star a precision?
+
+    // FILL IT
+    for (i = 0; i < conversion->length && 0 == results && used < SPEC_SIZE - 12; i++)
+    {
+        if ('*' == conversion->start[i])
+        {
+            results = _take_bytes(cursor, &star, sizeof(star));
+            precision = (used > 0 && '.' == spec[used - 1]);
+            if (0 == results && true == precision && star < 0)
+            {
+                used--;  // Drop the '.'
+            }
+            else if (0 == results)
+            {
+                used += snprintf(spec + used, SPEC_SIZE - used, "%d", (int)star);
+            }
+        }
+        else
+        {
+            spec[used++] = conversion->start[i];
+        }
+    }
+    spec[used] = '\0';
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Print format with the arguments recorded at cursor
+ *  Returns 0 on success, ENODATA if the record ran out
+ */
+static int _print_message(const char *format, Cursor *cursor)
+{
+    // LOCAL VARIABLES
+    int results = 0;                 // 0 on success, ENODATA if the record ran out
+    const char *printed = format;    // End of what's been printed
+    const char *next = NULL;         // End of the current conversion
+    LoggerConversion conversion;     // Current conversion specification
+    char spec[SPEC_SIZE] = { 0 };    // conversion with its stars filled in
+    char string[LOGGER_FRAME_SIZE + 1] = { 0 };  // String argument
+    int64_t number = 0;              // Integer (or pointer) argument
+    double real = 0;                 // Floating point argument
+
+    // PRINT IT
+    while (0 == results && (next = logger_next_conversion(printed, &conversion)))
+    {
+        printf("%.*s", (int)(conversion.start - printed), printed);
+        results = _fill_stars(&conversion, cursor, spec);
+        switch (conversion.type)
+        {
+            case LOGGER_ARG_NONE:
+                printf("%%");
+                break;
+            case LOGGER_ARG_INT:
+                results = results ? results : _take_bytes(cursor, &number, sizeof(number));
+                printf(results ? "" : spec, (int)number);
+                break;
+            case LOGGER_ARG_LONG:
+                results = results ? results : _take_bytes(cursor, &number, sizeof(number));
+                printf(results ? "" : spec, (long long)number);
+                break;
+            case LOGGER_ARG_DOUBLE:
+                results = results ? results : _take_bytes(cursor, &real, sizeof(real));
+                printf(results ? "" : spec, real);
+                break;
+            case LOGGER_ARG_LONG_DOUBLE:
+                results = results ? results : _take_bytes(cursor, &real, sizeof(real));
+                printf(results ? "" : spec, (long double)real);
+                break;
+            case LOGGER_ARG_STRING:
+                results = results ? results : _take_string(cursor, string, sizeof(string));
+                printf(results ? "" : spec, string);
+                break;
+            case LOGGER_ARG_POINTER:
+                // Wide strings weren't copied so they're printed as addresses too
+                results = results ? results : _take_bytes(cursor, &number, sizeof(number));
+                printf(results ? "" : "%p", (void *)(uintptr_t)number);
+                break;
+            case LOGGER_ARG_ERRNO:
+                results = results ? results : _take_bytes(cursor, &number, sizeof(number));
+                printf("%s", results ? "" : strerror((int)number));
+                break;
+            default:
+                break;  // %n prints nothing
+        }
+        printed = next;
+    }
+    if (0 == results)
+    {
+        printf("%s", printed);
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Print one record
+ */
+static void _print_record(const LoggerBinlogRecord *record, const char *data, const char *name,
+                          Mapping *executable)
+{
+    // LOCAL VARIABLES
+    Cursor cursor = { data + sizeof(LoggerBinlogRecord), data + record->length };  // Unread bytes
+    char label[LOGGER_FRAME_SIZE + 1] = { 0 };    // Record's label
+    char inline_format[LOGGER_FRAME_SIZE + 1] = { 0 };  // Format that followed the label
+    const char *format = NULL;        // Record's format string
+    time_t seconds = record->realtime_ns / 1000000000;  // When it was logged
+    struct tm broken_down;            // seconds in calendar form
+    char stamp[32] = { 0 };           // seconds, formatted
+    int results = 0;                  // 0 on success, ENODATA if the record ran out
+
+    // HEADER
+    localtime_r(&seconds, &broken_down);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &broken_down);
+    printf("%s.%06lu %s[%" PRIu32 "]: ", stamp, (unsigned long)(record->realtime_ns % 1000000000 / 1000),
+           name, record->pid);
+    results = _take_string(&cursor, label, sizeof(label));
+    if (0 == results && label[0])
+    {
+        printf("[%s] ", label);
+    }
+
+    // MESSAGE
+    if (0 == results && (record->flags & LOGGER_RECORD_INLINE))
+    {
+        results = _take_string(&cursor, inline_format, sizeof(inline_format));
+        format = inline_format;
+    }
+    else if (0 == results)
+    {
+        format = _lookup(executable, record->format);
+    }
+    if (0 == results && format)
+    {
+        results = _print_message(format, &cursor);
+    }
+    else if (0 == results)
+    {
+        printf("<format 0x%" PRIx64 " not found in the executable>", record->format);
+    }
+    if (results || (record->flags & LOGGER_RECORD_TRUNCATED))
+    {
+        printf(" <truncated>");
+    }
+    printf("\n");
+}
+
+
+int main(int argc, char *argv[])
+{
+    // LOCAL VARIABLES
+    int results = 0;                      // 0 on success, -1 on bad input, errno on failure
+    Mapping binlog = { NULL, 0 };         // Binary log
+    Mapping executable = { NULL, 0 };     // Executable that wrote it
+    const LoggerBinlogHeader *header = NULL;  // Start of the binary log
+    const char *executable_name = NULL;   // Executable's filename
+    const char *name = NULL;              // Executable's basename (printed with each record)
+    LoggerBinlogRecord record;            // Current record
+    size_t offset = 0;                    // Offset of the current record
+    size_t count = 0;                     // Records printed
+
+    // INPUT VALIDATION
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s <binary log> [executable]\n", argv[0]);
+        results = -1;
+    }
+    else
+    {
+        results = _map_file(argv[1], &binlog);
+        if (results)
+        {
+            fprintf(stderr, "Unable to read %s: %s\n", argv[1], strerror(results));
+        }
+    }
+    if (0 == results)
+    {
+        header = (const LoggerBinlogHeader *)binlog.data;
+        if (binlog.size < sizeof(LoggerBinlogHeader) || memcmp(header->magic, LOGGER_BINLOG_MAGIC, sizeof(header->magic))
+            || 1 != header->version || header->header_size < sizeof(LoggerBinlogHeader)
+            || header->header_size > binlog.size)
+        {
+            fprintf(stderr, "%s is not a HARE binary log\n", argv[1]);
+            results = EINVAL;
+        }
+    }
+
+    // FIND THE FORMAT STRINGS
+    if (0 == results)
+    {
+        executable_name = 3 == argc ? argv[2] : header->executable;
+        name = strrchr(executable_name, '/') ? strrchr(executable_name, '/') + 1 : executable_name;
+        results = _map_file(executable_name, &executable);
+        if (results)
+        {
+            // Inline formats can still be printed
+            fprintf(stderr, "Unable to read %s: %s\n", executable_name, strerror(results));
+            results = 0;
+        }
+    }
+
+    // PRINT IT
+    for (offset = header ? header->header_size : 0; 0 == results && offset < binlog.size; offset += record.length)
+    {
+        if (binlog.size - offset < sizeof(record))
+        {
+            fprintf(stderr, "%s ends with a partial record\n", argv[1]);
+            break;
+        }
+        memcpy(&record, binlog.data + offset, sizeof(record));
+        if (record.length < sizeof(record) || record.length > binlog.size - offset)
+        {
+            fprintf(stderr, "%s has a bad record at offset %zu\n", argv[1], offset);
+            results = EINVAL;
+        }
+        else
+        {
+            _print_record(&record, binlog.data + offset, name, &executable);
+            count++;
+        }
+    }
+    if (0 == results && header)
+    {
+        fprintf(stderr, "%zu records\n", count);
+    }
+
+    // CLEANUP
+    if (binlog.data)
+    {
+        munmap((void *)binlog.data, binlog.size);
+    }
+    if (executable.data)
+    {
+        munmap((void *)executable.data, executable.size);
+    }
+
+    // DONE
+    return results;
+}
@@ -0,0 +1,868 @@
+/*
+ *  Runs a fuzzing campaign on every core.  Each worker process starts its own copy of the harness
+ *      as a fork server (see: HARE_forkserver.h) with its own watch directory, generates inputs
+ *      from the seed corpus, and reports back through shared memory.  Replaces the Radamsa loops
+ *      in devops/scripts.
+ *  Usage: hare_campaign.bin [options] <harness binary> <seed corpus directory>
+ *      -j workers  Worker processes (default: one per online CPU)
+ *      -n inputs   Stop after this many inputs in all (default: run until -d or SIGINT)
+ *      -d seconds  Stop after this long
+ *      -t ms       Kill an input's child after this long (default: CAMPAIGN_TIMEOUT_MS)
+ *      -o dir      Output directory (default: CAMPAIGN_OUTPUT)
+ *      -r          Have radamsa generate inputs CAMPAIGN_BATCH at a time (default: mutate in-process)
+ *  The output directory holds:
+ *      crashes/     Inputs whose child was killed by a signal (w<worker>_<input>_sig<signal>)
+ *      hangs/       Inputs whose child ran past -t, and the harness' own daemon hangs
+ *      leftovers/   Inputs that left files in the watch directory (the scripts' `ls | wc -l` check).
+ *                   Harnesses delete their test files themselves (CLEANUP_ENV_VAR is "off") so
+ *                   the check doesn't race the cleanup service.
+ *      worker_<n>/  A worker's current input, watch directory, harness output (harness.log), and
+ *                   flight recorder (flight: harnesses sharing one would truncate it under each other)
+ *  Prints progress every CAMPAIGN_STATUS_MS and a summary of every exit status at the end.  Exits 1
+ *      if anything was found.
+ */
+
+#include <dirent.h>            // closedir(), opendir(), readdir()
+#include <errno.h>             // errno
+#include <fcntl.h>             // open()
+#include <inttypes.h>          // PRIu64
+#include <linux/limits.h>      // PATH_MAX
+#include <signal.h>            // signal(), NSIG, SIGINT, SIGPIPE, SIGTERM
+#include <stdatomic.h>         // _Atomic
+#include <stdbool.h>           // bool
+#include <stddef.h>            // offsetof()
+#include <stdint.h>            // SIZE_MAX, uint64_t
+#include <stdio.h>             // fprintf(), printf(), snprintf()
+#include <stdlib.h>            // atoi(), calloc(), free(), realpath(), setenv(), strtoull()
+#include <string.h>            // memcpy(), memmove(), strcmp(), strdup(), strerror(), strsignal()
+#include <sys/mman.h>          // mmap(), munmap()
+#include <sys/stat.h>          // mkdir(), stat()
+#include <sys/wait.h>          // waitpid(), W*()
+#include <time.h>              // clock_gettime(), nanosleep()
+#include <unistd.h>            // close(), dup2(), execvp(), fork(), getopt(), read(), rmdir(), unlink(), write()
+#include "HARE_cleanup.h"      // CLEANUP_ENV_VAR
+#include "HARE_forkserver.h"   // forkserver_*()
+#include "HARE_library.h"      // INVALID_FD, get_errno()
+#include "HARE_recorder.h"     // RECORDER_ENV_VAR
+
+#define CAMPAIGN_OUTPUT "/tmp/hare_campaign"  // Default -o
+#define CAMPAIGN_TIMEOUT_MS 5000  // Default -t (harnesses give their daemons 500 ms, see: DEADLINE_MS)
+#define CAMPAIGN_MAX_INPUT 4096   // Longest input (seeds are truncated to this)
+#define CAMPAIGN_MAX_SEEDS 4096   // Most seeds read from the corpus
+#define CAMPAIGN_STACK 8          // Most mutations stacked on one input
+#define CAMPAIGN_BATCH 256        // Inputs per radamsa run (-r)
+#define CAMPAIGN_STATUS_MS 2000   // How often progress is printed
+#define CAMPAIGN_POLL_MS 100      // How often the parent checks on its workers
+#define CAMPAIGN_EXITS 256        // Exit codes counted
+
+// Harness settings (see: source08_test_harness.c)
+#define HANGS_ENV_VAR "HARE_HANGS_DIR"  // Where the harness saves inputs its daemon hung on
+#define WATCH_ENV_VAR "HARE_WATCH_DIR"  // The harness' watch directory
+
+// One test input
+typedef struct _Input
+{
+    char *path;                              // File it came from (NULL if generated)
+    size_t size;                             // Bytes in data
+    unsigned char data[CAMPAIGN_MAX_INPUT];  // The input
+} Input;
+
+// A worker's results (shared with the parent)
+typedef struct _WorkerStats
+{
+    _Atomic uint64_t inputs;                 // Inputs run
+    _Atomic uint64_t crashes;                // Children killed by a signal
+    _Atomic uint64_t hangs;                  // Children killed for running past -t
+    _Atomic uint64_t leftovers;              // Inputs that left files in the watch directory
+    _Atomic uint64_t exits[CAMPAIGN_EXITS];  // Children that exited, by exit code
+    _Atomic uint64_t signals[NSIG];          // Crashes, by signal
+    _Atomic int error;                       // Why the worker stopped early (0 if it didn't)
+} WorkerStats;
+
+// State the parent shares with its workers
+typedef struct _Campaign
+{
+    _Atomic bool stop;         // Workers finish their current input and exit
+    _Atomic uint64_t claimed;  // Inputs workers have started (against limit)
+    uint64_t limit;            // -n (0 for no limit)
+    WorkerStats workers[];     // One per worker
+} Campaign;
+
+// Command line options
+typedef struct _Options
+{
+    int workers;                 // -j
+    uint64_t inputs;             // -n
+    int seconds;                 // -d
+    int timeout_ms;              // -t
+    char *output;                // -o
+    bool radamsa;                // -r
+    char *harness;               // Harness binary
+    char *corpus;                // Seed corpus directory
+} Options;
+
+static volatile sig_atomic_t _interrupted = 0;  // Set by SIGINT and SIGTERM
+
+
+/*
+ *  Remember that the campaign was interrupted (a signal handler)
+ */
+static void _interrupt(int signum)
+{
+    _interrupted = signum;
+}
+
+
+/*
+ *  Milliseconds on the monotonic clock
+ */
+static uint64_t _now_ms(void)
+{
+    // LOCAL VARIABLES
+    struct timespec now = { 0 };  // Current time
+
+    // DONE
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+
+/*
+ *  Next random number in [0, bound) from an xorshift64* generator (bound must be > 0)
+ */
+static size_t _random(uint64_t *state, size_t bound)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (size_t)((*state * 2685821657736338717ULL) >> 32) % bound;
+}
+
+
+/*
+ *  Replace input with a mutated copy of a random seed: a stack of byte-level mutations in the
+ *      spirit of radamsa's (flips, interesting values, deletions, duplications, insertions,
+ *      splices, and repeats that push lengths toward the limits)
+ */
+static void _mutate(uint64_t *rng, Input *input, const Input *seeds, size_t num_seeds)
+{
+    // LOCAL VARIABLES
+    static const unsigned char interesting[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF, '/', '.', '%', '\n', '*', '?', ' ' };
+    const Input *other = seeds + _random(rng, num_seeds);  // Seed to start from (then splice from)
+    size_t stack = 1 + _random(rng, CAMPAIGN_STACK);       // Mutations to apply
+    size_t position = 0;   // Where the mutation starts
+    size_t length = 0;     // Bytes it affects
+    size_t copies = 0;     // Repeats of a chunk
+    size_t i = 0;          // Iterating variable: mutations
+    size_t j = 0;          // Iterating variable: bytes or copies
+
+    // START FROM A SEED
+    input->path = NULL;
+    input->size = other->size;
+    memcpy(input->data, other->data, other->size);
+
+    // MUTATE IT
+    for (i = 0; i < stack; i++)
+    {
+        position = input->size ? _random(rng, input->size) : 0;
+        switch (_random(rng, 8))
+        {
+            case 0:  // Flip a bit
+                if (input->size)
+                {
+                    input->data[position] ^= 1 << _random(rng, 8);
+                }
+                break;
+            case 1:  // Random byte
+                if (input->size)
+                {
+                    input->data[position] = _random(rng, 256);
+                }
+                break;
+            case 2:  // Interesting byte
+                if (input->size)
+                {
+                    input->data[position] = interesting[_random(rng, sizeof(interesting))];
+                }
+                break;
+            case 3:  // Delete a range (never the whole input)
+                if (input->size > 1)
+                {
+                    length = 1 + _random(rng, input->size - position < 16 ? input->size - position : 16);
+                    length = length < input->size ? length : input->size - 1;
+                    memmove(input->data + position, input->data + position + length,
+                            input->size - position - length);
+                    input->size -= length;
+                }
+                break;
+            case 4:  // Duplicate a range in place
+                length = input->size - position < 16 ? input->size - position : 16;
+                length = length ? 1 + _random(rng, length) : 0;
+                if (length && input->size + length <= CAMPAIGN_MAX_INPUT)
+                {
+                    memmove(input->data + position + length, input->data + position, input->size - position);
+                    input->size += length;
+                }
+                break;
+            case 5:  // Insert random bytes
+                length = 1 + _random(rng, 16);
+                if (input->size + length <= CAMPAIGN_MAX_INPUT)
+                {
+                    memmove(input->data + position + length, input->data + position, input->size - position);
+                    for (j = 0; j < length; j++)
+                    {
+                        input->data[position + j] = _random(rng, 256);
+                    }
+                    input->size += length;
+                }
+                break;
+            case 6:  // Splice: keep the head, take another seed's tail
+                other = seeds + _random(rng, num_seeds);
+                length = other->size ? _random(rng, other->size) : 0;
+                if (position + other->size - length <= CAMPAIGN_MAX_INPUT)
+                {
+                    memcpy(input->data + position, other->data + length, other->size - length);
+                    input->size = position + other->size - length;
+                }
+                break;
+            default:  // Repeat a chunk (long names and paths find length bugs)
+                length = input->size - position < 8 ? input->size - position : 8;
+                length = length ? 1 + _random(rng, length) : 0;
+                copies = 1 + _random(rng, 256);
+                for (j = 0; length && j < copies && input->size + length <= CAMPAIGN_MAX_INPUT; j++)
+                {
+                    memmove(input->data + position + length, input->data + position, input->size - position);
+                    input->size += length;
+                }
+                break;
+        }
+    }
+}
+
+
+/*
+ *  Write size bytes of data to filename (replacing it)
+ *  Returns 0 on success, errno on failure
+ */
+static int _write_file(const char *filename, const void *data, size_t size)
+{
+    // LOCAL VARIABLES
+    int results = 0;                                                    // 0 on success, errno on failure
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);  // filename
+    ssize_t count = 0;                                                  // Return value from write()
+    size_t done = 0;                                                    // Bytes written so far
+
+    // WRITE IT
+    if (fd < 0)
+    {
+        results = get_errno();
+    }
+    while (0 == results && done < size)
+    {
+        count = write(fd, (const char *)data + done, size - done);
+        if (count > 0)
+        {
+            done += count;
+        }
+        else if (count < 0 && EINTR != errno)
+        {
+            results = get_errno();
+        }
+    }
+
+    // CLEANUP
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Read up to CAMPAIGN_MAX_INPUT bytes of filename into input
+ *  Returns 0 on success, errno on failure
+ */
+static int _read_file(const char *filename, Input *input)
+{
+    // LOCAL VARIABLES
+    int results = 0;                                  // 0 on success, errno on failure
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);    // filename
+    ssize_t count = 1;                                // Return value from read()
+
+    // READ IT
+    input->size = 0;
+    if (fd < 0)
+    {
+        results = get_errno();
+    }
+    while (0 == results && count > 0 && input->size < CAMPAIGN_MAX_INPUT)
+    {
+        count = read(fd, input->data + input->size, CAMPAIGN_MAX_INPUT - input->size);
+        if (count > 0)
+        {
+            input->size += count;
+        }
+        else if (count < 0 && EINTR != errno)
+        {
+            results = get_errno();
+        }
+    }
+
+    // CLEANUP
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Read every regular, non-empty file in corpus into *seeds (heap-allocated)
+ *  Returns the number of seeds (0 on failure)
+ */
+static size_t _read_corpus(const char *corpus, Input **seeds)
+{
+    // LOCAL VARIABLES
+    size_t num_seeds = 0;             // Return value
+    DIR *dir = opendir(corpus);       // corpus
+    struct dirent *entry = NULL;      // File in corpus
+    char path[PATH_MAX + 1] = { 0 };  // entry's full path
+    struct stat entry_stat;           // Is entry a regular file?
+
+    // READ IT
+    *seeds = dir ? calloc(CAMPAIGN_MAX_SEEDS, sizeof(Input)) : NULL;
+    while (*seeds && num_seeds < CAMPAIGN_MAX_SEEDS && (entry = readdir(dir)))
+    {
+        if (snprintf(path, sizeof(path), "%s/%s", corpus, entry->d_name) < (int)sizeof(path)
+            && 0 == stat(path, &entry_stat) && S_ISREG(entry_stat.st_mode)
+            && 0 == _read_file(path, *seeds + num_seeds) && (*seeds)[num_seeds].size > 0)
+        {
+            (*seeds)[num_seeds].path = strdup(path);
+            num_seeds += (*seeds)[num_seeds].path ? 1 : 0;
+        }
+    }
+
+    // CLEANUP
+    if (dir)
+    {
+        closedir(dir);
+    }
+
+    // DONE
+    return num_seeds;
+}
+
+
+/*
+ *  Copy input_file to <output>/<subdir>/<name> so it survives the next input
+ */
+static void _save_input(const char *input_file, const char *output, const char *subdir, const char *name)
+{
+    // LOCAL VARIABLES
+    Input *copy = calloc(1, sizeof(Input));  // input_file's contents (too big for the stack)
+    char path[PATH_MAX + 1] = { 0 };         // Where to save it
+
+    // SAVE IT
+    if (copy && 0 == _read_file(input_file, copy)
+        && snprintf(path, sizeof(path), "%s/%s/%s", output, subdir, name) < (int)sizeof(path))
+    {
+        _write_file(path, copy->data, copy->size);
+    }
+
+    // CLEANUP
+    free(copy);
+}
+
+
+/*
+ *  Remove everything the last input left in watch_dir (but not its process directory)
+ *  Returns the number of entries removed
+ */
+static size_t _clear_watch_dir(const char *watch_dir)
+{
+    // LOCAL VARIABLES
+    size_t removed = 0;               // Return value
+    DIR *dir = opendir(watch_dir);    // watch_dir (NULL if the harness uses the memory I/O backend)
+    struct dirent *entry = NULL;      // Entry in watch_dir
+    char path[PATH_MAX + 1] = { 0 };  // entry's full path
+
+    // CLEAR IT
+    while (dir && (entry = readdir(dir)))
+    {
+        if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..") && strcmp(entry->d_name, "processed"))
+        {
+            removed++;
+            if (snprintf(path, sizeof(path), "%s%s", watch_dir, entry->d_name) < (int)sizeof(path)
+                && unlink(path))
+            {
+                rmdir(path);  // Only if it's empty: the harness shouldn't have made any subdirectories
+            }
+        }
+    }
+
+    // CLEANUP
+    if (dir)
+    {
+        closedir(dir);
+    }
+
+    // DONE
+    return removed;
+}
+
+
+/*
+ *  Have radamsa write CAMPAIGN_BATCH inputs, mutated from the seeds, to <batch_dir>/1 through
+ *      <batch_dir>/CAMPAIGN_BATCH
+ *  Returns 0 on success, errno on failure (ECHILD if radamsa failed)
+ */
+static int _generate_batch(uint64_t *rng, const char *batch_dir, const Input *seeds, size_t num_seeds)
+{
+    // LOCAL VARIABLES
+    int results = ENOMEM;                           // 0 on success, errno on failure
+    char **argv = calloc(num_seeds + 8, sizeof(char *));  // radamsa's command line
+    char pattern[PATH_MAX + 1] = { 0 };             // radamsa's output filename pattern
+    char count[32] = { 0 };                         // CAMPAIGN_BATCH, as a string
+    char seed[32] = { 0 };                          // radamsa's random seed, as a string
+    pid_t child = 0;                                // radamsa's pid
+    int status = 0;                                 // radamsa's wait status
+    int null_fd = INVALID_FD;                       // /dev/null for radamsa's stdin
+    size_t i = 0;                                   // Iterating variable
+
+    // BUILD THE COMMAND LINE
+    if (argv && snprintf(pattern, sizeof(pattern), "%s/%%n", batch_dir) < (int)sizeof(pattern))
+    {
+        snprintf(count, sizeof(count), "%d", CAMPAIGN_BATCH);
+        snprintf(seed, sizeof(seed), "%zu", _random(rng, SIZE_MAX));
+        argv[0] = "radamsa";
+        argv[1] = "-o";
+        argv[2] = pattern;
+        argv[3] = "-n";
+        argv[4] = count;
+        argv[5] = "-s";
+        argv[6] = seed;
+        for (i = 0; i < num_seeds; i++)
+        {
+            argv[7 + i] = seeds[i].path;
+        }
+        results = 0;
+    }
+
+    // RUN IT
+    if (0 == results)
+    {
+        child = fork();
+        if (0 == child)
+        {
+            null_fd = open("/dev/null", O_RDONLY);
+            if (null_fd >= 0)
+            {
+                dup2(null_fd, STDIN_FILENO);
+            }
+            execvp(argv[0], argv);
+            _exit(127);  // What the shell returns for a command it couldn't run
+        }
+        else if (child < 0 || child != waitpid(child, &status, 0))
+        {
+            results = errno ? errno : ECHILD;
+        }
+        else if (!WIFEXITED(status) || WEXITSTATUS(status))
+        {
+            results = ECHILD;
+        }
+    }
+
+    // CLEANUP
+    free(argv);
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Run inputs through a fork server until the campaign stops, then exit
+ */
+static void _run_worker(const Options *options, Campaign *campaign, int index, const Input *seeds, size_t num_seeds)
+{
+    // LOCAL VARIABLES
+    WorkerStats *stats = campaign->workers + index;  // This worker's results
+    pid_t parent = getppid();               // The campaign (workers stop if it dies)
+    ForkServer server = { 0 };              // The harness
+    char *harness_argv[2] = { options->harness, NULL };  // The harness' command line
+    char worker_dir[PATH_MAX + 1] = { 0 };  // This worker's directory
+    char watch_dir[PATH_MAX + 1] = { 0 };   // The harness' watch directory
+    char input_file[PATH_MAX + 1] = { 0 };  // Current input
+    char batch_dir[PATH_MAX + 1] = { 0 };   // radamsa's output (-r)
+    char path[PATH_MAX + 1] = { 0 };        // harness.log, the hangs directory, or the next input in batch_dir
+    char name[64] = { 0 };                  // Saved input's filename
+    Input *input = calloc(1, sizeof(Input));  // Generated input (too big for the stack)
+    uint64_t rng = (uint64_t)_now_ms() ^ ((uint64_t)getpid() << 32) ^ (0x9E3779B97F4A7C15ULL * (index + 1));
+    uint64_t number = 0;                    // Inputs this worker has run
+    int next_batch_file = CAMPAIGN_BATCH;   // Index of the next input in batch_dir (past the end: generate)
+    int results = input ? 0 : ENOMEM;       // 0 on success, errno on failure
+    int outcome = 0;                        // Return value from forkserver_run()
+    int status = 0;                         // Input's wait status
+    int log_fd = INVALID_FD;                // harness.log
+
+    // SET UP
+    // Its own process group keeps a terminal's SIGINT away from the harness (the parent stops it)
+    setpgid(0, 0);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN);  // Find out about a dead server from forkserver_run() instead
+    if (0 == results
+        && (snprintf(worker_dir, sizeof(worker_dir), "%s/worker_%d", options->output, index) >= (int)sizeof(worker_dir)
+            || snprintf(watch_dir, sizeof(watch_dir), "%s/watch/", worker_dir) >= (int)sizeof(watch_dir)
+            || snprintf(input_file, sizeof(input_file), "%s/input", worker_dir) >= (int)sizeof(input_file)
+            || snprintf(batch_dir, sizeof(batch_dir), "%s/batch", worker_dir) >= (int)sizeof(batch_dir)))
+    {
+        results = ENAMETOOLONG;
+    }
+    if (0 == results && ((mkdir(worker_dir, 0755) && EEXIST != errno) || (mkdir(batch_dir, 0755) && EEXIST != errno)))
+    {
+        results = get_errno();
+    }
+    if (0 == results)
+    {
+        _clear_watch_dir(watch_dir);  // Left over from an earlier campaign
+        // The harness (and its daemon) inherit these
+        if (snprintf(path, sizeof(path), "%s/harness.log", worker_dir) < (int)sizeof(path))
+        {
+            log_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        }
+        if (log_fd >= 0)
+        {
+            dup2(log_fd, STDOUT_FILENO);
+            dup2(log_fd, STDERR_FILENO);
+            close(log_fd);
+        }
+        if (snprintf(path, sizeof(path), "%s/flight", worker_dir) < (int)sizeof(path))
+        {
+            setenv(RECORDER_ENV_VAR, path, 1);
+        }
+        snprintf(path, sizeof(path), "%s/hangs", options->output);
+        setenv(HANGS_ENV_VAR, path, 1);
+        setenv(WATCH_ENV_VAR, watch_dir, 1);
+        // A file queued for the cleanup service may or may not be gone by the leftovers check
+        setenv(CLEANUP_ENV_VAR, "off", 1);
+        results = forkserver_start(&server, harness_argv);
+    }
+
+    // RUN IT
+    while (0 == results && false == atomic_load(&campaign->stop) && getppid() == parent)
+    {
+        // 1. Claim an input
+        if (campaign->limit && atomic_fetch_add(&campaign->claimed, 1) >= campaign->limit)
+        {
+            break;
+        }
+        // 2. Generate it
+        if (false == options->radamsa)
+        {
+            _mutate(&rng, input, seeds, num_seeds);
+            results = _write_file(input_file, input->data, input->size);
+        }
+        else
+        {
+            if (next_batch_file >= CAMPAIGN_BATCH)
+            {
+                results = _generate_batch(&rng, batch_dir, seeds, num_seeds);
+                next_batch_file = 0;
+            }
+            if (0 == results && (snprintf(path, sizeof(path), "%s/%d", batch_dir, ++next_batch_file) >= (int)sizeof(path)
+                                 || rename(path, input_file)))
+            {
+                results = ENOENT == errno ? ENODATA : errno ? errno : EIO;  // ENODATA: radamsa wrote fewer than CAMPAIGN_BATCH
+            }
+        }
+        // 3. Run it
+        if (0 == results)
+        {
+            number++;
+            outcome = forkserver_run(&server, input_file, options->timeout_ms, &status);
+            atomic_fetch_add(&stats->inputs, 1);
+        }
+        // 4. Check it
+        if (0 == results && ETIMEDOUT == outcome)
+        {
+            atomic_fetch_add(&stats->hangs, 1);
+            snprintf(name, sizeof(name), "w%d_%" PRIu64, index, number);
+            _save_input(input_file, options->output, "hangs", name);
+        }
+        else if (0 == results && outcome)
+        {
+            // The server itself died: start over with a new one
+            forkserver_stop(&server);
+            results = forkserver_start(&server, harness_argv);
+        }
+        else if (0 == results && WIFSIGNALED(status))
+        {
+            atomic_fetch_add(&stats->crashes, 1);
+            atomic_fetch_add(&stats->signals[WTERMSIG(status) % NSIG], 1);
+            snprintf(name, sizeof(name), "w%d_%" PRIu64 "_sig%d", index, number, WTERMSIG(status));
+            _save_input(input_file, options->output, "crashes", name);
+        }
+        else if (0 == results)
+        {
+            atomic_fetch_add(&stats->exits[WEXITSTATUS(status) % CAMPAIGN_EXITS], 1);
+        }
+        if (0 == results && _clear_watch_dir(watch_dir))
+        {
+            atomic_fetch_add(&stats->leftovers, 1);
+            snprintf(name, sizeof(name), "w%d_%" PRIu64, index, number);
+            _save_input(input_file, options->output, "leftovers", name);
+        }
+    }
+
+    // DONE
+    atomic_store(&stats->error, results);
+    forkserver_stop(&server);
+    free(input);
+    _exit(results ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+
+/*
+ *  Add up every worker's counter at offset (a WorkerStats member) in campaign
+ */
+static uint64_t _total(Campaign *campaign, int workers, size_t offset)
+{
+    // LOCAL VARIABLES
+    uint64_t total = 0;  // Return value
+    int i = 0;           // Iterating variable
+
+    // ADD IT UP
+    for (i = 0; i < workers; i++)
+    {
+        total += atomic_load((_Atomic uint64_t *)((char *)(campaign->workers + i) + offset));
+    }
+
+    // DONE
+    return total;
+}
+
+
+/*
+ *  Print a one-line progress report
+ */
+static void _print_progress(FILE *stream, Campaign *campaign, int workers, double seconds)
+{
+    // LOCAL VARIABLES
+    uint64_t inputs = _total(campaign, workers, offsetof(WorkerStats, inputs));  // Inputs run
+
+    // PRINT IT
+    fprintf(stream, "%.1fs: %" PRIu64 " inputs (%.1f/s), %" PRIu64 " crashes, %" PRIu64 " hangs, %" PRIu64
+            " leftovers\n", seconds, inputs, seconds > 0 ? inputs / seconds : 0.0,
+            _total(campaign, workers, offsetof(WorkerStats, crashes)),
+            _total(campaign, workers, offsetof(WorkerStats, hangs)),
+            _total(campaign, workers, offsetof(WorkerStats, leftovers)));
+}
+
+
+int main(int argc, char *argv[])
+{
+    // LOCAL VARIABLES
+    int results = 0;                 // 0 on success, -1 on bad input, errno on failure
+    Options options = { 0 };         // Command line
+    char output[PATH_MAX + 1] = { 0 };  // Absolute output directory
+    char path[PATH_MAX + 1] = { 0 };    // Output subdirectory
+    Input *seeds = NULL;             // Seed corpus
+    size_t num_seeds = 0;            // Seeds in seeds
+    Campaign *campaign = MAP_FAILED; // Shared with the workers
+    size_t campaign_size = 0;        // Bytes mapped at campaign
+    pid_t *pids = NULL;              // Workers (0 once reaped)
+    int running = 0;                 // Workers that haven't been reaped
+    pid_t child = 0;                 // Return value from fork() or waitpid()
+    uint64_t start_ms = 0;           // When the workers started
+    uint64_t now_ms = 0;             // Current time
+    uint64_t status_ms = 0;          // When progress was last printed
+    struct timespec pause = { 0, CAMPAIGN_POLL_MS * 1000000L };  // Between checks on the workers
+    uint64_t count = 0;              // A counter being summarized
+    int option = 0;                  // Return value from getopt()
+    int i = 0;                       // Iterating variable: workers, exit codes, signals
+    int j = 0;                       // Iterating variable: workers
+
+    // INPUT VALIDATION
+    options.workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    options.timeout_ms = CAMPAIGN_TIMEOUT_MS;
+    options.output = CAMPAIGN_OUTPUT;
+    while (0 == results && -1 != (option = getopt(argc, argv, "j:n:d:t:o:r")))
+    {
+        switch (option)
+        {
+            case 'j': options.workers = atoi(optarg); break;
+            case 'n': options.inputs = strtoull(optarg, NULL, 10); break;
+            case 'd': options.seconds = atoi(optarg); break;
+            case 't': options.timeout_ms = atoi(optarg); break;
+            case 'o': options.output = optarg; break;
+            case 'r': options.radamsa = true; break;
+            default: results = -1; break;
+        }
+    }
+    if (0 == results && optind + 2 == argc && options.workers > 0 && options.timeout_ms > 0 && options.seconds >= 0)
+    {
+        options.harness = argv[optind];
+        options.corpus = argv[optind + 1];
+    }
+    else
+    {
+        fprintf(stderr, "Usage: %s [-j workers] [-n inputs] [-d seconds] [-t timeout_ms] [-o output dir] [-r] "
+                "<harness binary> <seed corpus directory>\n", argv[0]);
+        results = -1;
+    }
+
+    // SET UP
+    if (0 == results)
+    {
+        num_seeds = _read_corpus(options.corpus, &seeds);
+        if (0 == num_seeds)
+        {
+            fprintf(stderr, "No seeds found in %s\n", options.corpus);
+            results = ENOENT;
+        }
+    }
+    if (0 == results)
+    {
+        // Workers hand the harness absolute paths
+        if ((mkdir(options.output, 0755) && EEXIST != errno) || !realpath(options.output, output))
+        {
+            results = get_errno();
+        }
+        options.output = output;
+        for (i = 0; 0 == results && i < 3; i++)
+        {
+            if (snprintf(path, sizeof(path), "%s/%s", output, 0 == i ? "crashes" : 1 == i ? "hangs" : "leftovers")
+                >= (int)sizeof(path) || (mkdir(path, 0755) && EEXIST != errno))
+            {
+                results = get_errno();
+            }
+        }
+        if (results)
+        {
+            fprintf(stderr, "Unable to create %s: %s\n", output, strerror(results));
+        }
+    }
+    if (0 == results)
+    {
+        campaign_size = sizeof(Campaign) + options.workers * sizeof(WorkerStats);
+        campaign = mmap(NULL, campaign_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        pids = calloc(options.workers, sizeof(pid_t));
+        if (MAP_FAILED == campaign || !pids)
+        {
+            results = ENOMEM;
+        }
+        else
+        {
+            campaign->limit = options.inputs;
+        }
+    }
+
+    // RUN IT
+    if (0 == results)
+    {
+        signal(SIGINT, _interrupt);
+        signal(SIGTERM, _interrupt);
+        start_ms = _now_ms();
+        status_ms = start_ms;
+        for (i = 0; i < options.workers; i++)
+        {
+            child = fork();
+            if (0 == child)
+            {
+                _run_worker(&options, campaign, i, seeds, num_seeds);
+            }
+            else if (child > 0)
+            {
+                pids[i] = child;
+                running++;
+            }
+            else
+            {
+                atomic_store(&campaign->workers[i].error, errno ? errno : EAGAIN);
+            }
+        }
+        fprintf(stderr, "%d workers running %s on %zu seeds (results in %s)\n", running, options.harness,
+                num_seeds, output);
+    }
+    while (running > 0)
+    {
+        nanosleep(&pause, NULL);
+        now_ms = _now_ms();
+        if (_interrupted || (options.seconds && now_ms - start_ms >= (uint64_t)options.seconds * 1000))
+        {
+            atomic_store(&campaign->stop, true);
+        }
+        if (now_ms - status_ms >= CAMPAIGN_STATUS_MS)
+        {
+            _print_progress(stderr, campaign, options.workers, (now_ms - start_ms) / 1000.0);
+            status_ms = now_ms;
+        }
+        while (running > 0 && (child = waitpid(-1, NULL, WNOHANG)) > 0)
+        {
+            for (j = 0; j < options.workers; j++)
+            {
+                if (pids[j] == child)
+                {
+                    pids[j] = 0;
+                    running--;
+                }
+            }
+        }
+    }
+
+    // SUMMARIZE IT
+    if (MAP_FAILED != campaign)
+    {
+        _print_progress(stdout, campaign, options.workers, (_now_ms() - start_ms) / 1000.0);
+        for (i = 0; i < CAMPAIGN_EXITS; i++)
+        {
+            count = _total(campaign, options.workers, offsetof(WorkerStats, exits) + i * sizeof(uint64_t));
+            if (count)
+            {
+                printf("    exit %d: %" PRIu64 "\n", i, count);
+            }
+        }
+        for (i = 0; i < NSIG; i++)
+        {
+            count = _total(campaign, options.workers, offsetof(WorkerStats, signals) + i * sizeof(uint64_t));
+            if (count)
+            {
+                printf("    signal %d (%s): %" PRIu64 "\n", i, strsignal(i), count);
+            }
+        }
+        for (i = 0; i < options.workers; i++)
+        {
+            if (atomic_load(&campaign->workers[i].error))
+            {
+                printf("    worker %d stopped early: %s\n", i, strerror(atomic_load(&campaign->workers[i].error)));
+                results = atomic_load(&campaign->workers[i].error);
+            }
+        }
+        if (_total(campaign, options.workers, offsetof(WorkerStats, crashes))
+            + _total(campaign, options.workers, offsetof(WorkerStats, hangs))
+            + _total(campaign, options.workers, offsetof(WorkerStats, leftovers)))
+        {
+            printf("Saved findings in %s/{crashes,hangs,leftovers}\n", output);
+            results = results ? results : 1;
+        }
+        munmap(campaign, campaign_size);
+    }
+
+    // CLEANUP
+    for (i = 0; seeds && i < (int)num_seeds; i++)
+    {
+        free(seeds[i].path);
+    }
+    free(seeds);
+    free(pids);
+
+    // DONE
+    return results ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+/*
+ *  Runs test inputs through a harness' fork server (see: HARE_forkserver.h): the harness starts
+ *      once and every input runs in a child forked from it, instead of an exec() per input.
+ *  Usage: hare_driver.bin [-t timeout_ms] <harness binary> <input file>...
+ *      -t  Kill an input's child after this long (default: DRIVER_TIMEOUT_MS)
+ *  Prints each input's outcome and a summary.  Exits 1 if any input crashed or timed out.
+ */
+
+#include <errno.h>             // errno
+#include <signal.h>            // signal(), SIGPIPE
+#include <stdio.h>             // fprintf(), printf()
+#include <stdlib.h>            // atoi()
+#include <string.h>            // strcmp(), strerror(), strsignal()
+#include <sys/wait.h>          // WEXITSTATUS(), WIFEXITED(), WIFSIGNALED(), WTERMSIG()
+#include <time.h>              // clock_gettime()
+#include "HARE_forkserver.h"   // forkserver_*()
+
+#define DRIVER_TIMEOUT_MS 5000  // Default -t (harnesses give their daemons 500 ms, see: DEADLINE_MS)
+
+
+int main(int argc, char *argv[])
+{
+    // LOCAL VARIABLES
+    int results = 0;                  // 0 on success, -1 on bad input, errno on failure
+    int timeout_ms = DRIVER_TIMEOUT_MS;  // -t
+    int first = 1;                    // Index of the harness in argv
+    ForkServer server = { 0 };        // The harness
+    char *harness_argv[2] = { NULL, NULL };  // The harness' command line
+    int status = 0;                   // An input's wait status
+    int outcome = 0;                  // Return value from forkserver_run()
+    unsigned long passed = 0;         // Inputs that exited 0
+    unsigned long failed = 0;         // Inputs that exited non-zero
+    unsigned long crashed = 0;        // Inputs killed by a signal
+    unsigned long timed_out = 0;      // Inputs killed for running past timeout_ms
+    struct timespec start = { 0 };    // When the server was ready
+    struct timespec stop = { 0 };     // When the last input finished
+    double seconds = 0;               // Time spent running inputs
+    int i = 0;                        // Iterating variable
+
+    // INPUT VALIDATION
+    if (argc > 2 && 0 == strcmp(argv[1], "-t"))
+    {
+        timeout_ms = atoi(argv[2]);
+        first = 3;
+    }
+    if (argc < first + 2 || timeout_ms <= 0)
+    {
+        fprintf(stderr, "Usage: %s [-t timeout_ms] <harness binary> <input file>...\n", argv[0]);
+        results = -1;
+    }
+
+    // START IT
+    if (0 == results)
+    {
+        signal(SIGPIPE, SIG_IGN);  // Find out about a dead server from forkserver_run() instead
+        harness_argv[0] = argv[first];
+        results = forkserver_start(&server, harness_argv);
+        if (results)
+        {
+            fprintf(stderr, "Unable to start %s as a fork server: %s\n", argv[first],
+                    results > 0 ? strerror(results) : "Bad input");
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+
+    // RUN IT
+    for (i = first + 1; 0 == results && i < argc; i++)
+    {
+        outcome = forkserver_run(&server, argv[i], timeout_ms, &status);
+        if (ETIMEDOUT == outcome)
+        {
+            printf("%s: timed out after %d ms\n", argv[i], timeout_ms);
+            timed_out++;
+        }
+        else if (outcome)
+        {
+            fprintf(stderr, "The fork server failed on %s: %s\n", argv[i],
+                    outcome > 0 ? strerror(outcome) : "Bad input");
+            results = outcome;
+        }
+        else if (WIFSIGNALED(status))
+        {
+            printf("%s: crashed (signal %d, %s)\n", argv[i], WTERMSIG(status), strsignal(WTERMSIG(status)));
+            crashed++;
+        }
+        else if (WIFEXITED(status) && WEXITSTATUS(status))
+        {
+            printf("%s: exited %d\n", argv[i], WEXITSTATUS(status));
+            failed++;
+        }
+        else
+        {
+            passed++;
+        }
+    }
+
+    // SUMMARIZE IT
+    if (server.pid > 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1000000000.0;
+        printf("%lu inputs: %lu passed, %lu failed, %lu crashed, %lu timed out (%.1f inputs/s)\n",
+               passed + failed + crashed + timed_out, passed, failed, crashed, timed_out,
+               seconds > 0 ? (passed + failed + crashed + timed_out) / seconds : 0.0);
+        forkserver_stop(&server);
+    }
+
+    // DONE
+    return (results || crashed || timed_out) ? 1 : 0;
+}
@@ -0,0 +1,313 @@
+/*
+ *  Prints a flight recorder file (see: HARE_recorder.h) oldest record first, symbolizing
+ *      backtraces with the executable that wrote it (its path is recorded in the header).
+ *  Usage: hare_flight.bin <recorder file> [executable]
+ */
+
+#include <elf.h>             // Elf64_*, ELFMAG, SHT_*, STT_FUNC
+#include <errno.h>           // errno
+#include <fcntl.h>           // open()
+#include <inttypes.h>        // PRIu32, PRIu64, PRIx64
+#include <stdio.h>           // fprintf(), printf()
+#include <stdlib.h>          // calloc(), free(), qsort()
+#include <string.h>          // memchr(), memcmp(), strerror(), strrchr(), strsignal()
+#include <sys/mman.h>        // mmap(), munmap()
+#include <sys/stat.h>        // fstat(), struct stat
+#include <time.h>            // localtime_r(), strftime()
+#include <unistd.h>          // close()
+#include "HARE_recorder.h"   // RecorderHeader, RecorderRecord
+
+// A read-only file mapping
+typedef struct _Mapping
+{
+    const char *data;  // Start of the file (NULL if unmapped)
+    size_t size;       // Length of the file
+} Mapping;
+
+
+/*
+ *  Map filename into memory
+ *  Returns 0 on success, errno on failure
+ */
+static int _map_file(const char *filename, Mapping *mapping)
+{
+    // LOCAL VARIABLES
+    int results = 0;          // 0 on success, errno on failure
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);  // File to map
+    struct stat file_stat;    // Size of the file
+    void *data = MAP_FAILED;  // Return value from mmap()
+
+    // MAP IT
+    if (fd < 0 || fstat(fd, &file_stat))
+    {
+        results = errno ? errno : EIO;
+    }
+    else if (0 == file_stat.st_size)
+    {
+        results = ENODATA;
+    }
+    else
+    {
+        data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == data)
+        {
+            results = errno ? errno : EIO;
+        }
+        else
+        {
+            mapping->data = data;
+            mapping->size = file_stat.st_size;
+        }
+    }
+
+    // CLEANUP
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    // DONE
+    return results;
+}
+
+
+/*
+ *  Find the function containing ELF address in executable's symbol table (or dynamic symbols)
+ *  Returns the function's name (offset in offset), NULL if it isn't found
+ */
+static const char *_symbolize(Mapping *executable, uint64_t address, uint64_t *offset)
+{
+    // LOCAL VARIABLES
+    const char *name = NULL;           // Return value
+    const Elf64_Ehdr *elf = (const Elf64_Ehdr *)executable->data;  // ELF header
+    const Elf64_Shdr *sections = NULL; // Section headers
+    const Elf64_Shdr *strings = NULL;  // Symbol names for the current table
+    const Elf64_Sym *symbol = NULL;    // Current symbol
+    uint64_t count = 0;                // Symbols in the current table
+    uint64_t i = 0;                    // Iterating variable: symbols
+    int table = 0;                     // Iterating variable: SHT_SYMTAB, then SHT_DYNSYM
+    int j = 0;                         // Iterating variable: sections
+
+    // INPUT VALIDATION
+    if (!elf || executable->size < sizeof(Elf64_Ehdr) || memcmp(elf->e_ident, ELFMAG, SELFMAG)
+        || ELFCLASS64 != elf->e_ident[EI_CLASS]
+        || elf->e_shoff + (uint64_t)elf->e_shnum * sizeof(Elf64_Shdr) > executable->size)
+    {
+        elf = NULL;
+    }
+    else
+    {
+        sections = (const Elf64_Shdr *)(executable->data + elf->e_shoff);
+    }
+
+    // FIND IT
+    for (table = 0; elf && table < 2 && !name; table++)
+    {
+        for (j = 0; j < elf->e_shnum && !name; j++)
+        {
+            if ((0 == table ? SHT_SYMTAB : SHT_DYNSYM) != sections[j].sh_type || sections[j].sh_link >= elf->e_shnum
+                || sections[j].sh_offset + sections[j].sh_size > executable->size)
+            {
+                continue;
+            }
+            strings = sections + sections[j].sh_link;
+            count = sections[j].sh_size / sizeof(Elf64_Sym);
+            for (i = 0; i < count && !name; i++)
+            {
+                symbol = (const Elf64_Sym *)(executable->data + sections[j].sh_offset) + i;
+                if (STT_FUNC == ELF64_ST_TYPE(symbol->st_info) && address >= symbol->st_value
+                    && address < symbol->st_value + (symbol->st_size ? symbol->st_size : 1)
+                    && symbol->st_name < strings->sh_size
+                    && strings->sh_offset + strings->sh_size <= executable->size)
+                {
+                    name = executable->data + strings->sh_offset + symbol->st_name;
+                    *offset = address - symbol->st_value;
+                }
+            }
+        }
+    }
+
+    // DONE
+    return name;
+}
+
+
+/*
+ *  Print address, symbolized if it's in the executable
+ */
+static void _print_address(uint64_t address, const RecorderHeader *header, Mapping *executable)
+{
+    // LOCAL VARIABLES
+    uint64_t offset = 0;      // Offset into the function
+    const char *name = _symbolize(executable, address - header->image_base, &offset);  // Function
+
+    // PRINT IT
+    printf("0x%" PRIx64, address);
+    if (name)
+    {
+        printf(" %s+0x%" PRIx64, name, offset);
+    }
+}
+
+
+/*
+ *  Order records by sequence (a qsort() comparison function)
+ */
+static int _by_sequence(const void *left, const void *right)
+{
+    // LOCAL VARIABLES
+    uint64_t left_sequence = (*(const RecorderRecord **)left)->sequence;    // Left record's sequence
+    uint64_t right_sequence = (*(const RecorderRecord **)right)->sequence;  // Right record's sequence
+
+    // DONE
+    return left_sequence < right_sequence ? -1 : left_sequence > right_sequence ? 1 : 0;
+}
+
+
+/*
+ *  Print one record
+ */
+static void _print_record(const RecorderRecord *record, const char *name, const RecorderHeader *header,
+                          Mapping *executable)
+{
+    // LOCAL VARIABLES
+    time_t seconds = record->realtime_ns / 1000000000;  // When it was written
+    struct tm broken_down;      // seconds in calendar form
+    char stamp[32] = { 0 };     // seconds, formatted
+    uint16_t length = record->length;  // Text bytes or values in the record
+    uint16_t i = 0;             // Iterating variable
+
+    // HEADER
+    localtime_r(&seconds, &broken_down);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &broken_down);
+    printf("%s.%06lu %s[%" PRIu32 "]: ", stamp, (unsigned long)(record->realtime_ns % 1000000000 / 1000),
+           name, record->pid);
+
+    // BODY
+    if (RECORDER_LOG == record->kind)
+    {
+        length = length < RECORDER_DATA_SIZE ? length : RECORDER_DATA_SIZE;
+        printf("%.*s\n", (int)length, record->data.text);
+    }
+    else if (RECORDER_SIGNAL == record->kind)
+    {
+        printf("*** signal %" PRIu64 " (%s), si_code %" PRId64 ", address 0x%" PRIx64 ", pc ",
+               record->data.values[0], strsignal((int)record->data.values[0]), (int64_t)record->data.values[1],
+               record->data.values[2]);
+        _print_address(record->data.values[3], header, executable);
+        printf("\n");
+    }
+    else
+    {
+        printf("backtrace:\n");
+        for (i = 0; i < length && i < sizeof(record->data.values) / sizeof(record->data.values[0]); i++)
+        {
+            printf("    ");
+            _print_address(record->data.values[i], header, executable);
+            printf("\n");
+        }
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    // LOCAL VARIABLES
+    int results = 0;                      // 0 on success, -1 on bad input, errno on failure
+    Mapping recorder = { NULL, 0 };       // Recorder file
+    Mapping executable = { NULL, 0 };     // Executable that wrote it
+    const RecorderHeader *header = NULL;  // Start of the recorder file
+    const RecorderRecord *records = NULL; // The ring
+    const RecorderRecord **ordered = NULL;  // Complete records, oldest first
+    const char *executable_name = NULL;   // Executable's filename
+    const char *name = NULL;              // Executable's basename (printed with each record)
+    size_t count = 0;                     // Complete records
+    size_t torn = 0;                      // Records that were being written when the recorder was left
+    uint32_t i = 0;                       // Iterating variable
+
+    // INPUT VALIDATION
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s <recorder file> [executable]\n", argv[0]);
+        results = -1;
+    }
+    else
+    {
+        results = _map_file(argv[1], &recorder);
+        if (results)
+        {
+            fprintf(stderr, "Unable to read %s: %s\n", argv[1], strerror(results));
+        }
+    }
+    if (0 == results)
+    {
+        header = (const RecorderHeader *)recorder.data;
+        if (recorder.size < sizeof(RecorderHeader) || memcmp(header->magic, RECORDER_MAGIC, sizeof(header->magic))
+            || 1 != header->version || RECORDER_RECORD_SIZE != header->record_size
+            || header->header_size < sizeof(RecorderHeader)
+            || header->header_size + (uint64_t)header->slots * header->record_size > recorder.size
+            || !memchr(header->executable, '\0', sizeof(header->executable)))
+        {
+            fprintf(stderr, "%s is not a HARE flight recorder file\n", argv[1]);
+            results = EINVAL;
+        }
+    }
+
+    // FIND THE SYMBOLS
+    if (0 == results)
+    {
+        executable_name = 3 == argc ? argv[2] : header->executable;
+        name = strrchr(executable_name, '/') ? strrchr(executable_name, '/') + 1 : executable_name;
+        if (_map_file(executable_name, &executable))
+        {
+            fprintf(stderr, "Unable to read %s: backtraces won't be symbolized\n", executable_name);
+        }
+        records = (const RecorderRecord *)(recorder.data + header->header_size);
+        ordered = calloc(header->slots ? header->slots : 1, sizeof(RecorderRecord *));
+        if (!ordered)
+        {
+            results = ENOMEM;
+        }
+    }
+
+    // SORT IT
+    for (i = 0; 0 == results && i < header->slots; i++)
+    {
+        if (records[i].sequence && (records[i].sequence - 1) % header->slots == i)
+        {
+            ordered[count++] = records + i;
+        }
+        else if (RECORDER_EMPTY != records[i].kind)
+        {
+            torn++;
+        }
+    }
+    if (0 == results)
+    {
+        qsort(ordered, count, sizeof(RecorderRecord *), _by_sequence);
+    }
+
+    // PRINT IT
+    for (i = 0; 0 == results && i < count; i++)
+    {
+        _print_record(ordered[i], name, header, &executable);
+    }
+    if (0 == results)
+    {
+        fprintf(stderr, "%zu records (%" PRIu64 " written, %zu incomplete)\n", count, (uint64_t)header->next, torn);
+    }
+
+    // CLEANUP
+    free(ordered);
+    if (recorder.data)
+    {
+        munmap((void *)recorder.data, recorder.size);
+    }
+    if (executable.data)
+    {
+        munmap((void *)executable.data, executable.size);
+    }
+
+    // DONE
+    return results;
+}
@@ -0,0 +1,97 @@
+/*
+ *  Prints the latency histograms a running (or finished) HARE daemon publishes to its stats
+ *      file (see: INotifySettings.stats and HARE_stats.h).
+ *  Usage: hare_stats.bin <stats file> [-b]
+ *      -b  Also print every non-empty bucket
+ */
+
+#include <inttypes.h>        // PRIu64
+#include <stdio.h>           // fprintf(), printf()
+#include <string.h>          // strcmp(), strerror()
+#include "HARE_stats.h"      // stats_bucket_floor(), stats_read(), StatsFile
+
+static StatsFile snapshot;   // Too big for the stack
+
+
+/*
+ *  Print a nanosecond value in a readable unit
+ */
+static void _print_ns(uint64_t nanoseconds)
+{
+    if (nanoseconds < 10000)
+    {
+        printf(" %9" PRIu64 "ns", nanoseconds);
+    }
+    else if (nanoseconds < 10000000)
+    {
+        printf(" %9.1fus", nanoseconds / 1000.0);
+    }
+    else if (nanoseconds < 10000000000ULL)
+    {
+        printf(" %9.1fms", nanoseconds / 1000000.0);
+    }
+    else
+    {
+        printf(" %9.1fs ", nanoseconds / 1000000000.0);
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    // LOCAL VARIABLES
+    int results = 0;                 // Return value from stats_read()
+    int buckets = 0;                 // Print the buckets too?
+    StatsStageSnapshot *stage = NULL; // Stage being printed
+    uint32_t i = 0;                  // Iterating variable: stages
+    int j = 0;                       // Iterating variable: buckets
+
+    // INPUT VALIDATION
+    if (argc < 2 || argc > 3 || (3 == argc && strcmp(argv[2], "-b")))
+    {
+        fprintf(stderr, "Usage: %s <stats file> [-b]\n", argv[0]);
+        results = -1;
+    }
+    else
+    {
+        buckets = (3 == argc);
+        results = stats_read(argv[1], &snapshot);
+        if (results > 0)
+        {
+            fprintf(stderr, "Unable to read %s: %s\n", argv[1], strerror(results));
+        }
+    }
+
+    // PRINT IT
+    if (0 == results)
+    {
+        printf("pid %" PRId64 ", snapshot %.3fs after start\n", snapshot.pid,
+               (snapshot.snapshot_ns - snapshot.started_ns) / 1000000000.0);
+        printf("%-12s %10s %11s %11s %11s %11s %11s %11s\n", "stage", "count", "min", "mean", "p50",
+               "p99", "p999", "max");
+        for (i = 0; i < snapshot.num_stages; i++)
+        {
+            stage = snapshot.stages + i;
+            printf("%-12s %10" PRIu64, stage->name, stage->count);
+            _print_ns(stage->min_ns);
+            _print_ns(stage->count ? stage->sum_ns / stage->count : 0);
+            _print_ns(stage->p50_ns);
+            _print_ns(stage->p99_ns);
+            _print_ns(stage->p999_ns);
+            _print_ns(stage->max_ns);
+            printf("\n");
+            for (j = 0; buckets && j < STATS_BUCKETS; j++)
+            {
+                if (stage->buckets[j])
+                {
+                    printf("    >=");
+                    _print_ns(stats_bucket_floor(j));
+                    printf(" %10" PRIu64 "\n", stage->buckets[j]);
+                }
+            }
+        }
+    }
+
+    // DONE
+    return results ? 1 : 0;
+}
@@ -0,0 +1,105 @@
+/*
+ *  Test the journal's compaction (see: HARE_journal.h): commit more than JOURNAL_COMPACT_SIZE
+ *      bytes of completed records and verify the journal file shrinks back down
+ *  make journal_test && ./dist/journal_test.bin
+ */
+
+#include <stdio.h>           // printf(), remove(), snprintf()
+#include <string.h>          // memset(), strerror()
+#include <sys/stat.h>        // stat()
+#include <unistd.h>          // getpid()
+#include "HARE_journal.h"    // journal_*()
+
+#define PATH_LEN 2048  // Long paths mean fewer messages (and commits) to fill the journal
+
+
+int main(void)
+{
+    // LOCAL VARIABLES
+    int results = 0;                      // 0 on success, -1 on bad input, errno on failure
+    char filename[64] = { 0 };            // Journal file
+    Journal journal = { 0 };              // The journal under test
+    uint64_t seq = 0;                     // A message's sequence number
+    size_t written = 0;                   // Bytes of paths committed so far (records are bigger)
+    size_t largest = 0;                   // Largest the journal's mapping got
+    struct stat journal_stat = { 0 };     // The journal file, once compacted
+    char source[PATH_LEN + 1] = { 0 };    // Every message's source filename
+    char moved[PATH_LEN + 1] = { 0 };     // Every message's new filename
+
+    // SETUP
+    snprintf(filename, sizeof(filename), "/tmp/journal_test_%d.jnl", getpid());
+    remove(filename);
+    memset(source, 'S', PATH_LEN);
+    source[0] = '/';
+    memset(moved, 'M', PATH_LEN);
+    moved[0] = '/';
+    results = journal_open(&journal, filename);
+    if (results)
+    {
+        printf("FAIL: journal_open(%s) returned %d (%s)\n", filename, results,
+               results > 0 ? strerror(results) : "Bad input");
+    }
+
+    // DO IT
+    // Every message completes before the next one starts, so nothing is ever in flight
+    while (0 == results && written <= JOURNAL_COMPACT_SIZE + JOURNAL_INITIAL_SIZE)
+    {
+        results = journal_begin(&journal, source, &seq);
+        if (0 == results)
+        {
+            results = journal_append(&journal, seq, JOURNAL_SCANNED, 0, NULL);
+        }
+        if (0 == results)
+        {
+            results = journal_append(&journal, seq, JOURNAL_MOVED, 0, moved);
+        }
+        if (0 == results)
+        {
+            written += 2 * PATH_LEN;
+            largest = journal.map_size > largest ? journal.map_size : largest;
+            results = journal_commit(&journal, false);
+        }
+        if (results)
+        {
+            printf("FAIL: journaling message %lu returned %d (%s)\n", (unsigned long)seq, results,
+                   results > 0 ? strerror(results) : "Bad input");
+        }
+    }
+    if (0 == results)
+    {
+        results = journal_commit(&journal, true);
+    }
+
+    // CHECK IT
+    if (0 == results)
+    {
+        if (stat(filename, &journal_stat))
+        {
+            printf("FAIL: unable to stat %s\n", filename);
+            results = -1;
+        }
+        else if (journal_stat.st_size >= largest || journal.end > JOURNAL_COMPACT_SIZE)
+        {
+            printf("FAIL: %lu bytes of paths committed left a %ld byte journal (end: %lu)\n",
+                   (unsigned long)written, (long)journal_stat.st_size, (unsigned long)journal.end);
+            results = -1;
+        }
+        else if (0 != journal.num_in_flight)
+        {
+            printf("FAIL: %lu messages still in flight\n", (unsigned long)journal.num_in_flight);
+            results = -1;
+        }
+        else
+        {
+            printf("PASS: %lu bytes of paths committed, journal peaked at %lu bytes and ended at %ld bytes\n",
+                   (unsigned long)written, (unsigned long)largest, (long)journal_stat.st_size);
+        }
+    }
+
+    // CLEANUP
+    journal_close(&journal);
+    remove(filename);
+
+    // DONE
+    return results ? 1 : 0;
+}
@@ -7,7 +7,10 @@
 #include <string.h>        // strerror()
 #include <sys/stat.h>      // S_xxxx
 #include <unistd.h>        // close()
+#include "HARE_filelog.h"  // filelog_write()
+#include "HARE_forkserver.h" // forkserver_serve()
 #include "HARE_library.h"  // do_it()
+#include "HARE_recorder.h" // recorder_*()
 
 
 #ifndef ENOERR
@@ -51,7 +54,7 @@ char *get_fuzzed_contents(char *original, size_t *buff_size);
 
 
 /*
- *  Signal handler append signal number message to LOG_FILENAME
+ *  Signal handler: record the signal (and a backtrace) in the flight recorder, then re-raise it
  */
 void log_signal(int sigNum);
 
@@ -106,6 +109,14 @@ int main(int argc, char *argv[])
     int errnum = 0;              // Store errno values
 
     // DO IT
+    // Keep the last log lines (and any crash) in a file that survives it (see: HARE_recorder.h)
+    recorder_open(NULL);  // Best effort
+    // Everything above happens once per driver: each input starts here (see: HARE_forkserver.h)
+    if (0 != forkserver_serve(&filename))
+    {
+        log_external("Call to forkserver_serve() failed");  // DEBUGGING
+        filename = NULL;
+    }
     // 1. Read file containing test input
     log_external(filename);  // DEBUGGING
 
@@ -205,6 +216,7 @@ int main(int argc, char *argv[])
         free(test_content);
         test_content = NULL;
     }
+    recorder_close();
     return success;
 }
 
@@ -355,90 +367,26 @@ char *get_fuzzed_contents(char *original, size_t *buff_size)
 
 void log_external(char *log_entry)
 {
-    // LOCAL VARIABLES
-    char temp_cmd[1025] = { "echo \"%s\" >> %s" };  // Template command
-    char *full_cmd = NULL;                          // Heap allocated buffer w/ completed command
-    char *temp_out = NULL;                          // Output from process execution
-    size_t full_size = 0;                           // Necessary size to allocate full_cmd
-    size_t temp_size = 0;                           // Out parameter for read_from_process()
-
     // LOG IT
+    // Buffered on a persistent descriptor instead of popen()ing an echo for every entry
     if (log_entry && *log_entry)
     {
-        // Size Full Command
-        full_size = strlen(temp_cmd) + strlen(log_entry) + strlen(LOG_FILENAME);
-        // Allocate Buffer
-        full_cmd = calloc(full_size + 1, sizeof(char));
-        if (full_cmd)
-        {
-            // Construct Full Command
-            snprintf(full_cmd, full_size, temp_cmd, log_entry, LOG_FILENAME);
-            temp_out = read_from_process(full_cmd, &temp_size);
-        }
-    }
-
-    // DONE
-    if (full_cmd)
-    {
-        free(full_cmd);
-        full_cmd = NULL;
-    }
-    if (temp_out)
-    {
-        free(temp_out);
-        temp_out = NULL;
+        filelog_write(LOG_FILENAME, log_entry);
     }
 }
 
 
 void log_signal(int sigNum)
 {
-    // LOCAL VARIABLES
-    FILE *log_file = NULL;  // Log filename
-    int errNum = 0;        // Store errno here upon error
-    char template[] = { "Received signal #%02d\n" };  // Template message to log
-    char message[65] = { 0 };
-
     // DO IT
     // 1. LOG IT
-    // Open
-    log_file = fopen(LOG_FILENAME, "a+");
-    if (log_file)
-    {
-        // Format message
-        if (snprintf(message, 64, template, sigNum) < 0)
-        {
-            fprintf(stderr, "Call to snprintf() failed.\n");
-        }
-        // Write
-        else
-        {
-            if (65 != fwrite(message, sizeof(char), 65, log_file))
-            {
-               fprintf(stderr, "Call to fwrite() failed.\n");
-            }
-        }
-        // Close
-        fclose(log_file);
-        log_file = NULL;
-    }
-    else
-    {
-        errNum = errno;
-        fprintf(stderr, "Failed to open %s with: %s\n", LOG_FILENAME, strerror(errNum));
-    }
+    // Signal handlers can't fopen() or fprintf(): the recorder only writes to mapped memory
+    recorder_signal(sigNum, NULL, NULL);
     // 2. SIGNAL IT
-    // Reregister signal as default
-    if (SIG_ERR == signal(sigNum, old_sig_handlers[sigNum]))
-    {
-        errNum = errno;
-        fprintf(stderr, "Call to signal(%d) failed with: %s\n", sigNum, strerror(errNum));
-    }
-    // Raise
-    else if (raise(sigNum))
+    // Reregister signal as default and raise it (both async-signal-safe)
+    if (SIG_ERR != signal(sigNum, old_sig_handlers[sigNum]))
     {
-        errNum = errno;
-        fprintf(stderr, "Call to raise(%d) failed with: %s\n", sigNum, strerror(errNum));
+        raise(sigNum);
     }
 }
 
@@ -18,17 +18,48 @@
  *              - sudo ./dist/source08_test_harness_<choose one>.bin source08_test_input.txt
  */
 
+#define _GNU_SOURCE          // F_SETPIPE_SZ
 #include <errno.h>           // errno
-#include <fcntl.h>           // open()
+#include <fcntl.h>           // fcntl(), open(), F_SETPIPE_SZ
+#include <linux/limits.h>    // PATH_MAX
 // #include <signal.h>        // raise(), signal(), sa_handler
 // #include <stdio.h>         // fprintf(), remove(), snprintf()
 #include <stdint.h>          // SIZE_MAX
-#include <stdlib.h>          // calloc(), free()
-#include <string.h>          // strerror()
-#include <sys/stat.h>        // stat(), S_xxxx
+#include <stdlib.h>          // calloc(), free(), getenv()
+#include <string.h>          // strcmp(), strerror(), strlen()
+#include <sys/stat.h>        // mkdir(), stat(), S_xxxx
+#include <time.h>            // time()
 #include <unistd.h>          // close(), write()
-#include "HARE_library.h"    // be_sure()
-#include "HARE_sanitizer.h"  // fill_sanitizer_logs(), SanitizerLogs
+#include "HARE_arena.h"      // hare_free()
+#include "HARE_cleanup.h"    // cleanup_close(), cleanup_open(), cleanup_request()
+#include "HARE_filelog.h"    // filelog_write()
+#include "HARE_forkserver.h" // forkserver_serve(), forkserver_track()
+#include "HARE_io.h"         // hare_io, hare_io_posix, io_*(), io_release(), io_select()
+#include "HARE_library.h"    // be_sure(), get_errno()
+#include "HARE_logger.h"     // logger_parse_level()
+#include "HARE_logsink.h"    // log_sink_ring, logsink_create(), logsink_destroy(), logsink_next()
+#include "HARE_memwatch.h"   // initMemwatch(), termMemwatch()
+#include "HARE_recorder.h"   // recorder_close(), recorder_open()
+#include "HARE_ring.h"       // message_ring, ring_close(), ring_create(), ring_destroy(), ring_send()
+#include "HARE_sanitizer.h"  // fill_sanitizer_logs(), free_sanitizer_logs(), SanitizerLogs
+
+#define LOG_FILENAME "/tmp/log_file.txt"     // log_external() appends here
+#define DEADLINE_ENV_VAR "HARE_DEADLINE_MS"  // Overrides DEADLINE_MS (negative waits forever)
+#define DEADLINE_MS 500                      // How long the daemon gets before it's a hang
+#define HANGS_ENV_VAR "HARE_HANGS_DIR"       // Overrides HANGS_DIR
+#define HANGS_DIR "/tmp/hare_hangs"          // save_hang() copies hang inputs here
+#define RESULT_PIPE_SIZE 1048576             // Holds thousands of outcomes until wait_daemon() returns (pipe-max-size)
+#define WATCH_ENV_VAR "HARE_WATCH_DIR"       // Absolute watch directory, ending in '/' (e.g., one per campaign worker)
+
+
+/*
+ *  Log the records the daemon (any process but this one) published to ring at LOG_ERR or worse.
+ *      Counts come from ring's level counters (less before, the counts when the daemon started)
+ *      so records the ring overwrote before they were read still count.
+ *  Returns the number of those records, stores the most severe level the daemon logged in
+ *      worst (LOGSINK_LEVELS if it logged nothing)
+ */
+size_t check_daemon_log(LogSinkRing *ring, const uint64_t before[LOGSINK_LEVELS], int *worst);
 
 
 /*
@@ -37,6 +68,14 @@
 int check_dir(char *path);
 
 
+/*
+ *  Have the cleanup service delete filename in the background (see: HARE_cleanup.h), or delete
+ *      it now if the service is off, backed up, or can't see the file (e.g., the memory backend)
+ *  Returns 0 on success, errno on failure
+ */
+int delete_test_file(char *filename);
+
+
 /*
  *  Add filename to a radamsa command to file filename with fuzzed contents
  */
@@ -70,6 +109,14 @@ char *prepend_test_input(char *filename, char *prepend, size_t *total_size);
 char *read_from_process(char *command, size_t *buff_size);
 
 
+/*
+ *  Copy the test input in filename to the hangs directory (HANGS_ENV_VAR or HANGS_DIR), apart
+ *      from the fuzzer's crashes
+ *  Returns 0 on success, -1 on bad input, errno on failure
+ */
+int save_hang(char *filename);
+
+
 /*
  *  Read test input from filename into a custom-sized, heap-allocated buffer
  */
@@ -90,14 +137,15 @@ off_t size_test_file(char *filename);
 
 /*
  *  Test harness.
+ *  0. Select the I/O backend (see: HARE_io.h)
  *  1. Read and prepend test case filename
  *  2. Setup environment (e.g., watch dir, process dir)
  *  3. Prepare to "hook" inotify
  *  4. Attempt to create the test case file (with fuzzed contents)
  *  5. Tell the "daemon" about the test case
  *  6. Start the "daemon"
- *  7. Test results(?)
- *  8. Delete the test case file
+ *  7. Test results (the daemon's ERR and CRIT records, see: HARE_logsink.h)
+ *  8. Delete the test case file (in the background, see: HARE_cleanup.h)
  */
 int main(int argc, char *argv[])
 {
@@ -116,10 +164,55 @@ int main(int argc, char *argv[])
     mode_t old_umask = 0;            // Store umask() value here and restore it
     pid_t daemon = 0;                // PID if parent, 0 if child, -1 on failure
     int process_san_logs = 0;        // 0 for no sanitizer logs, otherwise 1
+    MessageRing ring = { 0 };        // Shared-memory transport (if RING_ENV_VAR asks for it)
+    char *transport = getenv(RING_ENV_VAR);  // Value of RING_ENV_VAR
+    LogSinkRing *sink = NULL;        // Records the daemon logs (see: HARE_logsink.h)
+    size_t daemon_errors = 0;        // Daemon records at LOG_ERR or worse
+    int worst_level = LOGSINK_LEVELS;  // Most severe level the daemon logged
+    int oracle_level = logger_parse_level(getenv(LOGSINK_ENV_VAR));  // abort() at this level or worse
+    int oracle_failed = 0;           // Makeshift boolean: abort() once everything is cleaned up
+    uint64_t sink_levels[LOGSINK_LEVELS] = { 0 };  // sink's level counts before the daemon started
+    int level = 0;                   // Iterating variable
+    ProcessResult result = { 0 };    // The daemon's report on test_filename (see: read_result())
+    char *deadline = getenv(DEADLINE_ENV_VAR);  // Value of DEADLINE_ENV_VAR
+    int deadline_ms = deadline && *deadline ? atoi(deadline) : DEADLINE_MS;  // Daemon's deadline
+    int reported = 0;                // Makeshift boolean: did the daemon report on test_filename?
+    char *watch_dir = getenv(WATCH_ENV_VAR);  // Value of WATCH_ENV_VAR
+    char process_dir[PATH_MAX + 1] = { 0 };  // watch_dir's process directory
 
     // DO IT
+    initMemwatch();  // Does nothing unless compiled with -DMEMWATCH
+    // Keep the last log lines (and any crash) in a file the daemon inherits (see: HARE_recorder.h)
+    if (0 != recorder_open(NULL))
+    {
+        syslog_it(LOG_NOTICE, "(TEST HARNESS) Running without the flight recorder");
+    }
+    // 0. Pick the I/O backend (IO_ENV_VAR or the build's default) before the daemon is forked
+    if (0 != io_select(NULL))
+    {
+        syslog_it(LOG_ERR, "(TEST HARNESS) Call to io_select() failed");
+        success = -1;
+    }
+    // Delete test files in the background (the service only sees the real filesystem)
+    if (0 == success && &hare_io_posix == hare_io && 0 != cleanup_open(NULL))
+    {
+        syslog_it(LOG_NOTICE, "(TEST HARNESS) Deleting test files without the cleanup service");
+    }
+    // Everything above happens once per driver: each input starts here (see: HARE_forkserver.h)
+    if (0 == success && 0 != forkserver_serve(&filename))
+    {
+        syslog_it(LOG_ERR, "(TEST HARNESS) Call to forkserver_serve() failed");
+        success = -1;
+    }
     // 1. Read file containing test input
-    if (1 == check_dir("/ramdisk"))
+    if (watch_dir && '/' == *watch_dir && '/' == watch_dir[strlen(watch_dir) - 1]
+        && snprintf(process_dir, sizeof(process_dir), "%sprocessed/", watch_dir) < (int)sizeof(process_dir))
+    {
+        test_filename = prepend_test_input(filename, watch_dir, &test_filename_len);
+        config.inotify_config.watched = watch_dir;
+        config.inotify_config.process = process_dir;
+    }
+    else if (1 == check_dir("/ramdisk"))
     {
         test_filename = prepend_test_input(filename, "/ramdisk/watch/", &test_filename_len);
         config.inotify_config.watched = "/ramdisk/watch/";
@@ -142,6 +235,12 @@ int main(int argc, char *argv[])
         syslog_it(LOG_ERR, "Call to prepend_test_input() failed with an unspecified error");
         success = -1;
     }
+    // The daemon's optional features (see: read_settings())
+    if (0 == success && 0 != read_settings(&config.inotify_config))
+    {
+        syslog_it(LOG_ERR, "(TEST HARNESS) Call to read_settings() failed");
+        success = -1;
+    }
 
     // Read sanitizer log files
     if (0 == success)
@@ -182,7 +281,7 @@ int main(int argc, char *argv[])
         old_umask = umask(0);
         if (0 == check_dir(config.inotify_config.watched))
         {
-            if (0 != mkdir(config.inotify_config.watched, S_IRWXU | S_IRWXG | S_IRWXO))
+            if (0 != io_mkdir(config.inotify_config.watched, S_IRWXU | S_IRWXG | S_IRWXO))
             {
                 errnum = errno;
                 syslog_errno(errnum, "(TEST HARNESS) Failed to create watch directory");
@@ -202,7 +301,7 @@ int main(int argc, char *argv[])
     {
         if (0 == check_dir(config.inotify_config.process))
         {
-            if (0 != mkdir(config.inotify_config.process, S_IRWXU | S_IRWXG | S_IRWXO))
+            if (0 != io_mkdir(config.inotify_config.process, S_IRWXU | S_IRWXG | S_IRWXO))
             {
                 errnum = errno;
                 syslog_errno(errnum, "(TEST HARNESS) Failed to create process directory");
@@ -237,6 +336,46 @@ int main(int argc, char *argv[])
             syslog_errno(success, "(TEST HARNESS) Failed to make the pipes");
         }
     }
+    if (0 == success)
+    {
+        // The daemon reports where it moved the test case on this pipe
+        success = make_pipes(result_fds, O_NONBLOCK);
+
+        if (-1 == success)
+        {
+            syslog_it(LOG_ERR, "(TEST HARNESS) Call to make_pipes() failed with bad input");
+        }
+        else if (0 != success)
+        {
+            syslog_errno(success, "(TEST HARNESS) Failed to make the result pipes");
+        }
+        // Nothing reads it until the daemon exits, so a watch directory full of files could fill
+        //  the default 64 KB and the daemon would drop outcomes
+        else if (fcntl(result_fds[PIPE_WRITE], F_SETPIPE_SZ, RESULT_PIPE_SIZE) < 0)
+        {
+            syslog_errno(errno, "(TEST HARNESS) Unable to grow the result pipe to %d bytes", RESULT_PIPE_SIZE);
+        }
+    }
+    if (0 == success && transport && 0 == strcmp(transport, "ring"))
+    {
+        success = ring_create(&ring, 0);  // Before be_sure() so the daemon inherits it
+        if (0 == success)
+        {
+            message_ring = &ring;
+        }
+    }
+    if (0 == success)
+    {
+        // Before be_sure() so the daemon inherits it
+        if (0 == logsink_create(&sink))
+        {
+            log_sink_ring = sink;
+        }
+        else
+        {
+            syslog_it(LOG_NOTICE, "(TEST HARNESS) Running without the log sink");
+        }
+    }
 
     // 4. Attempt file creation
     // syslog_it2(LOG_DEBUG, "Current status is... success: %d, test_filename: %s, daemon: %d", success, test_filename, daemon);  // DEBUGGING
@@ -245,7 +384,7 @@ int main(int argc, char *argv[])
         // Create
         // log_external("(PARENT) About to create the file");  // DEBUGGING
         // fprintf(stderr, "TEST FILENAME: %s\n", test_filename);  // DEBUGGING
-        fd = open(test_filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+        fd = io_open(test_filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
         if (fd > -1)
         {
             file_exists = 1;
@@ -261,7 +400,7 @@ int main(int argc, char *argv[])
             {
                 // syslog_it2(LOG_DEBUG, "Current status is... fd: %d, test_content: (%p) %s, content size: %zu", fd, test_content, test_content, content_size);  // DEBUGGING
                 // Write
-                if (-1 == write(fd, test_content, content_size))
+                if (-1 == io_write(fd, test_content, content_size))
                 {
                     errnum = errno;
                     syslog_errno(errnum, "(TEST HARNESS) Unable to write to %s", test_filename);
@@ -295,7 +434,7 @@ int main(int argc, char *argv[])
             }
 
             // Close
-            if (fsync(fd))
+            if (io_fsync(fd))
             {
                 errnum = errno;
                 syslog_errno(errnum, "(TEST HARNESS) Unable to synchronize %s", test_filename);
@@ -313,7 +452,7 @@ int main(int argc, char *argv[])
             {
                 // syslog_it2(LOG_DEBUG, "(TEST HARNESS) Synched file descriptor: %d", fd);  // DEBUGGING
             }
-            if (close(fd))
+            if (io_close(fd))
             {
                 errnum = errno;
                 syslog_errno(errnum, "(TEST HARNESS) Unable to close %s", test_filename);
@@ -355,7 +494,7 @@ int main(int argc, char *argv[])
         // syslog_it(LOG_DEBUG, "Here we are, handling some weird edge case...");  // DEBUGGING
         if (1 == verify_filename(test_filename))
         {
-            if (-1 == remove(test_filename))
+            if (-1 == io_remove(test_filename))
             {
                 errnum = errno;
                 // fprintf(stderr, "Unable to delete %s.\nERROR: %s\n", test_filename, strerror(errnum));
@@ -376,7 +515,21 @@ int main(int argc, char *argv[])
     // 5. Tell the daemon
     if (0 == success)
     {
-        errnum = write_a_pipe(pipe_fds[PIPE_WRITE], test_filename, test_filename_len);
+        if (message_ring)
+        {
+            errnum = ring_send(message_ring, test_filename, test_filename_len);
+            if (0 == errnum)
+            {
+                errnum = ring_close(message_ring);  // The daemon exits once it drains the ring
+            }
+        }
+        else
+        {
+            errnum = write_a_pipe(pipe_fds[PIPE_WRITE], test_filename, test_filename_len);
+            // Before be_sure() so the daemon reads end of file once it drains the pipe
+            close(pipe_fds[PIPE_WRITE]);
+            pipe_fds[PIPE_WRITE] = INVALID_FD;
+        }
 
         if (errnum)
         {
@@ -396,6 +549,10 @@ int main(int argc, char *argv[])
     {
         // log_external("Successfully created the pipes");  // DEBUGGING
         // syslog_it2(LOG_DEBUG, "pipe_fds[PIPE_READ] == %d and pipe_fds[PIPE_WRITE] == %d", pipe_fds[PIPE_READ], pipe_fds[PIPE_WRITE]);  // DEBUGGING
+        for (level = 0; sink && level < LOGSINK_LEVELS; level++)
+        {
+            sink_levels[level] = sink->levels[level];
+        }
         daemon = be_sure(&config);
         // log_external("The call to be_sure() returned");  // DEBUGGING
         // syslog_it2(LOG_DEBUG, "The call to be_sure() returned %d", daemon);  // DEBUGGING
@@ -404,17 +561,33 @@ int main(int argc, char *argv[])
             syslog_it(LOG_ERR, "(TEST HARNESS) The call to be_sure() failed");
             success = -1;
         }
+        else if (0 < daemon)
+        {
+            forkserver_track(daemon);  // A driver's timeout kills the daemon, not this process
+            log_sink_ring = NULL;      // Only the daemon publishes to sink from here on
+        }
     }
 
     // 7. Test results
     if (0 == success && 0 < daemon)
     {
         // WAIT FOR THE DAEMON TO EXIT
-        errnum = wait_daemon(daemon, &success);
+        errnum = wait_daemon(daemon, &success, deadline_ms);
+        forkserver_track(0);  // Reaped
         if (-1 == errnum)
         {
             syslog_it2(LOG_ERR, "(TEST HARNESS) Call to wait_daemon(%ld) failed with an unspecified error", daemon);
         }
+        else if (ETIMEDOUT == errnum)
+        {
+            // Record it here instead of letting it eat the fuzzer's timeout
+            syslog_it2(LOG_WARNING, "(TEST HARNESS) The daemon (%ld) hung for %d ms on %s", daemon, deadline_ms, filename);
+            errnum = save_hang(filename);
+            if (0 != errnum)
+            {
+                syslog_errno(errnum, "(TEST HARNESS) Unable to save the hang input %s", filename);
+            }
+        }
         else if (0 < errnum)
         {
             syslog_errno(errnum, "(TEST HARNESS) Call to wait_daemon(%ld) failed", daemon);
@@ -424,7 +597,38 @@ int main(int argc, char *argv[])
             syslog_it2(LOG_INFO, "(TEST HARNESS) Call to wait_daemon(%ld) succeeded.  Daemon exited with %d.", daemon, success);
         }
         // Was it processed?
+        while (0 == reported && 0 == read_result(result_fds[PIPE_READ], &result))
+        {
+            if (0 == strcmp(result.source, test_filename))
+            {
+                reported = 1;  // Anything else was already in the watch directory
+            }
+        }
+        if (0 == reported)
+        {
+            syslog_it2(LOG_NOTICE, "(TEST HARNESS) The daemon did not report on %s", test_filename);
+        }
+        else if (0 == result.status)
+        {
+            syslog_it2(LOG_INFO, "(TEST HARNESS) The daemon moved %s to %s (needle %s)", result.source,
+                       result.destination, true == result.found ? "found" : "not found");
+        }
+        else
+        {
+            syslog_it2(LOG_NOTICE, "(TEST HARNESS) The daemon failed to move %s (%d)", result.source, result.status);
+        }
         // Any errors detected among the syslog entries
+        if (sink)
+        {
+            daemon_errors = check_daemon_log(sink, sink_levels, &worst_level);
+            syslog_it2(LOG_INFO, "(TEST HARNESS) The daemon logged %zu ERR (or worse) records", daemon_errors);
+            if (oracle_level >= 0 && worst_level <= oracle_level)
+            {
+                syslog_it2(LOG_CRIT, "(TEST HARNESS) The daemon logged a level %d record (%s=%s)",
+                           worst_level, LOGSINK_ENV_VAR, getenv(LOGSINK_ENV_VAR));
+                oracle_failed = 1;  // Delete the test file first (see: 8. Delete files)
+            }
+        }
         // Did the "daemon" crash
         // Did this filename show up in the fuzzer's "output"?  (If so, maybe save it?)
     }
@@ -434,12 +638,17 @@ int main(int argc, char *argv[])
     {
         if (1 == verify_filename(test_filename))
         {
-            if (-1 == remove(test_filename))
+            errnum = delete_test_file(test_filename);
+            if (0 != errnum)
             {
-                errnum = errno;
                 syslog_errno(errnum, "(TEST HARNESS) Unable to delete %s", test_filename);
             }
         }
+        else if (1 == reported && *result.destination && 0 == delete_test_file(result.destination))
+        {
+            // The daemon said exactly where it went so there's nothing to search for
+            syslog_it2(LOG_INFO, "(TEST HARNESS) Successfully deleted %s", result.destination);
+        }
         else
         {
             errnum = delete_matching_file(config.inotify_config.process, base_filename, base_filename_len);
@@ -480,24 +689,39 @@ int main(int argc, char *argv[])
             close(pipe_fds[PIPE_WRITE]);
             pipe_fds[PIPE_WRITE] = INVALID_FD;
         }
+        if (INVALID_FD != result_fds[PIPE_READ])
+        {
+            close(result_fds[PIPE_READ]);
+            result_fds[PIPE_READ] = INVALID_FD;
+        }
+        if (INVALID_FD != result_fds[PIPE_WRITE])
+        {
+            close(result_fds[PIPE_WRITE]);
+            result_fds[PIPE_WRITE] = INVALID_FD;
+        }
+        // Free the in-memory filesystem (if any)
+        io_release();
+        // Destroy the ring
+        if (message_ring)
+        {
+            ring_destroy(message_ring);
+            message_ring = NULL;
+        }
+        // Destroy the log sink
+        if (sink)
+        {
+            logsink_destroy(sink);
+            sink = NULL;
+        }
         // processed_filename
         if (processed_filename)
         {
-            free(processed_filename);
+            hare_free(processed_filename);
             processed_filename = NULL;
         }
     }
     // EVERYBODY
-    if (san_logs.asan_log)
-    {
-        free(san_logs.asan_log);
-        san_logs.asan_log = NULL;
-    }
-    if (san_logs.memwatch_log)
-    {
-        free(san_logs.memwatch_log);
-        san_logs.memwatch_log = NULL;
-    }
+    free_sanitizer_logs(&san_logs);  // HARE_sanitizer.c allocated them without Memwatch
     // PRO TIP: Since test_filename gets allocated *before* the call to fork(), the child process
     //  gets a *copy* of the heap memory... not *access* to the parent processes memory.
     //  That means that both the parent and the child process need to free this address.
@@ -515,10 +739,68 @@ int main(int argc, char *argv[])
         syslog_it(LOG_NOTICE, "(TEST HARNESS) Exiting");
     }
 
+    cleanup_close();
+    if (1 == oracle_failed)
+    {
+        abort();  // Make it a crash so the fuzzer saves this input (and the recorder keeps its file)
+    }
+    recorder_close();
+    termMemwatch();  // Does nothing unless compiled with -DMEMWATCH
     return success;
 }
 
 
+size_t check_daemon_log(LogSinkRing *ring, const uint64_t before[LOGSINK_LEVELS], int *worst)
+{
+    // LOCAL VARIABLES
+    size_t count = 0;           // Daemon records at LOG_ERR or worse
+    size_t shown = 0;           // Those records still in ring
+    uint64_t logged = 0;        // Daemon records at one level
+    uint64_t cursor = 0;        // Position in ring
+    LogSinkRecord record;       // Current record
+    pid_t harness = getpid();   // Skip this process' records
+    int level = 0;              // Iterating variable
+
+    // INPUT VALIDATION
+    if (ring && before && worst)
+    {
+        *worst = LOGSINK_LEVELS;
+        // COUNT IT
+        for (level = LOGSINK_LEVELS - 1; level >= 0; level--)
+        {
+            logged = ring->levels[level] - before[level];
+            if (logged > 0)
+            {
+                *worst = level;
+            }
+            if (level <= LOG_ERR)
+            {
+                count += logged;
+            }
+        }
+        // READ IT
+        while (1 == logsink_next(ring, &cursor, &record))
+        {
+            if (harness != (pid_t)record.pid && record.level <= LOG_ERR)
+            {
+                shown++;
+                syslog_it2(LOG_NOTICE, "(TEST HARNESS) Daemon level %d record from PID %u (ID %08x, errno %d): %s",
+                           (int)record.level, record.pid, record.message_id, record.errnum,
+                           record.message);
+            }
+        }
+        if (shown < count)
+        {
+            syslog_it2(LOG_NOTICE, "(TEST HARNESS) The log sink overwrote %zu of those records before they were read",
+                       count - shown);
+        }
+    }
+
+    // DONE
+    return count;
+}
+
+
 int check_dir(char *path)
 {
     // LOCAL VARIABLES
@@ -529,7 +811,7 @@ int check_dir(char *path)
     if (path && *path)
     {
         // DO IT
-        if (stat(path, &sb) == 0 && S_ISDIR(sb.st_mode))
+        if (io_stat(path, &sb) == 0 && S_ISDIR(sb.st_mode))
         {
             retval = 1;  // Directory exists
         }
@@ -544,6 +826,22 @@ int check_dir(char *path)
 }
 
 
+int delete_test_file(char *filename)
+{
+    // LOCAL VARIABLES
+    int errnum = 0;  // 0 on success, errno on failure
+
+    // DELETE IT
+    if (0 != cleanup_request(filename) && -1 == io_remove(filename))
+    {
+        errnum = get_errno();
+    }
+
+    // DONE
+    return errnum;
+}
+
+
 char *get_fuzzed_contents(char *original, size_t *buff_size)
 {
     // LOCAL VARIABLES
@@ -628,7 +926,10 @@ char *get_fuzzed_contents(char *original, size_t *buff_size)
 
 void log_external(char *log_entry)
 {
-    syslog_it(LOG_DEBUG, log_entry);
+    if (log_entry && *log_entry)
+    {
+        filelog_write(LOG_FILENAME, log_entry);  // Buffered (see: HARE_filelog.h)
+    }
 }
 
 
@@ -902,6 +1203,69 @@ char *reallocate(char *old_buff, size_t curr_size, size_t add_space)
 }
 
 
+int save_hang(char *filename)
+{
+    // LOCAL VARIABLES
+    int errnum = -1;                       // 0 on success, -1 on bad input, errno on failure
+    char *hangs_dir = getenv(HANGS_ENV_VAR);  // Directory to copy filename into
+    char hang_filename[PATH_MAX + 1] = { 0 };  // filename's copy
+    char *contents = NULL;                 // filename's contents
+    off_t contents_size = 0;               // Length of contents
+    int fd = INVALID_FD;                   // hang_filename's file descriptor
+
+    // INPUT VALIDATION
+    if (filename && *filename)
+    {
+        hangs_dir = hangs_dir && *hangs_dir ? hangs_dir : HANGS_DIR;
+        // Name it like the fuzzer would: unique and in the order they were found
+        if (sizeof(hang_filename) > snprintf(hang_filename, sizeof(hang_filename), "%s/hang_%ld_%ld",
+                                             hangs_dir, (long)time(NULL), (long)getpid()))
+        {
+            errnum = 0;
+        }
+    }
+
+    // READ IT
+    if (0 == errnum)
+    {
+        contents = read_test_file(filename, &contents_size);
+        if (!contents)
+        {
+            errnum = get_errno();
+        }
+        else if (mkdir(hangs_dir, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) && EEXIST != errno)
+        {
+            errnum = errno;
+        }
+    }
+
+    // COPY IT
+    // On the real filesystem, like filename, for the user (not through hare_io)
+    if (0 == errnum)
+    {
+        fd = open(hang_filename, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (fd < 0 || contents_size != write(fd, contents, contents_size))
+        {
+            errnum = get_errno();
+        }
+        else
+        {
+            syslog_it2(LOG_NOTICE, "(TEST HARNESS) Saved the hang input as %s", hang_filename);
+        }
+    }
+
+    // CLEANUP
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    free(contents);
+
+    // DONE
+    return errnum;
+}
+
+
 off_t size_test_file(char *filename)
 {
     // LOCAL VARIABLES